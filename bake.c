@@ -0,0 +1,224 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bake.h"
+#include "parallel.h"
+
+// Angle in radians over which the sun sinks behind the horizon, so shadow edges are soft
+#define PENUMBRA 0.05f
+// Most samples taken along each direction, enough for any distance the steps can reach
+#define MAX_SAMPLES 64
+
+BakeSettings defaultBakeSettings(void) {
+    return (BakeSettings){
+        .maxDistance = 64.0f,
+        .sun = {1.0f, 1.0f, 1.0f},
+        .occlusion = 0.8f,
+        .shadow = 0.5f
+    };
+}
+
+typedef struct {
+    const GLfloat* heights;
+    int xSize, zSize;
+    const BakeSettings* settings;
+    GLubyte* shading;
+    const atomic_bool* cancelled; // NULL if the bake can not be cancelled
+
+    // Worked out once for every point
+    GLfloat distances[MAX_SAMPLES];
+    int numSamples;
+    Vector2 directions[BAKE_DIRECTIONS];
+    GLfloat sunElevation;
+    int sunDirection;      // Direction at or anticlockwise before the sun
+    GLfloat sunFraction;   // How far the sun is from there to the next direction
+} BakeContext;
+
+// Bilinear height of the copy at a point inside the terrain
+static GLfloat sampleHeight(const BakeContext* bake, GLfloat x, GLfloat z) {
+    int x0 = (int) x, z0 = (int) z;
+    if (x0 > bake->xSize - 2) x0 = bake->xSize - 2;
+    if (z0 > bake->zSize - 2) z0 = bake->zSize - 2;
+    GLfloat u = x - x0, v = z - z0;
+    const GLfloat* row0 = bake->heights + (long) x0 * bake->zSize + z0;
+    const GLfloat* row1 = row0 + bake->zSize;
+    GLfloat near = row0[0] + u * (row1[0] - row0[0]);
+    GLfloat far = row0[1] + u * (row1[1] - row0[1]);
+    return near + v * (far - near);
+}
+
+// Steps along each direction start at every point and spread out with distance, as far
+// away features need to be larger to raise the horizon as much
+static void prepareBake(BakeContext* bake) {
+    bake->numSamples = 0;
+    for (GLfloat d = 1.0f; d <= bake->settings->maxDistance && bake->numSamples < MAX_SAMPLES; d += 1.0f + d / 8.0f) {
+        bake->distances[bake->numSamples++] = d;
+    }
+    for (int i = 0; i < BAKE_DIRECTIONS; i++) {
+        GLfloat angle = 2.0f * (GLfloat) M_PI * i / BAKE_DIRECTIONS;
+        bake->directions[i] = (Vector2){cosf(angle), sinf(angle)};
+    }
+
+    Vector3 sun = bake->settings->sun;
+    bake->sunElevation = atan2f(sun.y, sqrtf(sun.x * sun.x + sun.z * sun.z));
+    GLfloat azimuth = atan2f(sun.z, sun.x);
+    if (azimuth < 0) azimuth += 2.0f * (GLfloat) M_PI;
+    GLfloat along = azimuth / (2.0f * (GLfloat) M_PI) * BAKE_DIRECTIONS;
+    bake->sunDirection = (int) along % BAKE_DIRECTIONS;
+    bake->sunFraction = along - floorf(along);
+}
+
+// Returns the light reaching a point: the occlusion from the average height of the
+// horizon, then the shadow from the horizon under the sun
+static GLubyte shadePoint(const BakeContext* bake, int x, int z) {
+    GLfloat height = bake->heights[(long) x * bake->zSize + z];
+    GLfloat horizons[BAKE_DIRECTIONS];
+    GLfloat open = 0;
+    for (int i = 0; i < BAKE_DIRECTIONS; i++) {
+        Vector2 direction = bake->directions[i];
+        // The horizon is the steepest slope up (or least steep down) to any sample
+        GLfloat steepest = -INFINITY;
+        for (int s = 0; s < bake->numSamples; s++) {
+            GLfloat d = bake->distances[s];
+            GLfloat px = x + direction.x * d;
+            GLfloat pz = z + direction.y * d;
+            if (px < 0 || pz < 0 || px > bake->xSize - 1 || pz > bake->zSize - 1) break;
+            GLfloat slope = (sampleHeight(bake, px, pz) - height) / d;
+            if (slope > steepest) steepest = slope;
+        }
+        horizons[i] = atanf(steepest);
+        // The sky above a horizon at angle h covers 1 - sin(h) of the directions
+        open += 1.0f - sinf(fmaxf(horizons[i], 0.0f));
+    }
+    GLfloat visible = open / BAKE_DIRECTIONS;
+
+    GLfloat h0 = horizons[bake->sunDirection];
+    GLfloat h1 = horizons[(bake->sunDirection + 1) % BAKE_DIRECTIONS];
+    GLfloat horizon = h0 + bake->sunFraction * (h1 - h0);
+    GLfloat lit = (bake->sunElevation - horizon) / PENUMBRA + 0.5f;
+    lit = fmaxf(0.0f, fminf(1.0f, lit));
+
+    const BakeSettings* settings = bake->settings;
+    GLfloat light = (1.0f - settings->occlusion * (1.0f - visible)) * (1.0f - settings->shadow * (1.0f - lit));
+    return (GLubyte) (fmaxf(0.0f, fminf(1.0f, light)) * 255.0f + 0.5f);
+}
+
+static void bakeRows(void* context, int begin, int end) {
+    BakeContext* bake = context;
+    for (int x = begin; x < end; x++) {
+        if (bake->cancelled != NULL && atomic_load(bake->cancelled)) return;
+        for (int z = 0; z < bake->zSize; z++) {
+            bake->shading[(long) x * bake->zSize + z] = shadePoint(bake, x, z);
+        }
+    }
+}
+
+static void bakeCopy(const GLfloat* heights, int xSize, int zSize, const BakeSettings* settings,
+                     GLubyte* shading, const atomic_bool* cancelled) {
+    if (xSize < 2 || zSize < 2) {
+        memset(shading, 255, (size_t) xSize * zSize);
+        return;
+    }
+    BakeContext bake = {heights, xSize, zSize, settings, shading, cancelled};
+    prepareBake(&bake);
+    parallel_for(xSize, bakeRows, &bake);
+}
+
+void bakeShading(const GLfloat* heights, int xSize, int zSize, const BakeSettings* settings, GLubyte* shading) {
+    bakeCopy(heights, xSize, zSize, settings, shading, NULL);
+}
+
+// Returns the heights in one block by x then z
+static GLfloat* copyHeights(Terrain* terrain) {
+    GLfloat* heights = malloc(sizeof(GLfloat) * terrain->xSize * terrain->zSize);
+    assert(heights != NULL);
+    for (int x = 0; x < terrain->xSize; x++) {
+        memcpy(heights + (long) x * terrain->zSize, terrain->heights[x], sizeof(GLfloat) * terrain->zSize);
+    }
+    return heights;
+}
+
+// Swaps in the new shading and marks everything dirty so the meshes pick it up, without
+// counting as a change to the heights
+static void applyShading(Terrain* terrain, GLubyte* shading) {
+    free(terrain->shading);
+    terrain->shading = shading;
+    markTerrainShaded(terrain, (TerrainRect){0, 0, terrain->xSize, terrain->zSize});
+}
+
+void bakeTerrain(Terrain* terrain, const BakeSettings* settings) {
+    GLfloat* heights = copyHeights(terrain);
+    GLubyte* shading = malloc((size_t) terrain->xSize * terrain->zSize);
+    assert(shading != NULL);
+    bakeShading(heights, terrain->xSize, terrain->zSize, settings, shading);
+    free(heights);
+    applyShading(terrain, shading);
+}
+
+struct BakeJob {
+    pthread_t thread;
+    GLfloat* heights;
+    int xSize, zSize;
+    unsigned long version; // Of the terrain's heights when they were copied
+    BakeSettings settings;
+    GLubyte* shading;
+    atomic_bool done, cancelled;
+};
+
+static void* runBake(void* context) {
+    BakeJob* job = context;
+    bakeCopy(job->heights, job->xSize, job->zSize, &job->settings, job->shading, &job->cancelled);
+    atomic_store(&job->done, true);
+    return NULL;
+}
+
+BakeJob* startBake(Terrain* terrain, const BakeSettings* settings) {
+    BakeJob* job = malloc(sizeof(BakeJob));
+    assert(job != NULL);
+    job->heights = copyHeights(terrain);
+    job->xSize = terrain->xSize;
+    job->zSize = terrain->zSize;
+    job->version = terrain->heightsVersion;
+    job->settings = *settings;
+    job->shading = malloc((size_t) terrain->xSize * terrain->zSize);
+    assert(job->shading != NULL);
+    atomic_init(&job->done, false);
+    atomic_init(&job->cancelled, false);
+    // Bakes in place if no thread can be started
+    if (pthread_create(&job->thread, NULL, runBake, job) != 0) {
+        runBake(job);
+        job->thread = pthread_self();
+    }
+    return job;
+}
+
+bool bakeReady(BakeJob* job) {
+    return atomic_load(&job->done);
+}
+
+// Joins the thread if one was started, then frees everything but the shading
+static void endBake(BakeJob* job) {
+    if (!pthread_equal(job->thread, pthread_self())) {
+        pthread_join(job->thread, NULL);
+    }
+    free(job->heights);
+    free(job);
+}
+
+bool finishBake(BakeJob* job, Terrain* terrain) {
+    bool current = job->version == terrain->heightsVersion;
+    GLubyte* shading = job->shading;
+    endBake(job);
+    applyShading(terrain, shading);
+    return current;
+}
+
+void cancelBake(BakeJob* job) {
+    atomic_store(&job->cancelled, true);
+    GLubyte* shading = job->shading;
+    endBake(job);
+    free(shading);
+}
@@ -0,0 +1,48 @@
+#ifndef BAKE_H
+#define BAKE_H
+
+#include <stdbool.h>
+#include "structures.h"
+#include "terrain.h"
+
+// Directions the horizon of every point is searched in, evenly spaced around it
+#define BAKE_DIRECTIONS 16
+
+// Settings for baking the light reaching every point of a terrain
+typedef struct {
+    GLfloat maxDistance; // Furthest a point's horizon is searched, in grid points
+    Vector3 sun;         // Direction towards the sun, in terrain coordinates
+    GLfloat occlusion;   // How much of the light blocked by the horizon is taken away, 0 to 1
+    GLfloat shadow;      // How much of the light is taken away in the sun's shadow, 0 to 1
+} BakeSettings;
+
+// Returns settings with the sun display lights the terrain from, fixed to the terrain
+extern BakeSettings defaultBakeSettings(void);
+
+// Finds the horizon of every point in each direction from the heights, stored by x then
+// z, and writes the light reaching it to shading: the sky left open by the horizon
+// (ambient occlusion), times whether the sun is above the horizon (shadow), with the
+// sun softened over a small angle. Rows are baked on all threads.
+extern void bakeShading(const GLfloat* heights, int xSize, int zSize, const BakeSettings*, GLubyte* shading);
+
+// Bakes the terrain's current heights and applies the shading
+extern void bakeTerrain(Terrain*, const BakeSettings*);
+
+// A bake of a copy of the heights running on its own thread
+typedef struct BakeJob BakeJob;
+
+// Copies the heights and starts baking them in the background
+extern BakeJob* startBake(Terrain*, const BakeSettings*);
+
+// Returns whether the background bake is done, without waiting
+extern bool bakeReady(BakeJob*);
+
+// Waits for the bake, applies its shading to the terrain and frees the job.
+// Returns false if the heights changed since the bake started, in which case the
+// shading is still applied but is a bake behind.
+extern bool finishBake(BakeJob*, Terrain*);
+
+// Stops the bake as soon as possible and frees the job, without applying it
+extern void cancelBake(BakeJob*);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "bake.h"
+#include "terrain.h"
+#include "mesh.h"
+#include "parallel.h"
+#include "testing.h"
+
+#define SIZE 120
+#define HEIGHT 30
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+static GLfloat flat(void* context, GLfloat x, GLfloat z) {
+    return 0;
+}
+
+// A pit in the middle, and a tall block with open ground around it
+static GLfloat features(void* context, GLfloat x, GLfloat z) {
+    GLfloat dx = x - 30, dz = z - 30;
+    if (dx * dx + dz * dz < 100) return -1;
+    if (x >= 80 && x < 90 && z >= 80 && z < 90) return 1;
+    return 0;
+}
+
+static Vector3 white(const ColourParams* params, GLfloat x, GLfloat y, GLfloat z) {
+    return (Vector3){1, 1, 1};
+}
+
+static GLubyte shade_at(Terrain* terrain, int x, int z) {
+    return terrain->shading[x * terrain->zSize + z];
+}
+
+int main(void) {
+    printf("Testing Baking: \n");
+    BakeSettings settings = defaultBakeSettings();
+    Terrain* terrain = createTerrain(SIZE, SIZE, HEIGHT);
+
+    // Open flat ground gets all the light
+    populateTerrain(terrain, flat, NULL);
+    bakeTerrain(terrain, &settings);
+    bool full = true;
+    for (int i = 0; i < SIZE * SIZE; i++) {
+        full = full && terrain->shading[i] == 255;
+    }
+    assert_test(full, "Flat ground fully lit.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // The pit is occluded, and the block shades the ground away from the sun, which is
+    // towards +x and +z
+    populateTerrain(terrain, features, NULL);
+    bakeTerrain(terrain, &settings);
+    bool occluded = shade_at(terrain, 30, 30) < shade_at(terrain, 30, 60) && shade_at(terrain, 30, 60) > 240;
+    bool shadowed = shade_at(terrain, 78, 78) < 180 && shade_at(terrain, 92, 92) > shade_at(terrain, 78, 78);
+    assert_test(occluded, "Pit is occluded.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(shadowed, "Block casts a shadow away from the sun.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // The same shading on any number of threads, and from the background
+    populateTerrain(terrain, test_hills, NULL);
+    parallel_set_threads(1);
+    bakeTerrain(terrain, &settings);
+    GLubyte* serial = malloc(SIZE * SIZE);
+    memcpy(serial, terrain->shading, SIZE * SIZE);
+    parallel_set_threads(4);
+    BakeJob* job = startBake(terrain, &settings);
+    bool current = finishBake(job, terrain);
+    parallel_set_threads(0);
+    assert_test(current && memcmp(serial, terrain->shading, SIZE * SIZE) == 0,
+                "Background bake matches on any threads.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // A bake of heights changed while it ran still applies, but says it is stale
+    job = startBake(terrain, &settings);
+    stampTerrain(terrain, 50, 50, 10, 5);
+    assert_test(!finishBake(job, terrain) && terrain->shading != NULL, "Stale bake reported.", TEST_OK_OUT, TEST_FAIL_OUT);
+    cancelBake(startBake(terrain, &settings));
+
+    // Both meshes multiply the shading into the colour
+    bakeTerrain(terrain, &settings);
+    ColourParams params = {HEIGHT, NULL};
+    TerrainMesh* mesh = createTerrainMesh(SIZE, SIZE);
+    CompactMesh* compact = createCompactMesh(SIZE, SIZE);
+    takeTerrainDirty(terrain);
+    markTerrainDirty(terrain, (TerrainRect){0, 0, SIZE, SIZE});
+    fillTerrainVertices(mesh, terrain, white, &params, (TerrainRect){0, 0, SIZE, SIZE});
+    updateCompactMesh(compact, terrain, white, &params);
+    bool matching = true, compactClose = true;
+    for (int p = 0; p < compact->patchesX * compact->patchesZ; p++) {
+        CompactPatch* patch = &compact->patches[p];
+        for (int i = 0; i < patch->xCount * patch->zCount; i++) {
+            int x = patch->x0 + i % patch->xCount;
+            int z = patch->z0 + i / patch->xCount;
+            GLfloat shade = shade_at(terrain, x, z) / 255.0f;
+            GLfloat full = mesh->vertices[z * SIZE + x].colour.x;
+            GLfloat quantised = decodeCompactVertex(compact, patch, i).colour.x;
+            matching = matching && fabsf(full - shade) < 1e-6f;
+            compactClose = compactClose && fabsf(quantised - shade) <= 0.5f / (SHADE_LEVELS - 1) + 0.01f;
+        }
+    }
+    assert_test(matching, "Mesh colours shaded.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(compactClose, "Compact colours shaded to a level.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    free(serial);
+    freeTerrainMesh(mesh);
+    freeCompactMesh(compact);
+    freeTerrain(terrain);
+    return EXIT_SUCCESS;
+}
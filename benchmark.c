@@ -0,0 +1,807 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <math.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <GL/gl.h>
+#include "perlin.h"
+#include "fixednoise.h"
+#include "generator.h"
+#include "terrain.h"
+#include "query.h"
+#include "viewshed.h"
+#include "mesh.h"
+#include "softrender.h"
+#include "tiles.h"
+#include "codec.h"
+#include "packed.h"
+#include "rtin.h"
+#include "scatter.h"
+#include "parallel.h"
+#include "structures.h"
+
+// Points along each side of the grid every noise benchmark samples
+#define NOISE_POINTS 512
+#define NOISE_FREQUENCY 0.05
+#define NOISE_REPEATS 20
+// Terrain size and frames of the animation benchmark
+#define ANIMATE_SIZE 1000
+#define ANIMATE_FRAMES 10
+// Generations timed by the biome mask benchmark, at the same size
+#define BIOMES_REPEATS 5
+// Terrain size and rays of the raycast benchmark, with fewer for the slow baseline
+#define RAYS_SIZE 1000
+#define RAYS_COUNT 1000000
+#define RAYS_MARCHED 20000
+#define MARCH_STEP 0.25f
+// Terrain size of the viewshed benchmark, with the radius and count of its observers
+#define VIEWSHED_SIZE 4096
+#define VIEWSHED_RADIUS 500
+#define VIEWSHED_OBSERVERS 256
+// Terrain size, image size and frames of the coarse mesh benchmark
+#define COARSE_SIZE 1000
+#define COARSE_WIDTH 800
+#define COARSE_HEIGHT 600
+#define COARSE_FRAMES 5
+
+#define WORLD_PATH "benchmark.world"
+#define WORLD_TILES 16
+#define WORLD_TILE_SIZE 256
+#define WORLD_VIEW 512
+#define WORLD_BUDGET (32 * sizeof(GLfloat) * WORLD_TILE_SIZE * WORLD_TILE_SIZE)
+#define WORLD_SPEED 16 // Points flown each frame
+#define WORLD_FRAME_SECONDS (1.0 / 60.0)
+
+#define CODEC_SIZE 1024
+#define CODEC_TILE 256
+#define CODEC_REPEATS 10
+
+#define PACKED_SIZE 1000
+#define PACKED_REPEATS 10
+
+// 2^10 + 1, so no triangles are cut off at the edges
+#define RTIN_SIZE 1025
+#define RTIN_REPEATS 3
+
+#define SCATTER_SIZE 1000
+#define SCATTER_REPEATS 3
+
+// Terrain size of the scaling benchmark, with the empty loops over its rows timed for
+// the overhead
+#define PARALLEL_SIZE 1000
+#define PARALLEL_REPEATS 3
+#define PARALLEL_EMPTY_LOOPS 1000
+// Thread counts timed even with fewer cores, so the results are always compared
+#define PARALLEL_MIN_THREADS 4
+
+#define NORMALS_SIZE 1000
+#define NORMALS_REPEATS 5
+
+static double seconds_since(struct timespec start) {
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Times one backend sampling the grid point by point, then as batches of a row each,
+// keeping the fastest of the repeats. The sums are printed so the work is not
+// optimised away.
+static void benchmark_noise_backend(NoiseBackend backend, const char* name, Vector2* points, GLfloat* out) {
+    int lattice = (backend == NOISE_SIMPLEX) ? simplex_lattice_size(NOISE_POINTS, NOISE_FREQUENCY, 0)
+                                             : perlin_lattice_size(NOISE_POINTS, NOISE_FREQUENCY, 0);
+    Perlin* perlin = create_perlin_seeded(lattice, lattice, 1);
+    perlin->backend = backend;
+    int count = NOISE_POINTS * NOISE_POINTS;
+
+    double sum = 0;
+    double single = INFINITY, batch = INFINITY;
+    for (int r = 0; r < NOISE_REPEATS; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < count; i++) {
+            sum += get_perlin_value(perlin, points[i], 2);
+        }
+        single = fmin(single, seconds_since(start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int row = 0; row < NOISE_POINTS; row++) {
+            get_perlin_values(perlin, points + row * NOISE_POINTS, NOISE_POINTS, 2, out + row * NOISE_POINTS);
+        }
+        batch = fmin(batch, seconds_since(start));
+        sum += out[r];
+    }
+
+    printf("%-8s %8.2f ns/sample single, %8.2f ns/sample batched (checksum %g)\n",
+           name, single * 1e9 / count, batch * 1e9 / count, sum);
+    free_perlin(perlin);
+}
+
+static void benchmark_noise(void) {
+    int count = NOISE_POINTS * NOISE_POINTS;
+    Vector2* points = malloc(sizeof(Vector2) * count);
+    GLfloat* out = malloc(sizeof(GLfloat) * count);
+    for (int x = 0; x < NOISE_POINTS; x++) {
+        for (int z = 0; z < NOISE_POINTS; z++) {
+            points[x * NOISE_POINTS + z] = (Vector2){ x * NOISE_FREQUENCY, z * NOISE_FREQUENCY };
+        }
+    }
+    printf("Noise, %d points:\n", count);
+    benchmark_noise_backend(NOISE_CLASSIC, "classic", points, out);
+    benchmark_noise_backend(NOISE_SIMPLEX, "simplex", points, out);
+    benchmark_noise_backend(NOISE_FIXED, "fixed", points, out);
+
+    // The fixed noise's own row kernel, at the same frequency over the same grid
+    FixedOctave octave = {fixed_from_float(NOISE_FREQUENCY), 0, FIXED_ONE, 2, false};
+    fixed* row = malloc(sizeof(fixed) * NOISE_POINTS);
+    double best = INFINITY;
+    int64_t sum = 0;
+    for (int r = 0; r < NOISE_REPEATS; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int x = 0; x < NOISE_POINTS; x++) {
+            fixed_octaves_row(&octave, 1, 1, x, 0, NOISE_POINTS, row);
+            sum += row[x];
+        }
+        best = fmin(best, seconds_since(start));
+    }
+    printf("%-8s %8.2f ns/sample in rows (checksum %" PRId64 ")\n", "fixed", best * 1e9 / count, sum);
+    free(row);
+    free(points);
+    free(out);
+}
+
+// Times the mountain mode animating a large terrain frame by frame, against
+// regenerating it from a new seed as every step of a morph used to
+static void benchmark_animate(void) {
+    Generator* generator = createGenerator(ANIMATE_SIZE, ANIMATE_SIZE, 30, 4, NOISE_CLASSIC, 0, 1);
+    Terrain* terrain = createTerrain(ANIMATE_SIZE, ANIMATE_SIZE, 30);
+
+    double animate = INFINITY, regenerate = INFINITY;
+    for (int frame = 0; frame < ANIMATE_FRAMES; frame++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        animateTerrain(generator, terrain, frame * 0.01f);
+        animate = fmin(animate, seconds_since(start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        reseedGenerator(generator, frame);
+        generateTerrain(generator, terrain);
+        regenerate = fmin(regenerate, seconds_since(start));
+    }
+    printf("Animation, %dx%d on %d threads:\n", ANIMATE_SIZE, ANIMATE_SIZE, parallel_num_threads());
+    printf("animate  %8.2f ms/frame\nreseed   %8.2f ms/frame\n", animate * 1e3, regenerate * 1e3);
+    freeTerrain(terrain);
+    freeGenerator(generator);
+}
+
+// Times generating mountains with the biome mask in the same pass, against without one
+// and against filling a separate map point by point afterwards as the generator used to
+static void benchmark_biomes(void) {
+    Generator* generator = createGenerator(ANIMATE_SIZE, ANIMATE_SIZE, 30, 4, NOISE_CLASSIC, 3, 1);
+    Terrain* terrain = createTerrain(ANIMATE_SIZE, ANIMATE_SIZE, 30);
+    Terrain* masked = createTerrain(ANIMATE_SIZE, ANIMATE_SIZE, 30);
+    addTerrainBiomes(masked);
+
+    double plain = INFINITY, fused = INFINITY, separate = INFINITY;
+    for (int r = 0; r < BIOMES_REPEATS; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        generateTerrain(generator, terrain);
+        plain = fmin(plain, seconds_since(start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        generateTerrain(generator, masked);
+        fused = fmin(fused, seconds_since(start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        generateTerrain(generator, terrain);
+        for (int x = 0; x < ANIMATE_SIZE; x++) {
+            for (int z = 0; z < ANIMATE_SIZE; z++) masked->biomes[x][z] = double_perlin(generator, x, z);
+        }
+        separate = fmin(separate, seconds_since(start));
+    }
+    printf("Biomes, %dx%d mountains on %d threads:\n", ANIMATE_SIZE, ANIMATE_SIZE, parallel_num_threads());
+    printf("heights  %8.2f ms\nfused    %8.2f ms with the mask\nseparate %8.2f ms with the mask\n",
+           plain * 1e3, fused * 1e3, separate * 1e3);
+    freeTerrain(masked);
+    freeTerrain(terrain);
+    freeGenerator(generator);
+}
+
+// Steps along the ray until it is below the terrain, the simple way to pick a point
+static bool march_ray(Terrain* terrain, TerrainRay ray, GLfloat* t) {
+    for (*t = 0; *t < ray.length; *t += MARCH_STEP) {
+        GLfloat x = ray.origin.x + *t * ray.direction.x;
+        GLfloat z = ray.origin.z + *t * ray.direction.z;
+        if (ray.origin.y + *t * ray.direction.y <= terrainHeightAt(terrain, x, z)) return true;
+    }
+    return false;
+}
+
+// Casts rays from above a large terrain towards points scattered over it, through the
+// pyramid on one thread and on all of them, against marching the rays
+static void benchmark_rays(void) {
+    Generator* generator = createGenerator(RAYS_SIZE, RAYS_SIZE, 30, 4, NOISE_CLASSIC, 0, 1);
+    Terrain* terrain = createTerrain(RAYS_SIZE, RAYS_SIZE, 30);
+    generateTerrain(generator, terrain);
+
+    uint32_t state = 1;
+    TerrainRay* rays = malloc(sizeof(TerrainRay) * RAYS_COUNT);
+    TerrainHit* hits = malloc(sizeof(TerrainHit) * RAYS_COUNT);
+    for (int i = 0; i < RAYS_COUNT; i++) {
+        Vector3 origin = {random_float(&state) * RAYS_SIZE, 80, random_float(&state) * RAYS_SIZE};
+        Vector3 target = {random_float(&state) * RAYS_SIZE, 0, random_float(&state) * RAYS_SIZE};
+        Vector3 direction = {target.x - origin.x, target.y - origin.y, target.z - origin.z};
+        GLfloat length = sqrtf(dot_product_3(direction, direction));
+        rays[i] = (TerrainRay){origin, {direction.x / length, direction.y / length, direction.z / length}, 2 * length};
+    }
+
+    int threads = parallel_num_threads();
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int hitCount = 0;
+    for (int i = 0; i < RAYS_COUNT; i++) {
+        hitCount += raycastTerrain(terrain, rays[i], &hits[i]);
+    }
+    double single = seconds_since(start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    raycastTerrainBatch(terrain, rays, RAYS_COUNT, hits);
+    double batch = seconds_since(start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int marchedCount = 0;
+    GLfloat t;
+    for (int i = 0; i < RAYS_MARCHED; i++) {
+        marchedCount += march_ray(terrain, rays[i], &t);
+    }
+    double march = seconds_since(start);
+
+    printf("Raycasts, %dx%d:\n", RAYS_SIZE, RAYS_SIZE);
+    printf("pyramid  %8.2f Mrays/s on 1 thread, %8.2f Mrays/s on %d threads (%d hits)\n",
+           RAYS_COUNT / single / 1e6, RAYS_COUNT / batch / 1e6, threads, hitCount);
+    printf("march    %8.2f Mrays/s on 1 thread (%d of %d hit)\n",
+           RAYS_MARCHED / march / 1e6, marchedCount, RAYS_MARCHED);
+    free(rays);
+    free(hits);
+    freeTerrain(terrain);
+    freeGenerator(generator);
+}
+
+static GLfloat viewshed_hills(void* context, GLfloat x, GLfloat z) {
+    return sinf(x * 0.011f) * cosf(z * 0.007f) + 0.3f * sinf(x * 0.05f + z * 0.037f);
+}
+
+// Computes the viewshed of one observer over the whole of a large terrain, then of
+// hundreds of observers each seeing a limited radius
+static void benchmark_viewshed(void) {
+    Terrain* terrain = createTerrain(VIEWSHED_SIZE, VIEWSHED_SIZE, 100);
+    populateTerrain(terrain, viewshed_hills, NULL);
+    int threads = parallel_num_threads();
+
+    Observer observer = {VIEWSHED_SIZE / 2, VIEWSHED_SIZE / 2, 10, 0, 0};
+    Viewshed* whole = createViewshed(observerArea(terrain, observer));
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    computeViewshed(terrain, observer, whole);
+    double single = seconds_since(start);
+    long points = (long) VIEWSHED_SIZE * VIEWSHED_SIZE;
+
+    uint32_t state = 1;
+    Observer observers[VIEWSHED_OBSERVERS];
+    Viewshed* viewsheds[VIEWSHED_OBSERVERS];
+    long swept = 0, visible = 0;
+    for (int i = 0; i < VIEWSHED_OBSERVERS; i++) {
+        observers[i] = (Observer){
+            random_next(&state) % VIEWSHED_SIZE, random_next(&state) % VIEWSHED_SIZE, 10, 0, VIEWSHED_RADIUS
+        };
+        viewsheds[i] = createViewshed(observerArea(terrain, observers[i]));
+        TerrainRect area = viewsheds[i]->area;
+        swept += (long) (area.x1 - area.x0) * (area.z1 - area.z0);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    computeViewsheds(terrain, observers, VIEWSHED_OBSERVERS, viewsheds);
+    double batch = seconds_since(start);
+    for (int i = 0; i < VIEWSHED_OBSERVERS; i++) {
+        visible += viewshedCount(viewsheds[i]);
+        freeViewshed(viewsheds[i]);
+    }
+
+    printf("Viewsheds, %dx%d on %d threads:\n", VIEWSHED_SIZE, VIEWSHED_SIZE, threads);
+    printf("whole    %8.2f ms, %8.2f Mpoints/s (%ld visible)\n",
+           single * 1e3, points / single / 1e6, viewshedCount(whole));
+    printf("radius   %8.2f ms for %d observers of radius %d, %8.2f Mpoints/s (%ld visible)\n",
+           batch * 1e3, VIEWSHED_OBSERVERS, VIEWSHED_RADIUS, swept / batch / 1e6, visible);
+    freeViewshed(whole);
+    freeTerrain(terrain);
+}
+
+// Returns the fastest of the frames drawn by the software renderer, with either the full
+// mesh or the coarse mesh given
+static double time_frames(SoftImage* image, const SoftScene* scene, const TerrainMesh* full, const CoarseMesh* coarse) {
+    double best = INFINITY;
+    for (int frame = 0; frame < COARSE_FRAMES; frame++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        if (coarse != NULL) {
+            renderCoarseMesh(image, scene, coarse);
+        } else {
+            renderTerrainMesh(image, scene, full);
+        }
+        best = fmin(best, seconds_since(start));
+    }
+    return best;
+}
+
+// Draws a large terrain with the software renderer from the full mesh, then from coarse
+// meshes lit by the normal map, comparing the frame times and how far the images differ
+static void benchmark_coarse(void) {
+    Generator* generator = createGenerator(COARSE_SIZE, COARSE_SIZE, 30, 4, NOISE_CLASSIC, 0, 1);
+    Terrain* terrain = createTerrain(COARSE_SIZE, COARSE_SIZE, 30);
+    generateTerrain(generator, terrain);
+    TerrainRect whole = {0, 0, COARSE_SIZE, COARSE_SIZE};
+    Vector3 eye = {COARSE_SIZE / 2.0f, 250.0f, COARSE_SIZE + 150.0f};
+    Vector3 centre = {COARSE_SIZE / 2.0f, 0.0f, COARSE_SIZE / 2.0f};
+    SoftScene scene = {
+        .projection = matrix_perspective(45.0f, (GLfloat) COARSE_WIDTH / COARSE_HEIGHT, 1.0f, 2000.0f),
+        .modelview = matrix_look_at(eye, centre, (Vector3){0.0f, 1.0f, 0.0f}),
+        .clearColour = {0.5f, 0.75f, 1.0f},
+        .lightDirection = {1.0f, 1.0f, 1.0f},
+        .water = true,
+        .xSize = COARSE_SIZE,
+        .zSize = COARSE_SIZE
+    };
+
+    TerrainMesh* mesh = createTerrainMesh(COARSE_SIZE, COARSE_SIZE);
+    fillTerrainVertices(mesh, terrain, generator->colour_function, &generator->colourParams, whole);
+    SoftImage* fullImage = createSoftImage(COARSE_WIDTH, COARSE_HEIGHT);
+    double full = time_frames(fullImage, &scene, mesh, NULL);
+    printf("Coarse mesh, %dx%d drawn at %dx%d by the software renderer on %d threads:\n",
+           COARSE_SIZE, COARSE_SIZE, COARSE_WIDTH, COARSE_HEIGHT, parallel_num_threads());
+    printf("full     %8.2f ms/frame, %8d triangles\n", full * 1e3, mesh->numIndices / 3);
+
+    SoftImage* image = createSoftImage(COARSE_WIDTH, COARSE_HEIGHT);
+    for (int step = 4; step <= 8; step *= 2) {
+        CoarseMesh* coarse = createCoarseMesh(COARSE_SIZE, COARSE_SIZE, step);
+        markTerrainDirty(terrain, whole);
+        updateCoarseMesh(coarse, terrain, generator->colour_function, &generator->colourParams);
+        double time = time_frames(image, &scene, NULL, coarse);
+        double outliers;
+        double mean = compareSoftImages(fullImage, image, 24, &outliers);
+        printf("step %-3d %8.2f ms/frame, %8d triangles, %5.2f mean difference, %5.2f%% of pixels off\n",
+               step, time * 1e3, coarse->numIndices / 3, mean, outliers * 100);
+        freeCoarseMesh(coarse);
+    }
+    freeSoftImage(image);
+    freeSoftImage(fullImage);
+    freeTerrainMesh(mesh);
+    freeTerrain(terrain);
+    freeGenerator(generator);
+}
+
+// Flies a camera straight across the world at a steady speed, moving the terrain to keep
+// it centred as the viewer does, starting with none of the world in the page cache
+static void fly_world(bool prefetch) {
+    int fd = open(WORLD_PATH, O_RDONLY);
+    fsync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+
+    TileStore* store = openTileStore(WORLD_PATH, WORLD_BUDGET);
+    int xSize, zSize, height;
+    tileWorldSize(store, &xSize, &zSize, &height);
+    Terrain* terrain = createTerrain(WORLD_VIEW, WORLD_VIEW, height);
+    int originX = 0, originZ = (zSize - WORLD_VIEW) / 2;
+    readTileRegion(store, terrain, originX, originZ);
+    TileStats start = tileStoreStats(store);
+
+    int moves = 0;
+    struct timespec frame = {0, (long) (WORLD_FRAME_SECONDS * 1e9)};
+    for (int x = WORLD_VIEW / 2; x < xSize - WORLD_VIEW / 2; x += WORLD_SPEED) {
+        if (prefetch) focusTileStore(store, x, zSize / 2.0f, WORLD_VIEW / 2.0f);
+        if (x - (originX + WORLD_VIEW / 2) > WORLD_VIEW / 4) {
+            originX = x - WORLD_VIEW / 2;
+            readTileRegion(store, terrain, originX, originZ);
+            moves++;
+        }
+        nanosleep(&frame, NULL);
+    }
+    TileStats stats = tileStoreStats(store);
+    printf("%-8s %8.2f ms/move, %3ld misses, %3ld stalls (%7.2f ms), %5ld major faults, %3ld prefetched\n",
+           prefetch ? "prefetch" : "demand", (stats.readSeconds - start.readSeconds) * 1e3 / moves,
+           stats.misses - start.misses, stats.stalls - start.stalls,
+           (stats.stallSeconds - start.stallSeconds) * 1e3, stats.majorFaults - start.majorFaults, stats.prefetched);
+    freeTerrain(terrain);
+    closeTileStore(store);
+}
+
+// Writes a world larger than the viewer's terrain and flies through it, with the tiles
+// only mapped as they are needed and then read ahead by the prefetch thread
+static void benchmark_world(void) {
+    int size = WORLD_TILES * WORLD_TILE_SIZE;
+    Generator* generator = createGenerator(size, size, 30, 4, NOISE_FIXED, 2, 1);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    writeTileWorld(WORLD_PATH, WORLD_TILES, WORLD_TILES, WORLD_TILE_SIZE, 30, generator->height_function, generator);
+    double written = seconds_since(start);
+    freeGenerator(generator);
+    printf("World, %dx%d in tiles of %d, viewed %dx%d flying %d points a frame:\n",
+           size, size, WORLD_TILE_SIZE, WORLD_VIEW, WORLD_VIEW, WORLD_SPEED);
+    printf("written  %8.2f s\n", written);
+    fly_world(false);
+    fly_world(true);
+    remove(WORLD_PATH);
+}
+
+// Compresses the tiles of a large mountain terrain, then times decoding them on one
+// thread against populating a terrain of the same size from the height function
+static void benchmark_codec(void) {
+    Generator* generator = createGenerator(CODEC_SIZE, CODEC_SIZE, 30, 4, NOISE_CLASSIC, 0, 1);
+    Terrain* terrain = createTerrain(CODEC_SIZE, CODEC_SIZE, 30);
+    generateTerrain(generator, terrain);
+
+    int tiles = (CODEC_SIZE / CODEC_TILE) * (CODEC_SIZE / CODEC_TILE);
+    long points = (long) CODEC_TILE * CODEC_TILE;
+    size_t bound = tileCodecBound(CODEC_TILE, CODEC_TILE);
+    uint8_t* data = malloc(bound * tiles);
+    size_t* sizes = malloc(sizeof(size_t) * tiles);
+    GLfloat* heights = malloc(sizeof(GLfloat) * points);
+    GLfloat* decoded = malloc(sizeof(GLfloat) * points);
+    size_t encoded = 0;
+    GLfloat error = 0;
+    for (int t = 0; t < tiles; t++) {
+        int x0 = (t % (CODEC_SIZE / CODEC_TILE)) * CODEC_TILE, z0 = (t / (CODEC_SIZE / CODEC_TILE)) * CODEC_TILE;
+        for (int x = 0; x < CODEC_TILE; x++) {
+            memcpy(heights + (long) x * CODEC_TILE, terrain->heights[x0 + x] + z0, sizeof(GLfloat) * CODEC_TILE);
+        }
+        sizes[t] = encodeTile(heights, CODEC_TILE, CODEC_TILE, data + bound * t);
+        encoded += sizes[t];
+        decodeTile(data + bound * t, sizes[t], decoded, CODEC_TILE, CODEC_TILE);
+        for (long i = 0; i < points; i++) error = fmaxf(error, fabsf(decoded[i] - heights[i]));
+    }
+
+    double decode = INFINITY, populate = INFINITY;
+    Terrain* tile = createTerrain(CODEC_TILE, CODEC_TILE, 30);
+    parallel_set_threads(1);
+    for (int r = 0; r < CODEC_REPEATS; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int t = 0; t < tiles; t++) {
+            decodeTile(data + bound * t, sizes[t], decoded, CODEC_TILE, CODEC_TILE);
+        }
+        decode = fmin(decode, seconds_since(start) / tiles);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        populateTerrain(tile, generator->height_function, generator);
+        populate = fmin(populate, seconds_since(start));
+    }
+    parallel_set_threads(0);
+
+    size_t raw = sizeof(GLfloat) * points * tiles;
+    printf("Codec, %dx%d mountains in tiles of %d:\n", CODEC_SIZE, CODEC_SIZE, CODEC_TILE);
+    printf("encoded  %8.2f bits/height, %5.2fx smaller than floats, %.5f most error\n",
+           encoded * 8.0 / (points * tiles), (double) raw / encoded, error);
+    printf("decode   %8.2f ns/height, %6.2f GB/s of heights on 1 thread\n",
+           decode * 1e9 / points, sizeof(GLfloat) * points / decode / 1e9);
+    printf("populate %8.2f ns/height on 1 thread\n", populate * 1e9 / points);
+    freeTerrain(tile);
+    free(decoded);
+    free(heights);
+    free(sizes);
+    free(data);
+    freeTerrain(terrain);
+    freeGenerator(generator);
+}
+
+// Packs a large mountain terrain to 16 bit heights and normals and unpacks it again,
+// printing the time per point on all threads and the most error of each
+static void benchmark_packed(void) {
+    Generator* generator = createGenerator(PACKED_SIZE, PACKED_SIZE, 30, 4, NOISE_CLASSIC, 0, 1);
+    Terrain* terrain = createTerrain(PACKED_SIZE, PACKED_SIZE, 30);
+    Terrain* unpacked = createTerrain(PACKED_SIZE, PACKED_SIZE, 30);
+    generateTerrain(generator, terrain);
+    PackedTerrain* packed = createPackedTerrain(PACKED_SIZE, PACKED_SIZE, 30);
+    TerrainRect all = {0, 0, PACKED_SIZE, PACKED_SIZE};
+
+    double pack = INFINITY, unpack = INFINITY;
+    for (int r = 0; r < PACKED_REPEATS; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        packTerrain(packed, terrain, all);
+        pack = fmin(pack, seconds_since(start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        unpackTerrain(packed, unpacked, all);
+        unpack = fmin(unpack, seconds_since(start));
+    }
+
+    GLfloat heightError = 0, normalError = 0;
+    for (int x = 0; x < PACKED_SIZE; x++) {
+        for (int z = 0; z < PACKED_SIZE; z++) {
+            heightError = fmaxf(heightError, fabsf(unpacked->heights[x][z] - terrain->heights[x][z]));
+            Vector3 a = terrain->normals[x][z], b = unpacked->normals[x][z];
+            GLfloat cosine = fminf(a.x * b.x + a.y * b.y + a.z * b.z, 1.0f);
+            normalError = fmaxf(normalError, acosf(cosine) * 180.0f / (GLfloat) M_PI);
+        }
+    }
+
+    long points = (long) PACKED_SIZE * PACKED_SIZE;
+    printf("Packed, %dx%d mountains on %d threads:\n", PACKED_SIZE, PACKED_SIZE, parallel_num_threads());
+    printf("size     %8d bytes/point against %zu\n", 2 * (int) sizeof(uint16_t), sizeof(GLfloat) + sizeof(Vector3));
+    printf("pack     %8.2f ns/point\n", pack * 1e9 / points);
+    printf("unpack   %8.2f ns/point\n", unpack * 1e9 / points);
+    printf("error    %8.5f most height, %.3f degrees most normal\n", heightError, normalError);
+    freePackedTerrain(packed);
+    freeTerrain(unpacked);
+    freeTerrain(terrain);
+    freeGenerator(generator);
+}
+
+// Works out the split errors of a large mountain terrain, then builds adaptive meshes of
+// it for a range of maximum errors, printing the triangles each keeps and how long it takes
+static void benchmark_rtin(void) {
+    static const GLfloat maxErrors[] = {0.0f, 0.05f, 0.1f, 0.25f, 0.5f, 1.0f, 2.0f};
+    Generator* generator = createGenerator(RTIN_SIZE, RTIN_SIZE, 30, 4, NOISE_CLASSIC, 0, 1);
+    Terrain* terrain = createTerrain(RTIN_SIZE, RTIN_SIZE, 30);
+    generateTerrain(generator, terrain);
+    Rtin* rtin = createRtin(RTIN_SIZE, RTIN_SIZE);
+
+    double errors = INFINITY;
+    for (int r = 0; r < RTIN_REPEATS; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        updateRtin(rtin, terrain);
+        errors = fmin(errors, seconds_since(start));
+    }
+
+    long full = 2L * (RTIN_SIZE - 1) * (RTIN_SIZE - 1);
+    printf("Adaptive mesh, %dx%d mountains against %ld triangles:\n", RTIN_SIZE, RTIN_SIZE, full);
+    printf("errors   %8.2f ms, %.2f ns/point\n", errors * 1e3, errors * 1e9 / ((long) RTIN_SIZE * RTIN_SIZE));
+    for (int e = 0; e < (int) (sizeof(maxErrors) / sizeof(maxErrors[0])); e++) {
+        double build = INFINITY;
+        int triangles = 0, vertices = 0;
+        for (int r = 0; r < RTIN_REPEATS; r++) {
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            TerrainMesh* mesh = createRtinMesh(rtin, terrain, maxErrors[e], generator->colour_function,
+                                               &generator->colourParams);
+            build = fmin(build, seconds_since(start));
+            triangles = mesh->numIndices / 3;
+            vertices = mesh->numVertices;
+            freeTerrainMesh(mesh);
+        }
+        printf("error %4.2f %8d triangles (%5.2f%%), %8d vertices, %7.2f ms\n", maxErrors[e], triangles,
+               100.0 * triangles / full, vertices, build * 1e3);
+    }
+    freeRtin(rtin);
+    freeTerrain(terrain);
+    freeGenerator(generator);
+}
+
+// Scatters the default trees and rocks over large mountains with biomes, on one thread
+// and on all of them, then builds the batches drawn for them, printing the objects placed
+// per second and what drawing them takes
+static void benchmark_scatter(void) {
+    Generator* generator = createGenerator(SCATTER_SIZE, SCATTER_SIZE, 30, 4, NOISE_CLASSIC, 3, 1);
+    Terrain* terrain = createTerrain(SCATTER_SIZE, SCATTER_SIZE, 30);
+    addTerrainBiomes(terrain);
+    generateTerrain(generator, terrain);
+    Scatter* scatter = createDefaultScatter(1);
+
+    double times[2] = {INFINITY, INFINITY}, batch = INFINITY;
+    for (int threads = 0; threads < 2; threads++) {
+        parallel_set_threads(threads == 0 ? 1 : 0);
+        for (int r = 0; r < SCATTER_REPEATS; r++) {
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            scatterTerrain(scatter, terrain);
+            times[threads] = fmin(times[threads], seconds_since(start));
+        }
+    }
+    for (int r = 0; r < SCATTER_REPEATS; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int l = 0; l < scatter->numLayers; l++) {
+            buildScatterBatch(&scatter->layers[l], l);
+        }
+        batch = fmin(batch, seconds_since(start));
+    }
+
+    long instances = 0, triangles = 0;
+    size_t vertexBytes = 0;
+    for (int l = 0; l < scatter->numLayers; l++) {
+        const ScatterLayer* layer = &scatter->layers[l];
+        instances += layer->count;
+        triangles += layer->batch->numIndices / 3;
+        vertexBytes += sizeof(TerrainVertex) * layer->batch->numVertices + sizeof(GLuint) * layer->batch->numIndices;
+    }
+    printf("Scatter, %dx%d mountains with biomes:\n", SCATTER_SIZE, SCATTER_SIZE);
+    for (int l = 0; l < scatter->numLayers; l++) {
+        printf("layer %d  %8d objects\n", l, scatter->layers[l].count);
+    }
+    printf("scatter  %8.2f ms on 1 thread, %.2f M objects/s\n", times[0] * 1e3, instances / times[0] / 1e6);
+    printf("         %8.2f ms on %d threads, %.2f M objects/s\n", times[1] * 1e3, parallel_num_threads(),
+           instances / times[1] / 1e6);
+    printf("batch    %8.2f ms, %.2f ns/object\n", batch * 1e3, batch * 1e9 / instances);
+    printf("draw     %8d calls, %ld triangles, %zu bytes of instances, %zu of vertices\n", scatter->numLayers,
+           triangles, sizeof(ScatterInstance) * instances, vertexBytes);
+    freeScatter(scatter);
+    freeTerrain(terrain);
+    freeGenerator(generator);
+}
+
+static void empty_chunk(void* context, int begin, int end) {
+}
+
+// Times generating mountains and filling the mesh from them on 1, 2, 4... threads up to
+// at least the core count and PARALLEL_MIN_THREADS, with the cost of an empty loop, checking every count gives
+// the same heights and vertices as one thread
+static void benchmark_parallel(void) {
+    int cores = parallel_num_threads();
+    Generator* generator = createGenerator(PARALLEL_SIZE, PARALLEL_SIZE, 30, 4, NOISE_CLASSIC, 3, 1);
+    Terrain* terrain = createTerrain(PARALLEL_SIZE, PARALLEL_SIZE, 30);
+    addTerrainBiomes(terrain);
+    generator->colourParams.biomeMap = terrain->biomes;
+    TerrainMesh* mesh = createTerrainMesh(PARALLEL_SIZE, PARALLEL_SIZE);
+    TerrainRect whole = {0, 0, PARALLEL_SIZE, PARALLEL_SIZE};
+    GLfloat* heights = malloc(sizeof(GLfloat) * PARALLEL_SIZE * PARALLEL_SIZE);
+    TerrainVertex* vertices = malloc(sizeof(TerrainVertex) * mesh->numVertices);
+
+    printf("Parallel, %dx%d mountains on up to %d cores:\n", PARALLEL_SIZE, PARALLEL_SIZE, cores);
+    double generateOne = 0, fillOne = 0;
+    for (int threads = 1; threads <= PARALLEL_MIN_THREADS || threads / 2 < cores; threads *= 2) {
+        parallel_set_threads(threads);
+        double generate = INFINITY, fill = INFINITY;
+        for (int r = 0; r < PARALLEL_REPEATS; r++) {
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            generateTerrain(generator, terrain);
+            generate = fmin(generate, seconds_since(start));
+
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            fillTerrainVertices(mesh, terrain, generator->colour_function, &generator->colourParams, whole);
+            fill = fmin(fill, seconds_since(start));
+        }
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int l = 0; l < PARALLEL_EMPTY_LOOPS; l++) {
+            parallel_for(PARALLEL_SIZE, empty_chunk, NULL);
+        }
+        double loop = seconds_since(start) / PARALLEL_EMPTY_LOOPS;
+
+        bool same = true;
+        for (int x = 0; x < PARALLEL_SIZE; x++) {
+            if (threads == 1) {
+                memcpy(&heights[x * PARALLEL_SIZE], terrain->heights[x], sizeof(GLfloat) * PARALLEL_SIZE);
+            } else {
+                same = same && memcmp(&heights[x * PARALLEL_SIZE], terrain->heights[x],
+                                      sizeof(GLfloat) * PARALLEL_SIZE) == 0;
+            }
+        }
+        if (threads == 1) {
+            memcpy(vertices, mesh->vertices, sizeof(TerrainVertex) * mesh->numVertices);
+            generateOne = generate;
+            fillOne = fill;
+        } else {
+            same = same && memcmp(vertices, mesh->vertices, sizeof(TerrainVertex) * mesh->numVertices) == 0;
+        }
+        printf("%2d threads generate %8.2f ms %5.2fx, fill %8.2f ms %5.2fx, empty loop %6.2f us%s\n", threads,
+               generate * 1e3, generateOne / generate, fill * 1e3, fillOne / fill, loop * 1e6,
+               same ? "" : ", DIFFERENT RESULTS");
+    }
+    parallel_set_threads(0);
+    free(vertices);
+    free(heights);
+    freeTerrainMesh(mesh);
+    freeTerrain(terrain);
+    freeGenerator(generator);
+}
+
+// The normal of a vertex as calculateNormals used to work it out, from each of the up to
+// 6 triangles around it in turn, each normalised on its own
+static Vector3 single_normal(Terrain* terrain, int x, int z) {
+    static const int faces[6][3] = {{-1, -1, 1}, {0, -1, 0}, {0, -1, 1}, {-1, 0, 0}, {-1, 0, 1}, {0, 0, 0}};
+    Vector3 normal = {0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 6; i++) {
+        int fx = x + faces[i][0], fz = z + faces[i][1];
+        if (fx < 0 || fz < 0 || fx >= terrain->xSize - 1 || fz >= terrain->zSize - 1) continue;
+        GLfloat h00 = terrain->heights[fx][fz], h10 = terrain->heights[fx + 1][fz];
+        GLfloat h01 = terrain->heights[fx][fz + 1], h11 = terrain->heights[fx + 1][fz + 1];
+        Vector3 face = (faces[i][2] == 0)
+            ? cross_product_3((Vector3){1, h10 - h00, 0}, (Vector3){0, h01 - h00, 1})
+            : cross_product_3((Vector3){0, h11 - h10, 1}, (Vector3){-1, h01 - h10, 1});
+        face = normalise_3(face);
+        normal = (Vector3){normal.x + face.x, normal.y + face.y, normal.z + face.z};
+    }
+    return normalise_3(normal);
+}
+
+// Times working out the normals of a mountain terrain on one thread from strips of
+// triangles with the batch functions, against a vertex at a time
+static void benchmark_normals(void) {
+    parallel_set_threads(1);
+    Generator* generator = createGenerator(NORMALS_SIZE, NORMALS_SIZE, 30, 4, NOISE_CLASSIC, 0, 1);
+    Terrain* terrain = createTerrain(NORMALS_SIZE, NORMALS_SIZE, 30);
+    generateTerrain(generator, terrain);
+    Vector3* single = malloc(sizeof(Vector3) * NORMALS_SIZE * NORMALS_SIZE);
+
+    double batched = INFINITY, each = INFINITY;
+    for (int r = 0; r < NORMALS_REPEATS; r++) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        calculateNormals(terrain);
+        batched = fmin(batched, seconds_since(start));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int x = 0; x < NORMALS_SIZE; x++) {
+            for (int z = 0; z < NORMALS_SIZE; z++) single[x * NORMALS_SIZE + z] = single_normal(terrain, x, z);
+        }
+        each = fmin(each, seconds_since(start));
+    }
+    GLfloat worst = 0.0f;
+    for (int x = 0; x < NORMALS_SIZE; x++) {
+        for (int z = 0; z < NORMALS_SIZE; z++) {
+            Vector3 a = single[x * NORMALS_SIZE + z], b = terrain->normals[x][z];
+            worst = fmaxf(worst, fmaxf(fabsf(a.x - b.x), fmaxf(fabsf(a.y - b.y), fabsf(a.z - b.z))));
+        }
+    }
+    int points = NORMALS_SIZE * NORMALS_SIZE;
+    printf("Normals, %dx%d mountains on 1 thread:\n", NORMALS_SIZE, NORMALS_SIZE);
+    printf("batched  %8.2f ms, %5.2f ns/vertex\n", batched * 1e3, batched * 1e9 / points);
+    printf("single   %8.2f ms, %5.2f ns/vertex, components at most %.1e apart\n", each * 1e3,
+           each * 1e9 / points, worst);
+    parallel_set_threads(0);
+    free(single);
+    freeTerrain(terrain);
+    freeGenerator(generator);
+}
+
+typedef struct {
+    const char* name;
+    void (*run)(void);
+} Benchmark;
+
+static const Benchmark benchmarks[] = {
+    {"noise", benchmark_noise},
+    {"animate", benchmark_animate},
+    {"biomes", benchmark_biomes},
+    {"rays", benchmark_rays},
+    {"viewshed", benchmark_viewshed},
+    {"coarse", benchmark_coarse},
+    {"world", benchmark_world},
+    {"codec", benchmark_codec},
+    {"packed", benchmark_packed},
+    {"rtin", benchmark_rtin},
+    {"scatter", benchmark_scatter},
+    {"parallel", benchmark_parallel},
+    {"normals", benchmark_normals},
+};
+
+#define NUM_BENCHMARKS (int) (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+// Runs the benchmarks named on the command line, or all of them, and prints how long
+// each takes per item so changes to the hot paths can be compared
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        bool found = false;
+        for (int b = 0; b < NUM_BENCHMARKS; b++) {
+            if (strcmp(argv[i], benchmarks[b].name) == 0) found = true;
+        }
+        if (!found) {
+            fprintf(stderr, "Benchmark '%s' not recognised.\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    for (int b = 0; b < NUM_BENCHMARKS; b++) {
+        bool selected = (argc == 1);
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], benchmarks[b].name) == 0) selected = true;
+        }
+        if (selected) benchmarks[b].run();
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "codec.h"
+
+#define QUANTISED_MAX 65535
+// Lanes of 16 bit words each block is packed in, 8 fill a 128 bit vector
+#define LANES 8
+
+typedef struct {
+    uint32_t xSize, zSize;
+    GLfloat minimum, step; // Height of the quantised value 0, and between values
+} TileCodecHeader;
+
+static long blockCount(int xSize, int zSize) {
+    return ((long) xSize * zSize + CODEC_BLOCK - 1) / CODEC_BLOCK;
+}
+
+size_t tileCodecBound(int xSize, int zSize) {
+    long blocks = blockCount(xSize, zSize);
+    return sizeof(TileCodecHeader) + blocks + blocks * CODEC_BLOCK * sizeof(uint16_t);
+}
+
+// Maps differences near 0 either way to small values: 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+static uint16_t zigzag(uint16_t difference) {
+    return (uint16_t) ((difference << 1) ^ ((difference & 0x8000) ? 0xFFFF : 0));
+}
+
+static uint16_t unzigzag(uint16_t value) {
+    return (uint16_t) ((value >> 1) ^ (uint16_t) -(value & 1));
+}
+
+static int bitWidth(uint16_t value) {
+    int width = 0;
+    while (value >> width) width++;
+    return width;
+}
+
+// Predicts a quantised height from the ones before it, wrapping around at 16 bits. Rows
+// from the third on carry on the line through the same point of the two rows before,
+// the first two rows are predicted along themselves and from the row before.
+static uint16_t predict(const uint16_t* row, int x, int z, int zSize) {
+    if (x >= 2) return (uint16_t) (2 * row[z - zSize] - row[z - 2 * zSize]);
+    if (x == 1) return row[z - zSize];
+    if (z >= 2) return (uint16_t) (2 * row[z - 1] - row[z - 2]);
+    return (z == 1) ? row[0] : 0;
+}
+
+// A block is packed in LANES interleaved lanes of 16 bit words: value i goes to lane
+// i % LANES, where the values take width bits each one after another. Every lane is
+// unpacked with the same shifts, so the compiler can unpack all the lanes at once.
+static void packBlock(const uint16_t* values, int width, uint8_t* out) {
+    uint16_t words[16 * LANES] = {0};
+    for (int k = 0; k < CODEC_BLOCK / LANES; k++) {
+        int bit = k * width, word = bit / 16, shift = bit % 16;
+        for (int lane = 0; lane < LANES; lane++) {
+            uint16_t value = values[k * LANES + lane];
+            words[word * LANES + lane] |= (uint16_t) (value << shift);
+            if (shift + width > 16) words[(word + 1) * LANES + lane] |= (uint16_t) (value >> (16 - shift));
+        }
+    }
+    memcpy(out, words, width * CODEC_BLOCK / 8);
+}
+
+static inline void unpackWidth(const uint8_t* in, int width, uint16_t* values) {
+    // One more row of words, as every value is taken from two
+    uint16_t words[17 * LANES];
+    memcpy(words, in, width * CODEC_BLOCK / 8);
+    memset(words + width * LANES, 0, sizeof(uint16_t) * LANES);
+    uint16_t mask = (uint16_t) ((1u << width) - 1);
+    for (int k = 0; k < CODEC_BLOCK / LANES; k++) {
+        int bit = k * width, word = bit / 16, shift = bit % 16;
+        // When the value fits in one word the bits of the next are masked off
+        for (int lane = 0; lane < LANES; lane++) {
+            uint32_t pair = words[word * LANES + lane] | (uint32_t) words[(word + 1) * LANES + lane] << 16;
+            values[k * LANES + lane] = (uint16_t) (pair >> shift) & mask;
+        }
+    }
+}
+
+// Each width is unpacked by its own copy of the loop, which the compiler unrolls with
+// the shifts and offsets as constants
+static void unpackBlock(const uint8_t* in, int width, uint16_t* values) {
+    switch (width) {
+        case 0: memset(values, 0, sizeof(uint16_t) * CODEC_BLOCK); break;
+        case 1: unpackWidth(in, 1, values); break;
+        case 2: unpackWidth(in, 2, values); break;
+        case 3: unpackWidth(in, 3, values); break;
+        case 4: unpackWidth(in, 4, values); break;
+        case 5: unpackWidth(in, 5, values); break;
+        case 6: unpackWidth(in, 6, values); break;
+        case 7: unpackWidth(in, 7, values); break;
+        case 8: unpackWidth(in, 8, values); break;
+        case 9: unpackWidth(in, 9, values); break;
+        case 10: unpackWidth(in, 10, values); break;
+        case 11: unpackWidth(in, 11, values); break;
+        case 12: unpackWidth(in, 12, values); break;
+        case 13: unpackWidth(in, 13, values); break;
+        case 14: unpackWidth(in, 14, values); break;
+        case 15: unpackWidth(in, 15, values); break;
+        default: unpackWidth(in, 16, values); break;
+    }
+}
+
+size_t encodeTile(const GLfloat* heights, int xSize, int zSize, uint8_t* out) {
+    long count = (long) xSize * zSize;
+    long blocks = blockCount(xSize, zSize);
+    GLfloat minimum = INFINITY, maximum = -INFINITY;
+    for (long i = 0; i < count; i++) {
+        minimum = fminf(minimum, heights[i]);
+        maximum = fmaxf(maximum, heights[i]);
+    }
+    TileCodecHeader header = {xSize, zSize, minimum, (maximum - minimum) / QUANTISED_MAX};
+    if (count == 0) {
+        header.minimum = 0;
+        header.step = 0;
+    }
+
+    uint16_t* quantised = malloc(sizeof(uint16_t) * count);
+    uint16_t* residuals = calloc(blocks * CODEC_BLOCK, sizeof(uint16_t));
+    assert(quantised != NULL && residuals != NULL);
+    for (long i = 0; i < count; i++) {
+        long value = (header.step > 0) ? lrintf((heights[i] - minimum) / header.step) : 0;
+        quantised[i] = (uint16_t) (value < 0 ? 0 : value > QUANTISED_MAX ? QUANTISED_MAX : value);
+    }
+    for (int x = 0; x < xSize; x++) {
+        const uint16_t* row = quantised + (long) x * zSize;
+        for (int z = 0; z < zSize; z++) {
+            residuals[(long) x * zSize + z] = zigzag((uint16_t) (row[z] - predict(row, x, z, zSize)));
+        }
+    }
+
+    memcpy(out, &header, sizeof(header));
+    uint8_t* widths = out + sizeof(header);
+    uint8_t* packed = widths + blocks;
+    for (long b = 0; b < blocks; b++) {
+        uint16_t bits = 0;
+        for (int i = 0; i < CODEC_BLOCK; i++) bits |= residuals[b * CODEC_BLOCK + i];
+        int width = bitWidth(bits);
+        widths[b] = (uint8_t) width;
+        packBlock(residuals + b * CODEC_BLOCK, width, packed);
+        packed += width * CODEC_BLOCK / 8;
+    }
+    free(quantised);
+    free(residuals);
+    return (size_t) (packed - out);
+}
+
+// Rows go through in whole blocks, as at -O2 the compiler only vectorises loops which
+// run a known multiple of the vector length
+static void extrapolateRow(uint16_t* restrict row, const uint16_t* restrict above,
+                           const uint16_t* restrict above2, int count) {
+    int z = 0;
+    for (; z + CODEC_BLOCK <= count; z += CODEC_BLOCK) {
+        for (int i = 0; i < CODEC_BLOCK; i++) {
+            row[z + i] = unzigzag(row[z + i]) + 2 * above[z + i] - above2[z + i];
+        }
+    }
+    for (; z < count; z++) row[z] = unzigzag(row[z]) + 2 * above[z] - above2[z];
+}
+
+static void scaleRow(const uint16_t* restrict row, GLfloat minimum, GLfloat step, GLfloat* restrict out, int count) {
+    int z = 0;
+    for (; z + CODEC_BLOCK <= count; z += CODEC_BLOCK) {
+        for (int i = 0; i < CODEC_BLOCK; i++) out[z + i] = minimum + step * row[z + i];
+    }
+    for (; z < count; z++) out[z] = minimum + step * row[z];
+}
+
+bool decodeTile(const uint8_t* data, size_t size, GLfloat* heights, int xSize, int zSize) {
+    TileCodecHeader header;
+    long blocks = blockCount(xSize, zSize);
+    if (size < sizeof(header) + blocks) return false;
+    memcpy(&header, data, sizeof(header));
+    if (header.xSize != (uint32_t) xSize || header.zSize != (uint32_t) zSize) return false;
+    const uint8_t* widths = data + sizeof(header);
+    size_t packedBytes = 0;
+    for (long b = 0; b < blocks; b++) {
+        if (widths[b] > 16) return false;
+        packedBytes += widths[b] * CODEC_BLOCK / 8;
+    }
+    if (size < sizeof(header) + blocks + packedBytes) return false;
+
+    uint16_t* values = malloc(sizeof(uint16_t) * blocks * CODEC_BLOCK);
+    assert(values != NULL);
+    const uint8_t* packed = widths + blocks;
+    for (long b = 0; b < blocks; b++) {
+        unpackBlock(packed, widths[b], values + b * CODEC_BLOCK);
+        packed += widths[b] * CODEC_BLOCK / 8;
+    }
+    // Undoes the predictions in place, every row from the third on as a whole
+    for (int x = 0; x < xSize; x++) {
+        uint16_t* row = values + (long) x * zSize;
+        if (x >= 2) {
+            extrapolateRow(row, row - zSize, row - 2 * zSize, zSize);
+        } else {
+            for (int z = 0; z < zSize; z++) row[z] = unzigzag(row[z]) + predict(row, x, z, zSize);
+        }
+        scaleRow(row, header.minimum, header.step, heights + (long) x * zSize, zSize);
+    }
+    free(values);
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "structures.h"
+
+// Residuals packed together at the same width, the width of every block is stored first
+#define CODEC_BLOCK 128
+
+// Returns the most bytes a tile of the given size can encode to
+extern size_t tileCodecBound(int xSize, int zSize);
+
+// Compresses a tile of heights, stored by x then z, into out, which must hold
+// tileCodecBound bytes, and returns the bytes written. The heights are quantised to 16
+// bits over the tile's own range, so each is off by at most a 131070th of the range.
+// Each is predicted by carrying on the line through the same point of the two rows
+// before, and the differences are packed in blocks with the fewest bits that hold them.
+extern size_t encodeTile(const GLfloat* heights, int xSize, int zSize, uint8_t* out);
+
+// Decompresses a tile written by encodeTile into heights, by x then z. Returns false if
+// the data is not a tile of that size. Runs on the calling thread, so tiles can be
+// decoded on as many threads as there are tiles.
+extern bool decodeTile(const uint8_t* data, size_t size, GLfloat* heights, int xSize, int zSize);
+
+#endif
@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "codec.h"
+#include "structures.h"
+#include "testing.h"
+
+#define SIZE 256
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+// The shared hills, scaled up to heights the quantisation steps can tell apart
+static GLfloat hills(int x, int z) {
+    return 30.0f * test_hills(NULL, x, z);
+}
+
+// Heights with no pattern to predict, spanning the whole range
+static GLfloat rough(int x, int z) {
+    return (hash_seed(3, x * 7919 + z) % 1000) * 0.05f - 25.0f;
+}
+
+// Encodes and decodes the tile, returning whether every height came back within half a
+// quantisation step of the tile's range. The encoded size is written to bytes.
+static bool round_trip(GLfloat (*height)(int, int), int xSize, int zSize, size_t* bytes) {
+    long count = (long) xSize * zSize;
+    GLfloat* heights = malloc(sizeof(GLfloat) * count);
+    GLfloat* decoded = malloc(sizeof(GLfloat) * count);
+    uint8_t* data = malloc(tileCodecBound(xSize, zSize));
+    GLfloat minimum = INFINITY, maximum = -INFINITY;
+    for (int x = 0; x < xSize; x++) {
+        for (int z = 0; z < zSize; z++) {
+            GLfloat h = height(x, z);
+            heights[(long) x * zSize + z] = h;
+            minimum = fminf(minimum, h);
+            maximum = fmaxf(maximum, h);
+        }
+    }
+    *bytes = encodeTile(heights, xSize, zSize, data);
+    bool close = *bytes <= tileCodecBound(xSize, zSize) && decodeTile(data, *bytes, decoded, xSize, zSize);
+    GLfloat tolerance = (maximum - minimum) / 65535 * 0.5f + 1e-5f * fmaxf(fabsf(minimum), fabsf(maximum));
+    for (long i = 0; i < count && close; i++) {
+        close = fabsf(decoded[i] - heights[i]) <= tolerance;
+    }
+    free(heights);
+    free(decoded);
+    free(data);
+    return close;
+}
+
+static GLfloat flat(int x, int z) {
+    return 4.5f;
+}
+
+int main(void) {
+    printf("Testing Codec: \n");
+    size_t raw = sizeof(GLfloat) * SIZE * SIZE;
+    size_t bytes;
+
+    // Smooth terrain is predicted well, so packs into a few bits a height
+    bool hillsClose = round_trip(hills, SIZE, SIZE, &bytes);
+    assert_test(hillsClose, "Hills decoded within half a step.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(bytes * 2 < raw, "Hills compressed over 2 times.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Flat ground has nothing to store but the header and block widths
+    assert_test(round_trip(flat, SIZE, SIZE, &bytes) && bytes < raw / 100, "Flat tile exact and tiny.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Noise needs the full width, with the predictions wrapping around
+    assert_test(round_trip(rough, SIZE, SIZE, &bytes), "Rough tile decoded.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Sizes which do not fill the last block
+    assert_test(round_trip(hills, 37, 53, &bytes) && round_trip(rough, 1, 5, &bytes),
+                "Odd sizes decoded.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Data cut short, or for another size, is refused
+    GLfloat heights[SIZE];
+    for (int i = 0; i < SIZE; i++) heights[i] = hills(i, 0);
+    uint8_t data[1024];
+    assert_test(tileCodecBound(16, 16) <= sizeof(data), "Bound fits.", TEST_OK_OUT, TEST_FAIL_OUT);
+    bytes = encodeTile(heights, 16, 16, data);
+    GLfloat decoded[SIZE];
+    assert_test(!decodeTile(data, bytes - 1, decoded, 16, 16) && !decodeTile(data, bytes, decoded, 8, 32)
+                && decodeTile(data, bytes, decoded, 16, 16),
+                "Bad data refused.", TEST_OK_OUT, TEST_FAIL_OUT);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,334 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include "erosion.h"
+#include "parallel.h"
+
+// Smallest tile used for grouping droplets
+#define MIN_TILE_SIZE 16
+
+// Returns settings that give a natural look on terrains of the default size
+ErosionSettings defaultErosionSettings(uint32_t seed) {
+    return (ErosionSettings){
+        .seed = seed,
+        .droplets = 0,
+        .dropletLifetime = 30,
+        .batches = 8,
+        .inertia = 0.05f,
+        .capacity = 4.0f,
+        .minCapacity = 0.01f,
+        .erodeRate = 0.3f,
+        .depositRate = 0.3f,
+        .evaporateRate = 0.01f,
+        .gravity = 4.0f,
+        .thermalIterations = 0,
+        .talus = 0.8f,
+        .thermalRate = 0.5f
+    };
+}
+
+void erodeTerrain(Terrain* terrain, const ErosionSettings* settings) {
+    hydraulicErosion(terrain, settings);
+    thermalErosion(terrain, settings);
+    calculateNormals(terrain);
+}
+
+// Returns the height at (x, z) by bilinear interpolation, and its gradient if gx and gz
+// are not NULL. PRE: 0 <= x < xSize - 1 and 0 <= z < zSize - 1.
+static GLfloat height_and_gradient(GLfloat** heights, GLfloat x, GLfloat z, GLfloat* gx, GLfloat* gz) {
+    int ix = (int) x;
+    int iz = (int) z;
+    GLfloat u = x - ix;
+    GLfloat v = z - iz;
+
+    GLfloat h00 = heights[ix][iz];
+    GLfloat h10 = heights[ix + 1][iz];
+    GLfloat h01 = heights[ix][iz + 1];
+    GLfloat h11 = heights[ix + 1][iz + 1];
+
+    if (gx != NULL && gz != NULL) {
+        *gx = (h10 - h00) * (1 - v) + (h11 - h01) * v;
+        *gz = (h01 - h00) * (1 - u) + (h11 - h10) * u;
+    }
+    return h00 * (1 - u) * (1 - v) + h10 * u * (1 - v) + h01 * (1 - u) * v + h11 * u * v;
+}
+
+// Adds amount to the four cells around (x, z), weighted by how close (x, z) is to each
+static void add_bilinear(GLfloat** heights, GLfloat x, GLfloat z, GLfloat amount) {
+    int ix = (int) x;
+    int iz = (int) z;
+    GLfloat u = x - ix;
+    GLfloat v = z - iz;
+
+    heights[ix][iz] += amount * (1 - u) * (1 - v);
+    heights[ix + 1][iz] += amount * u * (1 - v);
+    heights[ix][iz + 1] += amount * (1 - u) * v;
+    heights[ix + 1][iz + 1] += amount * u * v;
+}
+
+// State shared by every tile of one phase of hydraulic erosion.
+// Tiles are coloured like a 2x2 checkerboard and only tiles of one colour run at once.
+typedef struct {
+    Terrain* terrain;
+    const ErosionSettings* settings;
+    int tileSize, margin;
+    int shiftX, shiftZ;
+    int tilesX, tilesZ;
+    int colour;
+    int batch;
+    int* tileDroplets; // Droplets each tile simulates this batch
+} HydraulicPass;
+
+// Clamps val to [min, max]
+static int clamp_int(int val, int min, int max) {
+    if (val < min) return min;
+    if (val > max) return max;
+    return val;
+}
+
+// Simulates the droplets of one tile. Droplets start inside the tile and die if they
+// leave the tile grown by the margin, so they never touch cells of another tile
+// of the same colour.
+static void erode_tile(HydraulicPass* pass, int tileX, int tileZ) {
+    const ErosionSettings* s = pass->settings;
+    GLfloat** heights = pass->terrain->heights;
+    int droplets = pass->tileDroplets[tileX * pass->tilesZ + tileZ];
+
+    // Droplet positions must stay below size - 1 so all four bilinear cells exist
+    int maxX = pass->terrain->xSize - 1;
+    int maxZ = pass->terrain->zSize - 1;
+    int startX = tileX * pass->tileSize - pass->shiftX;
+    int startZ = tileZ * pass->tileSize - pass->shiftZ;
+    GLfloat spawnX0 = clamp_int(startX, 0, maxX);
+    GLfloat spawnX1 = clamp_int(startX + pass->tileSize, 0, maxX);
+    GLfloat spawnZ0 = clamp_int(startZ, 0, maxZ);
+    GLfloat spawnZ1 = clamp_int(startZ + pass->tileSize, 0, maxZ);
+    GLfloat regionX0 = clamp_int(startX - pass->margin, 0, maxX);
+    GLfloat regionX1 = clamp_int(startX + pass->tileSize + pass->margin - 1, 0, maxX);
+    GLfloat regionZ0 = clamp_int(startZ - pass->margin, 0, maxZ);
+    GLfloat regionZ1 = clamp_int(startZ + pass->tileSize + pass->margin - 1, 0, maxZ);
+
+    uint32_t random = hash_seed(hash_seed(s->seed, pass->batch), tileX * pass->tilesZ + tileZ);
+    for (int d = 0; d < droplets; d++) {
+        GLfloat x = spawnX0 + random_float(&random) * (spawnX1 - spawnX0);
+        GLfloat z = spawnZ0 + random_float(&random) * (spawnZ1 - spawnZ0);
+        // Rounding far from the origin can land exactly on the far edge
+        if (x >= spawnX1 || z >= spawnZ1) continue;
+        GLfloat dirX = 0, dirZ = 0;
+        GLfloat speed = 1, water = 1, sediment = 0;
+
+        for (int step = 0; step < s->dropletLifetime; step++) {
+            GLfloat gradX, gradZ;
+            GLfloat height = height_and_gradient(heights, x, z, &gradX, &gradZ);
+
+            // Turn towards the downhill direction, keeping some of the old direction
+            dirX = dirX * s->inertia - gradX * (1 - s->inertia);
+            dirZ = dirZ * s->inertia - gradZ * (1 - s->inertia);
+            GLfloat length = sqrtf(dirX * dirX + dirZ * dirZ);
+            if (length < 1e-6f) break;
+            dirX /= length;
+            dirZ /= length;
+
+            GLfloat newX = x + dirX;
+            GLfloat newZ = z + dirZ;
+            if (newX < regionX0 || newX >= regionX1 || newZ < regionZ0 || newZ >= regionZ1) break;
+
+            GLfloat heightChange = height_and_gradient(heights, newX, newZ, NULL, NULL) - height;
+            GLfloat capacity = fmaxf(-heightChange * speed * water * s->capacity, s->minCapacity);
+
+            if (sediment > capacity || heightChange > 0) {
+                // Going uphill fills the pit behind, otherwise drop some of the excess
+                GLfloat deposit = (heightChange > 0) ?
+                        fminf(heightChange, sediment) : (sediment - capacity) * s->depositRate;
+                sediment -= deposit;
+                add_bilinear(heights, x, z, deposit);
+            } else {
+                // Never dig deeper than the height difference, so no spikes are left behind
+                GLfloat erode = fminf((capacity - sediment) * s->erodeRate, -heightChange);
+                add_bilinear(heights, x, z, -erode);
+                sediment += erode;
+            }
+
+            speed = sqrtf(fmaxf(0, speed * speed - heightChange * s->gravity));
+            water *= 1 - s->evaporateRate;
+            x = newX;
+            z = newZ;
+        }
+    }
+}
+
+// Runs a range of the tiles of the current colour
+static void erode_tiles(void* context, int begin, int end) {
+    HydraulicPass* pass = context;
+    int offsetX = pass->colour & 1;
+    int offsetZ = pass->colour >> 1;
+    int countZ = (pass->tilesZ - offsetZ + 1) / 2;
+    for (int i = begin; i < end; i++) {
+        erode_tile(pass, offsetX + 2 * (i / countZ), offsetZ + 2 * (i % countZ));
+    }
+}
+
+// Works out how many droplets each tile runs in a batch, in proportion to the area
+// droplets can spawn in. Cumulative rounding keeps the total exact.
+static void share_droplets(HydraulicPass* pass, int droplets) {
+    int maxX = pass->terrain->xSize - 1;
+    int maxZ = pass->terrain->zSize - 1;
+    long totalArea = (long) maxX * maxZ;
+    long area = 0;
+    int given = 0;
+    for (int i = 0; i < pass->tilesX; i++) {
+        int startX = i * pass->tileSize - pass->shiftX;
+        int width = clamp_int(startX + pass->tileSize, 0, maxX) - clamp_int(startX, 0, maxX);
+        for (int j = 0; j < pass->tilesZ; j++) {
+            int startZ = j * pass->tileSize - pass->shiftZ;
+            int depth = clamp_int(startZ + pass->tileSize, 0, maxZ) - clamp_int(startZ, 0, maxZ);
+            area += (long) width * depth;
+            int upTo = (int) ((double) droplets * area / totalArea);
+            pass->tileDroplets[i * pass->tilesZ + j] = upTo - given;
+            given = upTo;
+        }
+    }
+}
+
+void hydraulicErosion(Terrain* terrain, const ErosionSettings* settings) {
+    if (settings->droplets <= 0 || terrain->xSize < 2 || terrain->zSize < 2) return;
+
+    HydraulicPass pass = {
+        .terrain = terrain,
+        .settings = settings,
+        .tileSize = 2 * (settings->dropletLifetime + 2)
+    };
+    if (pass.tileSize < MIN_TILE_SIZE) pass.tileSize = MIN_TILE_SIZE;
+    pass.margin = pass.tileSize / 2 - 1;
+
+    // The grid is shifted by up to a tile, so there may be one extra tile each way
+    int maxTilesX = (terrain->xSize - 1) / pass.tileSize + 2;
+    int maxTilesZ = (terrain->zSize - 1) / pass.tileSize + 2;
+    pass.tileDroplets = malloc(sizeof(int) * maxTilesX * maxTilesZ);
+    if (pass.tileDroplets == NULL) {
+        fprintf(stderr, "Allocation of erosion tiles failed.\n");
+        return;
+    }
+
+    int batches = (settings->batches < 1) ? 1 : settings->batches;
+    for (int batch = 0; batch < batches; batch++) {
+        // Move the tile grid every batch so tile borders do not leave visible seams
+        uint32_t random = hash_seed(settings->seed, batches + batch);
+        pass.batch = batch;
+        pass.shiftX = random_next(&random) % pass.tileSize;
+        pass.shiftZ = random_next(&random) % pass.tileSize;
+        pass.tilesX = (terrain->xSize - 1 + pass.shiftX + pass.tileSize - 1) / pass.tileSize;
+        pass.tilesZ = (terrain->zSize - 1 + pass.shiftZ + pass.tileSize - 1) / pass.tileSize;
+
+        int droplets = (int) ((long) settings->droplets * (batch + 1) / batches)
+                - (int) ((long) settings->droplets * batch / batches);
+        share_droplets(&pass, droplets);
+
+        for (int colour = 0; colour < 4; colour++) {
+            pass.colour = colour;
+            int countX = (pass.tilesX - (colour & 1) + 1) / 2;
+            int countZ = (pass.tilesZ - (colour >> 1) + 1) / 2;
+            parallel_for(countX * countZ, erode_tiles, &pass);
+        }
+    }
+    free(pass.tileDroplets);
+}
+
+// Scratch grids for thermal erosion, indexed by x * zSize + z
+typedef struct {
+    Terrain* terrain;
+    const ErosionSettings* settings;
+    GLfloat* moved;  // Material each cell gives away this pass
+    GLfloat* excess; // Sum of how far each lower neighbour is past the talus
+    GLfloat* next;   // Heights after this pass
+} ThermalPass;
+
+static const int neighbourX[4] = {-1, 1, 0, 0};
+static const int neighbourZ[4] = {0, 0, -1, 1};
+
+// Works out how much material each cell in the rows gives away
+static void thermal_outflow(void* context, int begin, int end) {
+    ThermalPass* pass = context;
+    Terrain* terrain = pass->terrain;
+    GLfloat talus = pass->settings->talus;
+    for (int x = begin; x < end; x++) {
+        for (int z = 0; z < terrain->zSize; z++) {
+            GLfloat height = terrain->heights[x][z];
+            GLfloat maxDiff = 0, excess = 0;
+            for (int n = 0; n < 4; n++) {
+                int nx = x + neighbourX[n];
+                int nz = z + neighbourZ[n];
+                if (nx < 0 || nz < 0 || nx >= terrain->xSize || nz >= terrain->zSize) continue;
+                GLfloat diff = height - terrain->heights[nx][nz];
+                if (diff > talus) excess += diff - talus;
+                if (diff > maxDiff) maxDiff = diff;
+            }
+            int cell = x * terrain->zSize + z;
+            // Only half the excess moves, otherwise two cells could swap heights forever
+            pass->moved[cell] = (maxDiff > talus) ? pass->settings->thermalRate * (maxDiff - talus) / 2 : 0;
+            pass->excess[cell] = excess;
+        }
+    }
+}
+
+// Each cell loses what it gives away and gains its share of what higher neighbours give
+static void thermal_gather(void* context, int begin, int end) {
+    ThermalPass* pass = context;
+    Terrain* terrain = pass->terrain;
+    GLfloat talus = pass->settings->talus;
+    for (int x = begin; x < end; x++) {
+        for (int z = 0; z < terrain->zSize; z++) {
+            int cell = x * terrain->zSize + z;
+            GLfloat height = terrain->heights[x][z];
+            GLfloat next = height - pass->moved[cell];
+            for (int n = 0; n < 4; n++) {
+                int nx = x + neighbourX[n];
+                int nz = z + neighbourZ[n];
+                if (nx < 0 || nz < 0 || nx >= terrain->xSize || nz >= terrain->zSize) continue;
+                int neighbour = nx * terrain->zSize + nz;
+                GLfloat diff = terrain->heights[nx][nz] - height;
+                if (pass->moved[neighbour] > 0 && diff > talus) {
+                    next += pass->moved[neighbour] * (diff - talus) / pass->excess[neighbour];
+                }
+            }
+            pass->next[cell] = next;
+        }
+    }
+}
+
+// Copies the new heights back into the terrain
+static void thermal_store(void* context, int begin, int end) {
+    ThermalPass* pass = context;
+    Terrain* terrain = pass->terrain;
+    for (int x = begin; x < end; x++) {
+        for (int z = 0; z < terrain->zSize; z++) {
+            terrain->heights[x][z] = pass->next[x * terrain->zSize + z];
+        }
+    }
+}
+
+// Every pass reads only the previous heights, so rows can be processed in any order
+void thermalErosion(Terrain* terrain, const ErosionSettings* settings) {
+    if (settings->thermalIterations <= 0) return;
+
+    int cells = terrain->xSize * terrain->zSize;
+    ThermalPass pass = {
+        .terrain = terrain,
+        .settings = settings,
+        .moved = malloc(sizeof(GLfloat) * cells),
+        .excess = malloc(sizeof(GLfloat) * cells),
+        .next = malloc(sizeof(GLfloat) * cells)
+    };
+    if (pass.moved == NULL || pass.excess == NULL || pass.next == NULL) {
+        fprintf(stderr, "Allocation of thermal erosion buffers failed.\n");
+    } else {
+        for (int i = 0; i < settings->thermalIterations; i++) {
+            parallel_for(terrain->xSize, thermal_outflow, &pass);
+            parallel_for(terrain->xSize, thermal_gather, &pass);
+            parallel_for(terrain->xSize, thermal_store, &pass);
+        }
+    }
+    free(pass.moved);
+    free(pass.excess);
+    free(pass.next);
+}
@@ -0,0 +1,44 @@
+#ifndef EROSION_H
+#define EROSION_H
+
+#include "structures.h"
+#include "terrain.h"
+
+// Settings for the erosion stage. The droplet count and thermal iterations are the
+// budgets that trade quality for time, every other value tunes the look.
+typedef struct {
+    uint32_t seed;
+
+    // Hydraulic (particle) erosion
+    int droplets;          // Total droplets simulated, 0 disables hydraulic erosion
+    int dropletLifetime;   // Maximum steps a droplet takes, each step moves one cell
+    int batches;           // Rounds the droplets are split into, the tile grid moves each round
+    GLfloat inertia;       // How much a droplet keeps its direction instead of following the slope
+    GLfloat capacity;      // Multiplier for how much sediment a droplet can carry
+    GLfloat minCapacity;   // Capacity of a droplet on flat ground
+    GLfloat erodeRate;     // Fraction of free capacity filled from the ground each step
+    GLfloat depositRate;   // Fraction of excess sediment dropped each step
+    GLfloat evaporateRate; // Fraction of water lost each step
+    GLfloat gravity;
+
+    // Thermal erosion
+    int thermalIterations; // Passes over the whole terrain, 0 disables thermal erosion
+    GLfloat talus;         // Height difference between neighbours above which material slides
+    GLfloat thermalRate;   // Fraction of the excess moved each pass
+} ErosionSettings;
+
+// Returns settings that give a natural look on terrains of the default size.
+extern ErosionSettings defaultErosionSettings(uint32_t seed);
+
+// Runs hydraulic then thermal erosion on the heights and recalculates the normals.
+// The output only depends on the settings and input heights, not on the thread count.
+extern void erodeTerrain(Terrain*, const ErosionSettings*);
+
+// Simulates droplets running down the terrain, carving and depositing sediment.
+// Droplets are grouped by tile and tiles far enough apart run at the same time.
+extern void hydraulicErosion(Terrain*, const ErosionSettings*);
+
+// Moves material from cells to lower neighbours while the slope is above the talus.
+extern void thermalErosion(Terrain*, const ErosionSettings*);
+
+#endif
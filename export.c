@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include "export.h"
+
+#define GLB_MAGIC 0x46546C67      // "glTF"
+#define GLB_VERSION 2
+#define GLB_CHUNK_JSON 0x4E4F534A // "JSON"
+#define GLB_CHUNK_BIN 0x004E4942  // "BIN\0"
+#define GLTF_FLOAT 5126
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_ARRAY_BUFFER 34962
+#define GLTF_ELEMENT_ARRAY_BUFFER 34963
+#define GLTF_TRIANGLES 4
+// Room for the JSON, which only grows with the digits of the counts and bounds
+#define GLB_JSON_SIZE 2048
+
+bool writeMeshObj(const TerrainMesh* mesh, const char* path) {
+    FILE* file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open '%s' to write.\n", path);
+        return false;
+    }
+    fprintf(file, "# %d vertices, %d triangles\n", mesh->numVertices, mesh->numIndices / 3);
+    for (int i = 0; i < mesh->numVertices; i++) {
+        const TerrainVertex* v = &mesh->vertices[i];
+        fprintf(file, "v %g %g %g %.4f %.4f %.4f\n", v->position.x, v->position.y, v->position.z,
+                v->colour.x, v->colour.y, v->colour.z);
+    }
+    for (int i = 0; i < mesh->numVertices; i++) {
+        const Vector3* n = &mesh->vertices[i].normal;
+        fprintf(file, "vn %.5f %.5f %.5f\n", n->x, n->y, n->z);
+    }
+    // OBJ counts from 1
+    for (int i = 0; i < mesh->numIndices; i += 3) {
+        GLuint a = mesh->indices[i] + 1, b = mesh->indices[i + 1] + 1, c = mesh->indices[i + 2] + 1;
+        fprintf(file, "f %u//%u %u//%u %u//%u\n", a, a, b, b, c, c);
+    }
+    bool written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
+
+static void writeWord(FILE* file, uint32_t word) {
+    uint8_t bytes[4] = {word & 0xFF, (word >> 8) & 0xFF, (word >> 16) & 0xFF, word >> 24};
+    fwrite(bytes, 1, 4, file);
+}
+
+// glTF needs the bounds of the positions
+static void positionBounds(const TerrainMesh* mesh, Vector3* min, Vector3* max) {
+    *min = (Vector3){INFINITY, INFINITY, INFINITY};
+    *max = (Vector3){-INFINITY, -INFINITY, -INFINITY};
+    for (int i = 0; i < mesh->numVertices; i++) {
+        Vector3 p = mesh->vertices[i].position;
+        *min = (Vector3){fminf(min->x, p.x), fminf(min->y, p.y), fminf(min->z, p.z)};
+        *max = (Vector3){fmaxf(max->x, p.x), fmaxf(max->y, p.y), fmaxf(max->z, p.z)};
+    }
+}
+
+bool writeMeshGlb(const TerrainMesh* mesh, const char* path) {
+    if (mesh->numVertices == 0 || mesh->numIndices == 0) {
+        fprintf(stderr, "An empty mesh can not be written as glTF.\n");
+        return false;
+    }
+    uint32_t vertexBytes = sizeof(TerrainVertex) * mesh->numVertices;
+    uint32_t indexBytes = sizeof(GLuint) * mesh->numIndices;
+    Vector3 min, max;
+    positionBounds(mesh, &min, &max);
+
+    // One buffer view holds the vertices as they are, the accessors pick out each part
+    char json[GLB_JSON_SIZE];
+    int length = snprintf(json, sizeof(json),
+        "{\"asset\":{\"version\":\"2.0\",\"generator\":\"Terrain Generation\"},"
+        "\"scene\":0,\"scenes\":[{\"nodes\":[0]}],\"nodes\":[{\"mesh\":0}],"
+        "\"meshes\":[{\"primitives\":[{\"attributes\":{\"POSITION\":0,\"NORMAL\":1,\"COLOR_0\":2},"
+        "\"indices\":3,\"mode\":%d}]}],"
+        "\"buffers\":[{\"byteLength\":%u}],"
+        "\"bufferViews\":[{\"buffer\":0,\"byteOffset\":0,\"byteLength\":%u,\"byteStride\":%zu,\"target\":%d},"
+        "{\"buffer\":0,\"byteOffset\":%u,\"byteLength\":%u,\"target\":%d}],"
+        "\"accessors\":["
+        "{\"bufferView\":0,\"byteOffset\":%zu,\"componentType\":%d,\"count\":%d,\"type\":\"VEC3\","
+        "\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]},"
+        "{\"bufferView\":0,\"byteOffset\":%zu,\"componentType\":%d,\"count\":%d,\"type\":\"VEC3\"},"
+        "{\"bufferView\":0,\"byteOffset\":%zu,\"componentType\":%d,\"count\":%d,\"type\":\"VEC3\"},"
+        "{\"bufferView\":1,\"byteOffset\":0,\"componentType\":%d,\"count\":%d,\"type\":\"SCALAR\"}]}",
+        GLTF_TRIANGLES, vertexBytes + indexBytes,
+        vertexBytes, sizeof(TerrainVertex), GLTF_ARRAY_BUFFER,
+        vertexBytes, indexBytes, GLTF_ELEMENT_ARRAY_BUFFER,
+        offsetof(TerrainVertex, position), GLTF_FLOAT, mesh->numVertices,
+        min.x, min.y, min.z, max.x, max.y, max.z,
+        offsetof(TerrainVertex, normal), GLTF_FLOAT, mesh->numVertices,
+        offsetof(TerrainVertex, colour), GLTF_FLOAT, mesh->numVertices,
+        GLTF_UNSIGNED_INT, mesh->numIndices);
+    if (length < 0 || length + 3 >= (int) sizeof(json)) return false;
+    // Chunks are padded to 4 bytes, the JSON with spaces
+    while (length % 4 != 0) json[length++] = ' ';
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open '%s' to write.\n", path);
+        return false;
+    }
+    writeWord(file, GLB_MAGIC);
+    writeWord(file, GLB_VERSION);
+    writeWord(file, 12 + 8 + length + 8 + vertexBytes + indexBytes);
+    writeWord(file, length);
+    writeWord(file, GLB_CHUNK_JSON);
+    fwrite(json, 1, length, file);
+    writeWord(file, vertexBytes + indexBytes);
+    writeWord(file, GLB_CHUNK_BIN);
+    // The floats and indices are written as they are in memory, little-endian on the
+    // machines this runs on
+    fwrite(mesh->vertices, sizeof(TerrainVertex), mesh->numVertices, file);
+    fwrite(mesh->indices, sizeof(GLuint), mesh->numIndices, file);
+    bool written = !ferror(file);
+    return fclose(file) == 0 && written;
+}
+
+bool writeMesh(const TerrainMesh* mesh, const char* path) {
+    const char* extension = strrchr(path, '.');
+    if (extension != NULL && strcmp(extension, ".obj") == 0) return writeMeshObj(mesh, path);
+    if (extension != NULL && strcmp(extension, ".glb") == 0) return writeMeshGlb(mesh, path);
+    fprintf(stderr, "Mesh '%s' must end in .obj or .glb.\n", path);
+    return false;
+}
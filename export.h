@@ -0,0 +1,20 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdbool.h>
+#include "mesh.h"
+
+// Writes the mesh's positions, normals and triangles as a Wavefront OBJ file, with the
+// colours after each position as many tools read them. Returns whether it succeeded.
+extern bool writeMeshObj(const TerrainMesh*, const char* path);
+
+// Writes the mesh as a binary glTF 2.0 file: the vertices as they are in memory, with
+// their positions, normals and colours interleaved, then the 32 bit indices. Returns
+// whether it succeeded.
+extern bool writeMeshGlb(const TerrainMesh*, const char* path);
+
+// Writes the mesh as OBJ or glTF from the path's extension, .obj or .glb. Returns false
+// if the extension is neither or the file could not be written.
+extern bool writeMesh(const TerrainMesh*, const char* path);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "export.h"
+#include "mesh.h"
+#include "terrain.h"
+#include "structures.h"
+#include "testing.h"
+
+#define X_SIZE 12
+#define Z_SIZE 9
+#define HEIGHT 10
+#define OBJ_PATH "/tmp/export_test.obj"
+#define GLB_PATH "/tmp/export_test.glb"
+#define LINE_SIZE 256
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+static GLfloat slope(void* context, GLfloat x, GLfloat z) {
+    return (x - z) / 10.0f;
+}
+
+static Vector3 green(const ColourParams* params, GLfloat x, GLfloat y, GLfloat z) {
+    return (Vector3){0.1f, 0.8f, 0.2f};
+}
+
+static uint32_t read_word(const uint8_t* bytes) {
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+}
+
+static uint8_t* read_file(const char* path, long* size) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    rewind(file);
+    uint8_t* bytes = malloc(*size);
+    if (fread(bytes, 1, *size, file) != (size_t) *size) *size = 0;
+    fclose(file);
+    return bytes;
+}
+
+int main(void) {
+    printf("Testing Export: \n");
+    Terrain* terrain = createTerrain(X_SIZE, Z_SIZE, HEIGHT);
+    populateTerrain(terrain, slope, NULL);
+    calculateNormals(terrain);
+    ColourParams params = {HEIGHT, NULL};
+    TerrainMesh* mesh = createTerrainMesh(X_SIZE, Z_SIZE);
+    fillTerrainVertices(mesh, terrain, green, &params, (TerrainRect){0, 0, X_SIZE, Z_SIZE});
+
+    assert_test(writeMesh(mesh, OBJ_PATH), "OBJ written.", TEST_OK_OUT, TEST_FAIL_OUT);
+    FILE* obj = fopen(OBJ_PATH, "r");
+    int positions = 0, normals = 0, faces = 0;
+    bool indicesInRange = true;
+    char line[LINE_SIZE];
+    while (obj != NULL && fgets(line, sizeof(line), obj) != NULL) {
+        if (strncmp(line, "v ", 2) == 0) positions++;
+        if (strncmp(line, "vn ", 3) == 0) normals++;
+        if (strncmp(line, "f ", 2) == 0) {
+            unsigned a, b, c;
+            faces++;
+            indicesInRange = indicesInRange && sscanf(line, "f %u//%*u %u//%*u %u//%*u", &a, &b, &c) == 3
+                             && a >= 1 && b >= 1 && c >= 1 && a <= X_SIZE * Z_SIZE && b <= X_SIZE * Z_SIZE
+                             && c <= X_SIZE * Z_SIZE;
+        }
+    }
+    if (obj != NULL) fclose(obj);
+    assert_test(positions == X_SIZE * Z_SIZE && normals == positions, "OBJ has every vertex.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(faces == mesh->numIndices / 3 && indicesInRange, "OBJ faces count from 1.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+
+    assert_test(writeMesh(mesh, GLB_PATH), "glTF written.", TEST_OK_OUT, TEST_FAIL_OUT);
+    long size = 0;
+    uint8_t* glb = read_file(GLB_PATH, &size);
+    assert_test(glb != NULL && size > 20 && read_word(glb) == 0x46546C67 && read_word(glb + 4) == 2
+                && read_word(glb + 8) == size, "glTF header.", TEST_OK_OUT, TEST_FAIL_OUT);
+    uint32_t jsonLength = read_word(glb + 12);
+    assert_test(jsonLength % 4 == 0 && read_word(glb + 16) == 0x4E4F534A, "JSON chunk padded.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+    uint8_t* bin = glb + 20 + jsonLength;
+    uint32_t binLength = read_word(bin);
+    assert_test(read_word(bin + 4) == 0x004E4942
+                && binLength == sizeof(TerrainVertex) * mesh->numVertices + sizeof(GLuint) * mesh->numIndices
+                && 20 + jsonLength + 8 + binLength == size, "Binary chunk holds the mesh.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(memcmp(bin + 8, mesh->vertices, sizeof(TerrainVertex) * mesh->numVertices) == 0,
+                "Vertices written as they are.", TEST_OK_OUT, TEST_FAIL_OUT);
+    char* json = malloc(jsonLength + 1);
+    memcpy(json, glb + 20, jsonLength);
+    json[jsonLength] = '\0';
+    assert_test(strstr(json, "\"COLOR_0\":2") != NULL && strstr(json, "\"byteStride\":36") != NULL,
+                "Attributes interleaved.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    assert_test(!writeMesh(mesh, "/tmp/export_test.stl"), "Unknown format refused.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    free(json);
+    free(glb);
+    remove(OBJ_PATH);
+    remove(GLB_PATH);
+    freeTerrainMesh(mesh);
+    freeTerrain(terrain);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <math.h>
+#include "fixednoise.h"
+
+// Points of a row processed by each step of fixed_octaves_row before the next step
+#define ROW_BLOCK 64
+
+// 16 unit gradients at multiples of 22.5 degrees, with FIXED_ONE as 1
+static const fixed gradients[16][2] = {
+    {65536, 0}, {60547, 25080}, {46341, 46341}, {25080, 60547},
+    {0, 65536}, {-25080, 60547}, {-46341, 46341}, {-60547, 25080},
+    {-65536, 0}, {-60547, -25080}, {-46341, -46341}, {-25080, -60547},
+    {0, -65536}, {25080, -60547}, {46341, -46341}, {60547, -25080}
+};
+
+// The lattice hash is split so the seed and x can be combined once for a whole row
+#define HASH_X 0x9E3779B1u
+#define HASH_Y 0x85EBCA77u
+
+fixed fixed_from_float(GLfloat value) {
+    return (fixed) lrintf(value * FIXED_ONE);
+}
+
+GLfloat fixed_to_float(fixed value) {
+    return (GLfloat) value / FIXED_ONE;
+}
+
+// Division rounds towards zero the same way everywhere, unlike shifting a negative number
+fixed fixed_mul(fixed a, fixed b) {
+    return (fixed) (((int64_t) a * b) / FIXED_ONE);
+}
+
+// Splits a value into the lattice line at or below it and the fraction above that line
+static void fixed_split(fixed value, int32_t* cell, fixed* fraction) {
+    *fraction = (fixed) ((uint32_t) value & (FIXED_ONE - 1));
+    *cell = (value - *fraction) / FIXED_ONE;
+}
+
+// Mixes the combined seed and coordinates, returning which of the 16 gradients to use
+static int gradient_index(uint32_t h) {
+    h = (h ^ (h >> 16)) * 0x7FEB352Du;
+    h = (h ^ (h >> 15)) * 0x846CA68Bu;
+    return (h ^ (h >> 16)) >> 28;
+}
+
+static fixed gradient_dot(int index, fixed dx, fixed dy) {
+    return fixed_mul(gradients[index][0], dx) + fixed_mul(gradients[index][1], dy);
+}
+
+static fixed fixed_lerp(fixed a, fixed b, fixed t) {
+    return a + fixed_mul(b - a, t);
+}
+
+// The interpolation curves of perlin.c, for t between 0 and FIXED_ONE
+static fixed fixed_curve(fixed t, int mode) {
+    switch (mode) {
+        case 1:
+            return fixed_mul(fixed_mul(t, t), 3 * FIXED_ONE - 2 * t);
+        case 2:
+            return fixed_mul(fixed_mul(fixed_mul(t, t), t),
+                             fixed_mul(t, 6 * t - 15 * FIXED_ONE) + 10 * FIXED_ONE);
+        default:
+            return t;
+    }
+}
+
+static fixed fixed_curve_derivative(fixed t, int mode) {
+    switch (mode) {
+        case 1:
+            return fixed_mul(6 * t, FIXED_ONE - t);
+        case 2:
+            return fixed_mul(30 * fixed_mul(t, t), fixed_mul(t - FIXED_ONE, t - FIXED_ONE));
+        default:
+            return FIXED_ONE;
+    }
+}
+
+// Dot products of the 4 corners of the cell with the offsets to the point, in the order
+// (x0, y0), (x1, y0), (x0, y1), (x1, y1)
+static void corner_dots(const int indices[4], fixed fx, fixed fy, fixed dots[4]) {
+    dots[0] = gradient_dot(indices[0], fx, fy);
+    dots[1] = gradient_dot(indices[1], fx - FIXED_ONE, fy);
+    dots[2] = gradient_dot(indices[2], fx, fy - FIXED_ONE);
+    dots[3] = gradient_dot(indices[3], fx - FIXED_ONE, fy - FIXED_ONE);
+}
+
+static void corner_indices(uint32_t seed, int32_t xc, int32_t yc, int indices[4]) {
+    uint32_t hx0 = seed ^ ((uint32_t) xc * HASH_X);
+    uint32_t hx1 = seed ^ ((uint32_t) (xc + 1) * HASH_X);
+    uint32_t hy0 = (uint32_t) yc * HASH_Y;
+    uint32_t hy1 = (uint32_t) (yc + 1) * HASH_Y;
+    indices[0] = gradient_index(hx0 ^ hy0);
+    indices[1] = gradient_index(hx1 ^ hy0);
+    indices[2] = gradient_index(hx0 ^ hy1);
+    indices[3] = gradient_index(hx1 ^ hy1);
+}
+
+fixed fixed_noise(uint32_t seed, fixed x, fixed y, int mode) {
+    int32_t xc, yc;
+    fixed fx, fy;
+    fixed_split(x, &xc, &fx);
+    fixed_split(y, &yc, &fy);
+    int indices[4];
+    fixed dots[4];
+    corner_indices(seed, xc, yc, indices);
+    corner_dots(indices, fx, fy, dots);
+
+    fixed u = fixed_curve(fx, mode);
+    fixed v = fixed_curve(fy, mode);
+    return fixed_lerp(fixed_lerp(dots[0], dots[1], u), fixed_lerp(dots[2], dots[3], u), v);
+}
+
+// The same product rule as get_perlin_value_d, in fixed point
+fixed fixed_noise_d(uint32_t seed, fixed x, fixed y, int mode, fixed* dx, fixed* dy) {
+    int32_t xc, yc;
+    fixed fx, fy;
+    fixed_split(x, &xc, &fx);
+    fixed_split(y, &yc, &fy);
+    int indices[4];
+    fixed dots[4];
+    corner_indices(seed, xc, yc, indices);
+    corner_dots(indices, fx, fy, dots);
+
+    fixed u = fixed_curve(fx, mode);
+    fixed v = fixed_curve(fy, mode);
+    fixed k = dots[0] - dots[1] - dots[2] + dots[3];
+    const fixed* g00 = gradients[indices[0]];
+    const fixed* g10 = gradients[indices[1]];
+    const fixed* g01 = gradients[indices[2]];
+    const fixed* g11 = gradients[indices[3]];
+    *dx = fixed_lerp(fixed_lerp(g00[0], g10[0], u), fixed_lerp(g01[0], g11[0], u), v)
+        + fixed_mul(fixed_curve_derivative(fx, mode), dots[1] - dots[0] + fixed_mul(v, k));
+    *dy = fixed_lerp(fixed_lerp(g00[1], g10[1], u), fixed_lerp(g01[1], g11[1], u), v)
+        + fixed_mul(fixed_curve_derivative(fy, mode), dots[2] - dots[0] + fixed_mul(u, k));
+    return fixed_lerp(fixed_lerp(dots[0], dots[1], u), fixed_lerp(dots[2], dots[3], u), v);
+}
+
+// Adds one octave along a block of a row. Along the row only y changes, so everything
+// depending on x is worked out once, and each pass over the block has no branches
+// apart from the gradient lookups.
+static void octave_block(const FixedOctave* octave, uint32_t seed, int x, int z, int count, fixed* out) {
+    int32_t xc;
+    fixed fx;
+    fixed_split((fixed) x * octave->frequency + octave->offset, &xc, &fx);
+    fixed u = fixed_curve(fx, octave->mode);
+    uint32_t hx0 = seed ^ ((uint32_t) xc * HASH_X);
+    uint32_t hx1 = seed ^ ((uint32_t) (xc + 1) * HASH_X);
+
+    int32_t yc[ROW_BLOCK];
+    fixed fy[ROW_BLOCK], v[ROW_BLOCK];
+    for (int i = 0; i < count; i++) {
+        fixed_split((fixed) (z + i) * octave->frequency + octave->offset, &yc[i], &fy[i]);
+        v[i] = fixed_curve(fy[i], octave->mode);
+    }
+
+    int indices[ROW_BLOCK][4];
+    for (int i = 0; i < count; i++) {
+        uint32_t hy0 = (uint32_t) yc[i] * HASH_Y;
+        uint32_t hy1 = (uint32_t) (yc[i] + 1) * HASH_Y;
+        indices[i][0] = gradient_index(hx0 ^ hy0);
+        indices[i][1] = gradient_index(hx1 ^ hy0);
+        indices[i][2] = gradient_index(hx0 ^ hy1);
+        indices[i][3] = gradient_index(hx1 ^ hy1);
+    }
+
+    for (int i = 0; i < count; i++) {
+        fixed dots[4];
+        corner_dots(indices[i], fx, fy[i], dots);
+        fixed noise = fixed_lerp(fixed_lerp(dots[0], dots[1], u), fixed_lerp(dots[2], dots[3], u), v[i]);
+        if (octave->positive && noise < 0) noise = 0;
+        out[i] += fixed_mul(noise, octave->weight);
+    }
+}
+
+void fixed_octaves_row(const FixedOctave* octaves, int numOctaves, uint32_t seed, int x, int z, int count, fixed* out) {
+    for (int start = 0; start < count; start += ROW_BLOCK) {
+        int block = (count - start < ROW_BLOCK) ? count - start : ROW_BLOCK;
+        for (int i = 0; i < block; i++) {
+            out[start + i] = 0;
+        }
+        for (int o = 0; o < numOctaves; o++) {
+            octave_block(&octaves[o], seed, x, z + start, block, out + start);
+        }
+    }
+}
+
+uint64_t fixed_checksum(const fixed* values, int count) {
+    uint64_t hash = 0xCBF29CE484222325u;
+    for (int i = 0; i < count; i++) {
+        uint32_t bits = (uint32_t) values[i];
+        for (int byte = 0; byte < 4; byte++) {
+            hash ^= (bits >> (8 * byte)) & 0xFF;
+            hash *= 0x100000001B3u;
+        }
+    }
+    return hash;
+}
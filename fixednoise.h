@@ -0,0 +1,47 @@
+#ifndef FIXEDNOISE_H
+#define FIXEDNOISE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "structures.h"
+
+// A fixed point number with 16 fractional bits, covering -32768 to 32768
+typedef int32_t fixed;
+#define FIXED_ONE 65536
+
+// Rounds a float to the nearest fixed point number
+extern fixed fixed_from_float(GLfloat);
+
+// Converts to a float, exactly for any number between -256 and 256
+extern GLfloat fixed_to_float(fixed);
+
+// Multiplies two fixed point numbers, rounding towards zero
+extern fixed fixed_mul(fixed, fixed);
+
+// Gradient noise computed only with integers, so the same seed and coordinates give the
+// same bits on every host and compiler. Gradients come from hashing the lattice points
+// with the seed, so there is no lattice to allocate or outgrow. The interpolation modes
+// are the same as for get_perlin_value. Returns between -FIXED_ONE and FIXED_ONE.
+extern fixed fixed_noise(uint32_t seed, fixed x, fixed y, int mode);
+
+// Computes the same value as fixed_noise, and writes its derivatives along x and y
+extern fixed fixed_noise_d(uint32_t seed, fixed x, fixed y, int mode, fixed* dx, fixed* dy);
+
+// One layer of noise in a sum of octaves, sampled at (x * frequency + offset) on both axes
+typedef struct {
+    fixed frequency, offset, weight;
+    int mode;      // Interpolation mode
+    bool positive; // Clamps the noise to 0 and above before it is weighted
+} FixedOctave;
+
+// Writes the weighted sums of the octaves at the grid points (x, z) to (x, z + count - 1)
+// to out. Rows are processed in blocks with each step a loop over the block, so the
+// integer arithmetic can be vectorised. Gives the same values as one point at a time.
+// PRE: every coordinate times its octave's frequency, plus the offset, fits in a fixed.
+extern void fixed_octaves_row(const FixedOctave*, int numOctaves, uint32_t seed, int x, int z, int count, fixed* out);
+
+// Returns the 64-bit FNV-1a hash of the values as little endian bytes, for checksums of
+// generated tiles which stay the same across builds
+extern uint64_t fixed_checksum(const fixed*, int count);
+
+#endif
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include "fixednoise.h"
+#include "testing.h"
+
+#define TILE 128
+#define SEED 1234
+
+// Checksums of the test tile for each octave table. These only change if the noise
+// itself is changed, which also invalidates every stored tile and cache key.
+#define GOLDEN_SINGLE 0x25C819DD3D9B9B8Bu
+#define GOLDEN_OCTAVES 0x9AFE7C710D037015u
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+static const FixedOctave single[] = {
+    {3277, 0, FIXED_ONE, 2, false}
+};
+static const FixedOctave octaves[] = {
+    {1311, FIXED_ONE, 49152, 2, false},
+    {3277, 0, 16384, 2, false},
+    {328, 0, 409600, 1, true}
+};
+
+// Generates the tile a row at a time and returns its checksum
+static uint64_t tile_checksum(const FixedOctave* table, int count) {
+    static fixed tile[TILE * TILE];
+    for (int x = 0; x < TILE; x++) {
+        fixed_octaves_row(table, count, SEED, x, 0, TILE, tile + x * TILE);
+    }
+    return fixed_checksum(tile, TILE * TILE);
+}
+
+int main(int argc, char** argv) {
+    printf("Testing Fixed Noise: \n");
+
+    // Zero on the lattice, bounded everywhere, and negative coordinates work
+    bool zero = true;
+    bool bounded = true;
+    uint32_t state = 7;
+    for (int i = 0; i < 5000; i++) {
+        int mode = i % 3;
+        int32_t cx = (int32_t) (random_next(&state) % 2000) - 1000;
+        int32_t cy = (int32_t) (random_next(&state) % 2000) - 1000;
+        zero = zero && fixed_noise(SEED, cx * FIXED_ONE, cy * FIXED_ONE, mode) == 0;
+        fixed x = (fixed) (random_next(&state) % (2000 * FIXED_ONE)) - 1000 * FIXED_ONE;
+        fixed y = (fixed) (random_next(&state) % (2000 * FIXED_ONE)) - 1000 * FIXED_ONE;
+        fixed value = fixed_noise(SEED, x, y, mode);
+        bounded = bounded && value >= -FIXED_ONE && value <= FIXED_ONE;
+    }
+    assert_test(zero, "Fixed noise zero on the lattice.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(bounded, "Fixed noise bounded.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Derivatives against differences over 1/256, inside the cells
+    bool close = true;
+    for (int i = 0; i < 2000; i++) {
+        int mode = i % 3;
+        fixed x = (fixed) (random_next(&state) % (100 * FIXED_ONE));
+        fixed y = (fixed) (random_next(&state) % (100 * FIXED_ONE));
+        fixed h = FIXED_ONE / 256;
+        if ((x & (FIXED_ONE - 1)) < h || (x & (FIXED_ONE - 1)) > FIXED_ONE - h ||
+            (y & (FIXED_ONE - 1)) < h || (y & (FIXED_ONE - 1)) > FIXED_ONE - h) continue;
+        fixed dx, dy;
+        fixed_noise_d(SEED, x, y, mode, &dx, &dy);
+        fixed ex = (fixed_noise(SEED, x + h, y, mode) - fixed_noise(SEED, x - h, y, mode)) * 128;
+        fixed ey = (fixed_noise(SEED, x, y + h, mode) - fixed_noise(SEED, x, y - h, mode)) * 128;
+        close = close && abs(ex - dx) < FIXED_ONE / 20 && abs(ey - dy) < FIXED_ONE / 20;
+    }
+    assert_test(close, "Fixed derivative matches differences.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // The row kernel gives the same values as single points, across block boundaries
+    fixed row[200];
+    fixed_octaves_row(octaves, 3, SEED, 37, -50, 200, row);
+    bool matching = true;
+    for (int z = 0; z < 200; z++) {
+        fixed point;
+        fixed_octaves_row(octaves, 3, SEED, 37, z - 50, 1, &point);
+        fixed expected = fixed_mul(fixed_noise(SEED, 37 * 1311 + FIXED_ONE, (z - 50) * 1311 + FIXED_ONE, 2), 49152)
+                       + fixed_mul(fixed_noise(SEED, 37 * 3277, (z - 50) * 3277, 2), 16384);
+        fixed mountains = fixed_noise(SEED, 37 * 328, (z - 50) * 328, 1);
+        expected += fixed_mul(mountains < 0 ? 0 : mountains, 409600);
+        matching = matching && row[z] == point && row[z] == expected;
+    }
+    assert_test(matching, "Row kernel matches single points.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // The golden tiles, printed with -p after an intended change to the noise
+    uint64_t singleSum = tile_checksum(single, 1);
+    uint64_t octavesSum = tile_checksum(octaves, 3);
+    if (argc > 1 && argv[1][0] == '-' && argv[1][1] == 'p') {
+        printf("Single: 0x%016" PRIX64 "\nOctaves: 0x%016" PRIX64 "\n", singleSum, octavesSum);
+    }
+    assert_test(singleSum == GOLDEN_SINGLE, "Single octave tile matches golden.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(octavesSum == GOLDEN_OCTAVES, "Octave tile matches golden.", TEST_OK_OUT, TEST_FAIL_OUT);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,502 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <math.h>
+#include "generator.h"
+#include "erosion.h"
+#include "parallel.h"
+
+// Frequencies (and offsets) the height functions sample the perlin noise at.
+// The gradient lattice only has to cover the furthest of these across the terrain.
+#define LOW_FREQUENCY 0.005
+#define MID_FREQUENCY 0.02
+#define MID_OFFSET 1
+#define HIGH_FREQUENCY 0.05
+
+// The same frequencies in fixed point, written out so no float rounding is involved
+#define FIXED_LOW_FREQUENCY 328   // 0.005
+#define FIXED_MID_FREQUENCY 1311  // 0.02
+#define FIXED_MID_OFFSET FIXED_ONE
+#define FIXED_HIGH_FREQUENCY 3277 // 0.05
+
+// The height modes as sums of octaves for the fixed noise. The weights include the
+// division by 1.6 of the float versions, 0.75, 0.25 and 6.25 being exact in fixed point.
+static const FixedOctave simple_octaves[] = {
+    {FIXED_HIGH_FREQUENCY, 0, FIXED_ONE, 2, false}
+};
+static const FixedOctave double_octaves[] = {
+    {FIXED_MID_FREQUENCY, FIXED_MID_OFFSET, 49152, 2, false},
+    {FIXED_HIGH_FREQUENCY, 0, 16384, 2, false}
+};
+static const FixedOctave mountain_octaves[] = {
+    {FIXED_MID_FREQUENCY, FIXED_MID_OFFSET, 49152, 2, false},
+    {FIXED_HIGH_FREQUENCY, 0, 16384, 2, false},
+    {FIXED_LOW_FREQUENCY, 0, 409600, 1, true}
+};
+
+// Creates a perlin with just enough gradients for the frequencies the height and
+// colour functions sample at, rather than one per point of the terrain
+static Perlin* createTerrainPerlin(int xSize, int zSize, NoiseBackend noise, uint32_t seed) {
+    if (noise == NOISE_FIXED) {
+        // Only the seed and the permutation for animation are used
+        Perlin* perlin = create_perlin_seeded(2, 2, seed);
+        if (perlin != NULL) perlin->backend = noise;
+        return perlin;
+    }
+    int size = (xSize > zSize) ? xSize : zSize;
+    int (*latticeSize)(int, GLfloat, GLfloat) = (noise == NOISE_SIMPLEX) ? &simplex_lattice_size : &perlin_lattice_size;
+    int high = latticeSize(size, HIGH_FREQUENCY, 0);
+    int mid = latticeSize(size, MID_FREQUENCY, MID_OFFSET);
+    int lattice = (high > mid) ? high : mid;
+    Perlin* perlin = create_perlin_seeded(lattice, lattice, seed);
+    if (perlin != NULL) perlin->backend = noise;
+    return perlin;
+}
+
+Generator* createGenerator(int xSize, int zSize, int height, int heightMode, NoiseBackend noise, int colourMode, uint32_t seed) {
+    Generator* generator = calloc(1, sizeof(Generator));
+    if (generator == NULL) {
+        fprintf(stderr, "Allocation of generator failed.\n");
+        return NULL;
+    }
+    generator->xSize = xSize;
+    generator->zSize = zSize;
+    generator->heightMode = heightMode;
+    generator->noise = noise;
+    generator->colourMode = colourMode;
+    generator->seed = seed;
+    generator->colourParams.height = height;
+
+    // Select height function.
+    switch (heightMode) {
+        case 0:
+            generator->height_function = &simple_perlin;
+            generator->height_gradient_function = &simple_perlin_d;
+            break;
+        case 1:
+            generator->height_function = &double_perlin;
+            generator->height_gradient_function = &double_perlin_d;
+            break;
+        case 2:
+            generator->height_function = &simple_perlin_blocky;
+            break;
+        case 3:
+            generator->height_function = &double_perlin_blocky;
+            break;
+        case 4:
+            generator->height_function = &mountain_perlin;
+            generator->height_gradient_function = &mountain_perlin_d;
+            break;
+        default:
+            fprintf(stderr, "Impossible height mode.\n");
+            free(generator);
+            return NULL;
+    }
+
+    // The fixed noise sums the same octaves with integers instead
+    if (noise == NOISE_FIXED) {
+        int table = (heightMode == 0 || heightMode == 2) ? 0 : (heightMode == 4) ? 2 : 1;
+        const FixedOctave* tables[] = {simple_octaves, double_octaves, mountain_octaves};
+        const int counts[] = {1, 2, 3};
+        generator->fixedOctaves = tables[table];
+        generator->numFixedOctaves = counts[table];
+        generator->fixedSteps = (heightMode == 2 || heightMode == 3) ? height : 0;
+        generator->height_function = &fixed_height;
+        generator->height_gradient_function = NULL;
+    }
+
+    // Select colour function.
+    switch (colourMode) {
+        case 0:
+            generator->colour_function = &classic_colour;
+            break;
+        case 1:
+            generator->colour_function = &heightmap_colour;
+            break;
+        case 2:
+            generator->colour_function = &grey_colour;
+            break;
+        case 3:
+            generator->colour_function = &biomes_colour;
+            break;
+        default:
+            fprintf(stderr, "Impossible colour mode.\n");
+            free(generator);
+            return NULL;
+    }
+
+    generator->perlin = createTerrainPerlin(xSize, zSize, noise, seed);
+    if (generator->perlin == NULL) {
+        free(generator);
+        return NULL;
+    }
+    return generator;
+}
+
+void reseedGenerator(Generator* generator, uint32_t seed) {
+    free_perlin(generator->perlin);
+    generator->seed = seed;
+    generator->perlin = createTerrainPerlin(generator->xSize, generator->zSize, generator->noise, seed);
+}
+
+// Converts a sum of fixed octaves to a height, in steps for the blocky modes. The steps
+// are taken in fixed point and the division is exactly rounded, so it is the same on
+// every build.
+static GLfloat fixedToHeight(Generator* generator, fixed sum) {
+    if (generator->fixedSteps == 0) return fixed_to_float(sum);
+    int64_t scaled = (int64_t) sum * generator->fixedSteps;
+    int64_t step = (scaled - (int64_t) ((uint64_t) scaled & (FIXED_ONE - 1))) / FIXED_ONE;
+    return (GLfloat) step / generator->fixedSteps;
+}
+
+GLfloat fixed_height(void* context, GLfloat x, GLfloat z) {
+    Generator* generator = context;
+    fixed sum;
+    fixed_octaves_row(generator->fixedOctaves, generator->numFixedOctaves, generator->seed, (int) x, (int) z, 1, &sum);
+    return fixedToHeight(generator, sum);
+}
+
+typedef struct {
+    Generator* generator;
+    Terrain* terrain;
+} GenerateJob;
+
+// Fills whole rows with the row kernel, which gives the same values as fixed_height. The
+// biome mask is the double mode's octaves, so is the same row when that is the mode.
+static void fixedHeightRows(void* context, int begin, int end) {
+    GenerateJob* job = context;
+    Terrain* terrain = job->terrain;
+    fixed* row = malloc(sizeof(fixed) * terrain->zSize);
+    assert(row != NULL);
+    fixed* biomes = NULL;
+    if (terrain->biomes != NULL) {
+        biomes = (job->generator->fixedOctaves == double_octaves) ? row : malloc(sizeof(fixed) * terrain->zSize);
+        assert(biomes != NULL);
+    }
+    for (int x = begin; x < end; x++) {
+        fixed_octaves_row(job->generator->fixedOctaves, job->generator->numFixedOctaves,
+                          job->generator->seed, x, 0, terrain->zSize, row);
+        for (int z = 0; z < terrain->zSize; z++) {
+            terrain->heights[x][z] = fixedToHeight(job->generator, row[z]) * terrain->height;
+        }
+        if (biomes == NULL) continue;
+        if (biomes != row) fixed_octaves_row(double_octaves, 2, job->generator->seed, x, 0, terrain->zSize, biomes);
+        for (int z = 0; z < terrain->zSize; z++) terrain->biomes[x][z] = fixed_to_float(biomes[z]);
+    }
+    if (biomes != row) free(biomes);
+    free(row);
+}
+
+static GLfloat mountain_sample(Generator*, GLfloat x, GLfloat z, Vector2* gradient, GLfloat* biome);
+
+// Returns the height and its gradient, writing the biome mask, the double mode's height,
+// to biome. The double and mountain modes start with the same two octaves as the mask,
+// so they are only sampled once for both.
+static GLfloat sample_with_biome(Generator* generator, GLfloat x, GLfloat z, Vector2* gradient, GLfloat* biome) {
+    switch (generator->heightMode) {
+        case 1:
+            *biome = double_perlin_d(generator, x, z, gradient);
+            return *biome;
+        case 4:
+            return mountain_sample(generator, x, z, gradient, biome);
+        default:
+            *biome = double_perlin(generator, x, z);
+            return generator->height_gradient_function(generator, x, z, gradient);
+    }
+}
+
+// Fills the heights, normals and biome mask of whole rows in one pass, the normals
+// from the gradients like populateTerrainWithGradients
+static void biomeGradientRows(void* context, int begin, int end) {
+    GenerateJob* job = context;
+    Terrain* terrain = job->terrain;
+    for (int x = begin; x < end; x++) {
+        for (int z = 0; z < terrain->zSize; z++) {
+            Vector2 gradient;
+            GLfloat height = sample_with_biome(job->generator, x, z, &gradient, &terrain->biomes[x][z]);
+            terrain->heights[x][z] = height * terrain->height;
+            terrain->normals[x][z] = (Vector3){-gradient.x * terrain->height, 1.0f, -gradient.y * terrain->height};
+        }
+        normalise_3_n(terrain->normals[x], terrain->zSize);
+    }
+}
+
+// The blocky modes have no gradients, their normals are averaged afterwards
+static void biomeRows(void* context, int begin, int end) {
+    GenerateJob* job = context;
+    Terrain* terrain = job->terrain;
+    for (int x = begin; x < end; x++) {
+        for (int z = 0; z < terrain->zSize; z++) {
+            terrain->heights[x][z] = job->generator->height_function(job->generator, x, z) * terrain->height;
+            terrain->biomes[x][z] = double_perlin(job->generator, x, z);
+        }
+    }
+}
+
+// Populates the terrain from the generator's noise, along with its biome mask if it has one
+static void populateFromNoise(Generator* generator, Terrain* terrain) {
+    GenerateJob job = {generator, terrain};
+    if (terrain->biomes != NULL && generator->height_gradient_function != NULL) {
+        parallel_for(terrain->xSize, biomeGradientRows, &job);
+        markTerrainDirty(terrain, (TerrainRect){0, 0, terrain->xSize, terrain->zSize});
+    } else if (terrain->biomes != NULL) {
+        parallel_for(terrain->xSize, biomeRows, &job);
+        calculateNormals(terrain);
+    } else if (generator->height_gradient_function != NULL) {
+        populateTerrainWithGradients(terrain, generator->height_gradient_function, generator);
+    } else {
+        populateTerrain(terrain, generator->height_function, generator);
+    }
+}
+
+void generateTerrain(Generator* generator, Terrain* terrain) {
+    generator->animated = false;
+    if (generator->noise == NOISE_FIXED) {
+        GenerateJob job = {generator, terrain};
+        parallel_for(terrain->xSize, fixedHeightRows, &job);
+        calculateNormals(terrain);
+    } else {
+        populateFromNoise(generator, terrain);
+    }
+    if (generator->droplets > 0 || generator->thermalIterations > 0) {
+        ErosionSettings settings = defaultErosionSettings(generator->seed);
+        settings.droplets = generator->droplets;
+        settings.thermalIterations = generator->thermalIterations;
+        erodeTerrain(terrain, &settings);
+    }
+}
+
+// Only the noise is sampled again, erosion would change the terrain too much between
+// frames and take far longer than one. The slices are as large as the perlin's lattice,
+// which covers every point the height functions sample.
+void animateTerrain(Generator* generator, Terrain* terrain, GLfloat time) {
+    for (int mode = 0; mode < NUM_SLICES; mode++) {
+        if (generator->slices[mode] == NULL) {
+            generator->slices[mode] = create_noise_slice(generator->perlin->xSize, generator->perlin->zSize);
+        }
+        set_noise_slice(generator->slices[mode], generator->perlin, time, mode);
+    }
+    generator->animated = true;
+    generator->time = time;
+    populateFromNoise(generator, terrain);
+}
+
+void freeGenerator(Generator* generator) {
+    for (int mode = 0; mode < NUM_SLICES; mode++) {
+        if (generator->slices[mode] != NULL) free_noise_slice(generator->slices[mode]);
+    }
+    free_perlin(generator->perlin);
+    free(generator);
+}
+
+// Samples the generator's noise at v, or the 3D noise at the generator's time when animated
+static GLfloat sample_noise(Generator* generator, Vector2 v, int mode) {
+    if (generator->animated) return get_slice_value(generator->slices[mode], v, NULL);
+    return get_perlin_value(generator->perlin, v, mode);
+}
+
+// Samples like sample_noise, writing the derivatives along x and z to derivative
+static GLfloat sample_noise_d(Generator* generator, Vector2 v, int mode, Vector2* derivative) {
+    if (generator->animated) return get_slice_value(generator->slices[mode], v, derivative);
+    return get_perlin_value_d(generator->perlin, v, mode, derivative);
+}
+
+GLfloat simple_perlin(void* context, GLfloat x, GLfloat z) {
+    Generator* generator = context;
+    Vector2 vect = { .x = x * HIGH_FREQUENCY , .y = z * HIGH_FREQUENCY };
+    return sample_noise(generator, vect, 2);
+}
+
+GLfloat double_perlin(void* context, GLfloat x, GLfloat z) {
+    Generator* generator = context;
+    Vector2 vect1 = { .x = (x * MID_FREQUENCY) + MID_OFFSET, .y = (z * MID_FREQUENCY) + MID_OFFSET};
+    GLfloat perlin1 = sample_noise(generator, vect1, 2) * 1.2;
+
+    Vector2 vect2 = { .x = x * HIGH_FREQUENCY, .y = z * HIGH_FREQUENCY };
+    GLfloat perlin2 = sample_noise(generator, vect2, 2) * 0.4;
+
+    return (perlin1 + perlin2)/1.6;
+}
+
+GLfloat simple_perlin_blocky(void* context, GLfloat x, GLfloat z) {
+    GLfloat steps = ((Generator*) context)->colourParams.height;
+    return floor(simple_perlin(context, x, z) * steps) / steps;
+}
+
+GLfloat double_perlin_blocky(void* context, GLfloat x, GLfloat z) {
+    GLfloat steps = ((Generator*) context)->colourParams.height;
+    return floor(double_perlin(context, x, z) * steps) / steps;
+}
+
+GLfloat mountain_perlin(void* context, GLfloat x, GLfloat z) {
+    Generator* generator = context;
+    Vector2 vect1 = { .x = (x * MID_FREQUENCY) + MID_OFFSET, .y = (z * MID_FREQUENCY) + MID_OFFSET};
+    GLfloat perlin1 = sample_noise(generator, vect1, 2) * 1.2;
+
+    Vector2 vect2 = { .x = x * HIGH_FREQUENCY, .y = z * HIGH_FREQUENCY };
+    GLfloat perlin2 = sample_noise(generator, vect2, 2) * 0.4;
+
+    Vector2 vect3 = { .x = x * LOW_FREQUENCY, .y = z * LOW_FREQUENCY };
+    GLfloat perlin3 = sample_noise(generator, vect3, 1) * 10.0;
+    if (perlin3 < 0.0f) perlin3 = 0.0f;
+
+    return (perlin1 + perlin2 + perlin3)/1.6;
+}
+
+// The gradient versions below scale each octave's derivative by its frequency and weight,
+// as sampling at x * f multiplies the derivative along x by f
+
+GLfloat simple_perlin_d(void* context, GLfloat x, GLfloat z, Vector2* gradient) {
+    Generator* generator = context;
+    Vector2 vect = { .x = x * HIGH_FREQUENCY , .y = z * HIGH_FREQUENCY };
+    Vector2 d;
+    GLfloat value = sample_noise_d(generator, vect, 2, &d);
+    gradient->x = d.x * HIGH_FREQUENCY;
+    gradient->y = d.y * HIGH_FREQUENCY;
+    return value;
+}
+
+GLfloat double_perlin_d(void* context, GLfloat x, GLfloat z, Vector2* gradient) {
+    Generator* generator = context;
+    Vector2 vect1 = { .x = (x * MID_FREQUENCY) + MID_OFFSET, .y = (z * MID_FREQUENCY) + MID_OFFSET};
+    Vector2 d1;
+    GLfloat perlin1 = sample_noise_d(generator, vect1, 2, &d1) * 1.2;
+
+    Vector2 vect2 = { .x = x * HIGH_FREQUENCY, .y = z * HIGH_FREQUENCY };
+    Vector2 d2;
+    GLfloat perlin2 = sample_noise_d(generator, vect2, 2, &d2) * 0.4;
+
+    gradient->x = (d1.x * MID_FREQUENCY * 1.2 + d2.x * HIGH_FREQUENCY * 0.4) / 1.6;
+    gradient->y = (d1.y * MID_FREQUENCY * 1.2 + d2.y * HIGH_FREQUENCY * 0.4) / 1.6;
+    return (perlin1 + perlin2)/1.6;
+}
+
+GLfloat mountain_perlin_d(void* context, GLfloat x, GLfloat z, Vector2* gradient) {
+    GLfloat biome;
+    return mountain_sample(context, x, z, gradient, &biome);
+}
+
+// The mountains, writing the first two octaves on their own to biome
+static GLfloat mountain_sample(Generator* generator, GLfloat x, GLfloat z, Vector2* gradient, GLfloat* biome) {
+    Vector2 vect1 = { .x = (x * MID_FREQUENCY) + MID_OFFSET, .y = (z * MID_FREQUENCY) + MID_OFFSET};
+    Vector2 d1;
+    GLfloat perlin1 = sample_noise_d(generator, vect1, 2, &d1) * 1.2;
+
+    Vector2 vect2 = { .x = x * HIGH_FREQUENCY, .y = z * HIGH_FREQUENCY };
+    Vector2 d2;
+    GLfloat perlin2 = sample_noise_d(generator, vect2, 2, &d2) * 0.4;
+
+    Vector2 vect3 = { .x = x * LOW_FREQUENCY, .y = z * LOW_FREQUENCY };
+    Vector2 d3;
+    GLfloat perlin3 = sample_noise_d(generator, vect3, 1, &d3) * 10.0;
+    // Flat wherever the mountains are clamped away
+    if (perlin3 < 0.0f) {
+        perlin3 = 0.0f;
+        d3 = (Vector2){0.0f, 0.0f};
+    }
+
+    gradient->x = (d1.x * MID_FREQUENCY * 1.2 + d2.x * HIGH_FREQUENCY * 0.4 + d3.x * LOW_FREQUENCY * 10.0) / 1.6;
+    gradient->y = (d1.y * MID_FREQUENCY * 1.2 + d2.y * HIGH_FREQUENCY * 0.4 + d3.y * LOW_FREQUENCY * 10.0) / 1.6;
+    *biome = (perlin1 + perlin2)/1.6;
+    return (perlin1 + perlin2 + perlin3)/1.6;
+}
+
+// old = old colour to interpolate from (r,g,b handled separately)
+// new = new colour to interpolate to
+// height = the height it should interpolate to, after this height it is new colour
+static GLfloat interpolate_colour(GLfloat old_col, GLfloat old_height, GLfloat new_col, GLfloat new_height, GLfloat y) {
+    GLfloat adjustedHeight = new_height - old_height; // make sure not negative
+
+    if (fabsf(adjustedHeight) < 1e-6) { // do not want to divide by 0
+        adjustedHeight = (adjustedHeight < 0) ? -1e-6f : 1e-6f;
+    }
+
+    GLfloat interpolationFactor = (y - old_height) / adjustedHeight;
+
+    // Ensure the interpolation factor is clamped between 0 and 1
+    GLfloat clampedFactor = (interpolationFactor < 0.0f) ?
+            0.0f : (interpolationFactor > 1.0f ? 1.0f : interpolationFactor);
+
+    GLfloat out = old_col + (new_col - old_col) * fabsf(clampedFactor);
+
+    // Clamp the output to be within the range [0.0, 1.0]
+    if (out < 0.0f) return 0.0f;
+    if (out > 1.0f) return 1.0f;
+
+    return out;
+}
+
+Vector3 classic_colour(const ColourParams* params, GLfloat x, GLfloat y, GLfloat z) {
+    GLfloat r; GLfloat g; GLfloat b;
+    if (y < 0.0f) {
+        // Low altitude: dark green
+        r = 0.0f;
+        g = 0.2f;
+        b = 0.0f;
+    } else if (y < (params->height / 3)) {
+        // Medium altitude: green
+        r = interpolate_colour(0.0f, 0.0f, 0.1f, params->height / 10, y);
+        g = interpolate_colour(0.2f, 0.0f, 0.7f, params->height / 10, y);
+        b = 0.0f;
+    } else {
+        // High altitude: white (snow)
+        r = interpolate_colour(0.1f, 0.0f, 1.0f, params->height / 2, y);
+        g = interpolate_colour(0.7f, 0.0f, 1.0f, params->height / 2, y);
+        b = interpolate_colour(0.0f, 0.0f, 1.0f, params->height / 2, y);
+    }
+    return (Vector3){r, g, b};
+}
+
+Vector3 heightmap_colour(const ColourParams* params, GLfloat x, GLfloat y, GLfloat z) {
+    GLfloat r; GLfloat g; GLfloat b;
+    if (y < 0.0f) {
+        r = interpolate_colour(0.0f, -params->height / 2, 0.5f, 0.0f, y);
+        g = 0.0f;
+        b = interpolate_colour(1.0f, -params->height / 2,0.5f, 0.0f, y);
+    } else {
+        // Medium altitude: green
+        r = interpolate_colour(0.5f, 0.0f, 1.0f, params->height / 2, y);
+        g = 0.0f;
+        b = interpolate_colour(1.0f, 0.0f, 0.5f, params->height / 2, y);
+    }
+    return (Vector3){r, g, b};
+}
+
+Vector3 grey_colour(const ColourParams* params, GLfloat x, GLfloat y, GLfloat z) {
+    return (Vector3){0.5f, 0.5f, 0.5f};
+}
+
+Vector3 biomes_colour(const ColourParams* params, GLfloat x, GLfloat y, GLfloat z) {
+    GLfloat r; GLfloat g; GLfloat b;
+    if (y < 0.0f) {
+        // Low altitude: dark green
+        r = 0.0f;
+        g = 0.2f;
+        b = 0.0f;
+    } else if (y < (params->height / 2)) {
+        // Medium altitude: green
+        r = interpolate_colour(0.0f, 0.0f, 0.1f, params->height / 10, y);
+        g = interpolate_colour(0.2f, 0.0f, 0.7f, params->height / 10, y);
+        b = 0.0f;
+    } else {
+        if (params->biomeMap[(int)x][(int)z] > 0.0f) {
+            if (y < params->height * 1.5){
+                // High altitude in biome: dark grey mountain
+                r = interpolate_colour(0.1f, params->height / 2, 0.3f, params->height, y);
+                g = interpolate_colour(0.7f, params->height / 2, 0.3f, params->height, y);
+                b = interpolate_colour(0.0f, params->height / 2, 0.3f, params->height, y);
+            } else {
+                // V High altitude in biome - lava (volcano)
+                r = interpolate_colour(0.3f, params->height *0.7, 1.0f, params->height * 2, y);
+                g = interpolate_colour(0.3f, params->height *0.7, 0.0f, params->height * 2, y);
+                b = interpolate_colour(0.3f, params->height *0.7, 0.0f, params->height * 2, y);
+            }
+        } else {
+            // High altitude not in biome: grey mountain
+            r = interpolate_colour(0.1f, params->height / 2, 0.5f, params->height, y);
+            g = interpolate_colour(0.7f, params->height / 2, 0.5f, params->height, y);
+            b = interpolate_colour(0.0f, params->height / 2, 0.5f, params->height, y);
+        }
+    }
+    return (Vector3){r, g, b};
+}
@@ -0,0 +1,85 @@
+#ifndef GENERATOR_H
+#define GENERATOR_H
+
+#include "structures.h"
+#include "perlin.h"
+#include "terrain.h"
+#include "fixednoise.h"
+
+// Slices of the 3D noise kept while animating, one per interpolation mode
+#define NUM_SLICES 3
+
+// Everything one terrain generation reads. Generators share no state with each other,
+// so any number of them can be used at the same time on different threads.
+typedef struct {
+    int xSize, zSize;
+    int heightMode, colourMode;
+    NoiseBackend noise;    // Backend every height function samples its noise with
+    uint32_t seed;
+    int droplets;          // Hydraulic erosion droplets, 0 to skip
+    int thermalIterations; // Thermal erosion passes, 0 to skip
+    bool animated;         // Whether the height functions sample 3D noise at time
+    GLfloat time;
+    NoiseSlice* slices[NUM_SLICES]; // The 3D noise at time, NULL until first animated
+
+    // The height mode as octaves of fixed noise, when the noise is NOISE_FIXED
+    const FixedOctave* fixedOctaves;
+    int numFixedOctaves;
+    int fixedSteps;        // Steps of height in the blocky modes, 0 for smooth
+
+    Perlin* perlin;
+    heightFunction height_function;   // Called with the generator as its context
+    heightGradientFunction height_gradient_function; // NULL when the height has steps
+    colourFunction colour_function;
+    ColourParams colourParams;        // Passed to the colour function
+} Generator;
+
+// Creates a generator for terrains of the given size and maximum height, with its own
+// perlin from the seed using the noise backend. Colour mode 3 needs a biome mask: add one
+// to the terrain with addTerrainBiomes and point colourParams.biomeMap at it.
+// Returns NULL if either mode is not valid.
+extern Generator* createGenerator(int xSize, int zSize, int height, int heightMode, NoiseBackend noise,
+                                  int colourMode, uint32_t seed);
+
+// Replaces the generator's perlin with one from a new seed
+extern void reseedGenerator(Generator*, uint32_t seed);
+
+// Populates the terrain with the generator's height function, taking the normals from
+// its gradient function when it has one, then runs the erosion stage if any droplets
+// or thermal iterations were requested. A terrain with biomes has its mask filled in the
+// same pass, from the octaves the height shares with it.
+extern void generateTerrain(Generator*, Terrain*);
+
+// Populates the terrain with a slice at time through 3D noise, so terrains at nearby
+// times are similar and advancing the time animates it smoothly. The perlin is kept and
+// only a small slice of its 3D lattice is recalculated, then the heights and normals
+// are calculated on all threads without erosion, along with any biome mask. The slices
+// use classic gradients whatever the generator's noise, so only classic noise animates.
+extern void animateTerrain(Generator*, Terrain*, GLfloat time);
+
+// Frees the generator, its perlin and noise slices
+extern void freeGenerator(Generator*);
+
+// Height functions, the context is a Generator
+extern GLfloat simple_perlin(void* context, GLfloat x, GLfloat z);
+extern GLfloat double_perlin(void* context, GLfloat x, GLfloat z);
+extern GLfloat simple_perlin_blocky(void* context, GLfloat x, GLfloat z);
+extern GLfloat double_perlin_blocky(void* context, GLfloat x, GLfloat z);
+extern GLfloat mountain_perlin(void* context, GLfloat x, GLfloat z);
+
+// Height function for NOISE_FIXED, the generator's octaves summed in fixed point at the
+// grid point (x, z). Heights are the same on every build for the same seed and mode.
+extern GLfloat fixed_height(void* context, GLfloat x, GLfloat z);
+
+// Gradient versions of the smooth height functions, returning the same heights
+extern GLfloat simple_perlin_d(void* context, GLfloat x, GLfloat z, Vector2* gradient);
+extern GLfloat double_perlin_d(void* context, GLfloat x, GLfloat z, Vector2* gradient);
+extern GLfloat mountain_perlin_d(void* context, GLfloat x, GLfloat z, Vector2* gradient);
+
+// Colour functions
+extern Vector3 classic_colour(const ColourParams*, GLfloat x, GLfloat y, GLfloat z);
+extern Vector3 heightmap_colour(const ColourParams*, GLfloat x, GLfloat y, GLfloat z);
+extern Vector3 grey_colour(const ColourParams*, GLfloat x, GLfloat y, GLfloat z);
+extern Vector3 biomes_colour(const ColourParams*, GLfloat x, GLfloat y, GLfloat z);
+
+#endif
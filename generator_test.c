@@ -0,0 +1,232 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "generator.h"
+#include "terrain.h"
+#include "parallel.h"
+#include "structures.h"
+#include "testing.h"
+
+#define SIZE 120
+#define HEIGHT 30
+#define NUM_GENERATORS 4
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+typedef struct {
+    Generator* generators[NUM_GENERATORS];
+    Terrain* terrains[NUM_GENERATORS];
+} Batch;
+
+// Generates each terrain of the batch with its own generator
+static void generate_batch(void* context, int begin, int end) {
+    Batch* batch = context;
+    for (int i = begin; i < end; i++) {
+        generateTerrain(batch->generators[i], batch->terrains[i]);
+    }
+}
+
+static bool same_heights(Terrain* t1, Terrain* t2) {
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) {
+            if (t1->heights[x][z] != t2->heights[x][z]) return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    printf("Testing Generator: \n");
+    assert_test(createGenerator(SIZE, SIZE, HEIGHT, 5, NOISE_CLASSIC, 0, 1) == NULL, "Invalid height mode rejected.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(createGenerator(SIZE, SIZE, HEIGHT, 0, NOISE_CLASSIC, 4, 1) == NULL, "Invalid colour mode rejected.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Generating serially, one after the other
+    Terrain* expected[NUM_GENERATORS];
+    for (int i = 0; i < NUM_GENERATORS; i++) {
+        Generator* generator = createGenerator(SIZE, SIZE, HEIGHT, i % 5, NOISE_CLASSIC, 0, 100 + i);
+        expected[i] = createTerrain(SIZE, SIZE, HEIGHT);
+        generateTerrain(generator, expected[i]);
+        freeGenerator(generator);
+    }
+    assert_test(!same_heights(expected[0], expected[1]), "Seeds give different terrains.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Generating the same terrains at the same time, interleaved with rand() calls
+    // which no longer affect the output
+    Batch batch;
+    for (int i = 0; i < NUM_GENERATORS; i++) {
+        rand();
+        batch.generators[i] = createGenerator(SIZE, SIZE, HEIGHT, i % 5, NOISE_CLASSIC, 0, 100 + i);
+        batch.terrains[i] = createTerrain(SIZE, SIZE, HEIGHT);
+    }
+    parallel_set_threads(NUM_GENERATORS);
+    parallel_for(NUM_GENERATORS, generate_batch, &batch);
+    parallel_set_threads(0);
+    bool matching = true;
+    for (int i = 0; i < NUM_GENERATORS; i++) {
+        matching = matching && same_heights(expected[i], batch.terrains[i]);
+    }
+    assert_test(matching, "Concurrent generation matches serial.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Reseeding changes the terrain but returning to the seed restores it
+    Generator* generator = batch.generators[0];
+    reseedGenerator(generator, 7);
+    generateTerrain(generator, batch.terrains[0]);
+    assert_test(!same_heights(expected[0], batch.terrains[0]), "Reseeding changes the terrain.", TEST_OK_OUT, TEST_FAIL_OUT);
+    reseedGenerator(generator, 100);
+    generateTerrain(generator, batch.terrains[0]);
+    assert_test(same_heights(expected[0], batch.terrains[0]), "Reseeding is repeatable.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Colour parameters are explicit
+    Generator* biomes = createGenerator(SIZE, SIZE, HEIGHT, 4, NOISE_CLASSIC, 3, 1);
+    assert_test(biomes->colourParams.height == HEIGHT, "Colour parameters hold the height.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(biomes->colourParams.biomeMap == NULL, "Biome map is the terrain's.", TEST_OK_OUT, TEST_FAIL_OUT);
+    ColourParams low = {HEIGHT, NULL};
+    ColourParams high = {HEIGHT * 10, NULL};
+    Vector3 lowColour = classic_colour(&low, 0, HEIGHT / 2, 0);
+    Vector3 highColour = classic_colour(&high, 0, HEIGHT / 2, 0);
+    assert_test(lowColour.x != highColour.x, "Colour depends on the given height.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Normals from the gradients agree with the ones averaged from the faces, and the
+    // heights are the same as without them, with either noise backend
+    for (int i = 0; i < 10; i++) {
+        int mode = i % 5;
+        Generator* smooth = createGenerator(SIZE, SIZE, HEIGHT, mode, i / 5, 0, 3);
+        Terrain* analytic = createTerrain(SIZE, SIZE, HEIGHT);
+        Terrain* averaged = createTerrain(SIZE, SIZE, HEIGHT);
+        generateTerrain(smooth, analytic);
+        populateTerrain(averaged, smooth->height_function, smooth);
+        assert_test(same_heights(analytic, averaged), "Gradient heights match.", TEST_OK_OUT, TEST_FAIL_OUT);
+        if (smooth->height_gradient_function == NULL) {
+            assert_test(mode == 2 || mode == 3, "Only blocky modes lack gradients.", TEST_OK_OUT, TEST_FAIL_OUT);
+        } else {
+            double total = 0;
+            for (int x = 1; x < SIZE - 1; x++) {
+                for (int z = 1; z < SIZE - 1; z++) {
+                    total += dot_product_3(analytic->normals[x][z], averaged->normals[x][z]);
+                }
+            }
+            double mean = total / ((SIZE - 2) * (SIZE - 2));
+            assert_test(mean > 0.995, "Gradient normals match face normals.", TEST_OK_OUT, TEST_FAIL_OUT);
+            TerrainRect dirty = takeTerrainDirty(analytic);
+            assert_test(dirty.x0 == 0 && dirty.z0 == 0 && dirty.x1 == SIZE && dirty.z1 == SIZE,
+                        "Gradient pass marks the terrain dirty.", TEST_OK_OUT, TEST_FAIL_OUT);
+        }
+        freeTerrain(analytic);
+        freeTerrain(averaged);
+        freeGenerator(smooth);
+    }
+
+    // Animating keeps the perlin, changes the terrain a little between close times and
+    // gives the same terrain for the same time
+    Generator* animated = createGenerator(SIZE, SIZE, HEIGHT, 4, NOISE_CLASSIC, 0, 9);
+    Perlin* perlin = animated->perlin;
+    Terrain* frame = createTerrain(SIZE, SIZE, HEIGHT);
+    Terrain* next = createTerrain(SIZE, SIZE, HEIGHT);
+    animateTerrain(animated, frame, 1.37f);
+    animateTerrain(animated, next, 1.38f);
+    GLfloat largest = 0;
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) {
+            GLfloat change = fabsf(frame->heights[x][z] - next->heights[x][z]);
+            if (change > largest) largest = change;
+        }
+    }
+    assert_test(animated->perlin == perlin, "Animating keeps the perlin.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(largest > 0 && largest < HEIGHT * 0.05, "Animation changes smoothly.", TEST_OK_OUT, TEST_FAIL_OUT);
+    parallel_set_threads(1);
+    animateTerrain(animated, next, 1.37f);
+    parallel_set_threads(0);
+    assert_test(same_heights(frame, next), "Animation repeatable at a time.", TEST_OK_OUT, TEST_FAIL_OUT);
+    bool matching3d = true;
+    for (int x = 0; x < SIZE; x += 7) {
+        for (int z = 0; z < SIZE; z += 7) {
+            Vector2 v = { x * 0.05f, z * 0.05f };
+            Vector3 p = { v.x, v.y, 1.37f };
+            Vector3 expectedD;
+            Vector2 d;
+            GLfloat expected = get_perlin_value_3d_d(animated->perlin, p, 2, &expectedD);
+            GLfloat value = get_slice_value(animated->slices[2], v, &d);
+            matching3d = matching3d && fabsf(value - expected) < 1e-5 &&
+                         fabsf(d.x - expectedD.x) < 1e-4 && fabsf(d.y - expectedD.y) < 1e-4;
+        }
+    }
+    assert_test(matching3d, "Slice matches the 3D noise.", TEST_OK_OUT, TEST_FAIL_OUT);
+    freeTerrain(frame);
+    freeTerrain(next);
+    freeGenerator(animated);
+
+    // Fixed noise fills rows with the same heights as point by point, on any thread count
+    Generator* fixedGenerator = createGenerator(SIZE, SIZE, HEIGHT, 3, NOISE_FIXED, 0, 21);
+    Terrain* rows = createTerrain(SIZE, SIZE, HEIGHT);
+    Terrain* points = createTerrain(SIZE, SIZE, HEIGHT);
+    generateTerrain(fixedGenerator, rows);
+    parallel_set_threads(1);
+    populateTerrain(points, fixedGenerator->height_function, fixedGenerator);
+    parallel_set_threads(0);
+    assert_test(same_heights(rows, points), "Fixed rows match fixed points.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(fixedGenerator->height_gradient_function == NULL, "Fixed normals come from faces.", TEST_OK_OUT, TEST_FAIL_OUT);
+    freeTerrain(rows);
+    freeTerrain(points);
+    freeGenerator(fixedGenerator);
+
+    // The biome mask comes out of the height pass as the double mode's heights, without
+    // changing the heights, for the modes which share its octaves and those which do not
+    bool masked = true, unchanged = true;
+    for (int mode = 1; mode <= 4; mode++) {
+        Generator* withBiomes = createGenerator(SIZE, SIZE, HEIGHT, mode, NOISE_CLASSIC, 3, 5);
+        Terrain* terrain = createTerrain(SIZE, SIZE, HEIGHT);
+        Terrain* plain = createTerrain(SIZE, SIZE, HEIGHT);
+        addTerrainBiomes(terrain);
+        generateTerrain(withBiomes, terrain);
+        generateTerrain(withBiomes, plain);
+        for (int x = 0; x < SIZE; x++) {
+            for (int z = 0; z < SIZE; z++) {
+                masked = masked && fabsf(terrain->biomes[x][z] - double_perlin(withBiomes, x, z)) < 1e-6f;
+            }
+        }
+        unchanged = unchanged && same_heights(terrain, plain);
+        freeTerrain(terrain);
+        freeTerrain(plain);
+        freeGenerator(withBiomes);
+    }
+    assert_test(masked, "Biome mask made in the height pass.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(unchanged, "Biome mask leaves the heights alone.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // A new terrain brings a new mask, animated or with the fixed noise too
+    Terrain* masks = createTerrain(SIZE, SIZE, HEIGHT);
+    addTerrainBiomes(masks);
+    generateTerrain(biomes, masks);
+    GLfloat before = masks->biomes[SIZE / 2][SIZE / 3];
+    reseedGenerator(biomes, 2);
+    generateTerrain(biomes, masks);
+    GLfloat reseeded = masks->biomes[SIZE / 2][SIZE / 3];
+    animateTerrain(biomes, masks, 0.5f);
+    assert_test(before != reseeded && masks->biomes[SIZE / 2][SIZE / 3] != reseeded,
+                "Biome mask regenerated.", TEST_OK_OUT, TEST_FAIL_OUT);
+    Generator* fixedMountains = createGenerator(SIZE, SIZE, HEIGHT, 4, NOISE_FIXED, 3, 5);
+    Generator* fixedDouble = createGenerator(SIZE, SIZE, HEIGHT, 1, NOISE_FIXED, 3, 5);
+    Terrain* doubled = createTerrain(SIZE, SIZE, HEIGHT);
+    generateTerrain(fixedMountains, masks);
+    generateTerrain(fixedDouble, doubled);
+    bool fixedMasked = true;
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) {
+            fixedMasked = fixedMasked && fabsf(masks->biomes[x][z] * HEIGHT - doubled->heights[x][z]) < 1e-4f;
+        }
+    }
+    assert_test(fixedMasked, "Fixed biome mask is the fixed double mode.", TEST_OK_OUT, TEST_FAIL_OUT);
+    freeTerrain(doubled);
+    freeGenerator(fixedDouble);
+    freeGenerator(fixedMountains);
+    freeTerrain(masks);
+
+    freeGenerator(biomes);
+    for (int i = 0; i < NUM_GENERATORS; i++) {
+        freeGenerator(batch.generators[i]);
+        freeTerrain(batch.terrains[i]);
+        freeTerrain(expected[i]);
+    }
+    return EXIT_SUCCESS;
+}
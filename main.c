@@ -4,29 +4,102 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
-#include "perlin.h"
+#include <time.h>
+#include "generator.h"
 #include "structures.h"
 #include "terrain.h"
-
-//For text overlay
-#define STB_EASY_FONT_IMPLEMENTATION
-#include "stb_easy_font.h"
-
+#include "text.h"
+#include "erosion.h"
+#include "mesh.h"
+#include "softrender.h"
+#include "query.h"
+#include "bake.h"
+#include "morph.h"
+#include "tiles.h"
+#include "rtin.h"
+#include "export.h"
+#include "scatter.h"
 
 #define MAX_HEIGHT 30
+// Frames rendered without a window, to time the software renderer
+#define HEADLESS_FRAMES 30
+// Seconds a morph blends over
+#define MORPH_SECONDS 1.0
+// Time through the 3D noise advanced each second of animation
+#define ANIMATION_SPEED 0.3f
+// Lowest the first person camera goes above the ground
+#define CAMERA_CLEARANCE 2.0f
+// Seconds between frames while the scene is moving, and between checks for a finished
+// bake while the scene is otherwise still
+#define FRAME_SECONDS (1.0 / 60.0)
+#define BAKE_POLL_SECONDS 0.1
+// Seconds of idle or active time the CPU usage in the overlay is averaged over
+#define STATS_SECONDS 1.0
+// Furthest away the ground can be edited
+#define EDIT_DISTANCE 500.0f
+// Grid points between the vertices of the coarse mesh, so it has 16 times fewer triangles
+#define COARSE_STEP 4
+// Furthest the adaptive mesh's surface is from any height it leaves out
+#define ADAPTIVE_ERROR 0.1f
+// Points along each side of the tiles a world is written in, and the most bytes of them
+// kept mapped while flying through it
+#define WORLD_TILE_SIZE 256
+#define WORLD_BUDGET ((size_t) 256 << 20)
 
 static int win_width = 800;
 static int win_height = 600;
 
 static int height_mode = 0;
+static int noise = NOISE_CLASSIC;
 static int size = 250;
 static int colour_mode = 0;
+static int seed = 1;
+static int droplets = 0;
+static int thermal_iterations = 0;
+static int vertex_format = 0;
+static int animate = 0;
+static GLfloat animation_time = 0.0f;
+static int baked_lighting = 1;
+static BakeJob* bake_job = NULL;
+static unsigned long baked_version = 0; // Heights version the shading was last baked from
+static char output_path[256] = "";
+static char export_path[256] = "";
+static int scattered = 0;
+static unsigned long scattered_version = 0; // Heights version the objects were last placed on
+static char world_path[256] = "";
+static int world_tiles = 0;           // Tiles along each side of a world to write first
+static int world_x = 0, world_z = 0;  // Point of the world at the terrain's origin
+
+// Set whenever the input, window or overlay changes what is drawn, the terrain tracks its
+// own changes with its version
+static bool scene_changed = true;
+static unsigned long drawn_version = 0;
+static unsigned long adapted_version = 0; // Heights version the adaptive mesh's errors are for
+
+// Process CPU time against wall time while idle and while active, since the last report
+typedef struct {
+    double wall, cpu;
+    double percent; // Of one core, at the last report
+} CpuUsage;
+static CpuUsage idle_usage, active_usage;
 
 static void display(GLFWwindow* window);
 static void setupOpenGL(void);
 static void drawTerrain(void);
-void drawText(float x, float y, const char *text);
-static void morph(GLFWwindow* window);
+static void updateOverlay(void);
+static void beginMorph(void);
+static void updateMorph(double now, double elapsed);
+static void updateBake(void);
+static bool openWorld(void);
+static void followCamera(void);
+static bool sceneActive(void);
+static bool recordUsage(CpuUsage* usage, double wall, double cpu);
+static double processSeconds(void);
+static Matrix4 cameraView(void);
+static int renderHeadless(void);
+static int exportMesh(void);
+static void updateAdaptiveMesh(void);
+static void freeAll(void);
 
 //All the callback functions for controls:
 static void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -37,42 +110,49 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
 bool checkModeArgs(int argc, int argNumber, char **argv);
 
-heightFunction height_function;
-GLfloat simple_perlin(GLfloat x, GLfloat z);
-GLfloat double_perlin(GLfloat x, GLfloat z);
-GLfloat simple_perlin_blocky(GLfloat x, GLfloat z);
-GLfloat double_perlin_blocky(GLfloat x, GLfloat z);
-GLfloat mountain_perlin(GLfloat x, GLfloat z);
-
-void populateColourMap(void);
-colourFunction colour_function;
-Vector3 classic_colour(GLfloat x, GLfloat y, GLfloat z);
-Vector3 heightmap_colour(GLfloat x, GLfloat y, GLfloat z);
-Vector3 grey_colour(GLfloat x, GLfloat y, GLfloat z);
-Vector3 biomes_colour(GLfloat x, GLfloat y, GLfloat z);
-
 Camera* camera;
 Terrain* terrain;
 Mouse* mouse;
-Perlin* perlin;
-GLfloat** colour_map;
+Generator* generator;
+TextLayer* overlay;
+TerrainMesh* mesh;
+CompactMesh* compact_mesh;
+CoarseMesh* coarse_mesh;
+Rtin* rtin;
+Scatter* scatter;
+Morph* morph;
+TileStore* world;
+
+// Every label drawn on the overlay
+enum {
+    LABEL_MOVE,
+    LABEL_MOVE_VERTICAL,
+    LABEL_MOUSE,
+    LABEL_MORPH,
+    LABEL_FIRST_PERSON,
+    LABEL_OVERHEAD,
+    LABEL_CONSTANT_MORPH,
+    LABEL_CONSTANT_ROTATE,
+    LABEL_EDIT,
+    LABEL_ARGUMENTS,
+    LABEL_COLOUR_ARGUMENT,
+    LABEL_HEIGHT_ARGUMENT,
+    LABEL_SIZE_ARGUMENT,
+    LABEL_CPU,
+    LABEL_WORLD,
+    NUM_LABELS
+};
 
 int main(int argc, char** argv) {
-    if (argc > 4) {
-        fprintf(stderr, "Proper usage: ./main -m=[Height Mode] -s=[Size] -c=[Colour Mode]\n");
-        return EXIT_FAILURE;
-    }
-    if (checkModeArgs(argc, 1, argv)) {
-        fprintf(stderr, "First argument must be either '-m=[Height Mode]' or '-s=[Size]' or '-c=[Colour Mode]'.\n");
-        return EXIT_FAILURE;
-    }
-    if (checkModeArgs(argc, 2, argv)) {
-        fprintf(stderr, "Second argument must be either '-m=[Height Mode]' or '-s=[Size]' or '-c=[Colour Mode]'.\n");
-        return EXIT_FAILURE;
-    }
-    if (checkModeArgs(argc, 3, argv)) {
-        fprintf(stderr, "Third argument must be either '-m=[Height Mode]' or '-s=[Size]' or '-c=[Colour Mode]'.\n");
-        return EXIT_FAILURE;
+    for (int i = 1; i < argc; i++) {
+        if (checkModeArgs(argc, i, argv)) {
+            fprintf(stderr, "Argument '%s' not recognised.\n"
+                            "Proper usage: ./main -m=[Height Mode] -n=[Noise] -s=[Size] -c=[Colour Mode]"
+                            " -r=[Seed] -e=[Erosion Droplets] -t=[Thermal Iterations]"
+                            " -f=[Vertex Format] -a=[Animate] -l=[Lighting] -o=[Output Image] -x=[Export Mesh] -v=[Scatter]"
+                            " -w=[World] -g=[World Tiles]\n", argv[i]);
+            return EXIT_FAILURE;
+        }
     }
     if (height_mode < 0 || height_mode > 4) {
         fprintf(stderr, "Mode must be either of the following:\n"
@@ -83,6 +163,18 @@ int main(int argc, char** argv) {
                              "\t4.\tMountain Perlin\n");
         return EXIT_FAILURE;
     }
+    if (noise != NOISE_CLASSIC && noise != NOISE_SIMPLEX && noise != NOISE_FIXED) {
+        fprintf(stderr, "Noise must be either of the following:\n"
+                        "\t0.\tClassic Perlin Noise\n"
+                        "\t1.\tSimplex Noise\n"
+                        "\t2.\tFixed Point Noise, identical on every build\n");
+        return EXIT_FAILURE;
+    }
+    if (noise != NOISE_CLASSIC && animate) {
+        // The 3D slices are only built from classic gradients
+        fprintf(stderr, "Only classic Perlin noise can be animated.\n");
+        return EXIT_FAILURE;
+    }
     if (colour_mode < 0 || colour_mode > 4) {
         fprintf(stderr, "Colour mode must be either of the following:\n"
                         "\t0.\tClassic green colour with snowy peak mountains, with water\n"
@@ -91,45 +183,47 @@ int main(int argc, char** argv) {
                         "\t3.\tVolcano biomes (best with mountain mode), with water\n");
         return EXIT_FAILURE;
     }
-    // Select height function.
-    switch (height_mode) {
-        case 0:
-            height_function = &simple_perlin;
-            break;
-        case 1:
-            height_function = &double_perlin;
-            break;
-        case 2:
-            height_function = &simple_perlin_blocky;
-            break;
-        case 3:
-            height_function = &double_perlin_blocky;
-            break;
-        case 4:
-            height_function = &mountain_perlin;
-            break;
-        default:
-            fprintf(stderr, "Impossible height mode.\n");
-            return EXIT_FAILURE;
+    if (vertex_format < 0 || vertex_format > 3) {
+        fprintf(stderr, "Vertex format must be either of the following:\n"
+                        "\t0.\tFull precision floats (36 bytes per vertex)\n"
+                        "\t1.\tCompact quantised patches (12 bytes per vertex)\n"
+                        "\t2.\tCoarse mesh lit from a normal map\n"
+                        "\t3.\tAdaptive mesh with fewer triangles where the ground is flat\n");
+        return EXIT_FAILURE;
     }
-
-    // Select colour function.
-    switch (colour_mode) {
-        case 0:
-            colour_function = &classic_colour;
-            break;
-        case 1:
-            colour_function = &heightmap_colour;
-            break;
-        case 2:
-            colour_function = &grey_colour;
-            break;
-        case 3:
-            colour_function = &biomes_colour;
-            break;
-        default:
-            fprintf(stderr, "Impossible colour mode.\n");
-            return EXIT_FAILURE;
+    if (export_path[0] != '\0' && (vertex_format == 1 || vertex_format == 2)) {
+        fprintf(stderr, "Only the full and adaptive meshes can be exported.\n");
+        return EXIT_FAILURE;
+    }
+    if (baked_lighting < 0 || baked_lighting > 1) {
+        fprintf(stderr, "Lighting must be either of the following:\n"
+                        "\t0.\tOpenGL lighting only\n"
+                        "\t1.\tBaked ambient occlusion and shadows as well\n");
+        return EXIT_FAILURE;
+    }
+    if (scattered < 0 || scattered > 1) {
+        fprintf(stderr, "Scatter must be either of the following:\n"
+                        "\t0.\tBare ground\n"
+                        "\t1.\tTrees and rocks placed by height, slope and biome\n");
+        return EXIT_FAILURE;
+    }
+    if (droplets < 0 || thermal_iterations < 0) {
+        fprintf(stderr, "Erosion droplets and thermal iterations must not be negative.\n");
+        return EXIT_FAILURE;
+    }
+    if (animate && (droplets > 0 || thermal_iterations > 0)) {
+        fprintf(stderr, "Erosion is not run on animated terrain.\n");
+    }
+    if (world_tiles < 0 || (world_tiles > 0 && world_path[0] == '\0')) {
+        fprintf(stderr, "World tiles must not be negative, and need a world to write to.\n");
+        return EXIT_FAILURE;
+    }
+    if (world_path[0] != '\0' && animate) {
+        fprintf(stderr, "A world can not be animated.\n");
+        return EXIT_FAILURE;
+    }
+    if (world_path[0] != '\0' && (droplets > 0 || thermal_iterations > 0)) {
+        fprintf(stderr, "Erosion is not run on a world.\n");
     }
 
     // Ensure size is > 2 and <= 1000;
@@ -137,6 +231,78 @@ int main(int argc, char** argv) {
         fprintf(stderr, "Size must be > 2 and <= 10000.\n");
     }
 
+    // A world is opened first, as the terrain is a window into it no larger than it
+    int xSize = size, zSize = size, height = MAX_HEIGHT;
+    int worldX = 0, worldZ = 0;
+    if (world_path[0] != '\0') {
+        if (!openWorld()) return EXIT_FAILURE;
+        tileWorldSize(world, &worldX, &worldZ, &height);
+        xSize = (size < worldX) ? size : worldX;
+        zSize = (size < worldZ) ? size : worldZ;
+    }
+
+    //Setup terrain and camera.
+    terrain = createTerrain(xSize, zSize, height);
+    camera = createCamera(terrain->xSize/2, 30.0f,terrain->zSize/2 + 30.f, 0, 1, 0);
+    mouse = createMouse();
+    generator = createGenerator(terrain->xSize, terrain->zSize, height, height_mode, noise, colour_mode, seed);
+    generator->droplets = droplets;
+    generator->thermalIterations = thermal_iterations;
+    // The biome colours read the terrain's mask, which is generated with every terrain
+    if (colour_mode == 3) {
+        addTerrainBiomes(terrain);
+        generator->colourParams.biomeMap = terrain->biomes;
+    }
+    overlay = createTextLayer(NUM_LABELS);
+    morph = createMorph(MORPH_SECONDS);
+    if (scattered) {
+        scatter = createDefaultScatter(seed);
+    }
+    if (vertex_format == 1) {
+        compact_mesh = createCompactMesh(terrain->xSize, terrain->zSize);
+        printf("Vertex data: %zu bytes\n", sizeof(CompactVertex) * compact_mesh->numVertices
+                                           + sizeof(GLushort) * compact_mesh->numIndices);
+    } else if (vertex_format == 2) {
+        coarse_mesh = createCoarseMesh(terrain->xSize, terrain->zSize, COARSE_STEP);
+        printf("Vertex data: %zu bytes, normal map: %d bytes\n",
+               sizeof(CoarseVertex) * coarse_mesh->numVertices + sizeof(GLuint) * coarse_mesh->numIndices,
+               coarse_mesh->xSize * coarse_mesh->zSize * 3);
+    } else if (vertex_format == 3) {
+        // The mesh is built once the terrain has its heights
+        rtin = createRtin(terrain->xSize, terrain->zSize);
+        mesh = NULL;
+        printf("Split errors: %zu bytes\n", sizeof(GLfloat) * rtin->gridSize * rtin->gridSize);
+    } else {
+        mesh = createTerrainMesh(terrain->xSize, terrain->zSize);
+        printf("Vertex data: %zu bytes\n", sizeof(TerrainVertex) * mesh->numVertices
+                                           + sizeof(GLuint) * mesh->numIndices);
+    }
+    if (world != NULL) {
+        // Starts in the middle of the world, with the tiles around it read ahead
+        world_x = (worldX - terrain->xSize) / 2;
+        world_z = (worldZ - terrain->zSize) / 2;
+        followCamera();
+        waitTilePrefetch(world);
+        readTileRegion(world, terrain, world_x, world_z);
+    } else if (animate) {
+        animateTerrain(generator, terrain, animation_time);
+    } else {
+        generateTerrain(generator, terrain);
+    }
+
+    // Without a window, export the mesh and render with the software renderer, then exit
+    if (output_path[0] != '\0' || export_path[0] != '\0') {
+        if (baked_lighting) {
+            BakeSettings settings = defaultBakeSettings();
+            bakeTerrain(terrain, &settings);
+        }
+        int result = EXIT_SUCCESS;
+        if (export_path[0] != '\0') result = exportMesh();
+        if (output_path[0] != '\0' && result == EXIT_SUCCESS) result = renderHeadless();
+        freeAll();
+        return result;
+    }
+
     // Initialise glfw
     if (glfwInit() == GLFW_FALSE) {
     	fprintf(stderr, "Failed to initialise GLFW\n");
@@ -162,29 +328,52 @@ int main(int argc, char** argv) {
     glfwSetScrollCallback(window, scroll_callback);
 
 
-    //Setup terrain and camera.
-    terrain = createTerrain(size, size,MAX_HEIGHT);
-    camera = createCamera(terrain->xSize/2, 30.0f,terrain->zSize/2 + 30.f, 0, 1, 0);
-    mouse = createMouse();
-    perlin = create_perlin(terrain->xSize, terrain->zSize);
-
-
     // Setup Open GL.
     setupOpenGL();
-    // Choose height function.
-    populateTerrain(terrain, height_function);
-    if (colour_mode == 3) {
-        populateColourMap();
-    }
 
-    // Wait until pressed the close button or other action
+    // Wait until pressed the close button or other action. While the scene is moving
+    // frames are drawn at a steady rate, otherwise the loop sleeps until an event (or a
+    // background bake) changes something, and only then draws a frame.
+    double last_frame = glfwGetTime();
+    double next_frame = last_frame;
+    double last_wall = last_frame, last_cpu = processSeconds();
     while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents(); // Execute any events e.g. resizes.
-        if (terrain->morphing) {
-            morph(window);
+        bool active = sceneActive();
+        double now = glfwGetTime();
+        if (active) {
+            if (next_frame > now) {
+                glfwWaitEventsTimeout(next_frame - now);
+            } else {
+                glfwPollEvents();
+            }
+        } else if (bake_job != NULL) {
+            glfwWaitEventsTimeout(BAKE_POLL_SECONDS);
+        } else {
+            glfwWaitEvents();
+        }
+
+        // The time up to here since the last check was spent idle or active
+        now = glfwGetTime();
+        double cpu = processSeconds();
+        if (recordUsage(active ? &active_usage : &idle_usage, now - last_wall, cpu - last_cpu)) {
+            scene_changed = true;
         }
-        else {
+        last_wall = now;
+        last_cpu = cpu;
+
+        // While the scene moves, the terrain only moves on and is drawn when a frame is
+        // due, so events in between cost no more than handling them. Changes made while
+        // idle are drawn straight away, as are the objects once the ground settles.
+        bool frame_due = active && now >= next_frame;
+        if (frame_due || !active) {
+            updateMorph(now, now - last_frame);
+            last_frame = now;
+        }
+        updateBake();
+        bool unscattered = scatter != NULL && scattered_version != terrain->heightsVersion;
+        if (frame_due || (!active && (scene_changed || unscattered || terrain->version != drawn_version))) {
             display(window);
+            next_frame = fmax(next_frame + FRAME_SECONDS, now);
         }
     }
 
@@ -192,30 +381,64 @@ int main(int argc, char** argv) {
     glfwDestroyWindow(window);
     glfwTerminate();
 
-    //Free everything
+    freeAll();
+    return EXIT_SUCCESS;
+}
+
+//Free everything
+void freeAll(void) {
+    if (bake_job != NULL) {
+        cancelBake(bake_job);
+    }
+    freeMorph(morph);
+    if (world != NULL) {
+        TileStats stats = tileStoreStats(world);
+        printf("World: %ld tiles prefetched, %ld evicted, %ld missed, %ld stalled for %.2f ms, "
+               "%ld major faults reading tiles\n", stats.prefetched, stats.evicted, stats.misses,
+               stats.stalls, stats.stallSeconds * 1e3, stats.majorFaults);
+        closeTileStore(world);
+    }
     free(mouse);
     free(camera);
-    if (colour_mode == 3) {
-        for (int x = 0; x < terrain->xSize; x++) {
-            free(colour_map[x]);
-        }
-        free(colour_map);
-    }
     freeTerrain(terrain);
-    free_perlin(perlin);
-    return EXIT_SUCCESS;
+    freeGenerator(generator);
+    freeTextLayer(overlay);
+    if (scatter != NULL) {
+        freeScatter(scatter);
+    }
+    if (vertex_format == 1) {
+        freeCompactMesh(compact_mesh);
+    } else if (vertex_format == 2) {
+        freeCoarseMesh(coarse_mesh);
+    } else if (vertex_format == 3) {
+        if (mesh != NULL) freeTerrainMesh(mesh);
+        freeRtin(rtin);
+    } else {
+        freeTerrainMesh(mesh);
+    }
 }
 
 bool checkModeArgs(int argc, int argNumber, char **argv) {
     return (
             argc > argNumber &&
             (sscanf(argv[argNumber], "-m=%d", &height_mode) != 1 &&
+            sscanf(argv[argNumber], "-n=%d", &noise) != 1 &&
             sscanf(argv[argNumber], "-s=%d", &size) != 1 &&
-            sscanf(argv[argNumber], "-c=%d", &colour_mode) != 1)
+            sscanf(argv[argNumber], "-c=%d", &colour_mode) != 1 &&
+            sscanf(argv[argNumber], "-r=%d", &seed) != 1 &&
+            sscanf(argv[argNumber], "-e=%d", &droplets) != 1 &&
+            sscanf(argv[argNumber], "-t=%d", &thermal_iterations) != 1 &&
+            sscanf(argv[argNumber], "-f=%d", &vertex_format) != 1 &&
+            sscanf(argv[argNumber], "-a=%d", &animate) != 1 &&
+            sscanf(argv[argNumber], "-l=%d", &baked_lighting) != 1 &&
+            sscanf(argv[argNumber], "-o=%255s", output_path) != 1 &&
+            sscanf(argv[argNumber], "-x=%255s", export_path) != 1 &&
+            sscanf(argv[argNumber], "-v=%d", &scattered) != 1 &&
+            sscanf(argv[argNumber], "-w=%255s", world_path) != 1 &&
+            sscanf(argv[argNumber], "-g=%d", &world_tiles) != 1)
             );
 }
 
-
 void setupOpenGL(void) {
     // Enable features we'll use (Depth/Lighting and Color)
     glEnable(GL_DEPTH_TEST);
@@ -223,10 +446,6 @@ void setupOpenGL(void) {
     glEnable(GL_LIGHT0);
     glEnable(GL_COLOR_MATERIAL);
 
-    // Set a place for the light to come from.
-    GLfloat light_position[] = {1.0, 1.0, 1.0, 0.0};
-    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
-
     // Set background.
     glClearColor(0.5f, 0.75f, 1.0f, 1.0f);
     glMatrixMode(GL_PROJECTION);
@@ -235,97 +454,119 @@ void setupOpenGL(void) {
 
 }
 
-// old = old colour to interpolate from (r,g,b handled separately)
-// new = new colour to interpolate to
-// height = the height it should interpolate to, after this height it is new colour
-static GLfloat interpolate_colour(GLfloat old_col, GLfloat old_height, GLfloat new_col, GLfloat new_height, GLfloat y) {
-    GLfloat adjustedHeight = new_height - old_height; // make sure not negative
-
-    if (fabsf(adjustedHeight) < 1e-6) { // do not want to divide by 0
-        adjustedHeight = (adjustedHeight < 0) ? -1e-6f : 1e-6f;
+// Applies the background bake once it is done, and starts another whenever the heights
+// have changed since the shading was baked. While the terrain is edited or morphing the
+// shading follows a bake behind, the frame never waits for it.
+void updateBake(void) {
+    if (!baked_lighting) return;
+    if (bake_job != NULL) {
+        if (!bakeReady(bake_job)) return;
+        if (finishBake(bake_job, terrain)) {
+            baked_version = terrain->heightsVersion;
+        }
+        bake_job = NULL;
     }
+    if (terrain->heightsVersion != baked_version) {
+        BakeSettings settings = defaultBakeSettings();
+        bake_job = startBake(terrain, &settings);
+    }
+}
 
-    GLfloat interpolationFactor = (y - old_height) / adjustedHeight;
+// Writes a world first if the number of tiles was given, from the height mode, noise and
+// seed, then opens it
+bool openWorld(void) {
+    if (world_tiles > 0) {
+        int worldSize = world_tiles * WORLD_TILE_SIZE;
+        printf("Writing a %dx%d world to '%s'\n", worldSize, worldSize, world_path);
+        Generator* worldGenerator = createGenerator(worldSize, worldSize, MAX_HEIGHT, height_mode, noise, 2, seed);
+        bool written = worldGenerator != NULL &&
+                       writeTileWorld(world_path, world_tiles, world_tiles, WORLD_TILE_SIZE, MAX_HEIGHT,
+                                      worldGenerator->height_function, worldGenerator);
+        if (worldGenerator != NULL) freeGenerator(worldGenerator);
+        if (!written) {
+            fprintf(stderr, "Could not write world '%s'.\n", world_path);
+            return false;
+        }
+    }
+    world = openTileStore(world_path, WORLD_BUDGET);
+    return world != NULL;
+}
 
-    // Ensure the interpolation factor is clamped between 0 and 1
-    GLfloat clampedFactor = (interpolationFactor < 0.0f) ?
-            0.0f : (interpolationFactor > 1.0f ? 1.0f : interpolationFactor);
+// Keeps the terrain around the camera while flying through a world. The prefetch thread
+// is told where the camera is heading, and once it strays a quarter of the terrain from
+// the middle, the terrain is read again centred on it and the camera moved by as much,
+// so it stays over the same ground.
+void followCamera(void) {
+    if (world == NULL) return;
+    int worldX, worldZ, height;
+    tileWorldSize(world, &worldX, &worldZ, &height);
+    GLfloat x = world_x + camera->eyeX, z = world_z + camera->eyeZ;
+    focusTileStore(world, x, z, fmaxf(terrain->xSize, terrain->zSize) / 2.0f);
+
+    int originX = (int) fminf(fmaxf(x - terrain->xSize / 2, 0), worldX - terrain->xSize);
+    int originZ = (int) fminf(fmaxf(z - terrain->zSize / 2, 0), worldZ - terrain->zSize);
+    if (abs(originX - world_x) <= terrain->xSize / 4 && abs(originZ - world_z) <= terrain->zSize / 4) return;
+    camera->eyeX -= originX - world_x;
+    camera->eyeZ -= originZ - world_z;
+    world_x = originX;
+    world_z = originZ;
+    readTileRegion(world, terrain, world_x, world_z);
+}
 
-    GLfloat out = old_col + (new_col - old_col) * fabsf(clampedFactor);
+// Returns whether the scene is moving by itself, so has to be drawn every frame
+bool sceneActive(void) {
+    return terrain->spinning || terrain->morphing || morphActive(morph);
+}
 
-    // Clamp the output to be within the range [0.0, 1.0]
-    if (out < 0.0f) return 0.0f;
-    if (out > 1.0f) return 1.0f;
+// Returns the CPU time used by every thread of the process
+double processSeconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec / 1e9;
+}
 
-    return out;
+// Adds a period of wall and CPU time. Once enough has passed, reports the average for
+// the overlay and starts again, returning true as the overlay has changed.
+bool recordUsage(CpuUsage* usage, double wall, double cpu) {
+    usage->wall += wall;
+    usage->cpu += cpu;
+    if (usage->wall < STATS_SECONDS) return false;
+    usage->percent = 100.0 * usage->cpu / usage->wall;
+    usage->wall = 0;
+    usage->cpu = 0;
+    return true;
 }
 
+// Refreshes whatever part of the mesh the terrain has changed since the last frame,
+// then draws it from the buffers kept on the GPU
 void drawTerrain(void) {
-    // Allocate memory for vertices, normals, colors, and indices
-    int numVertices = terrain->xSize * terrain->zSize;
-    int numTriangles = (terrain->xSize - 1) * (terrain->zSize - 1) * 2;
-
-    //Instead of 2d arrays for vertices, create a 1d array
-    Vector3* vertices = (Vector3*)malloc(numVertices * sizeof(Vector3));
-    Vector3* normals = (Vector3*)malloc(numVertices * sizeof(Vector3));
-    Vector3* colors = (Vector3*)malloc(numVertices * sizeof(Vector3));
-    GLuint* indices = (GLuint*)malloc(numTriangles * 3 * sizeof(GLuint));
-
-    // Fill the vertex, normal, and color arrays
-    int index = 0;
-    for (int z = 0; z < terrain->zSize; ++z) {
-        for (int x = 0; x < terrain->xSize; ++x) {
-            vertices[index] = (Vector3){x, terrain->heights[x][z], z};
-            normals[index] = terrain->normals[x][z];
-            colors[index] = colour_function(x, vertices[index].y,z);
-            ++index;
-        }
+    if (vertex_format == 1) {
+        updateCompactMesh(compact_mesh, terrain, generator->colour_function, &generator->colourParams);
+        drawCompactMesh(compact_mesh);
+    } else if (vertex_format == 2) {
+        updateCoarseMesh(coarse_mesh, terrain, generator->colour_function, &generator->colourParams);
+        drawCoarseMesh(coarse_mesh);
+    } else if (vertex_format == 3) {
+        // Stays NULL until an adaptive mesh could be allocated
+        updateAdaptiveMesh();
+        if (mesh != NULL) drawTerrainMesh(mesh);
+    } else {
+        updateTerrainMesh(mesh, terrain, generator->colour_function, &generator->colourParams);
+        drawTerrainMesh(mesh);
     }
 
-    // Fill the index array, used to index triangles
-    index = 0;
-    for (int z = 0; z < terrain->zSize - 1; ++z) {
-        for (int x = 0; x < terrain->xSize - 1; ++x) {
-            int topLeft = z * terrain->xSize + x;
-            int topRight = topLeft + 1;
-            int bottomLeft = topLeft + terrain->xSize;
-            int bottomRight = bottomLeft + 1;
-
-            indices[index++] = topLeft;
-            indices[index++] = bottomLeft;
-            indices[index++] = topRight;
-
-            indices[index++] = topRight;
-            indices[index++] = bottomLeft;
-            indices[index++] = bottomRight;
+    // Objects are placed again once the heights have settled after a change, as placing
+    // them takes too long for every step of a morph or animation. They are hidden while
+    // the ground moves under them, then drawn with a call per kind.
+    if (scatter != NULL) {
+        bool settled = !terrain->morphing && !morphActive(morph);
+        if (settled && terrain->heightsVersion != scattered_version) {
+            scatterTerrain(scatter, terrain);
+            scattered_version = terrain->heightsVersion;
         }
+        if (scattered_version == terrain->heightsVersion) drawScatter(scatter);
     }
 
-    // Enable arrays and set pointers
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_NORMAL_ARRAY);
-    glEnableClientState(GL_COLOR_ARRAY);
-
-    glVertexPointer(3, GL_FLOAT, sizeof(Vector3), vertices);
-    glNormalPointer(GL_FLOAT, sizeof(Vector3), normals);
-    glColorPointer(3, GL_FLOAT, sizeof(Vector3), colors);
-
-    // Draw the terrain
-    // This is more efficient than just drawing each of the points individually,
-    // As opengl keeps track fo the normals and colours and vertices for you.
-    glDrawElements(GL_TRIANGLES, numTriangles * 3, GL_UNSIGNED_INT, indices);
-
-    // Disable arrays
-    glDisableClientState(GL_VERTEX_ARRAY);
-    glDisableClientState(GL_NORMAL_ARRAY);
-    glDisableClientState(GL_COLOR_ARRAY);
-
-    // Free allocated memory
-    free(vertices);
-    free(normals);
-    free(colors);
-    free(indices);
-
     // Draw water
     if (colour_mode == 0 || colour_mode == 3) {
         glEnable(GL_BLEND);
@@ -342,71 +583,68 @@ void drawTerrain(void) {
     }
 }
 
-void populateColourMap(void) {
-    colour_map = malloc(sizeof(GLfloat*) * terrain->xSize);
-    for (int x = 0; x < terrain->xSize; x++) {
-        colour_map[x] = malloc(sizeof(GLfloat) * terrain->zSize);
-        for (int z = 0; z < terrain->zSize; z++) {
-            colour_map[x][z] = double_perlin(x, z);
-        }
-    }
-}
-
-void drawText(float x, float y, const char *text) {
-    char buffer[99999];
-    int num_quads;
+// Updates the overlay labels, select modes/etc are highlighted in red
+// Labels only regenerate their geometry when their text, position or colour changes
+void updateOverlay(void) {
+    Vector3 black = {0.0f, 0.0f, 0.0f};
+    Vector3 red = {1.0f, 0.0f, 0.0f};
+
+    // Render keybinds text
+    setTextLabel(overlay, LABEL_MOVE, 10, 20, "WASD: Move", black);
+    setTextLabel(overlay, LABEL_MOVE_VERTICAL, 10, 40, "Q/E: Move Down/Up", black);
+    setTextLabel(overlay, LABEL_MOUSE, 10, 60, "Mouse: Move/Zoom", black);
+    setTextLabel(overlay, LABEL_MORPH, 10, 80, "Space: Morph Terrain", black);
+    setTextLabel(overlay, LABEL_FIRST_PERSON, 10, 100, "1: First-Person View",
+                 camera->mode == 1 ? red : black);
+    setTextLabel(overlay, LABEL_OVERHEAD, 10, 120, "2: Overhead View",
+                 camera->mode == 2 ? red : black);
+    setTextLabel(overlay, LABEL_CONSTANT_MORPH, 10, 140, "M: Constant Morphing (Toggle)",
+                 terrain->morphing ? red : black);
+    setTextLabel(overlay, LABEL_CONSTANT_ROTATE, 10, 160, "R: Constant Rotating (Toggle)",
+                 terrain->spinning ? red : black);
+    setTextLabel(overlay, LABEL_EDIT, 10, 180, "F/G: Raise/Lower Ground", black);
 
-    //Uses the stb_font function to create points which can be drawn to the screen.
-    num_quads = stb_easy_font_print(x, y, (char *)text, NULL, buffer, sizeof(buffer));
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glVertexPointer(2, GL_FLOAT, 16, buffer);
-    glDrawArrays(GL_QUADS, 0, num_quads * 4);
-    glDisableClientState(GL_VERTEX_ARRAY);
+    //Draw information
+    float right = (float) win_width - 200;
+    setTextLabel(overlay, LABEL_ARGUMENTS, right, 20, "Command Line Arguments:", black);
+    setTextLabel(overlay, LABEL_COLOUR_ARGUMENT, right, 40, "-c=[0-3]: Changes Colour Mode.", black);
+    setTextLabel(overlay, LABEL_HEIGHT_ARGUMENT, right, 60, "-m=[0-4]: Changes Height Mode.", black);
+    setTextLabel(overlay, LABEL_SIZE_ARGUMENT, right, 80, "-s=[SIZE]: Changes size of terrain.", black);
+
+    //Draw CPU usage, of one core, while idle and while drawing every frame
+    char usage[64];
+    snprintf(usage, sizeof(usage), "CPU: %.1f%% idle, %.1f%% active", idle_usage.percent, active_usage.percent);
+    setTextLabel(overlay, LABEL_CPU, 10, 200, usage, black);
+
+    //Draw how well the world's tiles are read ahead of the camera
+    if (world != NULL) {
+        TileStats stats = tileStoreStats(world);
+        char tiles[96];
+        snprintf(tiles, sizeof(tiles), "World: %d tiles, %ld missed, %ld stalled, %ld major faults",
+                 stats.resident, stats.misses, stats.stalls, stats.majorFaults);
+        setTextLabel(overlay, LABEL_WORLD, 10, 220, tiles, stats.stalls > 0 ? red : black);
+    }
 }
 
 void display(GLFWwindow* window) {
     //Clear screen
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-
-    // First-person view
-    if (camera->mode == 1) {
-        float centerX = camera->eyeX + sin(camera->rotationX * M_PI / 180.0);
-        float centerY = camera->eyeY - tan(camera->rotationY * M_PI / 180.0);
-        float centerZ = camera->eyeZ - cos(camera->rotationX * M_PI / 180.0);
-
-        gluLookAt(camera->eyeX, camera->eyeY, camera->eyeZ, centerX, centerY, centerZ,
-                  camera->upX, camera->upY, camera->upZ);
-    }
-
-    // Overhead view
-    else if (camera->mode == 2) {
-        float centerX = terrain->xSize / 2.0;
-        float centerY = 0.0;
-        float centerZ = terrain->xSize / 2.0;
-
-        gluLookAt(camera->eyeX, camera->eyeY * camera->zoom, camera->eyeZ * camera->zoom, centerX, centerY, centerZ,
-                  camera->upX, camera->upY, camera->upZ);
-
-        //Set rotation based on rotationX and rotationY
-        glTranslatef(terrain->xSize/2,0.0f,terrain->zSize/2); //Move to center
-        glRotatef(camera->rotationX, 0.0f, 1.0f, 0.0f); //Rotate about x
-        glRotatef(camera->rotationY, 1.0f, 0.0f, 0.0f); //Rotate about y
-        glTranslatef(-(terrain->xSize/2), 0.0f, -(terrain->zSize/2)); //Move back from center
-    }
-
     if (terrain->spinning) {
         camera->rotationX += 0.1f;
         camera->rotationX += 0.1f;
-
-        glTranslatef(terrain->xSize/2,0.0f,terrain->zSize/2); //Move to center
-        glRotatef(camera->rotationX, 0.0f, 1.0f, 0.0f); //Rotate about x
-        glRotatef(camera->rotationY, 1.0f, 0.0f, 0.0f); //Rotate about y
-        glTranslatef(-(terrain->xSize/2), 0.0f, -(terrain->zSize/2)); //Move back from center
     }
 
+    glMatrixMode(GL_MODELVIEW);
+    Matrix4 view = cameraView();
+    glLoadMatrixf(view.m);
+
+    // The light is placed after the view so it stays fixed to the terrain, shining from
+    // the sun the shading is baked for
+    Vector3 sun = defaultBakeSettings().sun;
+    GLfloat light_position[] = {sun.x, sun.y, sun.z, 0.0f};
+    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+
     drawTerrain();
 
     // Switch to orthographic projection for 2D text rendering
@@ -419,38 +657,9 @@ void display(GLFWwindow* window) {
     glPushMatrix();
     glLoadIdentity();
 
-    // Change colour of text
-    glColor3f(0.0f, 0.0f, 0.0f);
-
-
-    // Render keybinds text, select modes/etc with colour
-    // The if statements are there so we can select the colour based on the mode/settings selected
-    drawText(10, 20, "WASD: Move");
-    drawText(10, 40, "Q/E: Move Down/Up");
-    drawText(10, 60, "Mouse: Move/Zoom");
-    drawText(10, 80, "Space: Morph Terrain");
-    if (camera->mode == 1) glColor3f(1.0f, 0.0f, 0.0f);
-    else glColor3f(0.0f, 0.0f, 0.0f);
-    drawText(10, 100, "1: First-Person View");
-
-    if (camera->mode == 2) glColor3f(1.0f, 0.0f, 0.0f);
-    else glColor3f(0.0f, 0.0f, 0.0f);
-    drawText(10, 120, "2: Overhead View");
-
-    if (terrain->morphing) glColor3f(1.0f, 0.0f, 0.0f);
-    else glColor3f(0.0f, 0.0f, 0.0f);
-    drawText(10, 140, "M: Constant Morphing (Toggle)");
-
-    if (terrain->spinning) glColor3f(1.0f, 0.0f, 0.0f);
-    else glColor3f(0.0f, 0.0f, 0.0f);
-    drawText(10, 160, "R: Constant Rotating (Toggle)");
-
-    //Draw information
-    glColor3f(0.0f, 0.0f, 0.0f);
-    drawText((float) win_width-200, 20, "Command Line Arguments:");
-    drawText((float) win_width-200, 40, "-c=[0-3]: Changes Colour Mode.");
-    drawText((float) win_width-200, 60, "-m=[0-4]: Changes Height Mode.");
-    drawText((float) win_width-200, 80, "-s=[SIZE]: Changes size of terrain.");
+    // Draw all the text in one batch
+    updateOverlay();
+    drawTextLayer(overlay);
 
 
     // Restore the previous projection and modelview matrices
@@ -460,167 +669,159 @@ void display(GLFWwindow* window) {
     glMatrixMode(GL_MODELVIEW);
 
     glfwSwapBuffers(window);
-
+    scene_changed = false;
+    drawn_version = terrain->version;
 }
 
-GLfloat simple_perlin(GLfloat x, GLfloat z) {
-    Vector2 vect = { .x = x * 0.05 , .y = z * 0.05 };
-    return get_perlin_value(perlin, vect, 2);
-}
-
-GLfloat double_perlin(GLfloat x, GLfloat z) {
-    Vector2 vect1 = { .x = (x * 0.02) + 1, .y = (z * 0.02) + 1};
-    GLfloat perlin1 = get_perlin_value(perlin, vect1, 2) * 1.2;
+// Returns the modelview matrix for the camera's mode, shared by display and the
+// software renderer so both draw the same scene
+Matrix4 cameraView(void) {
+    Matrix4 view = matrix_identity();
 
-    Vector2 vect2 = { .x = x * 0.05, .y = z * 0.05 };
-    GLfloat perlin2 = get_perlin_value(perlin, vect2, 2) * 0.4;
+    // First-person view
+    if (camera->mode == 1) {
+        Vector3 eye = {camera->eyeX, camera->eyeY, camera->eyeZ};
+        Vector3 center = {
+            camera->eyeX + sin(camera->rotationX * M_PI / 180.0),
+            camera->eyeY - tan(camera->rotationY * M_PI / 180.0),
+            camera->eyeZ - cos(camera->rotationX * M_PI / 180.0)
+        };
+        view = matrix_look_at(eye, center, (Vector3){camera->upX, camera->upY, camera->upZ});
+    }
 
-    return (perlin1 + perlin2)/1.6;
-}
+    // Overhead view
+    else if (camera->mode == 2) {
+        Vector3 eye = {camera->eyeX, camera->eyeY * camera->zoom, camera->eyeZ * camera->zoom};
+        Vector3 center = {terrain->xSize / 2.0, 0.0, terrain->xSize / 2.0};
+        view = matrix_look_at(eye, center, (Vector3){camera->upX, camera->upY, camera->upZ});
 
-GLfloat simple_perlin_blocky(GLfloat x, GLfloat z) {
-    return floor(simple_perlin(x, z) * MAX_HEIGHT) / (float) MAX_HEIGHT;
-}
+        //Set rotation based on rotationX and rotationY
+        view = matrix_translate(view, terrain->xSize/2, 0.0f, terrain->zSize/2); //Move to center
+        view = matrix_rotate(view, camera->rotationX, 0.0f, 1.0f, 0.0f); //Rotate about x
+        view = matrix_rotate(view, camera->rotationY, 1.0f, 0.0f, 0.0f); //Rotate about y
+        view = matrix_translate(view, -(terrain->xSize/2), 0.0f, -(terrain->zSize/2)); //Move back from center
+    }
 
-GLfloat double_perlin_blocky(GLfloat x, GLfloat z) {
-    return floor(double_perlin(x, z) * MAX_HEIGHT) / (float) MAX_HEIGHT;
+    if (terrain->spinning) {
+        view = matrix_translate(view, terrain->xSize/2, 0.0f, terrain->zSize/2); //Move to center
+        view = matrix_rotate(view, camera->rotationX, 0.0f, 1.0f, 0.0f); //Rotate about x
+        view = matrix_rotate(view, camera->rotationY, 1.0f, 0.0f, 0.0f); //Rotate about y
+        view = matrix_translate(view, -(terrain->xSize/2), 0.0f, -(terrain->zSize/2)); //Move back from center
+    }
+    return view;
 }
 
-GLfloat mountain_perlin(GLfloat x, GLfloat z) {
-    Vector2 vect1 = { .x = (x * 0.02) + 1, .y = (z * 0.02) + 1};
-    GLfloat perlin1 = get_perlin_value(perlin, vect1, 2) * 1.2;
-
-    Vector2 vect2 = { .x = x * 0.05, .y = z * 0.05 };
-    GLfloat perlin2 = get_perlin_value(perlin, vect2, 2) * 0.4;
-
-    Vector2 vect3 = { .x = x * 0.005, .y = z * 0.005 };
-    GLfloat perlin3 = get_perlin_value(perlin, vect3, 1) * 10.0;
-    if (perlin3 < 0.0f) perlin3 = 0.0f;
-
-    return (perlin1 + perlin2 + perlin3)/1.6;
+// Renders the scene display() would draw, without the overlay, into the output image.
+// The frames are timed so the renderer's speed can be tracked without a GPU.
+int renderHeadless(void) {
+    SoftImage* image = createSoftImage(win_width, win_height);
+    if (image == NULL) return EXIT_FAILURE;
+    // The sun is turned into eye space by the view, as OpenGL does for display's light
+    Matrix4 view = cameraView();
+    Vector3 sun = defaultBakeSettings().sun;
+    SoftScene scene = {
+        .projection = matrix_perspective(45.0f, (GLfloat) win_width / win_height, 1.0f, 1000.0f),
+        .modelview = view,
+        .clearColour = {0.5f, 0.75f, 1.0f},
+        .lightDirection = {
+            view.m[0] * sun.x + view.m[4] * sun.y + view.m[8] * sun.z,
+            view.m[1] * sun.x + view.m[5] * sun.y + view.m[9] * sun.z,
+            view.m[2] * sun.x + view.m[6] * sun.y + view.m[10] * sun.z
+        },
+        .water = colour_mode == 0 || colour_mode == 3,
+        .xSize = terrain->xSize,
+        .zSize = terrain->zSize
+    };
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int frame = 0; frame < HEADLESS_FRAMES; frame++) {
+        if (vertex_format == 1) {
+            updateCompactMesh(compact_mesh, terrain, generator->colour_function, &generator->colourParams);
+            renderCompactMesh(image, &scene, compact_mesh);
+        } else if (vertex_format == 2) {
+            updateCoarseMesh(coarse_mesh, terrain, generator->colour_function, &generator->colourParams);
+            renderCoarseMesh(image, &scene, coarse_mesh);
+        } else if (vertex_format == 3) {
+            updateAdaptiveMesh();
+            if (mesh != NULL) renderTerrainMesh(image, &scene, mesh);
+        } else {
+            updateTerrainMesh(mesh, terrain, generator->colour_function, &generator->colourParams);
+            renderTerrainMesh(image, &scene, mesh);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("Rendered %d frames of %dx%d at %.1f FPS (%.2f ms per frame)\n", HEADLESS_FRAMES,
+           win_width, win_height, HEADLESS_FRAMES / seconds, seconds * 1000.0 / HEADLESS_FRAMES);
+
+    bool written = writeSoftImage(image, output_path);
+    freeSoftImage(image);
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-Vector3 classic_colour(GLfloat x, GLfloat y, GLfloat z) {
-    GLfloat r; GLfloat g; GLfloat b;
-    if (y < 0.0f) {
-        // Low altitude: dark green
-        r = 0.0f;
-        g = 0.2f;
-        b = 0.0f;
-    } else if (y < (terrain->height / 3)) {
-        // Medium altitude: green
-        r = interpolate_colour(0.0f, 0.0f, 0.1f, terrain->height / 10, y);
-        g = interpolate_colour(0.2f, 0.0f, 0.7f, terrain->height / 10, y);
-        b = 0.0f;
+// Writes the mesh that would be drawn to the export path, as OBJ or glTF
+int exportMesh(void) {
+    if (vertex_format == 3) {
+        updateAdaptiveMesh();
     } else {
-        // High altitude: white (snow)
-        r = interpolate_colour(0.1f, 0.0f, 1.0f, terrain->height / 2, y);
-        g = interpolate_colour(0.7f, 0.0f, 1.0f, terrain->height / 2, y);
-        b = interpolate_colour(0.0f, 0.0f, 1.0f, terrain->height / 2, y);
+        updateTerrainMesh(mesh, terrain, generator->colour_function, &generator->colourParams);
     }
-    return (Vector3){r, g, b};
+    if (mesh == NULL || !writeMesh(mesh, export_path)) return EXIT_FAILURE;
+    printf("Exported %d vertices and %d triangles to %s\n", mesh->numVertices, mesh->numIndices / 3, export_path);
+    return EXIT_SUCCESS;
 }
 
-Vector3 heightmap_colour(GLfloat x, GLfloat y, GLfloat z) {
-    GLfloat r; GLfloat g; GLfloat b;
-    if (y < 0.0f) {
-        r = interpolate_colour(0.0f, -terrain->height / 2, 0.5f, 0.0f, y);
-        g = 0.0f;
-        b = interpolate_colour(1.0f, -terrain->height / 2,0.5f, 0.0f, y);
+// New heights only change the errors of splits near the dirty rectangle, but the mesh is
+// built again as they can move splits anywhere up to the two largest triangles. Shading
+// alone moves none, so then the vertices are only coloured again.
+void updateAdaptiveMesh(void) {
+    TerrainRect dirty = takeTerrainDirty(terrain);
+    if (mesh != NULL && (dirty.x0 >= dirty.x1 || dirty.z0 >= dirty.z1)) return;
+    if (mesh != NULL && terrain->heightsVersion == adapted_version) {
+        refreshTerrainMesh(mesh, terrain, generator->colour_function, &generator->colourParams);
+        return;
+    }
+    if (mesh == NULL) {
+        updateRtin(rtin, terrain);
     } else {
-        // Medium altitude: green
-        r = interpolate_colour(0.5f, 0.0f, 1.0f, terrain->height / 2, y);
-        g = 0.0f;
-        b = interpolate_colour(1.0f, 0.0f, 0.5f, terrain->height / 2, y);
+        updateRtinRegion(rtin, terrain, dirty);
     }
-    return (Vector3){r, g, b};
+    adapted_version = terrain->heightsVersion;
+    TerrainMesh* adapted = createRtinMesh(rtin, terrain, ADAPTIVE_ERROR, generator->colour_function,
+                                          &generator->colourParams);
+    if (adapted == NULL) return;
+    if (mesh != NULL) freeTerrainMesh(mesh);
+    mesh = adapted;
 }
 
-Vector3 grey_colour(GLfloat x, GLfloat y, GLfloat z) {
-    return (Vector3){0.5f, 0.5f, 0.5f};
-}
-
-Vector3 biomes_colour(GLfloat x, GLfloat y, GLfloat z) {
-    GLfloat r; GLfloat g; GLfloat b;
-    if (y < 0.0f) {
-        // Low altitude: dark green
-        r = 0.0f;
-        g = 0.2f;
-        b = 0.0f;
-    } else if (y < (terrain->height / 2)) {
-        // Medium altitude: green
-        r = interpolate_colour(0.0f, 0.0f, 0.1f, terrain->height / 10, y);
-        g = interpolate_colour(0.2f, 0.0f, 0.7f, terrain->height / 10, y);
-        b = 0.0f;
+// Starts a morph unless one is already going: animated terrain moves on through the
+// 3D noise, otherwise a new terrain is generated in the background to blend to
+void beginMorph(void) {
+    // A world is read from disk as the camera moves, so is never morphed
+    if (world != NULL || morphActive(morph)) return;
+    double now = glfwGetTime();
+    if (animate) {
+        startAnimatedMorph(morph, animation_time, animation_time + ANIMATION_SPEED * MORPH_SECONDS, now);
+        animation_time += ANIMATION_SPEED * MORPH_SECONDS;
     } else {
-        if (colour_map[(int)x][(int)z] > 0.0f) {
-            if (y < terrain->height * 1.5){
-                // High altitude in biome: dark grey mountain
-                r = interpolate_colour(0.1f, terrain->height / 2, 0.3f, terrain->height, y);
-                g = interpolate_colour(0.7f, terrain->height / 2, 0.3f, terrain->height, y);
-                b = interpolate_colour(0.0f, terrain->height / 2, 0.3f, terrain->height, y);
-            } else {
-                // V High altitude in biome - lava (volcano)
-                r = interpolate_colour(0.3f, terrain->height *0.7, 1.0f, terrain->height * 2, y);
-                g = interpolate_colour(0.3f, terrain->height *0.7, 0.0f, terrain->height * 2, y);
-                b = interpolate_colour(0.3f, terrain->height *0.7, 0.0f, terrain->height * 2, y);
-            }
-        } else {
-            // High altitude not in biome: grey mountain
-            r = interpolate_colour(0.1f, terrain->height / 2, 0.5f, terrain->height, y);
-            g = interpolate_colour(0.7f, terrain->height / 2, 0.5f, terrain->height, y);
-            b = interpolate_colour(0.0f, terrain->height / 2, 0.5f, terrain->height, y);
-        }
+        startMorph(morph, terrain, generator, now);
     }
-    return (Vector3){r, g, b};
 }
 
-void morph(GLFWwindow* window) {
-    //Create a copy of the terrain we're morphing from.
-    Terrain* oldTerrain = createTerrain(terrain->xSize, terrain->zSize, terrain->height);
-    populateTerrain(oldTerrain, height_function);
-
-    //Create a new perlin, and new terrain to morph to.
-    free_perlin(perlin);
-    perlin = create_perlin(terrain->xSize, terrain->zSize);
-
-    Terrain* newTerrain = createTerrain(terrain->xSize, terrain->zSize, terrain->height);
-    populateTerrain(newTerrain, height_function);
-
-    //Morph by changing size from one terrain to another based heights of the old terrain and new terrain.
-    int num_steps = 30;
-    for (int step = 0; !glfwWindowShouldClose(window) && step < num_steps; step++) {
-        //Change current terrain normals based on step
-        for (int x = 0; x < terrain->xSize; x++) {
-            for (int z = 0; z < terrain->zSize; z++) {
-                terrain->heights[x][z] = (oldTerrain->heights[x][z] * (num_steps - step) + newTerrain->heights[x][z] * step)/num_steps ;
-            }
-        }
-
-        for (int x = 0; x < terrain->xSize - 1; x++) {
-            for (int z = 0; z < terrain->zSize - 1; z++) {
-                terrain->normals[x][z].x =
-                        (oldTerrain->normals[x][z].x * (num_steps - step) + newTerrain->normals[x][z].x * step) /
-                        num_steps;
-                terrain->normals[x][z].y =
-                        (oldTerrain->normals[x][z].y * (num_steps - step) + newTerrain->normals[x][z].y * step) /
-                        num_steps;
-                terrain->normals[x][z].z =
-                        (oldTerrain->normals[x][z].x * (num_steps - step) + newTerrain->normals[x][z].z * step) /
-                        num_steps;
-            }
-        }
-
-        glfwPollEvents(); // Execute any events e.g. resizes.
-        display(window);
+// Moves the terrain on to the time now. Constant morphing starts a morph whenever the
+// last one is done, apart from animated terrain which instead moves on through the
+// noise by the time since the last frame.
+void updateMorph(double now, double elapsed) {
+    if (terrain->morphing && animate && !morphActive(morph)) {
+        animation_time += ANIMATION_SPEED * elapsed;
+        animateTerrain(generator, terrain, animation_time);
+        return;
     }
-
-    //Keep settings between the terrains, and free the previous terrains.
-    newTerrain->morphing = terrain->morphing;
-    newTerrain->spinning = terrain->spinning;
-    freeTerrain(terrain);
-    terrain = newTerrain;
-    freeTerrain(oldTerrain);
+    if (terrain->morphing) {
+        beginMorph();
+    }
+    advanceMorph(morph, terrain, generator, now);
 }
 
 //If the screen size changes, we need to change the gluPerspective to match this.
@@ -633,6 +834,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 
     win_height = height;
     win_width = width;
+    scene_changed = true;
 }
 
 //Callback functions for controls
@@ -663,6 +865,7 @@ void cursor_position_callback(GLFWwindow* window, double xpos, double ypos) {
 
         mouse->lastMouseX = xpos;
         mouse->lastMouseY = ypos;
+        scene_changed = true;
     }
 }
 
@@ -679,6 +882,7 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
             camera->zoom = 10.0f;
         }
         printf("New zoom: %f\n", camera->zoom);
+        scene_changed = true;
     }
 }
 
@@ -746,13 +950,40 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 
             camera->rotationX = 0.0f;
             camera->rotationY = 0.0f;
-        } else if (key == GLFW_KEY_M) {
+        } else if (key == GLFW_KEY_M && world == NULL) {
             terrain->morphing = !terrain->morphing;
         } else if (key == GLFW_KEY_R) {
             terrain->spinning = !terrain->spinning;
         } else if (key == GLFW_KEY_SPACE) {
-            morph(window);
+            beginMorph();
+        } else if ((key == GLFW_KEY_F || key == GLFW_KEY_G) && world == NULL) {
+            // Raise or lower the ground the first person camera looks at, or else under the
+            // camera, only the area around it is updated. A world is read only, so the
+            // window into it would lose the edits as soon as it moves.
+            GLfloat amount = (key == GLFW_KEY_F) ? 2.0f : -2.0f;
+            TerrainRay ray = {
+                .origin = {camera->eyeX, camera->eyeY, camera->eyeZ},
+                .direction = {
+                    sin(camera->rotationX * M_PI / 180.0) * cos(camera->rotationY * M_PI / 180.0),
+                    -sin(camera->rotationY * M_PI / 180.0),
+                    -cos(camera->rotationX * M_PI / 180.0) * cos(camera->rotationY * M_PI / 180.0)
+                },
+                .length = EDIT_DISTANCE
+            };
+            TerrainHit hit;
+            if (camera->mode == 1 && raycastTerrain(terrain, ray, &hit)) {
+                stampTerrain(terrain, hit.point.x, hit.point.z, 10.0f, amount);
+            } else {
+                stampTerrain(terrain, camera->eyeX, camera->eyeZ, 10.0f, amount);
+            }
+        }
+        followCamera();
+        // Keeps the first person camera from going underground
+        GLfloat ground = terrainHeightAt(terrain, camera->eyeX, camera->eyeZ) + CAMERA_CLEARANCE;
+        if (camera->mode == 1 && camera->eyeY < ground) {
+            camera->eyeY = ground;
         }
+        scene_changed = true;
     }
     printf("X: %f, Y: %f, Z: %f\n",camera->eyeX,camera->eyeY,camera->eyeZ);
 }
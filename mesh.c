@@ -0,0 +1,786 @@
+// Buffer objects are OpenGL 1.5, so their prototypes have to be asked for
+#define GL_GLEXT_PROTOTYPES
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <math.h>
+#include "mesh.h"
+#include "parallel.h"
+
+// Turns a byte offset into the bound buffer object into the pointer OpenGL expects
+#define BUFFER_OFFSET(bytes) ((void*) (size_t) (bytes))
+
+// Creates the mesh and builds the index array which never changes
+TerrainMesh* createTerrainMesh(int xSize, int zSize) {
+    TerrainMesh* mesh = malloc(sizeof(TerrainMesh));
+    if (mesh == NULL) {
+        fprintf(stderr, "Allocation of terrain mesh failed.\n");
+        return NULL;
+    }
+    int numTriangles = (xSize - 1) * (zSize - 1) * 2;
+    mesh->xSize = xSize;
+    mesh->zSize = zSize;
+    mesh->numVertices = xSize * zSize;
+    mesh->numIndices = numTriangles * 3;
+    mesh->vertexBuffer = 0;
+    mesh->indexBuffer = 0;
+    mesh->vertices = malloc(sizeof(TerrainVertex) * mesh->numVertices);
+    mesh->indices = malloc(sizeof(GLuint) * mesh->numIndices);
+    if (mesh->vertices == NULL || mesh->indices == NULL) {
+        fprintf(stderr, "Allocation of terrain mesh vertices failed.\n");
+        free(mesh->vertices);
+        free(mesh->indices);
+        free(mesh);
+        return NULL;
+    }
+
+    // Fill the index array, used to index triangles
+    int index = 0;
+    for (int z = 0; z < zSize - 1; ++z) {
+        for (int x = 0; x < xSize - 1; ++x) {
+            int topLeft = z * xSize + x;
+            int topRight = topLeft + 1;
+            int bottomLeft = topLeft + xSize;
+            int bottomRight = bottomLeft + 1;
+
+            mesh->indices[index++] = topLeft;
+            mesh->indices[index++] = bottomLeft;
+            mesh->indices[index++] = topRight;
+
+            mesh->indices[index++] = topRight;
+            mesh->indices[index++] = bottomLeft;
+            mesh->indices[index++] = bottomRight;
+        }
+    }
+    return mesh;
+}
+
+TerrainVertex terrainVertex(Terrain* terrain, colourFunction colour, const ColourParams* params, int x, int z) {
+    TerrainVertex vertex;
+    vertex.position = (Vector3){x, terrain->heights[x][z], z};
+    vertex.normal = terrain->normals[x][z];
+    vertex.colour = colour(params, x, vertex.position.y, z);
+    if (terrain->shading != NULL) {
+        GLfloat shade = terrain->shading[x * terrain->zSize + z] / 255.0f;
+        vertex.colour = (Vector3){vertex.colour.x * shade, vertex.colour.y * shade, vertex.colour.z * shade};
+    }
+    return vertex;
+}
+
+typedef struct {
+    TerrainMesh* mesh;
+    Terrain* terrain;
+    colourFunction colour;
+    const ColourParams* params;
+    TerrainRect rect;
+} VertexJob;
+
+// Fills a block of the rectangle, numbered from its corner
+static void fillVertexBlock(void* context, int x0, int z0, int x1, int z1) {
+    VertexJob* job = context;
+    TerrainMesh* mesh = job->mesh;
+    for (int z = job->rect.z0 + z0; z < job->rect.z0 + z1; ++z) {
+        for (int x = job->rect.x0 + x0; x < job->rect.x0 + x1; ++x) {
+            mesh->vertices[z * mesh->xSize + x] = terrainVertex(job->terrain, job->colour, job->params, x, z);
+        }
+    }
+}
+
+void fillTerrainVertices(TerrainMesh* mesh, Terrain* terrain, colourFunction colour, const ColourParams* params,
+                         TerrainRect rect) {
+    VertexJob job = {mesh, terrain, colour, params, rect};
+    parallel_for_2d(rect.x1 - rect.x0, rect.z1 - rect.z0, fillVertexBlock, &job);
+}
+
+// Only the rows touched by the dirty rectangle are sent to OpenGL again
+void updateTerrainMesh(TerrainMesh* mesh, Terrain* terrain, colourFunction colour, const ColourParams* params) {
+    TerrainRect dirty = takeTerrainDirty(terrain);
+    if (dirty.x0 >= dirty.x1 || dirty.z0 >= dirty.z1) return;
+
+    fillTerrainVertices(mesh, terrain, colour, params, dirty);
+    if (mesh->vertexBuffer == 0) return;
+
+    int first = dirty.z0 * mesh->xSize;
+    int count = (dirty.z1 - dirty.z0) * mesh->xSize;
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(TerrainVertex) * first, sizeof(TerrainVertex) * count,
+                    &mesh->vertices[first]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Refills a chunk of the vertices, each from the grid point under it
+static void refillVertices(void* context, int begin, int end) {
+    VertexJob* job = context;
+    TerrainMesh* mesh = job->mesh;
+    for (int i = begin; i < end; i++) {
+        Vector3 p = mesh->vertices[i].position;
+        mesh->vertices[i] = terrainVertex(job->terrain, job->colour, job->params, (int) p.x, (int) p.z);
+    }
+}
+
+void refreshTerrainMesh(TerrainMesh* mesh, Terrain* terrain, colourFunction colour, const ColourParams* params) {
+    VertexJob job = {mesh, terrain, colour, params, {0, 0, 0, 0}};
+    parallel_for(mesh->numVertices, refillVertices, &job);
+    if (mesh->vertexBuffer == 0) return;
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(TerrainVertex) * mesh->numVertices, mesh->vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+// Uploads every vertex and index into new buffer objects
+static void createTerrainBuffers(TerrainMesh* mesh) {
+    glGenBuffers(1, &mesh->vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(TerrainVertex) * mesh->numVertices, mesh->vertices, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &mesh->indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * mesh->numIndices, mesh->indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void drawTerrainMesh(TerrainMesh* mesh) {
+    if (mesh->vertexBuffer == 0) {
+        createTerrainBuffers(mesh);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
+
+    // Enable arrays and set pointers, which are offsets into the bound buffer
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+
+    glVertexPointer(3, GL_FLOAT, sizeof(TerrainVertex), BUFFER_OFFSET(offsetof(TerrainVertex, position)));
+    glNormalPointer(GL_FLOAT, sizeof(TerrainVertex), BUFFER_OFFSET(offsetof(TerrainVertex, normal)));
+    glColorPointer(3, GL_FLOAT, sizeof(TerrainVertex), BUFFER_OFFSET(offsetof(TerrainVertex, colour)));
+
+    glDrawElements(GL_TRIANGLES, mesh->numIndices, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+
+    // Disable arrays
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+void freeTerrainMesh(TerrainMesh* mesh) {
+    if (mesh->vertexBuffer != 0) {
+        glDeleteBuffers(1, &mesh->vertexBuffer);
+        glDeleteBuffers(1, &mesh->indexBuffer);
+    }
+    free(mesh->vertices);
+    free(mesh->indices);
+    free(mesh);
+}
+
+// Creates the patches and builds their indices, which never change.
+// Neighbouring patches share their edge vertices so each is drawn on its own.
+CompactMesh* createCompactMesh(int xSize, int zSize) {
+    CompactMesh* mesh = calloc(1, sizeof(CompactMesh));
+    if (mesh == NULL) {
+        fprintf(stderr, "Allocation of compact mesh failed.\n");
+        return NULL;
+    }
+    mesh->xSize = xSize;
+    mesh->zSize = zSize;
+    mesh->patchesX = (xSize - 2) / PATCH_SIZE + 1;
+    mesh->patchesZ = (zSize - 2) / PATCH_SIZE + 1;
+    mesh->patches = malloc(sizeof(CompactPatch) * mesh->patchesX * mesh->patchesZ);
+    if (mesh->patches == NULL) {
+        fprintf(stderr, "Allocation of compact mesh patches failed.\n");
+        free(mesh);
+        return NULL;
+    }
+
+    for (int px = 0; px < mesh->patchesX; px++) {
+        for (int pz = 0; pz < mesh->patchesZ; pz++) {
+            CompactPatch* patch = &mesh->patches[px * mesh->patchesZ + pz];
+            patch->x0 = px * PATCH_SIZE;
+            patch->z0 = pz * PATCH_SIZE;
+            patch->xCount = ((xSize - 1 - patch->x0 < PATCH_SIZE) ? xSize - 1 - patch->x0 : PATCH_SIZE) + 1;
+            patch->zCount = ((zSize - 1 - patch->z0 < PATCH_SIZE) ? zSize - 1 - patch->z0 : PATCH_SIZE) + 1;
+            patch->bias = 0;
+            patch->scale = 1;
+            patch->firstVertex = mesh->numVertices;
+            patch->firstIndex = mesh->numIndices;
+            patch->numIndices = (patch->xCount - 1) * (patch->zCount - 1) * 6;
+            mesh->numVertices += patch->xCount * patch->zCount;
+            mesh->numIndices += patch->numIndices;
+        }
+    }
+
+    mesh->vertices = malloc(sizeof(CompactVertex) * mesh->numVertices);
+    mesh->indices = malloc(sizeof(GLushort) * mesh->numIndices);
+    if (mesh->vertices == NULL || mesh->indices == NULL) {
+        fprintf(stderr, "Allocation of compact mesh vertices failed.\n");
+        free(mesh->vertices);
+        free(mesh->indices);
+        free(mesh->patches);
+        free(mesh);
+        return NULL;
+    }
+
+    // Same triangles as TerrainMesh, relative to the first vertex of the patch
+    for (int p = 0; p < mesh->patchesX * mesh->patchesZ; p++) {
+        CompactPatch* patch = &mesh->patches[p];
+        int index = patch->firstIndex;
+        for (int z = 0; z < patch->zCount - 1; z++) {
+            for (int x = 0; x < patch->xCount - 1; x++) {
+                int topLeft = z * patch->xCount + x;
+                int topRight = topLeft + 1;
+                int bottomLeft = topLeft + patch->xCount;
+                int bottomRight = bottomLeft + 1;
+
+                mesh->indices[index++] = topLeft;
+                mesh->indices[index++] = bottomLeft;
+                mesh->indices[index++] = topRight;
+
+                mesh->indices[index++] = topRight;
+                mesh->indices[index++] = bottomLeft;
+                mesh->indices[index++] = bottomRight;
+            }
+        }
+    }
+
+    // Forces the lookup table to be built on the first update
+    mesh->lutMin = 1;
+    mesh->lutMax = 0;
+    return mesh;
+}
+
+// Returns a normal component scaled to a signed byte
+static GLbyte pack_normal(GLfloat component) {
+    GLfloat scaled = roundf(component * 127.0f);
+    if (scaled > 127.0f) return 127;
+    if (scaled < -127.0f) return -127;
+    return (GLbyte) scaled;
+}
+
+// Quantises every vertex of the patch around the middle of its heights. The scale is
+// the smallest power of 2 which fits the patch's height range into 16 bits, and no
+// smaller than 1/256 so x and z (at most PATCH_SIZE) still fit.
+static void quantisePatch(CompactMesh* mesh, CompactPatch* patch, Terrain* terrain, GLfloat** variants) {
+    GLfloat min = INFINITY, max = -INFINITY;
+    for (int x = patch->x0; x < patch->x0 + patch->xCount; x++) {
+        for (int z = patch->z0; z < patch->z0 + patch->zCount; z++) {
+            min = fminf(min, terrain->heights[x][z]);
+            max = fmaxf(max, terrain->heights[x][z]);
+        }
+    }
+    GLfloat steps = 256.0f;
+    while (steps > 1.0f && (max - min) * steps > 65000.0f) {
+        steps /= 2;
+    }
+    patch->bias = (min + max) / 2;
+    patch->scale = 1.0f / steps;
+
+    for (int z = 0; z < patch->zCount; z++) {
+        for (int x = 0; x < patch->xCount; x++) {
+            int gridX = patch->x0 + x;
+            int gridZ = patch->z0 + z;
+            CompactVertex* vertex = &mesh->vertices[patch->firstVertex + z * patch->xCount + x];
+            GLfloat y = roundf((terrain->heights[gridX][gridZ] - patch->bias) * steps);
+            Vector3 normal = terrain->normals[gridX][gridZ];
+
+            vertex->x = (GLshort) (x * steps);
+            vertex->z = (GLshort) (z * steps);
+            vertex->y = (GLshort) fmaxf(-32767.0f, fminf(32767.0f, y));
+            int variant = (variants != NULL && variants[gridX][gridZ] > 0.0f) ? 1 : 0;
+            int level = SHADE_LEVELS - 1;
+            if (terrain->shading != NULL) {
+                level = (terrain->shading[gridX * terrain->zSize + gridZ] * (SHADE_LEVELS - 1) + 127) / 255;
+            }
+            vertex->variant = (GLshort) (variant * SHADE_LEVELS + level);
+            vertex->nx = pack_normal(normal.x);
+            vertex->ny = pack_normal(normal.y);
+            vertex->nz = pack_normal(normal.z);
+            vertex->pad = 0;
+        }
+    }
+}
+
+// Rebuilds the lookup table over the height range of the whole terrain, with some
+// room either side so small edits do not need another rebuild
+static void buildColourLut(CompactMesh* mesh, Terrain* terrain, colourFunction colour, const ColourParams* params) {
+    GLfloat** variants = params->biomeMap;
+    GLfloat min = INFINITY, max = -INFINITY;
+    // The colour function is called at a point of each row so it sees the right variant
+    int rowX[2] = {0, 0}, rowZ[2] = {0, 0};
+    bool found[2] = {false, false};
+    for (int x = 0; x < terrain->xSize; x++) {
+        for (int z = 0; z < terrain->zSize; z++) {
+            min = fminf(min, terrain->heights[x][z]);
+            max = fmaxf(max, terrain->heights[x][z]);
+            int row = (variants != NULL && variants[x][z] > 0.0f) ? 1 : 0;
+            if (!found[row]) {
+                found[row] = true;
+                rowX[row] = x;
+                rowZ[row] = z;
+            }
+        }
+    }
+    GLfloat margin = fmaxf((max - min) * 0.05f, 1.0f);
+    mesh->lutMin = min - margin;
+    mesh->lutMax = max + margin;
+
+    // Each level of shading has the colours darkened, so it costs nothing when drawing
+    for (int row = 0; row < 2; row++) {
+        for (int i = 0; i < COLOUR_LUT_SIZE; i++) {
+            GLfloat y = mesh->lutMin + (mesh->lutMax - mesh->lutMin) * i / (COLOUR_LUT_SIZE - 1);
+            Vector3 c = colour(params, rowX[row], y, rowZ[row]);
+            for (int level = 0; level < SHADE_LEVELS; level++) {
+                GLfloat shade = (GLfloat) level / (SHADE_LEVELS - 1);
+                GLubyte* entry = mesh->lut[row * SHADE_LEVELS + level][i];
+                entry[0] = (GLubyte) (fmaxf(0.0f, fminf(1.0f, c.x)) * shade * 255.0f + 0.5f);
+                entry[1] = (GLubyte) (fmaxf(0.0f, fminf(1.0f, c.y)) * shade * 255.0f + 0.5f);
+                entry[2] = (GLubyte) (fmaxf(0.0f, fminf(1.0f, c.z)) * shade * 255.0f + 0.5f);
+            }
+        }
+    }
+    mesh->lutChanged = true;
+}
+
+// Returns whether the patch overlaps the rectangle
+static bool patchInRect(CompactPatch* patch, TerrainRect rect) {
+    return patch->x0 < rect.x1 && patch->x0 + patch->xCount > rect.x0
+        && patch->z0 < rect.z1 && patch->z0 + patch->zCount > rect.z0;
+}
+
+// Whole patches are requantised since their height range may have changed
+void updateCompactMesh(CompactMesh* mesh, Terrain* terrain, colourFunction colour, const ColourParams* params) {
+    TerrainRect dirty = takeTerrainDirty(terrain);
+    if (dirty.x0 >= dirty.x1 || dirty.z0 >= dirty.z1) return;
+
+    // Check the lookup table still covers every height that changed
+    bool rebuildLut = mesh->lutMin > mesh->lutMax;
+    for (int x = dirty.x0; x < dirty.x1 && !rebuildLut; x++) {
+        for (int z = dirty.z0; z < dirty.z1; z++) {
+            if (terrain->heights[x][z] < mesh->lutMin || terrain->heights[x][z] > mesh->lutMax) {
+                rebuildLut = true;
+                break;
+            }
+        }
+    }
+    if (rebuildLut) {
+        buildColourLut(mesh, terrain, colour, params);
+    }
+
+    if (mesh->vertexBuffer != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+    }
+    for (int p = 0; p < mesh->patchesX * mesh->patchesZ; p++) {
+        CompactPatch* patch = &mesh->patches[p];
+        if (!patchInRect(patch, dirty)) continue;
+        quantisePatch(mesh, patch, terrain, params->biomeMap);
+        if (mesh->vertexBuffer != 0) {
+            glBufferSubData(GL_ARRAY_BUFFER, sizeof(CompactVertex) * patch->firstVertex,
+                            sizeof(CompactVertex) * patch->xCount * patch->zCount,
+                            &mesh->vertices[patch->firstVertex]);
+        }
+    }
+    if (mesh->vertexBuffer != 0) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+// Mirrors what OpenGL does when drawing: scales the position, normalises the normal and
+// linearly filters the lookup table at the texture coordinate the patch's matrix gives
+TerrainVertex decodeCompactVertex(const CompactMesh* mesh, const CompactPatch* patch, int index) {
+    const CompactVertex* v = &mesh->vertices[patch->firstVertex + index];
+    TerrainVertex out;
+    out.position = (Vector3){
+        patch->x0 + v->x * patch->scale,
+        patch->bias + v->y * patch->scale,
+        patch->z0 + v->z * patch->scale
+    };
+    out.normal = normalise_3((Vector3){v->nx / 127.0f, v->ny / 127.0f, v->nz / 127.0f});
+
+    GLfloat along = (out.position.y - mesh->lutMin) / (mesh->lutMax - mesh->lutMin) * (COLOUR_LUT_SIZE - 1);
+    along = fmaxf(0.0f, fminf(COLOUR_LUT_SIZE - 1, along));
+    int i = (int) along;
+    if (i > COLOUR_LUT_SIZE - 2) i = COLOUR_LUT_SIZE - 2;
+    GLfloat w = along - i;
+    const GLubyte* c0 = mesh->lut[v->variant][i];
+    const GLubyte* c1 = mesh->lut[v->variant][i + 1];
+    out.colour = (Vector3){
+        (c0[0] * (1 - w) + c1[0] * w) / 255.0f,
+        (c0[1] * (1 - w) + c1[1] * w) / 255.0f,
+        (c0[2] * (1 - w) + c1[2] * w) / 255.0f
+    };
+    return out;
+}
+
+// Uploads every vertex and index into buffer objects and creates the lookup texture
+static void createCompactBuffers(CompactMesh* mesh) {
+    glGenBuffers(1, &mesh->vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CompactVertex) * mesh->numVertices, mesh->vertices, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &mesh->indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLushort) * mesh->numIndices, mesh->indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glGenTextures(1, &mesh->lutTexture);
+    glBindTexture(GL_TEXTURE_2D, mesh->lutTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    mesh->lutChanged = true;
+}
+
+// Lighting is done on a white material and the lookup colour is multiplied in by the
+// texture stage, so the lit colour is clamped before the colour is applied
+void drawCompactMesh(CompactMesh* mesh) {
+    // Swaps the stored (x, z, y) back to (x, y, z)
+    static const GLfloat swapYZ[16] = {
+        1, 0, 0, 0,
+        0, 0, 1, 0,
+        0, 1, 0, 0,
+        0, 0, 0, 1
+    };
+
+    if (mesh->vertexBuffer == 0) {
+        createCompactBuffers(mesh);
+    }
+    glBindTexture(GL_TEXTURE_2D, mesh->lutTexture);
+    if (mesh->lutChanged) {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, COLOUR_LUT_SIZE, 2 * SHADE_LEVELS, 0, GL_RGB, GL_UNSIGNED_BYTE, mesh->lut);
+        mesh->lutChanged = false;
+    }
+
+    glEnable(GL_TEXTURE_2D);
+    glEnable(GL_NORMALIZE);
+    // Lighting is clamped to 1 before the texture is applied, so a half grey material
+    // lit then doubled gives the same colour * lighting as the full precision mesh
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, GL_MODULATE);
+    glTexEnvf(GL_TEXTURE_ENV, GL_RGB_SCALE, 2.0f);
+    glColor3f(0.5f, 0.5f, 0.5f);
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    GLfloat lutRange = mesh->lutMax - mesh->lutMin;
+    for (int p = 0; p < mesh->patchesX * mesh->patchesZ; p++) {
+        CompactPatch* patch = &mesh->patches[p];
+        size_t base = sizeof(CompactVertex) * patch->firstVertex;
+        glVertexPointer(3, GL_SHORT, sizeof(CompactVertex), BUFFER_OFFSET(base + offsetof(CompactVertex, x)));
+        glNormalPointer(GL_BYTE, sizeof(CompactVertex), BUFFER_OFFSET(base + offsetof(CompactVertex, nx)));
+        glTexCoordPointer(2, GL_SHORT, sizeof(CompactVertex), BUFFER_OFFSET(base + offsetof(CompactVertex, y)));
+
+        // Texture coordinate s picks the lookup entry for the height, t picks the middle
+        // of the row so rows never blend
+        glMatrixMode(GL_TEXTURE);
+        glLoadIdentity();
+        glTranslatef((0.5f + (COLOUR_LUT_SIZE - 1) * (patch->bias - mesh->lutMin) / lutRange) / COLOUR_LUT_SIZE,
+                     0.5f / (2 * SHADE_LEVELS), 0.0f);
+        glScalef((COLOUR_LUT_SIZE - 1) * patch->scale / (lutRange * COLOUR_LUT_SIZE), 1.0f / (2 * SHADE_LEVELS), 1.0f);
+
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glTranslatef(patch->x0, patch->bias, patch->z0);
+        glScalef(patch->scale, patch->scale, patch->scale);
+        glMultMatrixf(swapYZ);
+        glDrawElements(GL_TRIANGLES, patch->numIndices, GL_UNSIGNED_SHORT,
+                       BUFFER_OFFSET(sizeof(GLushort) * patch->firstIndex));
+        glPopMatrix();
+    }
+
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glMatrixMode(GL_MODELVIEW);
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glTexEnvf(GL_TEXTURE_ENV, GL_RGB_SCALE, 1.0f);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glDisable(GL_NORMALIZE);
+    glDisable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void freeCompactMesh(CompactMesh* mesh) {
+    if (mesh->vertexBuffer != 0) {
+        glDeleteBuffers(1, &mesh->vertexBuffer);
+        glDeleteBuffers(1, &mesh->indexBuffer);
+        glDeleteTextures(1, &mesh->lutTexture);
+    }
+    free(mesh->vertices);
+    free(mesh->indices);
+    free(mesh->patches);
+    free(mesh);
+}
+
+// Returns the smallest power of 2 at least the size
+static int powerOfTwo(int size) {
+    int power = 1;
+    while (power < size) power *= 2;
+    return power;
+}
+
+// Returns the grid position of the coarse vertex along a side, the last vertex being
+// moved in to the far edge
+static int coarseGrid(int index, int step, int size) {
+    return (index * step < size - 1) ? index * step : size - 1;
+}
+
+// Creates the mesh and builds the index array which never changes
+CoarseMesh* createCoarseMesh(int xSize, int zSize, int step) {
+    CoarseMesh* mesh = calloc(1, sizeof(CoarseMesh));
+    if (mesh == NULL) {
+        fprintf(stderr, "Allocation of coarse mesh failed.\n");
+        return NULL;
+    }
+    mesh->xSize = xSize;
+    mesh->zSize = zSize;
+    mesh->step = step;
+    mesh->xCount = (xSize - 2) / step + 2;
+    mesh->zCount = (zSize - 2) / step + 2;
+    mesh->numVertices = mesh->xCount * mesh->zCount;
+    mesh->numIndices = (mesh->xCount - 1) * (mesh->zCount - 1) * 6;
+    mesh->mapWidth = powerOfTwo(xSize);
+    mesh->mapHeight = powerOfTwo(zSize);
+    mesh->vertices = malloc(sizeof(CoarseVertex) * mesh->numVertices);
+    mesh->indices = malloc(sizeof(GLuint) * mesh->numIndices);
+    mesh->normalMap = malloc((size_t) xSize * zSize * 3);
+    if (mesh->vertices == NULL || mesh->indices == NULL || mesh->normalMap == NULL) {
+        fprintf(stderr, "Allocation of coarse mesh vertices failed.\n");
+        free(mesh->vertices);
+        free(mesh->indices);
+        free(mesh->normalMap);
+        free(mesh);
+        return NULL;
+    }
+
+    // Same triangles as TerrainMesh over the coarse grid
+    int index = 0;
+    for (int z = 0; z < mesh->zCount - 1; ++z) {
+        for (int x = 0; x < mesh->xCount - 1; ++x) {
+            int topLeft = z * mesh->xCount + x;
+            int topRight = topLeft + 1;
+            int bottomLeft = topLeft + mesh->xCount;
+            int bottomRight = bottomLeft + 1;
+
+            mesh->indices[index++] = topLeft;
+            mesh->indices[index++] = bottomLeft;
+            mesh->indices[index++] = topRight;
+
+            mesh->indices[index++] = topRight;
+            mesh->indices[index++] = bottomLeft;
+            mesh->indices[index++] = bottomRight;
+        }
+    }
+    return mesh;
+}
+
+// Returns a normal component mapped to an unsigned byte, as DOT3 combining expects
+static GLubyte mapNormal(GLfloat component) {
+    return (GLubyte) (fmaxf(0.0f, fminf(1.0f, component * 0.5f + 0.5f)) * 255.0f + 0.5f);
+}
+
+// Finds the coarse vertices along a side whose grid positions are inside [begin, end),
+// returning whether there are any. The last vertex sits at the far edge rather than at
+// a multiple of step.
+static bool coarseRange(int begin, int end, int step, int count, int size, int* first, int* last) {
+    *first = (begin + step - 1) / step;
+    if (*first > count - 1) *first = count - 1;
+    *last = (end == size) ? count - 1 : (end - 1) / step;
+    return *first <= *last;
+}
+
+void updateCoarseMesh(CoarseMesh* mesh, Terrain* terrain, colourFunction colour, const ColourParams* params) {
+    TerrainRect dirty = takeTerrainDirty(terrain);
+    if (dirty.x0 >= dirty.x1 || dirty.z0 >= dirty.z1) return;
+
+    for (int z = dirty.z0; z < dirty.z1; z++) {
+        for (int x = dirty.x0; x < dirty.x1; x++) {
+            Vector3 normal = terrain->normals[x][z];
+            GLubyte* texel = &mesh->normalMap[((size_t) z * mesh->xSize + x) * 3];
+            texel[0] = mapNormal(normal.x);
+            texel[1] = mapNormal(normal.y);
+            texel[2] = mapNormal(normal.z);
+        }
+    }
+
+    int x0, x1, z0, z1;
+    bool vertices = coarseRange(dirty.x0, dirty.x1, mesh->step, mesh->xCount, mesh->xSize, &x0, &x1)
+                 && coarseRange(dirty.z0, dirty.z1, mesh->step, mesh->zCount, mesh->zSize, &z0, &z1);
+    for (int j = z0; vertices && j <= z1; j++) {
+        for (int i = x0; i <= x1; i++) {
+            int x = coarseGrid(i, mesh->step, mesh->xSize);
+            int z = coarseGrid(j, mesh->step, mesh->zSize);
+            CoarseVertex* vertex = &mesh->vertices[j * mesh->xCount + i];
+            vertex->position = (Vector3){x, terrain->heights[x][z], z};
+            vertex->colour = colour(params, x, vertex->position.y, z);
+            if (terrain->shading != NULL) {
+                GLfloat shade = terrain->shading[x * terrain->zSize + z] / 255.0f;
+                vertex->colour = (Vector3){vertex->colour.x * shade, vertex->colour.y * shade, vertex->colour.z * shade};
+            }
+        }
+    }
+    if (mesh->vertexBuffer == 0) return;
+
+    glBindTexture(GL_TEXTURE_2D, mesh->normalTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, dirty.z0, mesh->xSize, dirty.z1 - dirty.z0, GL_RGB, GL_UNSIGNED_BYTE,
+                    &mesh->normalMap[(size_t) dirty.z0 * mesh->xSize * 3]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    if (!vertices) return;
+
+    int first = z0 * mesh->xCount;
+    int count = (z1 - z0 + 1) * mesh->xCount;
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(CoarseVertex) * first, sizeof(CoarseVertex) * count,
+                    &mesh->vertices[first]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+Vector3 coarseMapNormal(const CoarseMesh* mesh, int x, int z) {
+    const GLubyte* texel = &mesh->normalMap[((size_t) z * mesh->xSize + x) * 3];
+    return (Vector3){texel[0] / 127.5f - 1.0f, texel[1] / 127.5f - 1.0f, texel[2] / 127.5f - 1.0f};
+}
+
+// Uploads every vertex and index into buffer objects, and the normal map into the
+// corner of a texture with sides a power of 2
+static void createCoarseBuffers(CoarseMesh* mesh) {
+    glGenBuffers(1, &mesh->vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(CoarseVertex) * mesh->numVertices, mesh->vertices, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &mesh->indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * mesh->numIndices, mesh->indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glGenTextures(1, &mesh->normalTexture);
+    glBindTexture(GL_TEXTURE_2D, mesh->normalTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, mesh->mapWidth, mesh->mapHeight, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, mesh->xSize, mesh->zSize, GL_RGB, GL_UNSIGNED_BYTE, mesh->normalMap);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Sets the texture unit to combine two sources with the operation
+static void combineStage(GLenum unit, GLuint texture, GLenum operation, GLenum source0, GLenum source1) {
+    glActiveTexture(unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_COMBINE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_COMBINE_RGB, operation);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_RGB, source0);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE1_RGB, source1);
+}
+
+// Puts the texture unit back to the default OpenGL state
+static void resetStage(GLenum unit) {
+    glActiveTexture(unit);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE0_RGB, GL_TEXTURE);
+    glTexEnvi(GL_TEXTURE_ENV, GL_SOURCE1_RGB, GL_PREVIOUS);
+    glDisable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+// Fixed function lighting is replaced by the texture units: the first takes the dot
+// product of the normal map with the light, the second adds the scene's ambient light
+// and the third multiplies in the vertex colour. The light is moved into terrain space
+// as that is the space of the normals.
+void drawCoarseMesh(CoarseMesh* mesh) {
+    if (mesh->vertexBuffer == 0) {
+        createCoarseBuffers(mesh);
+    }
+
+    // GL_LIGHT0's position is kept in eye space, and the view only rotates and moves
+    // so its transpose turns the direction back
+    GLfloat modelview[16], position[4], ambient[4];
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+    glGetLightfv(GL_LIGHT0, GL_POSITION, position);
+    glGetFloatv(GL_LIGHT_MODEL_AMBIENT, ambient);
+    Vector3 light = normalise_3((Vector3){
+        modelview[0] * position[0] + modelview[1] * position[1] + modelview[2] * position[2],
+        modelview[4] * position[0] + modelview[5] * position[1] + modelview[6] * position[2],
+        modelview[8] * position[0] + modelview[9] * position[1] + modelview[10] * position[2]
+    });
+    GLfloat mappedLight[4] = {light.x * 0.5f + 0.5f, light.y * 0.5f + 0.5f, light.z * 0.5f + 0.5f, 1.0f};
+    GLint units;
+    glGetIntegerv(GL_MAX_TEXTURE_UNITS, &units);
+
+    // The texture coordinates are the grid position, at the centres of the texels
+    GLfloat sPlane[4] = {1.0f / mesh->mapWidth, 0.0f, 0.0f, 0.5f / mesh->mapWidth};
+    GLfloat tPlane[4] = {0.0f, 0.0f, 1.0f / mesh->mapHeight, 0.5f / mesh->mapHeight};
+
+    glDisable(GL_LIGHTING);
+    combineStage(GL_TEXTURE0, mesh->normalTexture, GL_DOT3_RGB, GL_TEXTURE, GL_CONSTANT);
+    glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, mappedLight);
+    glTexGeni(GL_S, GL_TEXTURE_GEN_MODE, GL_OBJECT_LINEAR);
+    glTexGeni(GL_T, GL_TEXTURE_GEN_MODE, GL_OBJECT_LINEAR);
+    glTexGenfv(GL_S, GL_OBJECT_PLANE, sPlane);
+    glTexGenfv(GL_T, GL_OBJECT_PLANE, tPlane);
+    glEnable(GL_TEXTURE_GEN_S);
+    glEnable(GL_TEXTURE_GEN_T);
+    // The later units ignore their texture, but it has to be enabled for them to run
+    if (units >= 3) {
+        combineStage(GL_TEXTURE1, mesh->normalTexture, GL_ADD, GL_PREVIOUS, GL_CONSTANT);
+        glTexEnvfv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_COLOR, ambient);
+        combineStage(GL_TEXTURE2, mesh->normalTexture, GL_MODULATE, GL_PREVIOUS, GL_PRIMARY_COLOR);
+    } else {
+        combineStage(GL_TEXTURE1, mesh->normalTexture, GL_MODULATE, GL_PREVIOUS, GL_PRIMARY_COLOR);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, mesh->vertexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh->indexBuffer);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(3, GL_FLOAT, sizeof(CoarseVertex), BUFFER_OFFSET(offsetof(CoarseVertex, position)));
+    glColorPointer(3, GL_FLOAT, sizeof(CoarseVertex), BUFFER_OFFSET(offsetof(CoarseVertex, colour)));
+
+    glDrawElements(GL_TRIANGLES, mesh->numIndices, GL_UNSIGNED_INT, BUFFER_OFFSET(0));
+
+    glDisableClientState(GL_VERTEX_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    if (units >= 3) {
+        resetStage(GL_TEXTURE2);
+    }
+    resetStage(GL_TEXTURE1);
+    resetStage(GL_TEXTURE0);
+    glDisable(GL_TEXTURE_GEN_S);
+    glDisable(GL_TEXTURE_GEN_T);
+    glEnable(GL_LIGHTING);
+}
+
+void freeCoarseMesh(CoarseMesh* mesh) {
+    if (mesh->vertexBuffer != 0) {
+        glDeleteBuffers(1, &mesh->vertexBuffer);
+        glDeleteBuffers(1, &mesh->indexBuffer);
+        glDeleteTextures(1, &mesh->normalTexture);
+    }
+    free(mesh->vertices);
+    free(mesh->indices);
+    free(mesh->normalMap);
+    free(mesh);
+}
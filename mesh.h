@@ -0,0 +1,159 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <stdbool.h>
+#include "structures.h"
+#include "terrain.h"
+
+// The data sent to OpenGL for every point of the terrain
+typedef struct {
+    Vector3 position;
+    Vector3 normal;
+    Vector3 colour;
+} TerrainVertex;
+
+// The renderer's copy of a terrain, kept in buffer objects between frames.
+// Vertices are stored row by row in z, so any range of rows is one contiguous block.
+typedef struct {
+    int xSize, zSize;
+    int numVertices, numIndices;
+    TerrainVertex* vertices;
+    GLuint* indices;
+    GLuint vertexBuffer, indexBuffer; // 0 until the mesh is first drawn
+} TerrainMesh;
+
+// Creates a mesh for terrains of the given size along with its triangle indices.
+// No OpenGL calls are made until the mesh is drawn.
+extern TerrainMesh* createTerrainMesh(int xSize, int zSize);
+
+// Takes the terrain's dirty rectangle and refills only those vertices, then uploads
+// the rows they are in. Does nothing if the terrain has not changed.
+extern void updateTerrainMesh(TerrainMesh*, Terrain*, colourFunction, const ColourParams*);
+
+// Refills every vertex from the grid point under it and uploads them all, keeping the
+// triangles. For meshes of only some points, such as adaptive ones, when new shading or
+// heights have not moved any splits.
+extern void refreshTerrainMesh(TerrainMesh*, Terrain*, colourFunction, const ColourParams*);
+
+// Fills the vertices of the mesh inside rect from the terrain, without uploading them.
+// Colours are multiplied by the terrain's baked shading if it has any.
+extern void fillTerrainVertices(TerrainMesh*, Terrain*, colourFunction, const ColourParams*, TerrainRect);
+
+// Returns the vertex of one grid point, coloured as fillTerrainVertices does
+extern TerrainVertex terrainVertex(Terrain*, colourFunction, const ColourParams*, int x, int z);
+
+// Draws the whole mesh with one call, creating its buffers the first time
+extern void drawTerrainMesh(TerrainMesh*);
+
+// Frees the buffers and vertex data
+extern void freeTerrainMesh(TerrainMesh*);
+
+// Grid cells along each side of a compact mesh patch
+#define PATCH_SIZE 64
+// Height entries in the colour lookup table of a compact mesh
+#define COLOUR_LUT_SIZE 256
+// Levels of baked shading the compact mesh's lookup table has a row for
+#define SHADE_LEVELS 16
+
+// A compact vertex is 12 bytes instead of 36.
+// The position is stored as (x, z, y) so that (y, variant) can be read as the texture
+// coordinate into the colour lookup table, the patch's matrix swaps y and z back.
+// x and z are relative to the patch and all three are multiplied by the patch's scale.
+typedef struct {
+    GLshort x, z, y;
+    GLshort variant;      // Row of the colour lookup table: 1 inside a biome, times
+                          // SHADE_LEVELS, plus the level of baked shading
+    GLbyte nx, nz, ny, pad; // Normal with each component scaled to [-127, 127]
+} CompactVertex;
+
+// A square of the terrain whose vertices share one position offset and scale
+typedef struct {
+    int x0, z0;           // Grid position of the first vertex
+    int xCount, zCount;   // Vertices along each side, at most PATCH_SIZE + 1
+    GLfloat bias;         // Height a stored y of 0 represents
+    GLfloat scale;        // World units per stored unit, a power of 2 so x and z are exact
+    int firstVertex;
+    int firstIndex, numIndices;
+} CompactPatch;
+
+// A terrain mesh quantised into patches: 16-bit positions, 8-bit normals and colour
+// from a lookup table by height, using around a third of the memory of TerrainMesh
+typedef struct {
+    int xSize, zSize;
+    int patchesX, patchesZ;
+    CompactPatch* patches;
+    int numVertices, numIndices;
+    CompactVertex* vertices;
+    GLushort* indices; // Relative to the first vertex of each patch
+
+    // Colours for heights from lutMin to lutMax, with a row for each level of shading
+    // outside the variant map then the same inside it
+    GLfloat lutMin, lutMax;
+    GLubyte lut[2 * SHADE_LEVELS][COLOUR_LUT_SIZE][3];
+    bool lutChanged;
+
+    GLuint vertexBuffer, indexBuffer, lutTexture; // 0 until the mesh is first drawn
+} CompactMesh;
+
+// Creates a compact mesh for terrains of the given size.
+// No OpenGL calls are made until the mesh is drawn.
+extern CompactMesh* createCompactMesh(int xSize, int zSize);
+
+// Takes the terrain's dirty rectangle and requantises every patch it touches, then
+// uploads them. Points inside the parameters' biome map use the second half of the
+// lookup table, and the terrain's baked shading picks the row within each half. The
+// colour function may only depend on the height and whether the point is in a biome.
+extern void updateCompactMesh(CompactMesh*, Terrain*, colourFunction, const ColourParams*);
+
+// Returns the vertex as it will be drawn, after dequantisation and the colour lookup
+extern TerrainVertex decodeCompactVertex(const CompactMesh*, const CompactPatch*, int index);
+
+// Draws the mesh with one call per patch, creating its buffers the first time
+extern void drawCompactMesh(CompactMesh*);
+
+// Frees the buffers, texture and vertex data
+extern void freeCompactMesh(CompactMesh*);
+
+// A vertex of a coarse mesh, which has no normal as it is lit from the normal map
+typedef struct {
+    Vector3 position;
+    Vector3 colour;
+} CoarseVertex;
+
+// A decimated terrain mesh with a vertex every step grid points, and the terrain's
+// normal at every grid point in a texture. The lighting is worked out per pixel from
+// the texture (DOT3 texture combining), so it keeps the detail of the full mesh with
+// step * step times fewer triangles. Colours and baked shading are only taken at the
+// vertices.
+typedef struct {
+    int xSize, zSize;     // Of the terrain
+    int step;
+    int xCount, zCount;   // Vertices along each side, the last at the terrain's far edge
+    int numVertices, numIndices;
+    CoarseVertex* vertices; // Row by row in z
+    GLuint* indices;
+    GLubyte* normalMap;   // RGB of every grid point row by row in z, each component mapped from [-1, 1] to [0, 255]
+    int mapWidth, mapHeight; // Of the texture, the powers of 2 holding the normal map
+
+    GLuint vertexBuffer, indexBuffer, normalTexture; // 0 until the mesh is first drawn
+} CoarseMesh;
+
+// Creates a coarse mesh for terrains of the given size with a vertex every step points.
+// No OpenGL calls are made until the mesh is drawn.
+extern CoarseMesh* createCoarseMesh(int xSize, int zSize, int step);
+
+// Takes the terrain's dirty rectangle, refills the normal map and the vertices inside it
+// and uploads the rows they are in. Does nothing if the terrain has not changed.
+extern void updateCoarseMesh(CoarseMesh*, Terrain*, colourFunction, const ColourParams*);
+
+// Returns the normal the normal map holds at a grid point, before filtering
+extern Vector3 coarseMapNormal(const CoarseMesh*, int x, int z);
+
+// Draws the mesh with one call, lit per pixel by GL_LIGHT0 against the normal map.
+// Needs three texture units, with fewer the ambient light is left out.
+extern void drawCoarseMesh(CoarseMesh*);
+
+// Frees the buffers, texture and vertex data
+extern void freeCoarseMesh(CoarseMesh*);
+
+#endif
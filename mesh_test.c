@@ -0,0 +1,139 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "mesh.h"
+#include "terrain.h"
+#include "structures.h"
+#include "testing.h"
+
+#define X_SIZE 150
+#define Z_SIZE 100
+#define HEIGHT 30
+#define COLOUR_EPSILON 0.02
+#define NORMAL_DOT 0.999
+#define COARSE_STEP 4
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+// Shades by height, in a different hue inside the variant map like the biomes mode
+static Vector3 shade(const ColourParams* params, GLfloat x, GLfloat y, GLfloat z) {
+    GLfloat t = fmaxf(0.0f, fminf(1.0f, (y + params->height) / (2 * params->height)));
+    if (params->biomeMap[(int) x][(int) z] > 0) {
+        return (Vector3){0.2f, t, 0.3f};
+    }
+    return (Vector3){t, t, 1 - t};
+}
+
+int main(void) {
+    printf("Testing Compact Mesh: \n");
+    Terrain* terrain = createTerrain(X_SIZE, Z_SIZE, HEIGHT);
+    populateTerrain(terrain, test_hills, NULL);
+    GLfloat** variants = malloc(sizeof(GLfloat*) * X_SIZE);
+    for (int x = 0; x < X_SIZE; x++) {
+        variants[x] = malloc(sizeof(GLfloat) * Z_SIZE);
+        for (int z = 0; z < Z_SIZE; z++) {
+            variants[x][z] = (x > X_SIZE / 2) ? 1.0f : 0.0f;
+        }
+    }
+
+    ColourParams params = {HEIGHT, variants};
+
+    TerrainMesh* full = createTerrainMesh(X_SIZE, Z_SIZE);
+    fillTerrainVertices(full, terrain, shade, &params, (TerrainRect){0, 0, X_SIZE, Z_SIZE});
+    CompactMesh* compact = createCompactMesh(X_SIZE, Z_SIZE);
+    updateCompactMesh(compact, terrain, shade, &params);
+
+    size_t fullBytes = sizeof(TerrainVertex) * full->numVertices + sizeof(GLuint) * full->numIndices;
+    size_t compactBytes = sizeof(CompactVertex) * compact->numVertices + sizeof(GLushort) * compact->numIndices;
+    assert_test(sizeof(CompactVertex) == 12, "Compact vertex is 12 bytes.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(compactBytes * 2 < fullBytes, "Compact mesh uses under half the memory.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Every grid point is covered by at least one patch, and decodes close to the full vertex
+    bool covered = true, positions = true, normals = true, colours = true;
+    int* seen = calloc(X_SIZE * Z_SIZE, sizeof(int));
+    for (int p = 0; p < compact->patchesX * compact->patchesZ; p++) {
+        CompactPatch* patch = &compact->patches[p];
+        for (int z = 0; z < patch->zCount; z++) {
+            for (int x = 0; x < patch->xCount; x++) {
+                int gridX = patch->x0 + x;
+                int gridZ = patch->z0 + z;
+                seen[gridZ * X_SIZE + gridX]++;
+                TerrainVertex expected = full->vertices[gridZ * X_SIZE + gridX];
+                TerrainVertex actual = decodeCompactVertex(compact, patch, z * patch->xCount + x);
+
+                positions = positions && actual.position.x == expected.position.x
+                    && actual.position.z == expected.position.z
+                    && fabsf(actual.position.y - expected.position.y) <= patch->scale;
+                normals = normals && dot_product_3(actual.normal, expected.normal) >= NORMAL_DOT;
+                colours = colours && fabsf(actual.colour.x - expected.colour.x) <= COLOUR_EPSILON
+                    && fabsf(actual.colour.y - expected.colour.y) <= COLOUR_EPSILON
+                    && fabsf(actual.colour.z - expected.colour.z) <= COLOUR_EPSILON;
+            }
+        }
+    }
+    for (int i = 0; i < X_SIZE * Z_SIZE; i++) {
+        covered = covered && seen[i] > 0;
+    }
+    assert_test(covered, "Patches cover the terrain.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(positions, "Positions within one step.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(normals, "Normals within quantisation error.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(colours, "Colours match through the lookup table.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Raising ground past the lookup table's range rebuilds it
+    GLfloat oldMax = compact->lutMax;
+    stampTerrain(terrain, 20.0f, 20.0f, 5.0f, 4 * HEIGHT);
+    updateCompactMesh(compact, terrain, shade, &params);
+    CompactPatch* first = &compact->patches[0];
+    TerrainVertex raised = decodeCompactVertex(compact, first, 20 * first->xCount + 20);
+    assert_test(compact->lutMax > oldMax, "Lookup table grows with the terrain.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(fabsf(raised.position.y - terrain->heights[20][20]) <= first->scale,
+                "Edited patch requantised.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // The coarse mesh has a vertex every step points up to the far edges, and a normal
+    // map of every point
+    CoarseMesh* coarse = createCoarseMesh(X_SIZE, Z_SIZE, COARSE_STEP);
+    markTerrainDirty(terrain, (TerrainRect){0, 0, X_SIZE, Z_SIZE});
+    updateCoarseMesh(coarse, terrain, shade, &params);
+    CoarseVertex* last = &coarse->vertices[coarse->numVertices - 1];
+    assert_test(coarse->numIndices * 10 < full->numIndices
+                && last->position.x == X_SIZE - 1 && last->position.z == Z_SIZE - 1,
+                "Coarse mesh spans the terrain with fewer triangles.", TEST_OK_OUT, TEST_FAIL_OUT);
+    bool coarseVertices = true, mapped = true;
+    for (int i = 0; i < coarse->numVertices; i++) {
+        CoarseVertex* v = &coarse->vertices[i];
+        int x = (int) v->position.x, z = (int) v->position.z;
+        Vector3 expected = shade(&params, x, terrain->heights[x][z], z);
+        int column = i % coarse->xCount;
+        coarseVertices = coarseVertices && v->position.y == terrain->heights[x][z]
+            && (column == coarse->xCount - 1 || x == column * COARSE_STEP)
+            && v->colour.x == expected.x && v->colour.y == expected.y && v->colour.z == expected.z;
+    }
+    for (int x = 0; x < X_SIZE; x++) {
+        for (int z = 0; z < Z_SIZE; z++) {
+            mapped = mapped && dot_product_3(coarseMapNormal(coarse, x, z), terrain->normals[x][z]) >= 0.99f;
+        }
+    }
+    assert_test(coarseVertices, "Coarse vertices match the full mesh.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(mapped, "Normal map holds every normal.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // An edit refills the normal map and the coarse vertices it covers
+    stampTerrain(terrain, 100.0f, 60.0f, 6.0f, 10.0f);
+    updateCoarseMesh(coarse, terrain, shade, &params);
+    CoarseVertex* edited = &coarse->vertices[(60 / COARSE_STEP) * coarse->xCount + 100 / COARSE_STEP];
+    assert_test(edited->position.y == terrain->heights[100][60]
+                && dot_product_3(coarseMapNormal(coarse, 103, 62), terrain->normals[103][62]) >= 0.99f,
+                "Edited coarse mesh refilled.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    free(seen);
+    for (int x = 0; x < X_SIZE; x++) {
+        free(variants[x]);
+    }
+    free(variants);
+    freeTerrainMesh(full);
+    freeCompactMesh(compact);
+    freeCoarseMesh(coarse);
+    freeTerrain(terrain);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,165 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "morph.h"
+#include "parallel.h"
+
+typedef enum {
+    MORPH_IDLE,
+    MORPH_GENERATING, // Waiting for the target terrain's thread
+    MORPH_BLENDING,   // Between copies of the heights and normals
+    MORPH_ANIMATING   // Between times through the 3D noise
+} MorphPhase;
+
+struct Morph {
+    MorphPhase phase;
+    double duration;
+    double start;            // Of the blend or animation
+    Terrain* from;           // Copied when the blend starts
+    Terrain* to;
+    GLfloat fromTime, toTime;
+
+    Generator* generator;    // Only used by the thread while generating
+    pthread_t thread;
+    bool threaded;           // Whether the thread was started, so has to be joined
+    atomic_bool generated;
+};
+
+Morph* createMorph(double duration) {
+    Morph* morph = calloc(1, sizeof(Morph));
+    assert(morph != NULL);
+    morph->phase = MORPH_IDLE;
+    morph->duration = duration;
+    atomic_init(&morph->generated, false);
+    return morph;
+}
+
+bool morphActive(const Morph* morph) {
+    return morph->phase != MORPH_IDLE;
+}
+
+static void* generateTarget(void* context) {
+    Morph* morph = context;
+    generateTerrain(morph->generator, morph->to);
+    atomic_store(&morph->generated, true);
+    return NULL;
+}
+
+void startMorph(Morph* morph, Terrain* terrain, Generator* generator, double now) {
+    if (morph->phase != MORPH_IDLE) return;
+    reseedGenerator(generator, hash_seed(generator->seed, 1));
+    morph->generator = generator;
+    morph->to = createTerrain(terrain->xSize, terrain->zSize, terrain->height);
+    // The target gets biomes of its own, so the mask morphs along with the heights
+    if (terrain->biomes != NULL) addTerrainBiomes(morph->to);
+    morph->phase = MORPH_GENERATING;
+    morph->start = now;
+    atomic_store(&morph->generated, false);
+    // Generates in place if no thread can be started
+    morph->threaded = pthread_create(&morph->thread, NULL, generateTarget, morph) == 0;
+    if (!morph->threaded) {
+        generateTarget(morph);
+    }
+}
+
+void startAnimatedMorph(Morph* morph, GLfloat fromTime, GLfloat toTime, double now) {
+    if (morph->phase != MORPH_IDLE) return;
+    morph->phase = MORPH_ANIMATING;
+    morph->fromTime = fromTime;
+    morph->toTime = toTime;
+    morph->start = now;
+}
+
+// Copies the heights, normals and biomes of one terrain to another of the same size
+static void copyTerrain(Terrain* to, Terrain* from) {
+    for (int x = 0; x < from->xSize; x++) {
+        memcpy(to->heights[x], from->heights[x], sizeof(GLfloat) * from->zSize);
+        memcpy(to->normals[x], from->normals[x], sizeof(Vector3) * from->zSize);
+    }
+    if (to->biomes != NULL && from->biomes != NULL) {
+        memcpy(to->biomes[0], from->biomes[0], sizeof(GLfloat) * from->xSize * from->zSize);
+    }
+}
+
+typedef struct {
+    Morph* morph;
+    Terrain* terrain;
+    GLfloat t;
+} BlendJob;
+
+static void blendRows(void* context, int begin, int end) {
+    BlendJob* job = context;
+    Terrain* from = job->morph->from;
+    Terrain* to = job->morph->to;
+    GLfloat t = job->t;
+    for (int x = begin; x < end; x++) {
+        for (int z = 0; z < job->terrain->zSize; z++) {
+            job->terrain->heights[x][z] = from->heights[x][z] + t * (to->heights[x][z] - from->heights[x][z]);
+            Vector3 a = from->normals[x][z], b = to->normals[x][z];
+            job->terrain->normals[x][z] = (Vector3){
+                a.x + t * (b.x - a.x), a.y + t * (b.y - a.y), a.z + t * (b.z - a.z)
+            };
+        }
+        normalise_3_n(job->terrain->normals[x], job->terrain->zSize);
+        if (job->terrain->biomes == NULL) continue;
+        for (int z = 0; z < job->terrain->zSize; z++) {
+            job->terrain->biomes[x][z] = from->biomes[x][z] + t * (to->biomes[x][z] - from->biomes[x][z]);
+        }
+    }
+}
+
+// Joins the generation thread and frees both copies, leaving the morph idle
+static void endMorph(Morph* morph) {
+    if (morph->phase == MORPH_GENERATING && morph->threaded) {
+        pthread_join(morph->thread, NULL);
+    }
+    if (morph->from != NULL) freeTerrain(morph->from);
+    if (morph->to != NULL) freeTerrain(morph->to);
+    morph->from = NULL;
+    morph->to = NULL;
+    morph->phase = MORPH_IDLE;
+}
+
+bool advanceMorph(Morph* morph, Terrain* terrain, Generator* generator, double now) {
+    if (morph->phase == MORPH_GENERATING) {
+        if (!atomic_load(&morph->generated)) return true;
+        if (morph->threaded) {
+            pthread_join(morph->thread, NULL);
+        }
+        // The blend starts now, from the terrain as it is after any edits meanwhile
+        morph->from = createTerrain(terrain->xSize, terrain->zSize, terrain->height);
+        if (terrain->biomes != NULL) addTerrainBiomes(morph->from);
+        copyTerrain(morph->from, terrain);
+        morph->phase = MORPH_BLENDING;
+        morph->start = now;
+    }
+    if (morph->phase == MORPH_IDLE) return false;
+
+    double t = (morph->duration > 0) ? (now - morph->start) / morph->duration : 1.0;
+    if (t < 0) t = 0;
+    bool done = t >= 1;
+    if (done) t = 1;
+
+    if (morph->phase == MORPH_ANIMATING) {
+        animateTerrain(generator, terrain, morph->fromTime + (GLfloat) t * (morph->toTime - morph->fromTime));
+        if (done) morph->phase = MORPH_IDLE;
+        return !done;
+    }
+
+    if (done) {
+        copyTerrain(terrain, morph->to);
+    } else {
+        BlendJob job = {morph, terrain, (GLfloat) t};
+        parallel_for(terrain->xSize, blendRows, &job);
+    }
+    markTerrainDirty(terrain, (TerrainRect){0, 0, terrain->xSize, terrain->zSize});
+    if (done) endMorph(morph);
+    return !done;
+}
+
+void freeMorph(Morph* morph) {
+    endMorph(morph);
+    free(morph);
+}
@@ -0,0 +1,33 @@
+#ifndef MORPH_H
+#define MORPH_H
+
+#include <stdbool.h>
+#include "terrain.h"
+#include "generator.h"
+
+// A morph of the terrain towards a new one, advanced by the main loop every frame by the
+// time that has passed rather than by frames, so it takes the same time at any frame rate
+typedef struct Morph Morph;
+
+// Creates an idle morph whose blends take the given number of seconds
+extern Morph* createMorph(double duration);
+
+// Returns whether a morph is generating or blending
+extern bool morphActive(const Morph*);
+
+// Reseeds the generator and starts generating a terrain the size of this one to morph to
+// on its own thread. The blend starts from the terrain as it is when that is done.
+extern void startMorph(Morph*, Terrain*, Generator*, double now);
+
+// Starts moving an animated terrain through the 3D noise from one time to another
+extern void startAnimatedMorph(Morph*, GLfloat fromTime, GLfloat toTime, double now);
+
+// Sets the terrain to where the morph is at the time now, with one blend of the heights,
+// normals and any biomes (or one slice of the noise) on all threads whatever the time since the
+// last call. Returns whether the morph is still going, it ends exactly at its target.
+extern bool advanceMorph(Morph*, Terrain*, Generator*, double now);
+
+// Waits for any generation, then frees the morph without finishing it
+extern void freeMorph(Morph*);
+
+#endif
@@ -0,0 +1,98 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "morph.h"
+#include "generator.h"
+#include "terrain.h"
+#include "testing.h"
+
+#define SIZE 64
+#define HEIGHT 30
+#define DURATION 2.0
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+// Returns whether every height is within epsilon of the expected one
+static bool heights_match(Terrain* terrain, Terrain* expected, GLfloat epsilon) {
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) {
+            if (fabsf(terrain->heights[x][z] - expected->heights[x][z]) > epsilon) return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    printf("Testing Morph: \n");
+    Generator* generator = createGenerator(SIZE, SIZE, HEIGHT, 1, NOISE_CLASSIC, 0, 5);
+    Generator* reference = createGenerator(SIZE, SIZE, HEIGHT, 1, NOISE_CLASSIC, 0, 5);
+    Terrain* terrain = createTerrain(SIZE, SIZE, HEIGHT);
+    Terrain* from = createTerrain(SIZE, SIZE, HEIGHT);
+    Terrain* to = createTerrain(SIZE, SIZE, HEIGHT);
+    generateTerrain(generator, terrain);
+    generateTerrain(reference, from);
+    reseedGenerator(reference, hash_seed(reference->seed, 1));
+    generateTerrain(reference, to);
+
+    // The target is generated in the background, then the blend starts when it is
+    // first picked up, however late that is
+    Morph* morph = createMorph(DURATION);
+    assert_test(!morphActive(morph) && !advanceMorph(morph, terrain, generator, 0.0), "New morph is idle.", TEST_OK_OUT, TEST_FAIL_OUT);
+    startMorph(morph, terrain, generator, 0.0);
+    bool active = morphActive(morph);
+    unsigned long version = terrain->version;
+    while (advanceMorph(morph, terrain, generator, 10.0) && terrain->version == version) {}
+    assert_test(active && heights_match(terrain, from, 0.0f), "Blend starts from the terrain.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Blends by the time passed, not the calls made
+    advanceMorph(morph, terrain, generator, 10.5);
+    advanceMorph(morph, terrain, generator, 11.0);
+    bool halfway = true;
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) {
+            GLfloat expected = (from->heights[x][z] + to->heights[x][z]) / 2;
+            halfway = halfway && fabsf(terrain->heights[x][z] - expected) < 1e-4f;
+        }
+    }
+    assert_test(halfway, "Halfway through the time is halfway between.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(!advanceMorph(morph, terrain, generator, 20.0) && !morphActive(morph) && heights_match(terrain, to, 0.0f),
+                "Morph ends exactly at the new terrain.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Animated morphs move through the noise by time too
+    startAnimatedMorph(morph, 0.0f, 1.0f, 0.0);
+    advanceMorph(morph, terrain, generator, 0.5);
+    animateTerrain(reference, from, 0.25f);
+    bool matching = heights_match(terrain, from, 0.0f);
+    advanceMorph(morph, terrain, generator, 3.0);
+    animateTerrain(reference, from, 1.0f);
+    assert_test(matching && heights_match(terrain, from, 0.0f) && !morphActive(morph),
+                "Animated morph follows the time.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // A terrain's biome mask ends at the new terrain's along with the heights
+    addTerrainBiomes(terrain);
+    addTerrainBiomes(to);
+    generateTerrain(generator, terrain);
+    reseedGenerator(reference, hash_seed(generator->seed, 1));
+    generateTerrain(reference, to);
+    startMorph(morph, terrain, generator, 0.0);
+    for (double now = 0.0; advanceMorph(morph, terrain, generator, now); now += DURATION) {}
+    bool biomesMatch = true;
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) biomesMatch = biomesMatch && terrain->biomes[x][z] == to->biomes[x][z];
+    }
+    assert_test(biomesMatch && heights_match(terrain, to, 0.0f), "Biomes morph with the terrain.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // A morph can be freed while it is still generating
+    startMorph(morph, terrain, generator, 0.0);
+    freeMorph(morph);
+
+    freeTerrain(terrain);
+    freeTerrain(from);
+    freeTerrain(to);
+    freeGenerator(generator);
+    freeGenerator(reference);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <assert.h>
+#include <math.h>
+#include "packed.h"
+#include "parallel.h"
+
+#define PACKED_MAX 65535
+// The packed value of height 0, so flat ground packs exactly
+#define PACKED_ZERO 32768.0f
+// Points converted by each inner loop, so it vectorises as codec.c's extrapolateRow does
+#define RUN 64
+// Values each coordinate of a normal takes either side of 0
+#define NORMAL_STEPS 127.0f
+
+PackedTerrain* createPackedTerrain(int xSize, int zSize, int height) {
+    PackedTerrain* packed = malloc(sizeof(PackedTerrain));
+    assert(packed != NULL);
+    packed->xSize = xSize;
+    packed->zSize = zSize;
+    packed->height = height;
+    size_t count = (size_t) xSize * zSize;
+    packed->heights = malloc(sizeof(uint16_t) * count);
+    packed->normals = malloc(sizeof(uint16_t) * count);
+    assert(packed->heights != NULL && packed->normals != NULL);
+    uint16_t up = encodeOctahedral((Vector3){0.0f, 1.0f, 0.0f});
+    for (size_t i = 0; i < count; i++) {
+        packed->heights[i] = (uint16_t) PACKED_ZERO;
+        packed->normals[i] = up;
+    }
+    return packed;
+}
+
+// Both conversions of a height are a multiply and add, so a whole run of them fits in a
+// few vector instructions
+static inline uint16_t packHeight(GLfloat height, GLfloat scale, GLfloat offset) {
+    int value = (int) (height * scale + offset + 0.5f);
+    return (uint16_t) ((value < 0) ? 0 : (value > PACKED_MAX) ? PACKED_MAX : value);
+}
+
+static inline GLfloat unpackHeight(uint16_t value, GLfloat scale, GLfloat offset) {
+    return value * scale + offset;
+}
+
+static inline uint16_t packNormal(GLfloat x, GLfloat y, GLfloat z) {
+    GLfloat sum = fabsf(x) + fabsf(y) + fabsf(z);
+    // A zero vector is stored as straight up
+    GLfloat inverse = 1.0f / (sum + 1e-30f);
+    GLfloat u = x * inverse, v = z * inverse;
+    // The lower half is folded out over the corners of the square. It is blended in by
+    // multiplying, as the compiler will not vectorise a choice between floats at -O2.
+    GLfloat below = (GLfloat) (y < 0);
+    u += below * (copysignf(1.0f - fabsf(z * inverse), u) - u);
+    v += below * (copysignf(1.0f - fabsf(x * inverse), v) - v);
+    int low = (int) ((u + 1.0f) * NORMAL_STEPS + 0.5f);
+    int high = (int) ((v + 1.0f) * NORMAL_STEPS + 0.5f);
+    return (uint16_t) (low | high << 8);
+}
+
+uint16_t encodeOctahedral(Vector3 normal) {
+    return packNormal(normal.x, normal.y, normal.z);
+}
+
+// Unpacking normals stays scalar, as at -O2 the square root may set errno
+static inline Vector3 unpackNormal(uint16_t value) {
+    GLfloat u = (value & 0xFF) / NORMAL_STEPS - 1.0f;
+    GLfloat v = (value >> 8) / NORMAL_STEPS - 1.0f;
+    GLfloat y = 1.0f - fabsf(u) - fabsf(v);
+    // Points past the diamond are on the lower half, folded back under it
+    GLfloat fold = (y < 0) ? -y : 0.0f;
+    u -= copysignf(fold, u);
+    v -= copysignf(fold, v);
+    GLfloat inverse = 1.0f / sqrtf(u * u + y * y + v * v);
+    return (Vector3){u * inverse, y * inverse, v * inverse};
+}
+
+Vector3 decodeOctahedral(uint16_t value) {
+    return unpackNormal(value);
+}
+
+typedef struct {
+    PackedTerrain* packed;
+    Terrain* terrain;
+    TerrainRect rect;
+    GLfloat scale, offset;
+} PackJob;
+
+static void packRows(void* context, int begin, int end) {
+    PackJob* job = context;
+    int zSize = job->packed->zSize, z0 = job->rect.z0, z1 = job->rect.z1;
+    GLfloat scale = job->scale, offset = job->offset;
+    for (int x = job->rect.x0 + begin; x < job->rect.x0 + end; x++) {
+        const GLfloat* restrict heights = job->terrain->heights[x];
+        const Vector3* restrict normals = job->terrain->normals[x];
+        uint16_t* restrict packedHeights = job->packed->heights + (long) x * zSize;
+        uint16_t* restrict packedNormals = job->packed->normals + (long) x * zSize;
+        int z = z0;
+        for (; z + RUN <= z1; z += RUN) {
+            for (int i = 0; i < RUN; i++) packedHeights[z + i] = packHeight(heights[z + i], scale, offset);
+            for (int i = 0; i < RUN; i++) {
+                packedNormals[z + i] = packNormal(normals[z + i].x, normals[z + i].y, normals[z + i].z);
+            }
+        }
+        for (; z < z1; z++) {
+            packedHeights[z] = packHeight(heights[z], scale, offset);
+            packedNormals[z] = packNormal(normals[z].x, normals[z].y, normals[z].z);
+        }
+    }
+}
+
+static void unpackRows(void* context, int begin, int end) {
+    PackJob* job = context;
+    int zSize = job->packed->zSize, z0 = job->rect.z0, z1 = job->rect.z1;
+    GLfloat scale = job->scale, offset = job->offset;
+    for (int x = job->rect.x0 + begin; x < job->rect.x0 + end; x++) {
+        GLfloat* restrict heights = job->terrain->heights[x];
+        Vector3* restrict normals = job->terrain->normals[x];
+        const uint16_t* restrict packedHeights = job->packed->heights + (long) x * zSize;
+        const uint16_t* restrict packedNormals = job->packed->normals + (long) x * zSize;
+        int z = z0;
+        for (; z + RUN <= z1; z += RUN) {
+            for (int i = 0; i < RUN; i++) heights[z + i] = unpackHeight(packedHeights[z + i], scale, offset);
+        }
+        for (; z < z1; z++) heights[z] = unpackHeight(packedHeights[z], scale, offset);
+        for (z = z0; z < z1; z++) {
+            normals[z] = unpackNormal(packedNormals[z]);
+        }
+    }
+}
+
+// The span of heights a packed terrain holds, from -range to range
+static GLfloat heightRange(const PackedTerrain* packed) {
+    GLfloat range = PACKED_HEIGHT_RANGE * (GLfloat) packed->height;
+    return (range > 0) ? range : 1.0f;
+}
+
+void packTerrain(PackedTerrain* packed, const Terrain* terrain, TerrainRect rect) {
+    assert(packed->xSize == terrain->xSize && packed->zSize == terrain->zSize);
+    if (rect.x0 >= rect.x1 || rect.z0 >= rect.z1) return;
+    GLfloat range = heightRange(packed);
+    PackJob job = {packed, (Terrain*) terrain, rect, PACKED_ZERO / range, PACKED_ZERO};
+    parallel_for(rect.x1 - rect.x0, packRows, &job);
+}
+
+void unpackTerrain(const PackedTerrain* packed, Terrain* terrain, TerrainRect rect) {
+    assert(packed->xSize == terrain->xSize && packed->zSize == terrain->zSize);
+    if (rect.x0 >= rect.x1 || rect.z0 >= rect.z1) return;
+    GLfloat range = heightRange(packed);
+    PackJob job = {(PackedTerrain*) packed, terrain, rect, range / PACKED_ZERO, -range};
+    parallel_for(rect.x1 - rect.x0, unpackRows, &job);
+    markTerrainDirty(terrain, rect);
+}
+
+GLfloat packedHeight(const PackedTerrain* packed, int x, int z) {
+    GLfloat range = heightRange(packed);
+    return unpackHeight(packed->heights[(long) x * packed->zSize + z], range / PACKED_ZERO, -range);
+}
+
+Vector3 packedNormal(const PackedTerrain* packed, int x, int z) {
+    return unpackNormal(packed->normals[(long) x * packed->zSize + z]);
+}
+
+void freePackedTerrain(PackedTerrain* packed) {
+    free(packed->heights);
+    free(packed->normals);
+    free(packed);
+}
@@ -0,0 +1,51 @@
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <stdint.h>
+#include "structures.h"
+#include "terrain.h"
+
+// Heights are packed over this many times the terrain's height either side of 0, which
+// holds the mountains, the highest of the height modes at up to 7.25 times
+#define PACKED_HEIGHT_RANGE 8
+
+// A terrain's heights and normals kept in 4 bytes a point instead of the 16 a Terrain
+// uses, for keeping large terrains resident. Heights are 16 bits over
+// [-PACKED_HEIGHT_RANGE * height, PACKED_HEIGHT_RANGE * height], so each is off by at most
+// PACKED_HEIGHT_RANGE * height / 65536 (0.004 for a height of 30), and heights outside
+// are clamped. Normals are octahedral with 8 bits for each of the two coordinates, off
+// by at most about 1 degree.
+typedef struct {
+    int xSize, zSize, height;
+    uint16_t* heights; // By x then z
+    uint16_t* normals; // By x then z, see encodeOctahedral
+} PackedTerrain;
+
+// Creates a packed terrain with every height 0 and every normal straight up
+extern PackedTerrain* createPackedTerrain(int xSize, int zSize, int height);
+
+// Packs the heights and normals inside the rectangle of a terrain of the same size.
+// Rows are packed on all threads.
+extern void packTerrain(PackedTerrain*, const Terrain*, TerrainRect);
+
+// Unpacks the heights and normals inside the rectangle into a terrain of the same size,
+// then marks the rectangle dirty. Rows are unpacked on all threads.
+extern void unpackTerrain(const PackedTerrain*, Terrain*, TerrainRect);
+
+// Returns the unpacked height and normal of one point
+extern GLfloat packedHeight(const PackedTerrain*, int x, int z);
+extern Vector3 packedNormal(const PackedTerrain*, int x, int z);
+
+// Projects a unit vector onto the octahedron |x| + |y| + |z| = 1, folds the lower half
+// over the upper and unfolds it onto the square of x and z, which is stored with 8 bits
+// for x in the low byte and 8 for z in the high byte. Each takes one of 255 values, so
+// straight up is stored exactly.
+extern uint16_t encodeOctahedral(Vector3);
+
+// Returns the unit vector an encoded normal stands for
+extern Vector3 decodeOctahedral(uint16_t);
+
+// Frees the packed terrain and its arrays
+extern void freePackedTerrain(PackedTerrain*);
+
+#endif
@@ -0,0 +1,85 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "packed.h"
+#include "terrain.h"
+#include "structures.h"
+#include "testing.h"
+
+// Not a multiple of the runs rows are converted in, so the ends of rows are covered
+#define X_SIZE 100
+#define Z_SIZE 70
+#define HEIGHT 30
+// Half a step of the 16 bit heights, over the packed range
+#define HEIGHT_TOLERANCE (PACKED_HEIGHT_RANGE * HEIGHT / 65536.0f + 1e-4f)
+#define NORMAL_DEGREES 1.5f
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+static GLfloat degrees_between(Vector3 a, Vector3 b) {
+    GLfloat cosine = fminf(a.x * b.x + a.y * b.y + a.z * b.z, 1.0f);
+    return acosf(cosine) * 180.0f / (GLfloat) M_PI;
+}
+
+// Whether every direction on a sphere of latitudes and longitudes decodes close to itself
+static bool sphere_round_trips(void) {
+    for (int i = 0; i <= 36; i++) {
+        GLfloat latitude = (GLfloat) M_PI * (i / 36.0f - 0.5f);
+        for (int j = 0; j < 72; j++) {
+            GLfloat longitude = 2.0f * (GLfloat) M_PI * j / 72.0f;
+            Vector3 normal = {cosf(latitude) * cosf(longitude), sinf(latitude), cosf(latitude) * sinf(longitude)};
+            if (degrees_between(normal, decodeOctahedral(encodeOctahedral(normal))) > NORMAL_DEGREES) return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    printf("Testing Packed: \n");
+    Terrain* terrain = createTerrain(X_SIZE, Z_SIZE, HEIGHT);
+    populateTerrain(terrain, test_hills, NULL);
+    calculateNormals(terrain);
+    PackedTerrain* packed = createPackedTerrain(X_SIZE, Z_SIZE, HEIGHT);
+    assert_test(packedHeight(packed, 3, 4) == 0 && packedNormal(packed, 3, 4).y == 1.0f,
+                "Created flat.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    TerrainRect all = {0, 0, X_SIZE, Z_SIZE};
+    packTerrain(packed, terrain, all);
+    Terrain* unpacked = createTerrain(X_SIZE, Z_SIZE, HEIGHT);
+    takeTerrainDirty(unpacked);
+    unpackTerrain(packed, unpacked, all);
+    GLfloat heightError = 0, normalError = 0;
+    for (int x = 0; x < X_SIZE; x++) {
+        for (int z = 0; z < Z_SIZE; z++) {
+            heightError = fmaxf(heightError, fabsf(unpacked->heights[x][z] - terrain->heights[x][z]));
+            normalError = fmaxf(normalError, degrees_between(unpacked->normals[x][z], terrain->normals[x][z]));
+        }
+    }
+    assert_test(heightError <= HEIGHT_TOLERANCE, "Heights within half a step.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(normalError <= NORMAL_DEGREES, "Normals within 1.5 degrees.", TEST_OK_OUT, TEST_FAIL_OUT);
+    TerrainRect dirty = takeTerrainDirty(unpacked);
+    assert_test(dirty.x0 == 0 && dirty.z0 == 0 && dirty.x1 == X_SIZE && dirty.z1 == Z_SIZE,
+                "Unpacked region dirty.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(sphere_round_trips(), "Normals below the ground round trip.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Only the rectangle is repacked, and heights past the range are clamped to it
+    terrain->heights[10][10] = 1000.0f;
+    terrain->heights[11][10] = -1000.0f;
+    terrain->heights[50][50] = 7.0f;
+    TerrainRect corner = {0, 0, 20, 20};
+    packTerrain(packed, terrain, corner);
+    GLfloat range = PACKED_HEIGHT_RANGE * HEIGHT;
+    assert_test(fabsf(packedHeight(packed, 10, 10) - range) <= 2 * HEIGHT_TOLERANCE
+                && fabsf(packedHeight(packed, 11, 10) + range) <= HEIGHT_TOLERANCE,
+                "Heights clamped to the range.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(fabsf(packedHeight(packed, 50, 50) - 7.0f) > 1.0f, "Outside the rectangle left alone.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+
+    freePackedTerrain(packed);
+    freeTerrain(unpacked);
+    freeTerrain(terrain);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,352 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "parallel.h"
+
+// Pieces each thread's share of a loop is split into at most, so threads that finish
+// early can take work from those still going
+#define TASKS_PER_THREAD 8
+#define INITIAL_DEQUE_SIZE 64
+
+// Number of threads requested by the user, 0 to use every core
+static int requested_threads = 0;
+
+struct ParallelGroup {
+    atomic_int pending; // Tasks spawned and not yet finished
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+};
+
+// A rectangle of a loop still to be run, which is halved while it has more than grain
+// indices. 1D loops are rectangles one deep.
+typedef struct {
+    parallelFunction fn;
+    parallelFunction2D fn2D; // Called instead of fn if set
+    void* context;
+    int x0, z0, x1, z1;
+    long grain;
+    ParallelGroup* group;
+} ParallelTask;
+
+// Tasks are pushed and popped at the bottom by the threads it belongs to, and stolen
+// from the top by the others, so thieves take the oldest and largest pieces
+typedef struct {
+    pthread_mutex_t mutex;
+    ParallelTask* tasks; // A ring of capacity tasks, count of them from top
+    int top, count, capacity;
+} ParallelDeque;
+
+// Worker threads sleep while every deque is empty. There is a deque for each worker,
+// then one shared by every thread outside the pool.
+static struct {
+    pthread_mutex_t lock; // Held while the pool is started or stopped
+    int workers, started; // Threads asked for and those that could be created
+    pthread_t* ids;
+    ParallelDeque* deques; // One per worker, then the shared one
+    atomic_int queued;    // Tasks in all the deques
+    atomic_int sleeping;  // Workers waiting for a task
+    bool stopping;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+} pool = {PTHREAD_MUTEX_INITIALIZER, 0, 0, NULL, NULL, 0, 0, false, PTHREAD_MUTEX_INITIALIZER,
+          PTHREAD_COND_INITIALIZER};
+
+// Index of the deque of the worker running on this thread, -1 outside the pool
+static _Thread_local int worker_index = -1;
+
+static void run_task(ParallelTask*);
+
+static int own_deque(void) {
+    return (worker_index >= 0) ? worker_index : pool.workers;
+}
+
+static void push_task(const ParallelTask* task) {
+    ParallelDeque* deque = &pool.deques[own_deque()];
+    pthread_mutex_lock(&deque->mutex);
+    if (deque->count == deque->capacity) {
+        int capacity = (deque->capacity == 0) ? INITIAL_DEQUE_SIZE : 2 * deque->capacity;
+        ParallelTask* tasks = malloc(sizeof(ParallelTask) * capacity);
+        if (tasks == NULL) {
+            // The task is run here instead, which only loses the parallelism
+            pthread_mutex_unlock(&deque->mutex);
+            fprintf(stderr, "Allocation of parallel task deque failed, running serially.\n");
+            ParallelTask copy = *task;
+            run_task(&copy);
+            return;
+        }
+        for (int i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->top + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->top = 0;
+        deque->capacity = capacity;
+    }
+    deque->tasks[(deque->top + deque->count) % deque->capacity] = *task;
+    deque->count++;
+    pthread_mutex_unlock(&deque->mutex);
+
+    // Queued is raised before sleeping is read, and workers raise sleeping before reading
+    // queued, so a worker going to sleep either sees the task or is woken for it
+    atomic_fetch_add(&pool.queued, 1);
+    if (atomic_load(&pool.sleeping) > 0) {
+        pthread_mutex_lock(&pool.mutex);
+        pthread_cond_signal(&pool.wake);
+        pthread_mutex_unlock(&pool.mutex);
+    }
+}
+
+// Takes the task nearest the bottom or top of the deque which belongs to the group, or
+// any task if group is NULL, closing the gap it leaves
+static bool take_task(ParallelDeque* deque, const ParallelGroup* group, bool bottom, ParallelTask* task) {
+    pthread_mutex_lock(&deque->mutex);
+    int found = -1;
+    for (int i = 0; i < deque->count && found < 0; i++) {
+        int at = bottom ? deque->count - 1 - i : i;
+        if (group == NULL || deque->tasks[(deque->top + at) % deque->capacity].group == group) found = at;
+    }
+    if (found >= 0) {
+        *task = deque->tasks[(deque->top + found) % deque->capacity];
+        if (found == 0) {
+            deque->top = (deque->top + 1) % deque->capacity;
+        } else {
+            for (int i = found; i < deque->count - 1; i++) {
+                int to = (deque->top + i) % deque->capacity;
+                deque->tasks[to] = deque->tasks[(to + 1) % deque->capacity];
+            }
+        }
+        deque->count--;
+        atomic_fetch_sub(&pool.queued, 1);
+    }
+    pthread_mutex_unlock(&deque->mutex);
+    return found >= 0;
+}
+
+// Takes the newest task of this thread's deque, or else steals the oldest of another's.
+// With a group, only that group's tasks are taken.
+static bool find_task(const ParallelGroup* group, ParallelTask* task) {
+    if (atomic_load(&pool.queued) == 0) return false;
+    int own = own_deque(), numDeques = pool.workers + 1;
+    if (take_task(&pool.deques[own], group, true, task)) return true;
+    for (int i = 1; i < numDeques; i++) {
+        if (take_task(&pool.deques[(own + i) % numDeques], group, false, task)) return true;
+    }
+    return false;
+}
+
+static void finish_task(ParallelGroup* group) {
+    // Decremented while locked, so the waiter can not free the group before it is unlocked
+    pthread_mutex_lock(&group->mutex);
+    if (atomic_fetch_sub(&group->pending, 1) == 1) {
+        pthread_cond_broadcast(&group->done);
+    }
+    pthread_mutex_unlock(&group->mutex);
+}
+
+// Pushes the far half of the longer side for another thread to take until what is left
+// is no larger than the grain, then runs it
+static void run_task(ParallelTask* task) {
+    while ((long) (task->x1 - task->x0) * (task->z1 - task->z0) > task->grain) {
+        ParallelTask half = *task;
+        if (task->x1 - task->x0 >= task->z1 - task->z0) {
+            half.x0 = task->x1 = task->x0 + (task->x1 - task->x0) / 2;
+        } else {
+            half.z0 = task->z1 = task->z0 + (task->z1 - task->z0) / 2;
+        }
+        atomic_fetch_add(&task->group->pending, 1);
+        push_task(&half);
+    }
+    if (task->fn2D != NULL) {
+        task->fn2D(task->context, task->x0, task->z0, task->x1, task->z1);
+    } else {
+        task->fn(task->context, task->x0, task->x1);
+    }
+    finish_task(task->group);
+}
+
+static void* worker_main(void* arg) {
+    worker_index = (int) (intptr_t) arg;
+    while (true) {
+        ParallelTask task;
+        if (find_task(NULL, &task)) {
+            run_task(&task);
+            continue;
+        }
+        pthread_mutex_lock(&pool.mutex);
+        atomic_fetch_add(&pool.sleeping, 1);
+        while (atomic_load(&pool.queued) == 0 && !pool.stopping) {
+            pthread_cond_wait(&pool.wake, &pool.mutex);
+        }
+        atomic_fetch_sub(&pool.sleeping, 1);
+        bool stopping = pool.stopping;
+        pthread_mutex_unlock(&pool.mutex);
+        if (stopping) return NULL;
+    }
+}
+
+static void stop_pool(void) {
+    pthread_mutex_lock(&pool.mutex);
+    pool.stopping = true;
+    pthread_cond_broadcast(&pool.wake);
+    pthread_mutex_unlock(&pool.mutex);
+    for (int i = 0; i < pool.started; i++) {
+        pthread_join(pool.ids[i], NULL);
+    }
+    for (int i = 0; i <= pool.workers; i++) {
+        pthread_mutex_destroy(&pool.deques[i].mutex);
+        free(pool.deques[i].tasks);
+    }
+    free(pool.deques);
+    free(pool.ids);
+    pool.deques = NULL;
+    pool.ids = NULL;
+    pool.workers = 0;
+    pool.started = 0;
+    pool.stopping = false;
+}
+
+// Starts a worker for every thread but the caller's. If a thread can not be created the
+// pool is left smaller, as the threads waiting on tasks run them too.
+static void start_pool(int workers) {
+    pool.ids = malloc(sizeof(pthread_t) * workers);
+    pool.deques = calloc(workers + 1, sizeof(ParallelDeque));
+    assert(pool.ids != NULL && pool.deques != NULL);
+    for (int i = 0; i <= workers; i++) {
+        pthread_mutex_init(&pool.deques[i].mutex, NULL);
+    }
+    pool.workers = workers;
+    for (pool.started = 0; pool.started < workers; pool.started++) {
+        int index = pool.started;
+        if (pthread_create(&pool.ids[index], NULL, worker_main, (void*) (intptr_t) index) != 0) {
+            fprintf(stderr, "Could only start %d of %d parallel workers.\n", index, workers);
+            break;
+        }
+    }
+}
+
+// Returns the number of threads to run on, with the pool started for them if needed
+static int ensure_pool(void) {
+    int threads = parallel_num_threads();
+    if (threads == 1) return 1;
+    pthread_mutex_lock(&pool.lock);
+    if (pool.deques == NULL || pool.workers != threads - 1) {
+        if (pool.deques != NULL) stop_pool();
+        start_pool(threads - 1);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return threads;
+}
+
+// Returns the requested number of threads, or the number of online cores
+int parallel_num_threads(void) {
+    if (requested_threads > 0) return requested_threads;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return (cores < 1) ? 1 : (int) cores;
+}
+
+void parallel_set_threads(int threads) {
+    requested_threads = (threads < 0) ? 0 : threads;
+}
+
+static void init_group(ParallelGroup* group) {
+    atomic_init(&group->pending, 0);
+    pthread_mutex_init(&group->mutex, NULL);
+    pthread_cond_init(&group->done, NULL);
+}
+
+static void destroy_group(ParallelGroup* group) {
+    pthread_mutex_destroy(&group->mutex);
+    pthread_cond_destroy(&group->done);
+}
+
+ParallelGroup* parallel_group_create(void) {
+    ParallelGroup* group = malloc(sizeof(ParallelGroup));
+    if (group == NULL) {
+        fprintf(stderr, "Allocation of parallel group failed.\n");
+        return NULL;
+    }
+    init_group(group);
+    return group;
+}
+
+// With one thread the rectangle is run straight away, in one call
+static void spawn(ParallelGroup* group, ParallelTask task) {
+    long area = (long) (task.x1 - task.x0) * (task.z1 - task.z0);
+    if (area <= 0) return;
+    int threads = ensure_pool();
+    if (threads == 1) {
+        if (task.fn2D != NULL) {
+            task.fn2D(task.context, task.x0, task.z0, task.x1, task.z1);
+        } else {
+            task.fn(task.context, task.x0, task.x1);
+        }
+        return;
+    }
+    task.grain = area / ((long) threads * TASKS_PER_THREAD);
+    if (task.grain < 1) task.grain = 1;
+    task.group = group;
+    atomic_fetch_add(&group->pending, 1);
+    push_task(&task);
+}
+
+void parallel_spawn(ParallelGroup* group, int count, parallelFunction fn, void* context) {
+    spawn(group, (ParallelTask){.fn = fn, .context = context, .x1 = count, .z1 = 1});
+}
+
+void parallel_spawn_2d(ParallelGroup* group, int xCount, int zCount, parallelFunction2D fn, void* context) {
+    spawn(group, (ParallelTask){.fn2D = fn, .context = context, .x1 = xCount, .z1 = zCount});
+}
+
+// Only the group's own tasks are run, so a short loop never waits on the pieces of a
+// long one started on another thread, such as a bake in the background
+void parallel_wait(ParallelGroup* group) {
+    while (atomic_load(&group->pending) > 0) {
+        ParallelTask task;
+        if (!find_task(group, &task)) break;
+        run_task(&task);
+    }
+    // The rest are running on other threads
+    pthread_mutex_lock(&group->mutex);
+    while (atomic_load(&group->pending) > 0) {
+        pthread_cond_wait(&group->done, &group->mutex);
+    }
+    pthread_mutex_unlock(&group->mutex);
+}
+
+void parallel_group_free(ParallelGroup* group) {
+    destroy_group(group);
+    free(group);
+}
+
+// The caller takes the first task itself, so a loop on one thread, or run while the
+// others are busy, goes ahead without waiting on them
+void parallel_for(int count, parallelFunction fn, void* context) {
+    if (count <= 0) return;
+    if (count == 1 || parallel_num_threads() == 1) {
+        fn(context, 0, count);
+        return;
+    }
+    ParallelGroup group;
+    init_group(&group);
+    parallel_spawn(&group, count, fn, context);
+    parallel_wait(&group);
+    destroy_group(&group);
+}
+
+void parallel_for_2d(int xCount, int zCount, parallelFunction2D fn, void* context) {
+    if (xCount <= 0 || zCount <= 0) return;
+    if ((long) xCount * zCount == 1 || parallel_num_threads() == 1) {
+        fn(context, 0, 0, xCount, zCount);
+        return;
+    }
+    ParallelGroup group;
+    init_group(&group);
+    parallel_spawn_2d(&group, xCount, zCount, fn, context);
+    parallel_wait(&group);
+    destroy_group(&group);
+}
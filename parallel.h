@@ -0,0 +1,51 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+// A parallelFunction processes the indices [begin, end) of a parallel_for.
+typedef void (*parallelFunction) (void* context, int begin, int end);
+
+// A parallelFunction2D processes the rectangle [x0, x1) by [z0, z1) of a parallel_for_2d.
+typedef void (*parallelFunction2D) (void* context, int x0, int z0, int x1, int z1);
+
+// Tasks waited for together, which can be spawned from any thread, including from
+// inside other tasks
+typedef struct ParallelGroup ParallelGroup;
+
+// Splits the indices [0, count) into contiguous chunks and processes them on all
+// worker threads, returning once every chunk is done. fn must only write data
+// belonging to its own indices so results do not depend on the thread count.
+// Chunks are halved as threads take them from each other, so their sizes vary from
+// run to run. Can be called from inside a chunk, the caller runs its own loop's chunks
+// while it waits.
+extern void parallel_for(int count, parallelFunction fn, void* context);
+
+// Like parallel_for over the rectangle [0, xCount) by [0, zCount), halving its longer
+// side into smaller rectangles.
+extern void parallel_for_2d(int xCount, int zCount, parallelFunction2D fn, void* context);
+
+// Creates an empty group of tasks
+extern ParallelGroup* parallel_group_create(void);
+
+// Adds the indices [0, count) to the group, to be split and run like parallel_for
+// without waiting for them. With one thread they are run before returning.
+extern void parallel_spawn(ParallelGroup*, int count, parallelFunction fn, void* context);
+
+// Adds the rectangle [0, xCount) by [0, zCount) to the group like parallel_for_2d
+extern void parallel_spawn_2d(ParallelGroup*, int xCount, int zCount, parallelFunction2D fn, void* context);
+
+// Runs the group's waiting tasks, then sleeps until those taken by other threads are
+// done. Tasks of other groups are left to their own threads and the workers.
+extern void parallel_wait(ParallelGroup*);
+
+// Frees a group with no tasks left to run
+extern void parallel_group_free(ParallelGroup*);
+
+// Returns the number of threads parallel_for uses.
+extern int parallel_num_threads(void);
+
+// Sets the number of threads parallel_for uses, 0 means one per online core.
+// The worker threads are started again with the new number on the next parallel_for,
+// so it must not be called while any are running.
+extern void parallel_set_threads(int);
+
+#endif
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include "parallel.h"
+#include "testing.h"
+
+#define COUNT 10007
+#define X_COUNT 301
+#define Z_COUNT 97
+#define OUTER 13
+#define INNER 501
+#define CALLERS 3
+// Rows of the slow loop run in the background, and how long each takes
+#define SLOW_ROWS 200
+#define SLOW_MICROSECONDS 1000
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+static const int thread_counts[] = {1, 2, 3, 8};
+#define NUM_THREAD_COUNTS (int) (sizeof(thread_counts) / sizeof(thread_counts[0]))
+
+static void count_indices(void* context, int begin, int end) {
+    atomic_int* visits = context;
+    for (int i = begin; i < end; i++) {
+        atomic_fetch_add(&visits[i], 1);
+    }
+}
+
+static void count_cells(void* context, int x0, int z0, int x1, int z1) {
+    atomic_int* visits = context;
+    for (int x = x0; x < x1; x++) {
+        for (int z = z0; z < z1; z++) {
+            atomic_fetch_add(&visits[x * Z_COUNT + z], 1);
+        }
+    }
+}
+
+// Whether every one of the count visits is 1, resetting them to 0
+static bool once_each(atomic_int* visits, int count) {
+    bool once = true;
+    for (int i = 0; i < count; i++) {
+        once = once && atomic_load(&visits[i]) == 1;
+        atomic_store(&visits[i], 0);
+    }
+    return once;
+}
+
+// Each outer index runs a loop of its own over its row
+static void nested_rows(void* context, int begin, int end) {
+    atomic_int* visits = context;
+    for (int i = begin; i < end; i++) {
+        parallel_for(INNER, count_indices, &visits[i * INNER]);
+    }
+}
+
+// Each outer index spawns its row into one group shared by all of them, waited on once
+static void spawn_rows(void* context, int begin, int end) {
+    atomic_int* visits = context;
+    ParallelGroup* group = parallel_group_create();
+    for (int i = begin; i < end; i++) {
+        parallel_spawn(group, INNER, count_indices, &visits[i * INNER]);
+    }
+    parallel_wait(group);
+    parallel_group_free(group);
+}
+
+static void* call_parallel_for(void* arg) {
+    parallel_for(COUNT, count_indices, arg);
+    return NULL;
+}
+
+static pthread_t main_thread;
+static atomic_bool slow_done;
+
+// Sleeps through each row, counting those the main thread ran
+static void slow_rows(void* context, int begin, int end) {
+    atomic_int* stolen = context;
+    for (int i = begin; i < end; i++) {
+        nanosleep(&(struct timespec){0, SLOW_MICROSECONDS * 1000L}, NULL);
+        if (pthread_equal(pthread_self(), main_thread)) atomic_fetch_add(stolen, 1);
+    }
+}
+
+static void* call_slow_rows(void* arg) {
+    parallel_for(SLOW_ROWS, slow_rows, arg);
+    atomic_store(&slow_done, true);
+    return NULL;
+}
+
+// A sum in which each index adds its own term, so the result can not depend on the chunks
+static void sum_squares(void* context, int begin, int end) {
+    double* terms = context;
+    for (int i = begin; i < end; i++) {
+        terms[i] = (double) i * i;
+    }
+}
+
+int main(void) {
+    printf("Testing Parallel: \n");
+    atomic_int* visits = calloc(OUTER * INNER > X_COUNT * Z_COUNT ? OUTER * INNER : X_COUNT * Z_COUNT,
+                                sizeof(atomic_int));
+    atomic_int* callerVisits = calloc(CALLERS * COUNT, sizeof(atomic_int));
+    bool loops = true, rectangles = true, nested = true, groups = true, callers = true, empty = true;
+    for (int t = 0; t < NUM_THREAD_COUNTS; t++) {
+        parallel_set_threads(thread_counts[t]);
+        parallel_for(COUNT, count_indices, visits);
+        loops = loops && once_each(visits, COUNT);
+        parallel_for(1, count_indices, visits);
+        loops = loops && once_each(visits, 1);
+
+        parallel_for_2d(X_COUNT, Z_COUNT, count_cells, visits);
+        rectangles = rectangles && once_each(visits, X_COUNT * Z_COUNT);
+
+        parallel_for(OUTER, nested_rows, visits);
+        nested = nested && once_each(visits, OUTER * INNER);
+
+        parallel_for(OUTER, spawn_rows, visits);
+        groups = groups && once_each(visits, OUTER * INNER);
+
+        // Threads outside the pool share it
+        pthread_t ids[CALLERS];
+        for (int c = 0; c < CALLERS; c++) {
+            pthread_create(&ids[c], NULL, call_parallel_for, &callerVisits[c * COUNT]);
+        }
+        for (int c = 0; c < CALLERS; c++) {
+            pthread_join(ids[c], NULL);
+        }
+        callers = callers && once_each(callerVisits, CALLERS * COUNT);
+
+        parallel_for(0, count_indices, visits);
+        parallel_for_2d(X_COUNT, 0, count_cells, visits);
+        ParallelGroup* group = parallel_group_create();
+        parallel_wait(group);
+        parallel_group_free(group);
+        for (int i = 0; i < COUNT; i++) {
+            empty = empty && atomic_load(&visits[i]) == 0;
+        }
+    }
+    assert_test(loops, "Loops run every index once.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(rectangles, "2D loops run every cell once.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(nested, "Loops inside loops finish.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(groups, "Groups wait for their tasks.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(callers, "Several threads share the pool.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(empty, "Empty loops and groups do nothing.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // A loop waits only for its own pieces, not those of a slow loop on another thread
+    parallel_set_threads(4);
+    main_thread = pthread_self();
+    atomic_int stolen;
+    atomic_init(&stolen, 0);
+    atomic_init(&slow_done, false);
+    pthread_t background;
+    pthread_create(&background, NULL, call_slow_rows, &stolen);
+    bool fast = true;
+    while (!atomic_load(&slow_done)) {
+        parallel_for(COUNT, count_indices, visits);
+        fast = fast && once_each(visits, COUNT);
+    }
+    pthread_join(background, NULL);
+    assert_test(atomic_load(&stolen) == 0 && fast, "Loops never run another loop's pieces.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+
+    double* single = malloc(sizeof(double) * COUNT);
+    double* several = malloc(sizeof(double) * COUNT);
+    parallel_set_threads(1);
+    parallel_for(COUNT, sum_squares, single);
+    parallel_set_threads(5);
+    parallel_for(COUNT, sum_squares, several);
+    double a = 0, b = 0;
+    for (int i = 0; i < COUNT; i++) {
+        a += single[i];
+        b += several[i];
+    }
+    assert_test(a == b, "Same results on any number of threads.", TEST_OK_OUT, TEST_FAIL_OUT);
+    parallel_set_threads(0);
+
+    free(several);
+    free(single);
+    free(callerVisits);
+    free(visits);
+    return EXIT_SUCCESS;
+}
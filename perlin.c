@@ -3,16 +3,19 @@
 #include <assert.h>
 #include <stdio.h>
 #include "perlin.h"
+#include "fixednoise.h"
 #include "structures.h"
 
 // Returns a Vector2 at a random angle with magnitude 1
-static Vector2* generate_random_vector2() {
+// The angle comes from the random state if there is one, otherwise from rand()
+static Vector2* generate_random_vector2(uint32_t* state) {
     Vector2* out = malloc(sizeof(Vector2));
     if (out == NULL) {
         fprintf(stderr, "Could not allocate memory for vector.\n");
         return NULL;
     }
-    GLfloat a = (((GLfloat)rand())/((GLfloat)RAND_MAX)) * 2 * M_PI;
+    GLfloat random = (state != NULL) ? random_float(state) : ((GLfloat)rand())/((GLfloat)RAND_MAX);
+    GLfloat a = random * 2 * M_PI;
     out->x = cosf(a);
     out->y = sinf(a);
     return out;
@@ -24,8 +27,15 @@ void free_perlin(Perlin* perlin) {
     free(perlin);
 }
 
+// The last point sampled is at (size - 1) * frequency + offset, and the cell containing it
+// needs the gradient after it too
+int perlin_lattice_size(int size, GLfloat frequency, GLfloat offset) {
+    int last = (int) floorf((size - 1) * frequency + offset);
+    return (last < 0) ? 2 : last + 2;
+}
+
 // Returns a perlin with its grid of random 2D vectors initialised and generated
-Perlin* create_perlin(int xSize, int zSize) {
+static Perlin* create_perlin_from(int xSize, int zSize, uint32_t seed, uint32_t* state) {
     // Creating perlin
     Perlin* perlin = malloc(sizeof(Perlin));
     if (perlin == NULL) {
@@ -41,7 +51,7 @@ Perlin* create_perlin(int xSize, int zSize) {
     // Initialising and generating the random vectors
     for (int i = 0; i < xSize; i++) {
         for (int j = 0; j < zSize; j++) {
-            grid[i][j] = generate_random_vector2();
+            grid[i][j] = generate_random_vector2(state);
             if (grid[i][j] == NULL) {
                 fprintf(stderr, "Allocation of vector (x, z) = (%d, %d) failed.\n", i, j);
                 free2D((void ****) &grid, xSize, zSize);
@@ -53,9 +63,35 @@ Perlin* create_perlin(int xSize, int zSize) {
     perlin->vectorGrid = grid;
     perlin->xSize = xSize;
     perlin->zSize = zSize;
+    perlin->backend = NOISE_CLASSIC;
+    perlin->seed = seed;
+
+    // Shuffles 0 to 255 for the 3D hash, after the gradients so they are unaffected
+    for (int i = 0; i < 256; i++) {
+        perlin->permutation[i] = i;
+    }
+    for (int i = 255; i > 0; i--) {
+        uint32_t random = (state != NULL) ? random_next(state) : (uint32_t) rand();
+        int j = random % (i + 1);
+        unsigned char swap = perlin->permutation[i];
+        perlin->permutation[i] = perlin->permutation[j];
+        perlin->permutation[j] = swap;
+    }
+    for (int i = 0; i < 256; i++) {
+        perlin->permutation[256 + i] = perlin->permutation[i];
+    }
     return perlin;
 }
 
+Perlin* create_perlin(int xSize, int zSize) {
+    return create_perlin_from(xSize, zSize, (uint32_t) rand(), NULL);
+}
+
+Perlin* create_perlin_seeded(int xSize, int zSize, uint32_t seed) {
+    uint32_t state = seed;
+    return create_perlin_from(xSize, zSize, seed, &state);
+}
+
 // Returns the dot product of the vector to v from the point (xGrid, yGrid) with
 // the gradient vector at the point (xGrid, yGrid)
 // This is used to get the perlin value at a point, once it has been interpolated
@@ -124,16 +160,39 @@ static GLfloat interpolate_general(GLfloat val1, GLfloat val2, GLfloat weight, i
     }
 }
 
-// Returns the perlin value (between -1 and 1) at the point specified by the vector v
+// Returns the derivative of the weight curve each interpolation mode uses,
+// at 'weight' between 0 and 1
+static GLfloat interpolation_derivative(GLfloat weight, int mode) {
+    switch (mode) {
+        case 0:
+            return 1;
+        case 1:
+            return 6 * weight * (1 - weight);
+        case 2:
+            return 30 * weight * weight * (weight - 1) * (weight - 1);
+        default:
+            return 0;
+    }
+}
+
+// Returns the weight curve each interpolation mode uses, at 'weight' between 0 and 1
+static GLfloat interpolation_curve(GLfloat weight, int mode) {
+    return interpolate_general(0, 1, weight, mode);
+}
+
+// Returns the classic perlin value (between -1 and 1) at the point specified by the vector v
 // The interpolation mode specifies which specific interpolation function should be used
 // for the interpolation, giving the resulting terrain a different look
-GLfloat get_perlin_value(Perlin* perlin, Vector2 v, int interpolation_mode){
-    assert(v.x >= 0 && v.x < perlin->xSize);
-    assert(v.y >= 0 && v.y < perlin->zSize);
+static GLfloat classic_value(Perlin* perlin, Vector2 v, int interpolation_mode){
+    assert(v.x >= 0 && v.x <= perlin->xSize - 1);
+    assert(v.y >= 0 && v.y <= perlin->zSize - 1);
     // Finds the coordinates of points surrounding the grid cell containing vector v.
+    // A point on the far edge uses the last cell, with a weight of 1 towards that edge.
     int x0 = (int) floor(v.x);
+    if (x0 > perlin->xSize - 2) x0 = perlin->xSize - 2;
     int x1 = x0 + 1;
     int y0 = (int) floor(v.y);
+    if (y0 > perlin->zSize - 2) y0 = perlin->zSize - 2;
     int y1 = y0 + 1;
 
     // Obtain dot products to corners
@@ -156,3 +215,315 @@ GLfloat get_perlin_value(Perlin* perlin, Vector2 v, int interpolation_mode){
     return out;
 }
 
+// The value is n = a + u(b - a) + v(c - a) + uv(a - b - c + d), where a to d are the
+// dot products at the corners and u, v the interpolation curves. Each dot product is
+// linear in the point with the corner's gradient as its derivative, so n's derivative
+// follows from the product rule.
+static GLfloat classic_value_d(Perlin* perlin, Vector2 v, int interpolation_mode, Vector2* derivative) {
+    assert(v.x >= 0 && v.x <= perlin->xSize - 1);
+    assert(v.y >= 0 && v.y <= perlin->zSize - 1);
+    int x0 = (int) floor(v.x);
+    if (x0 > perlin->xSize - 2) x0 = perlin->xSize - 2;
+    int y0 = (int) floor(v.y);
+    if (y0 > perlin->zSize - 2) y0 = perlin->zSize - 2;
+
+    Vector2* g00 = perlin->vectorGrid[x0][y0];
+    Vector2* g10 = perlin->vectorGrid[x0 + 1][y0];
+    Vector2* g01 = perlin->vectorGrid[x0][y0 + 1];
+    Vector2* g11 = perlin->vectorGrid[x0 + 1][y0 + 1];
+    GLfloat a = get_gradient_dot(perlin, x0, y0, v);
+    GLfloat b = get_gradient_dot(perlin, x0 + 1, y0, v);
+    GLfloat c = get_gradient_dot(perlin, x0, y0 + 1, v);
+    GLfloat d = get_gradient_dot(perlin, x0 + 1, y0 + 1, v);
+
+    GLfloat wx = v.x - x0;
+    GLfloat wy = v.y - y0;
+    GLfloat u = interpolation_curve(wx, interpolation_mode);
+    GLfloat w = interpolation_curve(wy, interpolation_mode);
+    GLfloat du = interpolation_derivative(wx, interpolation_mode);
+    GLfloat dw = interpolation_derivative(wy, interpolation_mode);
+    GLfloat k = a - b - c + d;
+
+    derivative->x = g00->x + u * (g10->x - g00->x) + w * (g01->x - g00->x)
+                  + u * w * (g00->x - g10->x - g01->x + g11->x) + du * (b - a + w * k);
+    derivative->y = g00->y + u * (g10->y - g00->y) + w * (g01->y - g00->y)
+                  + u * w * (g00->y - g10->y - g01->y + g11->y) + dw * (c - a + u * k);
+
+    // Interpolated in the same order as get_perlin_value so the values are identical
+    GLfloat ix0 = interpolate_general(a, b, wx, interpolation_mode);
+    GLfloat ix1 = interpolate_general(c, d, wx, interpolation_mode);
+    return interpolate_general(ix0, ix1, wy, interpolation_mode);
+}
+
+// Skewing along the diagonal turns the grid of equilateral triangles into square cells
+// split in two, and unskewing turns it back
+#define SIMPLEX_SKEW 0.36602540378f   // (sqrt(3) - 1) / 2
+#define SIMPLEX_UNSKEW 0.21132486540f // (3 - sqrt(3)) / 6
+// Squared radius of each corner's contribution, reaching exactly to the opposite edge
+// so only the three corners of the triangle containing the point are needed
+#define SIMPLEX_RADIUS 0.5f
+// Largest sum of the three contributions with unit gradients is about 1 / 99.2
+#define SIMPLEX_SCALE 99.2f
+
+int simplex_lattice_size(int size, GLfloat frequency, GLfloat offset) {
+    int last = (int) floorf(((size - 1) * frequency + offset) * (1 + 2 * SIMPLEX_SKEW));
+    return (last < 0) ? 2 : last + 2;
+}
+
+// Finds the triangle containing v, from its first corner (i, j) in the skewed grid and
+// the offsets to v from its three corners. The middle corner is (i + 1, j) below the
+// diagonal of the cell and (i, j + 1) above it.
+static void simplex_corners(Perlin* perlin, Vector2 v, int* i, int* j, int* i1, int* j1, Vector2 offsets[3]) {
+    GLfloat s = (v.x + v.y) * SIMPLEX_SKEW;
+    *i = (int) floorf(v.x + s);
+    *j = (int) floorf(v.y + s);
+    assert(*i >= 0 && *i + 1 < perlin->xSize);
+    assert(*j >= 0 && *j + 1 < perlin->zSize);
+
+    GLfloat t = (*i + *j) * SIMPLEX_UNSKEW;
+    offsets[0] = (Vector2){ v.x - (*i - t), v.y - (*j - t) };
+    if (offsets[0].x > offsets[0].y) {
+        *i1 = 1;
+        *j1 = 0;
+    } else {
+        *i1 = 0;
+        *j1 = 1;
+    }
+    offsets[1] = (Vector2){ offsets[0].x - *i1 + SIMPLEX_UNSKEW, offsets[0].y - *j1 + SIMPLEX_UNSKEW };
+    offsets[2] = (Vector2){ offsets[0].x - 1 + 2 * SIMPLEX_UNSKEW, offsets[0].y - 1 + 2 * SIMPLEX_UNSKEW };
+}
+
+// Returns the simplex value (between -1 and 1) at v, the sum over the three corners of
+// the triangle containing it of (r^2 - d^2)^4 times the dot product of d with the
+// corner's gradient, where d is the offset from the corner
+static GLfloat simplex_value(Perlin* perlin, Vector2 v) {
+    int i, j, i1, j1;
+    Vector2 offsets[3];
+    simplex_corners(perlin, v, &i, &j, &i1, &j1, offsets);
+    Vector2* gradients[3] = {
+        perlin->vectorGrid[i][j], perlin->vectorGrid[i + i1][j + j1], perlin->vectorGrid[i + 1][j + 1]
+    };
+
+    // Clamped rather than branched on, as which corners reach v is unpredictable
+    GLfloat out = 0;
+    for (int c = 0; c < 3; c++) {
+        GLfloat t = fmaxf(SIMPLEX_RADIUS - offsets[c].x * offsets[c].x - offsets[c].y * offsets[c].y, 0);
+        t *= t;
+        out += t * t * (gradients[c]->x * offsets[c].x + gradients[c]->y * offsets[c].y);
+    }
+    return out * SIMPLEX_SCALE;
+}
+
+// Each contribution is t^4 * (g . d) with t = r^2 - d . d, so its derivative is
+// t^4 * g - 8 * t^3 * (g . d) * d
+static GLfloat simplex_value_d(Perlin* perlin, Vector2 v, Vector2* derivative) {
+    int i, j, i1, j1;
+    Vector2 offsets[3];
+    simplex_corners(perlin, v, &i, &j, &i1, &j1, offsets);
+    Vector2* gradients[3] = {
+        perlin->vectorGrid[i][j], perlin->vectorGrid[i + i1][j + j1], perlin->vectorGrid[i + 1][j + 1]
+    };
+
+    GLfloat out = 0;
+    derivative->x = 0;
+    derivative->y = 0;
+    for (int c = 0; c < 3; c++) {
+        GLfloat t = SIMPLEX_RADIUS - offsets[c].x * offsets[c].x - offsets[c].y * offsets[c].y;
+        if (t > 0) {
+            GLfloat t2 = t * t;
+            GLfloat dot = dot_product_2(*gradients[c], offsets[c]);
+            out += t2 * t2 * dot;
+            derivative->x += t2 * t2 * gradients[c]->x - 8 * t2 * t * dot * offsets[c].x;
+            derivative->y += t2 * t2 * gradients[c]->y - 8 * t2 * t * dot * offsets[c].y;
+        }
+    }
+    derivative->x *= SIMPLEX_SCALE;
+    derivative->y *= SIMPLEX_SCALE;
+    return out * SIMPLEX_SCALE;
+}
+
+static GLfloat fixed_value(Perlin* perlin, Vector2 v, int interpolation_mode) {
+    return fixed_to_float(fixed_noise(perlin->seed, fixed_from_float(v.x), fixed_from_float(v.y), interpolation_mode));
+}
+
+GLfloat get_perlin_value(Perlin* perlin, Vector2 v, int interpolation_mode) {
+    if (perlin->backend == NOISE_SIMPLEX) return simplex_value(perlin, v);
+    if (perlin->backend == NOISE_FIXED) return fixed_value(perlin, v, interpolation_mode);
+    return classic_value(perlin, v, interpolation_mode);
+}
+
+GLfloat get_perlin_value_d(Perlin* perlin, Vector2 v, int interpolation_mode, Vector2* derivative) {
+    if (perlin->backend == NOISE_SIMPLEX) return simplex_value_d(perlin, v, derivative);
+    if (perlin->backend == NOISE_FIXED) {
+        fixed dx, dy;
+        fixed value = fixed_noise_d(perlin->seed, fixed_from_float(v.x), fixed_from_float(v.y),
+                                    interpolation_mode, &dx, &dy);
+        *derivative = (Vector2){fixed_to_float(dx), fixed_to_float(dy)};
+        return fixed_to_float(value);
+    }
+    return classic_value_d(perlin, v, interpolation_mode, derivative);
+}
+
+// The backend is chosen once for the whole batch, leaving a loop over the points
+// the compiler can inline the evaluation into
+void get_perlin_values(Perlin* perlin, const Vector2* points, int count, int interpolation_mode, GLfloat* out) {
+    if (perlin->backend == NOISE_SIMPLEX) {
+        for (int i = 0; i < count; i++) {
+            out[i] = simplex_value(perlin, points[i]);
+        }
+    } else if (perlin->backend == NOISE_FIXED) {
+        for (int i = 0; i < count; i++) {
+            out[i] = fixed_value(perlin, points[i], interpolation_mode);
+        }
+    } else {
+        for (int i = 0; i < count; i++) {
+            out[i] = classic_value(perlin, points[i], interpolation_mode);
+        }
+    }
+}
+
+// The 12 directions to the middles of a cube's edges, with 4 repeated so a hash can
+// pick one with its low 4 bits
+static const GLfloat gradients_3d[16][3] = {
+    {1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0},
+    {1, 0, 1}, {-1, 0, 1}, {1, 0, -1}, {-1, 0, -1},
+    {0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1},
+    {1, 1, 0}, {0, -1, 1}, {-1, 1, 0}, {0, -1, -1}
+};
+
+static GLfloat lerp(GLfloat a, GLfloat b, GLfloat t) {
+    return a + t * (b - a);
+}
+
+// Interpolates the 8 corner values, ordered by x then y then z, by the curves u, v, w
+static GLfloat trilerp(const GLfloat c[8], GLfloat u, GLfloat v, GLfloat w) {
+    return lerp(lerp(lerp(c[0], c[1], u), lerp(c[2], c[3], u), v),
+                lerp(lerp(c[4], c[5], u), lerp(c[6], c[7], u), v), w);
+}
+
+// Writes the derivative of 3D noise to derivative if it is not NULL. Like the 2D case,
+// it is the interpolated corner gradients plus each curve's derivative times the
+// change in the interpolated dot products along that axis.
+static GLfloat noise_3d(Perlin* perlin, Vector3 p, int mode, Vector3* derivative) {
+    GLfloat fx = floorf(p.x), fy = floorf(p.y), fz = floorf(p.z);
+    int x0 = (int) fx & 255, y0 = (int) fy & 255, z0 = (int) fz & 255;
+    GLfloat wx = p.x - fx, wy = p.y - fy, wz = p.z - fz;
+
+    const unsigned char* perm = perlin->permutation;
+    GLfloat dots[8];
+    const GLfloat* grads[8];
+    for (int c = 0; c < 8; c++) {
+        int dx = c & 1, dy = (c >> 1) & 1, dz = c >> 2;
+        int hash = perm[perm[perm[x0 + dx] + y0 + dy] + z0 + dz];
+        grads[c] = gradients_3d[hash & 15];
+        dots[c] = grads[c][0] * (wx - dx) + grads[c][1] * (wy - dy) + grads[c][2] * (wz - dz);
+    }
+
+    GLfloat u = interpolation_curve(wx, mode);
+    GLfloat v = interpolation_curve(wy, mode);
+    GLfloat w = interpolation_curve(wz, mode);
+    if (derivative != NULL) {
+        GLfloat gx[8], gy[8], gz[8];
+        for (int c = 0; c < 8; c++) {
+            gx[c] = grads[c][0];
+            gy[c] = grads[c][1];
+            gz[c] = grads[c][2];
+        }
+        GLfloat alongX = lerp(lerp(dots[1] - dots[0], dots[3] - dots[2], v),
+                              lerp(dots[5] - dots[4], dots[7] - dots[6], v), w);
+        GLfloat alongY = lerp(lerp(dots[2] - dots[0], dots[3] - dots[1], u),
+                              lerp(dots[6] - dots[4], dots[7] - dots[5], u), w);
+        GLfloat alongZ = lerp(lerp(dots[4] - dots[0], dots[5] - dots[1], u),
+                              lerp(dots[6] - dots[2], dots[7] - dots[3], u), v);
+        derivative->x = trilerp(gx, u, v, w) + interpolation_derivative(wx, mode) * alongX;
+        derivative->y = trilerp(gy, u, v, w) + interpolation_derivative(wy, mode) * alongY;
+        derivative->z = trilerp(gz, u, v, w) + interpolation_derivative(wz, mode) * alongZ;
+    }
+    return trilerp(dots, u, v, w);
+}
+
+GLfloat get_perlin_value_3d(Perlin* perlin, Vector3 p, int interpolation_mode) {
+    return noise_3d(perlin, p, interpolation_mode, NULL);
+}
+
+GLfloat get_perlin_value_3d_d(Perlin* perlin, Vector3 p, int interpolation_mode, Vector3* derivative) {
+    return noise_3d(perlin, p, interpolation_mode, derivative);
+}
+
+NoiseSlice* create_noise_slice(int xSize, int zSize) {
+    NoiseSlice* slice = malloc(sizeof(NoiseSlice));
+    if (slice == NULL) {
+        fprintf(stderr, "Allocation of noise slice failed.\n");
+        return NULL;
+    }
+    slice->corners = malloc(sizeof(GLfloat) * 3 * xSize * zSize);
+    if (slice->corners == NULL) {
+        fprintf(stderr, "Allocation of noise slice lattice failed.\n");
+        free(slice);
+        return NULL;
+    }
+    slice->xSize = xSize;
+    slice->zSize = zSize;
+    slice->mode = 0;
+    slice->z = 0;
+    return slice;
+}
+
+// At a lattice point the two corners above and below the plane contribute
+// lerp(g0 . (dx, dy, wz), g1 . (dx, dy, wz - 1), w), which is linear in (dx, dy)
+void set_noise_slice(NoiseSlice* slice, Perlin* perlin, GLfloat z, int mode) {
+    GLfloat fz = floorf(z);
+    int z0 = (int) fz & 255;
+    GLfloat wz = z - fz;
+    GLfloat w = interpolation_curve(wz, mode);
+    const unsigned char* perm = perlin->permutation;
+
+    for (int i = 0; i < slice->xSize; i++) {
+        for (int j = 0; j < slice->zSize; j++) {
+            int column = perm[perm[i & 255] + (j & 255)];
+            const GLfloat* g0 = gradients_3d[perm[column + z0] & 15];
+            const GLfloat* g1 = gradients_3d[perm[column + z0 + 1] & 15];
+            GLfloat* corner = &slice->corners[3 * (i * slice->zSize + j)];
+            corner[0] = lerp(g0[0], g1[0], w);
+            corner[1] = lerp(g0[1], g1[1], w);
+            corner[2] = lerp(g0[2] * wz, g1[2] * (wz - 1), w);
+        }
+    }
+    slice->mode = mode;
+    slice->z = z;
+}
+
+GLfloat get_slice_value(const NoiseSlice* slice, Vector2 v, Vector2* derivative) {
+    assert(v.x >= 0 && v.x <= slice->xSize - 1);
+    assert(v.y >= 0 && v.y <= slice->zSize - 1);
+    int x0 = (int) v.x;
+    if (x0 > slice->xSize - 2) x0 = slice->xSize - 2;
+    int y0 = (int) v.y;
+    if (y0 > slice->zSize - 2) y0 = slice->zSize - 2;
+    GLfloat wx = v.x - x0, wy = v.y - y0;
+
+    const GLfloat* c00 = &slice->corners[3 * (x0 * slice->zSize + y0)];
+    const GLfloat* c01 = c00 + 3;
+    const GLfloat* c10 = c00 + 3 * slice->zSize;
+    const GLfloat* c11 = c10 + 3;
+    GLfloat a = c00[0] * wx + c00[1] * wy + c00[2];
+    GLfloat b = c10[0] * (wx - 1) + c10[1] * wy + c10[2];
+    GLfloat c = c01[0] * wx + c01[1] * (wy - 1) + c01[2];
+    GLfloat d = c11[0] * (wx - 1) + c11[1] * (wy - 1) + c11[2];
+
+    GLfloat u = interpolation_curve(wx, slice->mode);
+    GLfloat w = interpolation_curve(wy, slice->mode);
+    if (derivative != NULL) {
+        GLfloat k = a - b - c + d;
+        GLfloat du = interpolation_derivative(wx, slice->mode);
+        GLfloat dw = interpolation_derivative(wy, slice->mode);
+        derivative->x = lerp(lerp(c00[0], c10[0], u), lerp(c01[0], c11[0], u), w) + du * (b - a + w * k);
+        derivative->y = lerp(lerp(c00[1], c10[1], u), lerp(c01[1], c11[1], u), w) + dw * (c - a + u * k);
+    }
+    return lerp(lerp(a, b, u), lerp(c, d, u), w);
+}
+
+void free_noise_slice(NoiseSlice* slice) {
+    free(slice->corners);
+    free(slice);
+}
@@ -3,20 +3,86 @@
 
 #include "structures.h"
 
+// The algorithms a perlin can evaluate with its gradients
+typedef enum {
+    NOISE_CLASSIC, // Square cells, interpolating between the dot products at 4 corners
+    NOISE_SIMPLEX, // Triangles, summing the falloff of 3 corners, without axis-aligned artefacts
+    NOISE_FIXED    // fixed_noise from the seed, identical on every build, needing no lattice
+} NoiseBackend;
+
 // Holds the grid of 2D gradient vectors used to generate perlin noise
 typedef struct {
     int xSize, zSize;
     Vector2*** vectorGrid;
+    NoiseBackend backend; // NOISE_CLASSIC unless changed after creation
+    uint32_t seed;        // Seed the gradients were made from, also used by NOISE_FIXED
+    unsigned char permutation[512]; // Hashes 3D lattice points, the first 256 repeated
 } Perlin;
 
 // Creates a perlin and its grid of random 2D gradient vectors
 // All gradient vectors are normalised to magnitude 1
 extern Perlin* create_perlin(int, int);
 
+// Creates a perlin like create_perlin, but with gradients from its own random sequence
+// so the same seed always gives the same perlin and no global state is used
+extern Perlin* create_perlin_seeded(int, int, uint32_t seed);
+
+// Returns how many gradients a perlin needs along a side so that a terrain of the given
+// size can be sampled at (position * frequency + offset) everywhere on it
+extern int perlin_lattice_size(int size, GLfloat frequency, GLfloat offset);
+
+// Returns the same for the simplex backend, whose skewed grid reaches further along
+// each side than the points sampled
+extern int simplex_lattice_size(int size, GLfloat frequency, GLfloat offset);
+
 // Frees the memory associated with perlin and its grid of vectors
 extern void free_perlin(Perlin* perlin);
 
-// Compute Perlin noise at certain coordinates
+// Compute Perlin noise at certain coordinates, between -1 and 1, with the perlin's backend.
+// The interpolation mode only applies to the classic backend.
+// PRE: 0 <= coordinates <= size - 1 along each axis, and the perlin is at least 2 by 2.
+// With the simplex backend the perlin must be sized with simplex_lattice_size, and the
+// fixed backend takes any coordinates.
 extern GLfloat get_perlin_value(Perlin*, Vector2, int);
 
+// Computes get_perlin_value for count points, writing the values to out
+extern void get_perlin_values(Perlin*, const Vector2* points, int count, int, GLfloat* out);
+
+// Computes the same value as get_perlin_value, and writes its analytic derivatives
+// with respect to the x and y of the coordinates to derivative
+extern GLfloat get_perlin_value_d(Perlin*, Vector2, int, Vector2* derivative);
+
+// Computes 3D gradient noise, between about -1 and 1, at any coordinates. Gradients come
+// from hashing the lattice points with the perlin's permutation, so there is no lattice
+// to outgrow and slices at nearby z are similar. The backend does not apply.
+extern GLfloat get_perlin_value_3d(Perlin*, Vector3, int);
+
+// Computes the same value as get_perlin_value_3d, and writes its analytic derivatives
+// with respect to each coordinate to derivative
+extern GLfloat get_perlin_value_3d_d(Perlin*, Vector3, int, Vector3* derivative);
+
+// The 3D noise on the plane at one z, flattened into a 2D lattice. Interpolating along z
+// first leaves each lattice point of the plane with a 2D gradient and a constant, so
+// points of the slice cost about as much as 2D noise instead of 8 hashed corners each.
+typedef struct {
+    int xSize, zSize;
+    int mode;       // Interpolation mode the slice was set with
+    GLfloat z;
+    GLfloat* corners; // Gradient x, gradient y and constant of each point, by x then y
+} NoiseSlice;
+
+// Creates a slice covering coordinates up to size - 1 along each axis
+extern NoiseSlice* create_noise_slice(int xSize, int zSize);
+
+// Recalculates the slice through the perlin's 3D noise at z with the interpolation mode
+extern void set_noise_slice(NoiseSlice*, Perlin*, GLfloat z, int mode);
+
+// Returns the same as get_perlin_value_3d at (v.x, v.y, z) up to rounding, and writes the
+// derivatives along x and y to derivative if it is not NULL
+// PRE: 0 <= coordinates <= size - 1 along each axis
+extern GLfloat get_slice_value(const NoiseSlice*, Vector2, Vector2* derivative);
+
+// Frees the slice and its lattice
+extern void free_noise_slice(NoiseSlice*);
+
 #endif
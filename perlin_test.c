@@ -63,6 +63,136 @@ int main(void) {
         }
     }
 
+    // Checking the far edge can be sampled and matches the values approaching it.
+    Vector2 edge = { .x = XSIZE - 1, .y = ZSIZE - 1 };
+    Vector2 nearEdge = { .x = XSIZE - 1 - 1e-3f, .y = ZSIZE - 1 - 1e-3f };
+    GLfloat edgeVal = get_perlin_value(perlin, edge, 2);
+    assert_test(edgeVal >= -EPSILON && edgeVal <= EPSILON, "Perlin far edge value zero.", TEST_OK_OUT, TEST_FAIL_OUT);
+    GLfloat nearVal = get_perlin_value(perlin, nearEdge, 2);
+    assert_test(fabsf(edgeVal - nearVal) <= EPSILON, "Perlin continuous at far edge.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Checking the lattice is sized to the sampled frequency.
+    assert_test(perlin_lattice_size(1000, 0.05, 0) == 51, "Lattice size for frequency.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(perlin_lattice_size(1000, 0.02, 1) == 22, "Lattice size with offset.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(perlin_lattice_size(1, 0.05, 0) == 2, "Lattice size at least 2.", TEST_OK_OUT, TEST_FAIL_OUT);
+    int lattice = perlin_lattice_size(250, 0.05, 0);
+    Perlin* small = create_perlin(lattice, lattice);
+    bool sampled = true;
+    for (int x = 0; x < 250; x++) {
+        Vector2 v = { .x = x * 0.05f, .y = 249 * 0.05f };
+        GLfloat val = get_perlin_value(small, v, 2);
+        sampled = sampled && val >= -1 - EPSILON && val <= 1 + EPSILON;
+    }
+    assert_test(sampled, "Sized lattice covers the terrain.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Checking the analytic derivatives against central differences, away from the
+    // lattice lines where mode 0 has a corner.
+    for (int mode = 0; mode <= 2; mode++) {
+        bool sameValue = true;
+        bool closeDerivative = true;
+        for (int i = 0; i < 200; i++) {
+            Vector2 v = {
+                .x = 1 + rand() % (XSIZE - 3) + 0.05 + 0.9 * ((double)rand()) / RAND_MAX,
+                .y = 1 + rand() % (ZSIZE - 3) + 0.05 + 0.9 * ((double)rand()) / RAND_MAX
+            };
+            Vector2 d;
+            GLfloat val = get_perlin_value_d(perlin, v, mode, &d);
+            sameValue = sameValue && val == get_perlin_value(perlin, v, mode);
+
+            GLfloat h = 1e-3f;
+            Vector2 xp = { v.x + h, v.y }, xm = { v.x - h, v.y };
+            Vector2 yp = { v.x, v.y + h }, ym = { v.x, v.y - h };
+            GLfloat dx = (get_perlin_value(perlin, xp, mode) - get_perlin_value(perlin, xm, mode)) / (2 * h);
+            GLfloat dy = (get_perlin_value(perlin, yp, mode) - get_perlin_value(perlin, ym, mode)) / (2 * h);
+            closeDerivative = closeDerivative && fabsf(dx - d.x) <= EPSILON && fabsf(dy - d.y) <= EPSILON;
+        }
+        assert_test(sameValue, "Perlin value with derivative unchanged.", TEST_OK_OUT, TEST_FAIL_OUT);
+        assert_test(closeDerivative, "Perlin derivative matches differences.", TEST_OK_OUT, TEST_FAIL_OUT);
+    }
+
+    // Checking the simplex backend over a lattice sized for it: bounded, matching its
+    // derivatives and giving the same values in a batch.
+    int simplexLattice = simplex_lattice_size(250, 0.05, 0);
+    Perlin* simplex = create_perlin_seeded(simplexLattice, simplexLattice, 5);
+    simplex->backend = NOISE_SIMPLEX;
+    Vector2 row[250];
+    GLfloat batch[250];
+    bool bounded = true;
+    bool batched = true;
+    bool closeSimplex = true;
+    GLfloat largest = 0;
+    for (int x = 0; x < 250; x++) {
+        for (int z = 0; z < 250; z++) {
+            row[z] = (Vector2){ x * 0.05f, z * 0.05f };
+        }
+        get_perlin_values(simplex, row, 250, 2, batch);
+        for (int z = 0; z < 250; z++) {
+            Vector2 d;
+            GLfloat val = get_perlin_value_d(simplex, row[z], 2, &d);
+            bounded = bounded && val >= -1 && val <= 1;
+            batched = batched && val == batch[z];
+            if (fabsf(val) > largest) largest = fabsf(val);
+
+            if (x == 0 || z == 0) continue;
+            GLfloat h = 1e-3f;
+            Vector2 xp = { row[z].x + h, row[z].y }, xm = { row[z].x - h, row[z].y };
+            Vector2 yp = { row[z].x, row[z].y + h }, ym = { row[z].x, row[z].y - h };
+            GLfloat dx = (get_perlin_value(simplex, xp, 2) - get_perlin_value(simplex, xm, 2)) / (2 * h);
+            GLfloat dy = (get_perlin_value(simplex, yp, 2) - get_perlin_value(simplex, ym, 2)) / (2 * h);
+            closeSimplex = closeSimplex && fabsf(dx - d.x) <= 0.05 && fabsf(dy - d.y) <= 0.05;
+        }
+    }
+    assert_test(bounded, "Simplex values bounded.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(largest > 0.5, "Simplex values use the range.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(batched, "Simplex batch matches single values.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(closeSimplex, "Simplex derivative matches differences.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    Vector2 cornerRow[3] = { {0, 0}, {1.5f, 2.25f}, {XSIZE - 1, ZSIZE - 1} };
+    GLfloat cornerBatch[3];
+    get_perlin_values(perlin, cornerRow, 3, 1, cornerBatch);
+    assert_test(cornerBatch[1] == get_perlin_value(perlin, cornerRow[1], 1), "Classic batch matches single values.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Checking 3D noise: bounded, continuous through a slice's z, matching its
+    // derivatives and the same for the same seed.
+    Perlin* again = create_perlin_seeded(simplexLattice, simplexLattice, 5);
+    bool bounded3d = true;
+    bool continuous = true;
+    bool close3d = true;
+    bool repeatable = true;
+    for (int i = 0; i < 2000; i++) {
+        Vector3 p = {
+            ((double)rand()) / RAND_MAX * 300 - 20,
+            ((double)rand()) / RAND_MAX * 300 - 20,
+            ((double)rand()) / RAND_MAX * 10
+        };
+        int mode = i % 3;
+        Vector3 d;
+        GLfloat val = get_perlin_value_3d_d(simplex, p, mode, &d);
+        bounded3d = bounded3d && val >= -1.1 && val <= 1.1;
+        repeatable = repeatable && val == get_perlin_value_3d(again, p, mode);
+        Vector3 later = { p.x, p.y, p.z + 1e-3f };
+        continuous = continuous && fabsf(get_perlin_value_3d(simplex, later, 2) - get_perlin_value_3d(simplex, p, 2)) <= EPSILON;
+
+        // Mode 0 has corners on the lattice planes, so is only checked inside cells
+        GLfloat h = 1e-3f;
+        if (mode == 0 && (fabsf(p.x - roundf(p.x)) < 2 * h || fabsf(p.y - roundf(p.y)) < 2 * h ||
+                          fabsf(p.z - roundf(p.z)) < 2 * h)) continue;
+        Vector3 xp = { p.x + h, p.y, p.z }, xm = { p.x - h, p.y, p.z };
+        Vector3 yp = { p.x, p.y + h, p.z }, ym = { p.x, p.y - h, p.z };
+        Vector3 zp = { p.x, p.y, p.z + h }, zm = { p.x, p.y, p.z - h };
+        GLfloat dx = (get_perlin_value_3d(simplex, xp, mode) - get_perlin_value_3d(simplex, xm, mode)) / (2 * h);
+        GLfloat dy = (get_perlin_value_3d(simplex, yp, mode) - get_perlin_value_3d(simplex, ym, mode)) / (2 * h);
+        GLfloat dz = (get_perlin_value_3d(simplex, zp, mode) - get_perlin_value_3d(simplex, zm, mode)) / (2 * h);
+        close3d = close3d && fabsf(dx - d.x) <= 0.05 && fabsf(dy - d.y) <= 0.05 && fabsf(dz - d.z) <= 0.05;
+    }
+    assert_test(bounded3d, "3D values bounded.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(continuous, "3D values continuous in time.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(close3d, "3D derivative matches differences.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(repeatable, "3D values repeat with the seed.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    free_perlin(again);
+    free_perlin(simplex);
+    free_perlin(small);
     free_perlin(perlin);
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <math.h>
+#include "query.h"
+#include "parallel.h"
+
+GLfloat terrainHeightAt(Terrain* terrain, GLfloat x, GLfloat z) {
+    if (x < 0) x = 0;
+    if (z < 0) z = 0;
+    if (x > terrain->xSize - 1) x = terrain->xSize - 1;
+    if (z > terrain->zSize - 1) z = terrain->zSize - 1;
+    int x0 = (int) x;
+    int z0 = (int) z;
+    if (x0 > terrain->xSize - 2) x0 = (terrain->xSize > 1) ? terrain->xSize - 2 : 0;
+    if (z0 > terrain->zSize - 2) z0 = (terrain->zSize > 1) ? terrain->zSize - 2 : 0;
+    int x1 = (terrain->xSize > 1) ? x0 + 1 : x0;
+    int z1 = (terrain->zSize > 1) ? z0 + 1 : z0;
+    GLfloat u = x - x0;
+    GLfloat v = z - z0;
+
+    GLfloat** h = terrain->heights;
+    GLfloat near = h[x0][z0] + u * (h[x1][z0] - h[x0][z0]);
+    GLfloat far = h[x0][z1] + u * (h[x1][z1] - h[x0][z1]);
+    return near + v * (far - near);
+}
+
+void terrainHeightsAt(Terrain* terrain, const Vector2* points, int count, GLfloat* out) {
+    for (int i = 0; i < count; i++) {
+        out[i] = terrainHeightAt(terrain, points[i].x, points[i].y);
+    }
+}
+
+// A ray with the reciprocals of its direction, worked out once for every box it is tested against
+typedef struct {
+    TerrainRay ray;
+    Vector3 inverse;
+} RayState;
+
+// Narrows [near, far] to where the ray is between low and high along one axis,
+// returning false if it never is
+static bool clipSlab(GLfloat origin, GLfloat direction, GLfloat inverse, GLfloat low, GLfloat high,
+                     GLfloat* near, GLfloat* far) {
+    if (direction == 0) return origin >= low && origin <= high;
+    GLfloat t0 = (low - origin) * inverse;
+    GLfloat t1 = (high - origin) * inverse;
+    if (t0 > t1) {
+        GLfloat swap = t0;
+        t0 = t1;
+        t1 = swap;
+    }
+    if (t0 > *near) *near = t0;
+    if (t1 < *far) *far = t1;
+    return *near <= *far;
+}
+
+// The plain cross product, as cross_product_3 normalises and turns its result upwards
+static Vector3 cross(Vector3 a, Vector3 b) {
+    return (Vector3){a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+// Moller-Trumbore, updating the hit if the triangle is nearer than it
+static void hitTriangle(const TerrainRay* ray, Vector3 a, Vector3 b, Vector3 c, TerrainHit* hit) {
+    Vector3 e1 = {b.x - a.x, b.y - a.y, b.z - a.z};
+    Vector3 e2 = {c.x - a.x, c.y - a.y, c.z - a.z};
+    Vector3 p = cross(ray->direction, e2);
+    GLfloat det = dot_product_3(e1, p);
+    if (fabsf(det) < 1e-12f) return;
+    GLfloat invDet = 1.0f / det;
+    Vector3 s = {ray->origin.x - a.x, ray->origin.y - a.y, ray->origin.z - a.z};
+    GLfloat u = dot_product_3(s, p) * invDet;
+    if (u < 0 || u > 1) return;
+    Vector3 q = cross(s, e1);
+    GLfloat v = dot_product_3(ray->direction, q) * invDet;
+    if (v < 0 || u + v > 1) return;
+    GLfloat t = dot_product_3(e2, q) * invDet;
+    if (t < 0 || t > hit->t) return;
+    hit->hit = true;
+    hit->t = t;
+}
+
+// The two triangles of the cell, split the same way as the mesh
+static void hitCell(Terrain* terrain, const TerrainRay* ray, int x, int z, TerrainHit* hit) {
+    GLfloat** h = terrain->heights;
+    Vector3 v00 = {x, h[x][z], z};
+    Vector3 v10 = {x + 1, h[x + 1][z], z};
+    Vector3 v01 = {x, h[x][z + 1], z + 1};
+    Vector3 v11 = {x + 1, h[x + 1][z + 1], z + 1};
+    hitTriangle(ray, v00, v10, v01, hit);
+    hitTriangle(ray, v10, v11, v01, hit);
+}
+
+// Visits the entry of a pyramid level if the ray passes through its box before the
+// nearest hit so far, descending into its children nearest first
+static void raycastNode(Terrain* terrain, const RayState* state, int level, int x, int z, TerrainHit* hit) {
+    HeightPyramid* pyramid = &terrain->pyramid;
+    int index = x * pyramid->zCells[level] + z;
+    int span = 1 << level;
+    GLfloat x0 = (GLfloat) x * span;
+    GLfloat z0 = (GLfloat) z * span;
+    GLfloat x1 = fminf(x0 + span, pyramid->xCells[0]);
+    GLfloat z1 = fminf(z0 + span, pyramid->zCells[0]);
+
+    const TerrainRay* ray = &state->ray;
+    GLfloat near = 0, far = hit->t;
+    if (!clipSlab(ray->origin.x, ray->direction.x, state->inverse.x, x0, x1, &near, &far) ||
+        !clipSlab(ray->origin.z, ray->direction.z, state->inverse.z, z0, z1, &near, &far) ||
+        !clipSlab(ray->origin.y, ray->direction.y, state->inverse.y,
+                  pyramid->min[level][index], pyramid->max[level][index], &near, &far)) {
+        return;
+    }
+
+    if (level == 0) {
+        hitCell(terrain, ray, x, z, hit);
+        return;
+    }
+    // Children the ray reaches first are visited first, so later ones are usually cut off
+    int firstX = (ray->direction.x < 0) ? 1 : 0;
+    int firstZ = (ray->direction.z < 0) ? 1 : 0;
+    for (int i = 0; i < 4; i++) {
+        int cx = 2 * x + ((i & 1) ^ firstX);
+        int cz = 2 * z + (((i >> 1) & 1) ^ firstZ);
+        if (cx < pyramid->xCells[level - 1] && cz < pyramid->zCells[level - 1]) {
+            raycastNode(terrain, state, level - 1, cx, cz, hit);
+        }
+    }
+}
+
+bool raycastTerrain(Terrain* terrain, TerrainRay ray, TerrainHit* hit) {
+    *hit = (TerrainHit){.hit = false, .t = ray.length};
+    if (terrain->xSize < 2 || terrain->zSize < 2) return false;
+    RayState state = {
+        .ray = ray,
+        .inverse = {1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z}
+    };
+    raycastNode(terrain, &state, terrain->pyramid.levels - 1, 0, 0, hit);
+    if (hit->hit) {
+        hit->point = (Vector3){
+            ray.origin.x + hit->t * ray.direction.x,
+            ray.origin.y + hit->t * ray.direction.y,
+            ray.origin.z + hit->t * ray.direction.z
+        };
+    }
+    return hit->hit;
+}
+
+typedef struct {
+    Terrain* terrain;
+    const TerrainRay* rays;
+    TerrainHit* hits;
+} RayJob;
+
+static void raycastRange(void* context, int begin, int end) {
+    RayJob* job = context;
+    for (int i = begin; i < end; i++) {
+        raycastTerrain(job->terrain, job->rays[i], &job->hits[i]);
+    }
+}
+
+void raycastTerrainBatch(Terrain* terrain, const TerrainRay* rays, int count, TerrainHit* hits) {
+    RayJob job = {terrain, rays, hits};
+    parallel_for(count, raycastRange, &job);
+}
+
+// Takes in the entry of a pyramid level if the rectangle covers every point of it,
+// otherwise the children overlapping the rectangle, down to single points at level 0
+static void regionNode(Terrain* terrain, TerrainRect rect, int level, int x, int z, GLfloat* min, GLfloat* max) {
+    HeightPyramid* pyramid = &terrain->pyramid;
+    int span = 1 << level;
+    // Points covered, inclusive
+    int px0 = x * span, pz0 = z * span;
+    int px1 = (px0 + span < pyramid->xCells[0]) ? px0 + span : pyramid->xCells[0];
+    int pz1 = (pz0 + span < pyramid->zCells[0]) ? pz0 + span : pyramid->zCells[0];
+    if (px1 >= terrain->xSize) px1 = terrain->xSize - 1;
+    if (pz1 >= terrain->zSize) pz1 = terrain->zSize - 1;
+    if (px1 < rect.x0 || px0 >= rect.x1 || pz1 < rect.z0 || pz0 >= rect.z1) return;
+
+    int index = x * pyramid->zCells[level] + z;
+    if (px0 >= rect.x0 && px1 < rect.x1 && pz0 >= rect.z0 && pz1 < rect.z1) {
+        if (pyramid->min[level][index] < *min) *min = pyramid->min[level][index];
+        if (pyramid->max[level][index] > *max) *max = pyramid->max[level][index];
+        return;
+    }
+
+    if (level == 0) {
+        for (int px = px0; px <= px1; px++) {
+            for (int pz = pz0; pz <= pz1; pz++) {
+                if (px < rect.x0 || px >= rect.x1 || pz < rect.z0 || pz >= rect.z1) continue;
+                GLfloat h = terrain->heights[px][pz];
+                if (h < *min) *min = h;
+                if (h > *max) *max = h;
+            }
+        }
+        return;
+    }
+    for (int cx = 2 * x; cx < 2 * x + 2 && cx < pyramid->xCells[level - 1]; cx++) {
+        for (int cz = 2 * z; cz < 2 * z + 2 && cz < pyramid->zCells[level - 1]; cz++) {
+            regionNode(terrain, rect, level - 1, cx, cz, min, max);
+        }
+    }
+}
+
+void terrainRegionMinMax(Terrain* terrain, TerrainRect rect, GLfloat* min, GLfloat* max) {
+    *min = INFINITY;
+    *max = -INFINITY;
+    regionNode(terrain, rect, terrain->pyramid.levels - 1, 0, 0, min, max);
+}
+
+void terrainRegionsMinMax(Terrain* terrain, const TerrainRect* rects, int count, GLfloat* min, GLfloat* max) {
+    for (int i = 0; i < count; i++) {
+        terrainRegionMinMax(terrain, rects[i], &min[i], &max[i]);
+    }
+}
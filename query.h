@@ -0,0 +1,46 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdbool.h>
+#include "structures.h"
+#include "terrain.h"
+
+// The points origin + t * direction for t from 0 to length, in the terrain's coordinates
+// where point (x, z) of the grid is at (x, heights[x][z], z)
+typedef struct {
+    Vector3 origin, direction;
+    GLfloat length;
+} TerrainRay;
+
+// Where a ray first meets the terrain, if it does
+typedef struct {
+    bool hit;
+    GLfloat t;
+    Vector3 point;
+} TerrainHit;
+
+// Returns the height at (x, z) interpolated bilinearly between the 4 surrounding points,
+// with points outside the terrain taking the height at its nearest edge
+extern GLfloat terrainHeightAt(Terrain*, GLfloat x, GLfloat z);
+
+// Writes terrainHeightAt for every point (x, y as z) to out
+extern void terrainHeightsAt(Terrain*, const Vector2* points, int count, GLfloat* out);
+
+// Finds the first point along the ray on the triangles the terrain is drawn with.
+// The height pyramid skips every square the ray passes over or under, so a ray visits
+// around log(size) squares rather than every cell under it.
+// Returns whether the ray hit, also writing the result to hit.
+extern bool raycastTerrain(Terrain*, TerrainRay, TerrainHit* hit);
+
+// Casts every ray on all threads, writing the results to hits
+extern void raycastTerrainBatch(Terrain*, const TerrainRay* rays, int count, TerrainHit* hits);
+
+// Writes the lowest and highest heights of the points in the rectangle, which must be
+// inside the terrain and not empty. Squares of the pyramid inside the rectangle are
+// used whole, so only the cells along its edges are looked at individually.
+extern void terrainRegionMinMax(Terrain*, TerrainRect, GLfloat* min, GLfloat* max);
+
+// Writes terrainRegionMinMax of every rectangle to min and max
+extern void terrainRegionsMinMax(Terrain*, const TerrainRect* rects, int count, GLfloat* min, GLfloat* max);
+
+#endif
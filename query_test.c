@@ -0,0 +1,169 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "query.h"
+#include "terrain.h"
+#include "structures.h"
+#include "testing.h"
+
+#define X_SIZE 130
+#define Z_SIZE 97
+#define HEIGHT 30
+#define RAYS 3000
+#define EPSILON 0.001
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+static Vector3 cross(Vector3 a, Vector3 b) {
+    return (Vector3){a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+// Tests the ray against the triangles of every cell
+static bool brute_force_raycast(Terrain* terrain, TerrainRay ray, GLfloat* nearest) {
+    *nearest = ray.length;
+    bool hit = false;
+    for (int x = 0; x < terrain->xSize - 1; x++) {
+        for (int z = 0; z < terrain->zSize - 1; z++) {
+            GLfloat** h = terrain->heights;
+            Vector3 corners[2][3] = {
+                {{x, h[x][z], z}, {x + 1, h[x + 1][z], z}, {x, h[x][z + 1], z + 1}},
+                {{x + 1, h[x + 1][z], z}, {x + 1, h[x + 1][z + 1], z + 1}, {x, h[x][z + 1], z + 1}}
+            };
+            for (int i = 0; i < 2; i++) {
+                Vector3 a = corners[i][0], b = corners[i][1], c = corners[i][2];
+                Vector3 e1 = {b.x - a.x, b.y - a.y, b.z - a.z};
+                Vector3 e2 = {c.x - a.x, c.y - a.y, c.z - a.z};
+                Vector3 p = cross(ray.direction, e2);
+                GLfloat det = dot_product_3(e1, p);
+                if (fabsf(det) < 1e-12f) continue;
+                Vector3 s = {ray.origin.x - a.x, ray.origin.y - a.y, ray.origin.z - a.z};
+                GLfloat u = dot_product_3(s, p) / det;
+                Vector3 q = cross(s, e1);
+                GLfloat v = dot_product_3(ray.direction, q) / det;
+                GLfloat t = dot_product_3(e2, q) / det;
+                if (u >= 0 && v >= 0 && u + v <= 1 && t >= 0 && t <= *nearest) {
+                    *nearest = t;
+                    hit = true;
+                }
+            }
+        }
+    }
+    return hit;
+}
+
+// Random rays from above the terrain towards points below it, some starting off its edges
+static TerrainRay random_ray(uint32_t* state) {
+    Vector3 origin = {
+        random_float(state) * (X_SIZE + 40) - 20,
+        45 + random_float(state) * 20,
+        random_float(state) * (Z_SIZE + 40) - 20
+    };
+    Vector3 target = {random_float(state) * X_SIZE, -HEIGHT * 2, random_float(state) * Z_SIZE};
+    // Some rays straight along the axes to cover the zero direction components
+    if (random_next(state) % 10 == 0) target.x = origin.x;
+    if (random_next(state) % 10 == 0) target.z = origin.z;
+    Vector3 direction = {target.x - origin.x, target.y - origin.y, target.z - origin.z};
+    GLfloat length = sqrtf(dot_product_3(direction, direction));
+    return (TerrainRay){
+        origin, {direction.x / length, direction.y / length, direction.z / length}, length
+    };
+}
+
+// Returns whether every ray finds the same hit as brute force
+static bool rays_match(Terrain* terrain, uint32_t seed) {
+    uint32_t state = seed;
+    TerrainRay* rays = malloc(sizeof(TerrainRay) * RAYS);
+    TerrainHit* hits = malloc(sizeof(TerrainHit) * RAYS);
+    for (int i = 0; i < RAYS; i++) {
+        rays[i] = random_ray(&state);
+    }
+    raycastTerrainBatch(terrain, rays, RAYS, hits);
+
+    bool matching = true;
+    int hitCount = 0;
+    for (int i = 0; i < RAYS; i++) {
+        GLfloat expected;
+        bool hit = brute_force_raycast(terrain, rays[i], &expected);
+        TerrainHit single;
+        raycastTerrain(terrain, rays[i], &single);
+        hitCount += hit;
+        matching = matching && hit == hits[i].hit && single.hit == hits[i].hit && single.t == hits[i].t;
+        if (hit && hits[i].hit) {
+            matching = matching && fabsf(expected - hits[i].t) < EPSILON;
+            Vector3 p = hits[i].point;
+            matching = matching && fabsf(p.y - terrainHeightAt(terrain, p.x, p.z)) < 0.5f;
+        }
+    }
+    free(rays);
+    free(hits);
+    // A test where nothing hits would prove nothing
+    return matching && hitCount > RAYS / 4 && hitCount < RAYS;
+}
+
+// Returns whether every region's bounds match a scan of its points
+static bool regions_match(Terrain* terrain, uint32_t seed) {
+    uint32_t state = seed;
+    bool matching = true;
+    for (int i = 0; i < 500; i++) {
+        TerrainRect rect;
+        rect.x0 = random_next(&state) % X_SIZE;
+        rect.z0 = random_next(&state) % Z_SIZE;
+        rect.x1 = rect.x0 + 1 + random_next(&state) % (X_SIZE - rect.x0);
+        rect.z1 = rect.z0 + 1 + random_next(&state) % (Z_SIZE - rect.z0);
+        GLfloat low = INFINITY, high = -INFINITY;
+        for (int x = rect.x0; x < rect.x1; x++) {
+            for (int z = rect.z0; z < rect.z1; z++) {
+                low = fminf(low, terrain->heights[x][z]);
+                high = fmaxf(high, terrain->heights[x][z]);
+            }
+        }
+        GLfloat min, max;
+        terrainRegionsMinMax(terrain, &rect, 1, &min, &max);
+        matching = matching && min == low && max == high;
+    }
+    return matching;
+}
+
+int main(void) {
+    printf("Testing Queries: \n");
+    Terrain* terrain = createTerrain(X_SIZE, Z_SIZE, HEIGHT);
+    populateTerrain(terrain, test_hills, NULL);
+
+    // Heights on the grid points, between them and off the edges
+    bool heights = terrainHeightAt(terrain, 17, 23) == terrain->heights[17][23];
+    GLfloat middle = terrainHeightAt(terrain, 17.5f, 23.5f);
+    GLfloat average = (terrain->heights[17][23] + terrain->heights[18][23]
+                     + terrain->heights[17][24] + terrain->heights[18][24]) / 4;
+    heights = heights && fabsf(middle - average) < EPSILON;
+    heights = heights && terrainHeightAt(terrain, -10, -3) == terrain->heights[0][0];
+    heights = heights && terrainHeightAt(terrain, X_SIZE + 5, Z_SIZE) == terrain->heights[X_SIZE - 1][Z_SIZE - 1];
+    Vector2 points[2] = {{17, 23}, {17.5f, 23.5f}};
+    GLfloat batch[2];
+    terrainHeightsAt(terrain, points, 2, batch);
+    heights = heights && batch[0] == terrain->heights[17][23] && batch[1] == middle;
+    assert_test(heights, "Heights interpolated and clamped.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    HeightPyramid* pyramid = &terrain->pyramid;
+    int top = pyramid->levels - 1;
+    assert_test(pyramid->xCells[top] == 1 && pyramid->zCells[top] == 1 && pyramid->xCells[0] == X_SIZE - 1,
+                "Pyramid reduces to one entry.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    assert_test(rays_match(terrain, 11), "Raycasts match brute force.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(regions_match(terrain, 12), "Region bounds match brute force.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // The pyramid follows edits to the heights
+    stampTerrain(terrain, 60, 40, 12, 100);
+    stampTerrain(terrain, X_SIZE - 1, 0, 9, -100);
+    GLfloat low, high;
+    TerrainRect whole = {0, 0, X_SIZE, Z_SIZE};
+    terrainRegionMinMax(terrain, whole, &low, &high);
+    assert_test(high == pyramid->max[top][0] && high == terrain->heights[60][40] && low == terrain->heights[X_SIZE - 1][0],
+                "Pyramid includes stamped heights.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(rays_match(terrain, 13), "Raycasts match after stamping.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(regions_match(terrain, 14), "Region bounds match after stamping.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    freeTerrain(terrain);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "softrender.h"
+#include "mesh.h"
+#include "terrain.h"
+#include "parallel.h"
+#include "structures.h"
+#include "testing.h"
+
+#define SIZE 96
+#define HEIGHT 12
+#define WIDTH 160
+#define HEIGHT_PIXELS 120
+#define GOLDEN_IMAGE "render_test.ppm"
+
+// Mean channel difference and fraction of pixels off by more than the threshold
+// allowed against the golden image, for differences in floating point between machines
+#define MEAN_TOLERANCE 1.0
+#define OUTLIER_THRESHOLD 24
+#define OUTLIER_TOLERANCE 0.01
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+// Green lowlands up to white peaks, so both lighting and colour show up in the image
+static Vector3 shade(const ColourParams* params, GLfloat x, GLfloat y, GLfloat z) {
+    GLfloat t = fmaxf(0.0f, fminf(1.0f, y / params->height));
+    return (Vector3){0.1f + 0.9f * t, 0.6f + 0.4f * t, 0.1f + 0.9f * t};
+}
+
+// Looks down at the terrain from one corner, like the overhead view
+static SoftScene overhead_scene(void) {
+    Vector3 eye = {-20.0f, 70.0f, SIZE + 40.0f};
+    Vector3 centre = {SIZE / 2.0f, 0.0f, SIZE / 2.0f};
+    SoftScene scene = {
+        .projection = matrix_perspective(45.0f, (GLfloat) WIDTH / HEIGHT_PIXELS, 1.0f, 1000.0f),
+        .modelview = matrix_look_at(eye, centre, (Vector3){0.0f, 1.0f, 0.0f}),
+        .clearColour = {0.5f, 0.75f, 1.0f},
+        .lightDirection = {1.0f, 1.0f, 1.0f},
+        .water = true,
+        .xSize = SIZE,
+        .zSize = SIZE
+    };
+    return scene;
+}
+
+static bool same_pixels(SoftImage* a, SoftImage* b) {
+    return memcmp(a->pixels, b->pixels, (size_t) a->width * a->height * 3) == 0;
+}
+
+// Run with -u to replace the golden image after an intended change to the output
+int main(int argc, char** argv) {
+    printf("Testing Software Renderer: \n");
+    Terrain* terrain = createTerrain(SIZE, SIZE, HEIGHT);
+    populateTerrain(terrain, test_hills, NULL);
+    ColourParams params = {HEIGHT, NULL};
+    TerrainMesh* mesh = createTerrainMesh(SIZE, SIZE);
+    fillTerrainVertices(mesh, terrain, shade, &params, (TerrainRect){0, 0, SIZE, SIZE});
+    SoftScene scene = overhead_scene();
+
+    parallel_set_threads(1);
+    SoftImage* serial = createSoftImage(WIDTH, HEIGHT_PIXELS);
+    renderTerrainMesh(serial, &scene, mesh);
+    parallel_set_threads(4);
+    SoftImage* threaded = createSoftImage(WIDTH, HEIGHT_PIXELS);
+    renderTerrainMesh(threaded, &scene, mesh);
+    parallel_set_threads(0);
+    assert_test(same_pixels(serial, threaded), "Image independent of threads.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // The terrain fills the middle of the image and the sky is left in the corners
+    const GLubyte* corner = &serial->pixels[0];
+    const GLubyte* middle = &serial->pixels[((HEIGHT_PIXELS / 2) * WIDTH + WIDTH / 2) * 3];
+    assert_test(corner[0] == 128 && corner[1] == 191 && corner[2] == 255, "Background is the clear colour.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(middle[0] != corner[0] || middle[1] != corner[1] || middle[2] != corner[2],
+                "Terrain drawn over the background.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Water is blended over the terrain below 0
+    SoftScene dry = scene;
+    dry.water = false;
+    SoftImage* noWater = createSoftImage(WIDTH, HEIGHT_PIXELS);
+    renderTerrainMesh(noWater, &dry, mesh);
+    assert_test(!same_pixels(serial, noWater), "Water changes the image.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Compact vertices draw nearly the same image
+    CompactMesh* compact = createCompactMesh(SIZE, SIZE);
+    takeTerrainDirty(terrain);
+    markTerrainDirty(terrain, (TerrainRect){0, 0, SIZE, SIZE});
+    updateCompactMesh(compact, terrain, shade, &params);
+    SoftImage* compactImage = createSoftImage(WIDTH, HEIGHT_PIXELS);
+    renderCompactMesh(compactImage, &scene, compact);
+    double outliers;
+    double mean = compareSoftImages(serial, compactImage, OUTLIER_THRESHOLD, &outliers);
+    assert_test(mean < 2.0 && outliers < 0.02, "Compact mesh matches full mesh.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // A coarse mesh lit from the normal map looks close to the full mesh, apart from
+    // where its flatter hills change the outline
+    CoarseMesh* coarse = createCoarseMesh(SIZE, SIZE, 4);
+    markTerrainDirty(terrain, (TerrainRect){0, 0, SIZE, SIZE});
+    updateCoarseMesh(coarse, terrain, shade, &params);
+    SoftImage* coarseImage = createSoftImage(WIDTH, HEIGHT_PIXELS);
+    renderCoarseMesh(coarseImage, &scene, coarse);
+    double coarseOutliers;
+    double coarseMean = compareSoftImages(serial, coarseImage, OUTLIER_THRESHOLD, &coarseOutliers);
+    assert_test(coarseMean < 4.0 && coarseOutliers < 0.08, "Coarse mesh close to full mesh.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Compare against the golden image
+    if (argc > 1 && strcmp(argv[1], "-u") == 0) {
+        assert_test(writeSoftImage(serial, GOLDEN_IMAGE), "Golden image updated.", stdout, TEST_FAIL_OUT);
+    }
+    SoftImage* golden = readSoftImage(GOLDEN_IMAGE);
+    assert_test(golden != NULL, "Golden image read.", TEST_OK_OUT, TEST_FAIL_OUT);
+    if (golden != NULL) {
+        mean = compareSoftImages(serial, golden, OUTLIER_THRESHOLD, &outliers);
+        if (mean >= MEAN_TOLERANCE || outliers >= OUTLIER_TOLERANCE) {
+            printf("Mean difference %.3f, %.2f%% of pixels differ.\n", mean, outliers * 100);
+        }
+        assert_test(mean < MEAN_TOLERANCE && outliers < OUTLIER_TOLERANCE, "Image matches golden image.", TEST_OK_OUT, TEST_FAIL_OUT);
+    }
+
+    freeSoftImage(golden);
+    freeSoftImage(serial);
+    freeSoftImage(threaded);
+    freeSoftImage(noWater);
+    freeSoftImage(compactImage);
+    freeSoftImage(coarseImage);
+    freeCompactMesh(compact);
+    freeCoarseMesh(coarse);
+    freeTerrainMesh(mesh);
+    freeTerrain(terrain);
+    return EXIT_SUCCESS;
+}
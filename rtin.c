@@ -0,0 +1,215 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "rtin.h"
+
+Rtin* createRtin(int xSize, int zSize) {
+    Rtin* rtin = malloc(sizeof(Rtin));
+    assert(rtin != NULL);
+    rtin->xSize = xSize;
+    rtin->zSize = zSize;
+    int largest = (xSize > zSize) ? xSize : zSize;
+    rtin->gridSize = 2;
+    while (rtin->gridSize < largest) rtin->gridSize = 2 * rtin->gridSize - 1;
+    rtin->errors = calloc((size_t) rtin->gridSize * rtin->gridSize, sizeof(GLfloat));
+    assert(rtin->errors != NULL);
+    return rtin;
+}
+
+// A triangle by its corners, c at the right angle and the long side from a to b
+typedef struct {
+    int ax, az, bx, bz, cx, cz;
+} RtinTriangle;
+
+// The two halves of a split, each with its right angle at the middle of the long side
+static RtinTriangle leftHalf(RtinTriangle t) {
+    return (RtinTriangle){t.cx, t.cz, t.ax, t.az, (t.ax + t.bx) / 2, (t.az + t.bz) / 2};
+}
+
+static RtinTriangle rightHalf(RtinTriangle t) {
+    return (RtinTriangle){t.bx, t.bz, t.cx, t.cz, (t.ax + t.bx) / 2, (t.az + t.bz) / 2};
+}
+
+static int minimum3(int a, int b, int c) {
+    return (a < b) ? ((a < c) ? a : c) : ((b < c) ? b : c);
+}
+
+static int maximum3(int a, int b, int c) {
+    return (a > b) ? ((a > c) ? a : c) : ((b > c) ? b : c);
+}
+
+// Whether the triangle is inside the terrain, outside it, or crosses its edges
+typedef enum { RTIN_INSIDE, RTIN_OUTSIDE, RTIN_CROSSING } RtinCoverage;
+
+static RtinCoverage coverage(const Rtin* rtin, RtinTriangle t) {
+    if (minimum3(t.ax, t.bx, t.cx) >= rtin->xSize || minimum3(t.az, t.bz, t.cz) >= rtin->zSize) return RTIN_OUTSIDE;
+    if (maximum3(t.ax, t.bx, t.cx) < rtin->xSize && maximum3(t.az, t.bz, t.cz) < rtin->zSize) return RTIN_INSIDE;
+    return RTIN_CROSSING;
+}
+
+// Whether the error of the triangle's split can depend on heights inside rect. It takes
+// in the triangle across the long side and every split below either, which stay within
+// the long side's length of the box around that side. Only the long side is used, so the
+// triangles on both sides of it agree, and the halves never reach past the whole.
+static bool reaches(RtinTriangle t, TerrainRect rect) {
+    int reach = ((abs(t.ax - t.bx) > abs(t.az - t.bz)) ? abs(t.ax - t.bx) : abs(t.az - t.bz)) + 1;
+    return ((t.ax < t.bx) ? t.ax : t.bx) - reach < rect.x1 && ((t.ax > t.bx) ? t.ax : t.bx) + reach >= rect.x0
+           && ((t.az < t.bz) ? t.az : t.bz) - reach < rect.z1 && ((t.az > t.bz) ? t.az : t.bz) + reach >= rect.z0;
+}
+
+// Zeroes the errors of the splits down to depth levels below the triangle which reach rect
+static void clearErrors(Rtin* rtin, RtinTriangle t, int depth, TerrainRect rect) {
+    if (!reaches(t, rect)) return;
+    rtin->errors[(t.ax + t.bx) / 2 * rtin->gridSize + (t.az + t.bz) / 2] = 0.0f;
+    if (depth > 0) {
+        clearErrors(rtin, leftHalf(t), depth - 1, rect);
+        clearErrors(rtin, rightHalf(t), depth - 1, rect);
+    }
+}
+
+// Works out the errors of the splits depth levels below the triangle which reach rect.
+// Every level is done before the one above it, so when a split takes in the errors of its
+// halves' splits they already hold those of the triangles on the other side of them too.
+static void levelErrors(Rtin* rtin, const Terrain* terrain, RtinTriangle t, int depth, bool halvesSplit,
+                        TerrainRect rect) {
+    if (!reaches(t, rect)) return;
+    if (depth > 0) {
+        levelErrors(rtin, terrain, leftHalf(t), depth - 1, halvesSplit, rect);
+        levelErrors(rtin, terrain, rightHalf(t), depth - 1, halvesSplit, rect);
+        return;
+    }
+    int size = rtin->gridSize;
+    int mx = (t.ax + t.bx) / 2, mz = (t.az + t.bz) / 2;
+    GLfloat* error = &rtin->errors[mx * size + mz];
+    RtinCoverage covered = coverage(rtin, t);
+    if (covered == RTIN_OUTSIDE) return;
+    // Crossing triangles are always split, down to ones wholly on either side
+    if (covered == RTIN_CROSSING) {
+        *error = INFINITY;
+        return;
+    }
+    GLfloat middle = (terrain->heights[t.ax][t.az] + terrain->heights[t.bx][t.bz]) / 2;
+    GLfloat e = fabsf(middle - terrain->heights[mx][mz]);
+    if (halvesSplit) {
+        RtinTriangle left = leftHalf(t), right = rightHalf(t);
+        e = fmaxf(e, rtin->errors[(left.ax + left.bx) / 2 * size + (left.az + left.bz) / 2]);
+        e = fmaxf(e, rtin->errors[(right.ax + right.bx) / 2 * size + (right.az + right.bz) / 2]);
+    }
+    *error = fmaxf(*error, e);
+}
+
+// The two triangles covering the whole square
+static void topTriangles(const Rtin* rtin, RtinTriangle top[2]) {
+    int last = rtin->gridSize - 1;
+    top[0] = (RtinTriangle){0, 0, last, last, last, 0};
+    top[1] = (RtinTriangle){last, last, 0, 0, 0, last};
+}
+
+void updateRtin(Rtin* rtin, const Terrain* terrain) {
+    updateRtinRegion(rtin, terrain, (TerrainRect){0, 0, rtin->xSize, rtin->zSize});
+}
+
+void updateRtinRegion(Rtin* rtin, const Terrain* terrain, TerrainRect rect) {
+    assert(terrain->xSize == rtin->xSize && terrain->zSize == rtin->zSize);
+    if (rect.x0 >= rect.x1 || rect.z0 >= rect.z1) return;
+    // Each level halves the triangles' area. Only the last, with sides of 1, has no middle
+    // points on the grid, the one before it splits into those.
+    int levels = 0;
+    for (int size = rtin->gridSize - 1; size > 1; size /= 2) levels += 2;
+    RtinTriangle top[2];
+    topTriangles(rtin, top);
+    for (int i = 0; i < 2; i++) clearErrors(rtin, top[i], levels - 1, rect);
+    for (int depth = levels - 1; depth >= 0; depth--) {
+        for (int i = 0; i < 2; i++) levelErrors(rtin, terrain, top[i], depth, depth < levels - 1, rect);
+    }
+}
+
+typedef struct {
+    const Rtin* rtin;
+    GLfloat maxError;
+    int* vertexIndex;  // Of each point of the terrain in the mesh, -1 if not in it
+    int numVertices, numTriangles;
+    GLuint* indices;   // NULL while counting
+} RtinExtraction;
+
+static int meshVertex(RtinExtraction* extraction, int x, int z) {
+    int* index = &extraction->vertexIndex[x * extraction->rtin->zSize + z];
+    if (*index < 0) *index = extraction->numVertices++;
+    return *index;
+}
+
+// Splits the triangle while its error is above the maximum, then adds the triangles
+// inside the terrain, facing up like those of the full mesh
+static void extractTriangles(RtinExtraction* extraction, RtinTriangle t) {
+    const Rtin* rtin = extraction->rtin;
+    int mx = (t.ax + t.bx) / 2, mz = (t.az + t.bz) / 2;
+    if (abs(t.ax - t.cx) + abs(t.az - t.cz) > 1 && rtin->errors[mx * rtin->gridSize + mz] > extraction->maxError) {
+        extractTriangles(extraction, leftHalf(t));
+        extractTriangles(extraction, rightHalf(t));
+        return;
+    }
+    if (coverage(rtin, t) != RTIN_INSIDE) return;
+    int a = meshVertex(extraction, t.ax, t.az);
+    int b = meshVertex(extraction, t.bx, t.bz);
+    int c = meshVertex(extraction, t.cx, t.cz);
+    if (extraction->indices != NULL) {
+        bool up = (t.bz - t.az) * (t.cx - t.ax) - (t.bx - t.ax) * (t.cz - t.az) > 0;
+        GLuint* triangle = &extraction->indices[3 * extraction->numTriangles];
+        triangle[0] = a;
+        triangle[1] = up ? b : c;
+        triangle[2] = up ? c : b;
+    }
+    extraction->numTriangles++;
+}
+
+// Counts the triangles and numbers their vertices first, then fills in the indices
+TerrainMesh* createRtinMesh(const Rtin* rtin, Terrain* terrain, GLfloat maxError, colourFunction colour,
+                            const ColourParams* params) {
+    assert(terrain->xSize == rtin->xSize && terrain->zSize == rtin->zSize);
+    RtinExtraction extraction = {rtin, maxError, malloc(sizeof(int) * terrain->xSize * terrain->zSize), 0, 0, NULL};
+    TerrainMesh* mesh = malloc(sizeof(TerrainMesh));
+    if (extraction.vertexIndex == NULL || mesh == NULL) {
+        fprintf(stderr, "Allocation of adaptive mesh failed.\n");
+        free(extraction.vertexIndex);
+        free(mesh);
+        return NULL;
+    }
+    memset(extraction.vertexIndex, -1, sizeof(int) * terrain->xSize * terrain->zSize);
+    RtinTriangle top[2];
+    topTriangles(rtin, top);
+    for (int i = 0; i < 2; i++) extractTriangles(&extraction, top[i]);
+
+    mesh->xSize = terrain->xSize;
+    mesh->zSize = terrain->zSize;
+    mesh->numVertices = extraction.numVertices;
+    mesh->numIndices = 3 * extraction.numTriangles;
+    mesh->vertexBuffer = 0;
+    mesh->indexBuffer = 0;
+    mesh->vertices = malloc(sizeof(TerrainVertex) * mesh->numVertices);
+    mesh->indices = malloc(sizeof(GLuint) * mesh->numIndices);
+    if (mesh->vertices == NULL || mesh->indices == NULL) {
+        fprintf(stderr, "Allocation of adaptive mesh failed.\n");
+        free(extraction.vertexIndex);
+        freeTerrainMesh(mesh);
+        return NULL;
+    }
+    extraction.indices = mesh->indices;
+    extraction.numTriangles = 0;
+    for (int i = 0; i < 2; i++) extractTriangles(&extraction, top[i]);
+
+    for (int x = 0; x < terrain->xSize; x++) {
+        for (int z = 0; z < terrain->zSize; z++) {
+            int index = extraction.vertexIndex[x * terrain->zSize + z];
+            if (index >= 0) mesh->vertices[index] = terrainVertex(terrain, colour, params, x, z);
+        }
+    }
+    free(extraction.vertexIndex);
+    return mesh;
+}
+
+void freeRtin(Rtin* rtin) {
+    free(rtin->errors);
+    free(rtin);
+}
@@ -0,0 +1,47 @@
+#ifndef RTIN_H
+#define RTIN_H
+
+#include "structures.h"
+#include "terrain.h"
+#include "mesh.h"
+
+// A right-triangulated irregular network over a terrain: the grid is covered by two right
+// triangles, and any triangle can be split in two from its right angle to the middle of
+// its long side. The error of each split, how far the middle point is from the long side,
+// is worked out once for the whole terrain, then meshes for any maximum error are taken
+// from it by splitting only where the error is larger. Neighbouring triangles always
+// split together, so the meshes have no cracks.
+//
+// The triangles cover a square of 2^k + 1 points, the smallest holding the terrain.
+// Triangles crossing the terrain's far edges are always split, and whatever is past
+// them is left out, so other sizes have small triangles along those edges.
+typedef struct {
+    int xSize, zSize; // Of the terrain
+    int gridSize;     // Points along each side of the square, 2^k + 1
+    GLfloat* errors;  // Of the split at each point of the square by x then z, the
+                      // largest of its own and every split it needs first
+} Rtin;
+
+// Creates the errors for terrains of the given size, all 0
+extern Rtin* createRtin(int xSize, int zSize);
+
+// Works out the error of every split from the terrain's heights, in time linear in the
+// number of points. The terrain must be the size the errors were created for.
+extern void updateRtin(Rtin*, const Terrain*);
+
+// Works out again only the errors of splits which can depend on heights inside rect, such
+// as the terrain's dirty rectangle, giving the same errors as updateRtin if no height
+// outside it changed. Small edits only touch the splits around them and those above.
+extern void updateRtinRegion(Rtin*, const Terrain*, TerrainRect);
+
+// Creates a mesh of the terrain split wherever the error is above maxError, with only the
+// points its triangles use as vertices, coloured as fillTerrainVertices does. A maxError
+// of 0 gives the exact surface, merging only flat triangles. The mesh can be drawn,
+// rendered and exported like a full one, and has buffers of its own once drawn. Returns
+// NULL if it could not be allocated.
+extern TerrainMesh* createRtinMesh(const Rtin*, Terrain*, GLfloat maxError, colourFunction, const ColourParams*);
+
+// Frees the errors
+extern void freeRtin(Rtin*);
+
+#endif
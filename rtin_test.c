@@ -0,0 +1,176 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "rtin.h"
+#include "mesh.h"
+#include "terrain.h"
+#include "structures.h"
+#include "testing.h"
+
+// Not 2^k + 1 either way, so the edges of the square are cut off
+#define X_SIZE 50
+#define Z_SIZE 37
+#define HEIGHT 30
+#define FLAT_SIZE 65
+#define HEIGHT_EPSILON 1e-3f
+#define AREA_EPSILON 1e-3
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+static GLfloat flat(void* context, GLfloat x, GLfloat z) {
+    return 0.25f;
+}
+
+static Vector3 grey(const ColourParams* params, GLfloat x, GLfloat y, GLfloat z) {
+    return (Vector3){0.5f, 0.5f, 0.5f};
+}
+
+static int triangles(const TerrainMesh* mesh) {
+    return mesh->numIndices / 3;
+}
+
+// Twice the area facing up, positive for triangles wound like the full mesh
+static GLfloat up_area(const TerrainMesh* mesh, int triangle) {
+    Vector3 a = mesh->vertices[mesh->indices[3 * triangle]].position;
+    Vector3 b = mesh->vertices[mesh->indices[3 * triangle + 1]].position;
+    Vector3 c = mesh->vertices[mesh->indices[3 * triangle + 2]].position;
+    return (b.z - a.z) * (c.x - a.x) - (b.x - a.x) * (c.z - a.z);
+}
+
+// Whether every grid point under a triangle is on its plane
+static bool matches_heights(const TerrainMesh* mesh, const Terrain* terrain) {
+    for (int t = 0; t < triangles(mesh); t++) {
+        Vector3 a = mesh->vertices[mesh->indices[3 * t]].position;
+        Vector3 b = mesh->vertices[mesh->indices[3 * t + 1]].position;
+        Vector3 c = mesh->vertices[mesh->indices[3 * t + 2]].position;
+        GLfloat area = up_area(mesh, t);
+        for (int x = fminf(a.x, fminf(b.x, c.x)); x <= fmaxf(a.x, fmaxf(b.x, c.x)); x++) {
+            for (int z = fminf(a.z, fminf(b.z, c.z)); z <= fmaxf(a.z, fmaxf(b.z, c.z)); z++) {
+                GLfloat wa = ((b.z - z) * (c.x - x) - (b.x - x) * (c.z - z)) / area;
+                GLfloat wb = ((c.z - z) * (a.x - x) - (c.x - x) * (a.z - z)) / area;
+                GLfloat wc = 1 - wa - wb;
+                if (wa < 0 || wb < 0 || wc < 0) continue;
+                GLfloat y = wa * a.y + wb * b.y + wc * c.y;
+                if (fabsf(y - terrain->heights[x][z]) > HEIGHT_EPSILON) return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int compare_edges(const void* a, const void* b) {
+    const long* x = a;
+    const long* y = b;
+    return (*x > *y) - (*x < *y);
+}
+
+// Whether every edge is shared by two triangles, or is on the terrain's border. A vertex
+// in the middle of a neighbour's edge would leave edges used once inside.
+static bool no_cracks(const TerrainMesh* mesh) {
+    int count = mesh->numIndices;
+    long* edges = malloc(sizeof(long) * count);
+    for (int t = 0; t < triangles(mesh); t++) {
+        for (int i = 0; i < 3; i++) {
+            long a = mesh->indices[3 * t + i], b = mesh->indices[3 * t + (i + 1) % 3];
+            edges[3 * t + i] = (a < b) ? a * mesh->numVertices + b : b * mesh->numVertices + a;
+        }
+    }
+    qsort(edges, count, sizeof(long), compare_edges);
+    bool closed = true;
+    for (int i = 0; i < count && closed; ) {
+        int uses = 1;
+        while (i + uses < count && edges[i + uses] == edges[i]) uses++;
+        Vector3 a = mesh->vertices[edges[i] / mesh->numVertices].position;
+        Vector3 b = mesh->vertices[edges[i] % mesh->numVertices].position;
+        bool border = (a.x == b.x && (a.x == 0 || a.x == mesh->xSize - 1))
+                      || (a.z == b.z && (a.z == 0 || a.z == mesh->zSize - 1));
+        closed = uses == 2 || (uses == 1 && border);
+        i += uses;
+    }
+    free(edges);
+    return closed;
+}
+
+int main(void) {
+    printf("Testing Adaptive Mesh: \n");
+    ColourParams params = {HEIGHT, NULL};
+
+    Terrain* level = createTerrain(FLAT_SIZE, FLAT_SIZE, HEIGHT);
+    populateTerrain(level, flat, NULL);
+    calculateNormals(level);
+    Rtin* levelRtin = createRtin(FLAT_SIZE, FLAT_SIZE);
+    assert_test(levelRtin->gridSize == FLAT_SIZE, "Square of 2^k + 1 kept.", TEST_OK_OUT, TEST_FAIL_OUT);
+    updateRtin(levelRtin, level);
+    TerrainMesh* levelMesh = createRtinMesh(levelRtin, level, 0.0f, grey, &params);
+    assert_test(triangles(levelMesh) == 2 && levelMesh->numVertices == 4, "Flat square is two triangles.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+    freeTerrainMesh(levelMesh);
+    freeRtin(levelRtin);
+    freeTerrain(level);
+
+    Terrain* terrain = createTerrain(X_SIZE, Z_SIZE, HEIGHT);
+    populateTerrain(terrain, test_hills, NULL);
+    calculateNormals(terrain);
+    Rtin* rtin = createRtin(X_SIZE, Z_SIZE);
+    updateRtin(rtin, terrain);
+    TerrainMesh* exact = createRtinMesh(rtin, terrain, 0.0f, grey, &params);
+    assert_test(matches_heights(exact, terrain), "No error matches every height.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    double area = 0;
+    bool up = true;
+    for (int t = 0; t < triangles(exact); t++) {
+        area += up_area(exact, t) / 2.0;
+        up = up && up_area(exact, t) > 0;
+    }
+    assert_test(fabs(area - (X_SIZE - 1) * (Z_SIZE - 1)) < AREA_EPSILON, "Triangles cover the terrain.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(up, "Triangles face up.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(no_cracks(exact), "No cracks with no error.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    TerrainMesh* coarse = createRtinMesh(rtin, terrain, 0.5f, grey, &params);
+    assert_test(no_cracks(coarse), "No cracks when coarse.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(triangles(coarse) < triangles(exact) && triangles(exact) <= 2 * (X_SIZE - 1) * (Z_SIZE - 1),
+                "Fewer triangles with more error.", TEST_OK_OUT, TEST_FAIL_OUT);
+    bool onGrid = true;
+    for (int i = 0; i < coarse->numVertices; i++) {
+        Vector3 p = coarse->vertices[i].position;
+        onGrid = onGrid && p.x >= 0 && p.x < X_SIZE && p.z >= 0 && p.z < Z_SIZE
+                 && p.y == terrain->heights[(int) p.x][(int) p.z];
+    }
+    assert_test(onGrid, "Vertices are terrain points.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Edits only need the errors around them worked out again
+    takeTerrainDirty(terrain);
+    stampTerrain(terrain, 12.0f, 9.0f, 4.0f, 3.0f);
+    stampTerrain(terrain, X_SIZE - 2, Z_SIZE - 3, 3.0f, -2.0f);
+    updateRtinRegion(rtin, terrain, takeTerrainDirty(terrain));
+    Rtin* full = createRtin(X_SIZE, Z_SIZE);
+    updateRtin(full, terrain);
+    bool same = true;
+    for (int i = 0; i < rtin->gridSize * rtin->gridSize; i++) {
+        same = same && rtin->errors[i] == full->errors[i];
+    }
+    assert_test(same, "Region update matches a full one.", TEST_OK_OUT, TEST_FAIL_OUT);
+    freeRtin(full);
+
+    // The errors follow the heights when they change
+    for (int x = 0; x < X_SIZE; x++) {
+        for (int z = 0; z < Z_SIZE; z++) {
+            terrain->heights[x][z] = 0.25f;
+        }
+    }
+    updateRtin(rtin, terrain);
+    TerrainMesh* levelled = createRtinMesh(rtin, terrain, 0.0f, grey, &params);
+    assert_test(triangles(levelled) < triangles(exact) && matches_heights(levelled, terrain),
+                "Updated from new heights.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    freeTerrainMesh(levelled);
+    freeTerrainMesh(coarse);
+    freeTerrainMesh(exact);
+    freeRtin(rtin);
+    freeTerrain(terrain);
+    return EXIT_SUCCESS;
+}
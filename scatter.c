@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "scatter.h"
+#include "query.h"
+#include "parallel.h"
+
+// Cells along each side of a tile. Tiles sampled at once are a tile apart, which must be
+// further than the 2 cells either side a point looks through.
+#define TILE_CELLS 16
+// Candidates thrown in a tile for each spacing squared of its area, enough to fill it
+// nearly as full as it can be
+#define ATTEMPTS 12
+// Points either side of a cell that can be within the spacing, as cells are
+// spacing / sqrt(2) across
+#define NEIGHBOUR_CELLS 2
+#define TREE_SIDES 6
+#define TREE_RADIUS 0.6f
+#define TREE_HEIGHT 2.5f
+#define ROCK_RADIUS 0.5f
+#define ROCK_MIDDLE 0.2f // Height of the widest part, the rest is sunk into the ground
+#define ROCK_TOP 0.6f
+// Most vertices and indices of any shape
+#define SHAPE_VERTICES 8
+#define SHAPE_INDICES 24
+// Brightness of each object is varied by up to this either way
+#define COLOUR_VARIATION 0.15f
+
+Scatter* createScatter(const ScatterRule* rules, int numRules, uint32_t seed) {
+    Scatter* scatter = malloc(sizeof(Scatter));
+    assert(scatter != NULL);
+    scatter->seed = seed;
+    scatter->numLayers = numRules;
+    scatter->layers = calloc(numRules, sizeof(ScatterLayer));
+    assert(scatter->layers != NULL);
+    for (int i = 0; i < numRules; i++) {
+        scatter->layers[i].rule = rules[i];
+    }
+    return scatter;
+}
+
+Scatter* createDefaultScatter(uint32_t seed) {
+    const ScatterRule rules[] = {
+        {SCATTER_TREE, 3.0f, 0.02f, 0.3f, 0.85f, 1.0f, 0, 0.6f, 0.6f, 1.2f, {0.05f, 0.3f, 0.05f}},
+        {SCATTER_ROCK, 5.0f, 0.0f, 10.0f, 0.4f, 0.85f, SCATTER_ANY_BIOME, 0.5f, 0.8f, 2.0f, {0.45f, 0.42f, 0.4f}},
+        {SCATTER_ROCK, 4.0f, 0.3f, 10.0f, 0.0f, 1.0f, 1, 0.8f, 1.0f, 2.5f, {0.15f, 0.12f, 0.12f}}
+    };
+    return createScatter(rules, sizeof(rules) / sizeof(rules[0]), seed);
+}
+
+// A point of the background grid, empty while x is negative. Points thinned out by the
+// density keep their place, so the others stay spaced, with a scale of 0.
+typedef struct {
+    GLfloat x, z, scale;
+} ScatterCell;
+
+typedef struct {
+    const ScatterRule* rule;
+    const Terrain* terrain;
+    ScatterCell* cells;
+    int cellsX, cellsZ;
+    GLfloat cellSize;
+    int tilesX, tilesZ;
+    int phaseX, phaseZ; // Of the tiles sampled in this pass, each 0 or 1
+    uint32_t seed;
+} ScatterJob;
+
+// Whether the ground at the nearest point meets the rule
+static bool ruleHolds(const ScatterRule* rule, const Terrain* terrain, GLfloat x, GLfloat z) {
+    int px = (int) (x + 0.5f), pz = (int) (z + 0.5f);
+    GLfloat height = terrain->heights[px][pz] / terrain->height;
+    GLfloat up = terrain->normals[px][pz].y;
+    if (height < rule->minHeight || height > rule->maxHeight || up < rule->minUp || up > rule->maxUp) return false;
+    if (rule->biome == SCATTER_ANY_BIOME) return true;
+    bool inside = terrain->biomes != NULL && terrain->biomes[px][pz] > 0.0f;
+    return inside == (rule->biome == 1);
+}
+
+// Whether any point already placed is within the spacing
+static bool crowded(const ScatterJob* job, int cx, int cz, GLfloat x, GLfloat z) {
+    GLfloat spacing2 = job->rule->spacing * job->rule->spacing;
+    int x0 = (cx > NEIGHBOUR_CELLS) ? cx - NEIGHBOUR_CELLS : 0;
+    int z0 = (cz > NEIGHBOUR_CELLS) ? cz - NEIGHBOUR_CELLS : 0;
+    int x1 = (cx + NEIGHBOUR_CELLS < job->cellsX) ? cx + NEIGHBOUR_CELLS : job->cellsX - 1;
+    int z1 = (cz + NEIGHBOUR_CELLS < job->cellsZ) ? cz + NEIGHBOUR_CELLS : job->cellsZ - 1;
+    for (int j = z0; j <= z1; j++) {
+        for (int i = x0; i <= x1; i++) {
+            const ScatterCell* cell = &job->cells[j * job->cellsX + i];
+            if (cell->x < 0) continue;
+            GLfloat dx = cell->x - x, dz = cell->z - z;
+            if (dx * dx + dz * dz < spacing2) return true;
+        }
+    }
+    return false;
+}
+
+// Throws candidates at each tile, keeping those the rule allows that are far enough from
+// every point so far. Neighbouring tiles are all from other passes, so are not written
+// while these are read.
+static void sampleTiles(void* context, int begin, int end) {
+    const ScatterJob* job = context;
+    const ScatterRule* rule = job->rule;
+    int phaseTilesX = (job->tilesX - job->phaseX + 1) / 2;
+    GLfloat tileSize = TILE_CELLS * job->cellSize;
+    GLfloat xEnd = job->terrain->xSize - 1, zEnd = job->terrain->zSize - 1;
+    int attempts = (int) (ATTEMPTS * tileSize * tileSize / (rule->spacing * rule->spacing));
+    for (int t = begin; t < end; t++) {
+        int tx = job->phaseX + 2 * (t % phaseTilesX), tz = job->phaseZ + 2 * (t / phaseTilesX);
+        uint32_t state = hash_seed(job->seed, tz * job->tilesX + tx);
+        GLfloat x0 = tx * tileSize, z0 = tz * tileSize;
+        GLfloat width = fminf(tileSize, xEnd - x0), depth = fminf(tileSize, zEnd - z0);
+        int lastX = (tx + 1) * TILE_CELLS - 1, lastZ = (tz + 1) * TILE_CELLS - 1;
+        if (lastX >= job->cellsX) lastX = job->cellsX - 1;
+        if (lastZ >= job->cellsZ) lastZ = job->cellsZ - 1;
+        for (int a = 0; a < attempts; a++) {
+            GLfloat x = x0 + random_float(&state) * width, z = z0 + random_float(&state) * depth;
+            if (!ruleHolds(rule, job->terrain, x, z)) continue;
+            // Rounding can put a point on the last edge in the next tile's cells
+            int cx = (int) (x / job->cellSize), cz = (int) (z / job->cellSize);
+            if (cx > lastX) cx = lastX;
+            if (cz > lastZ) cz = lastZ;
+            if (crowded(job, cx, cz, x, z)) continue;
+            GLfloat keep = random_float(&state), scale = random_float(&state);
+            GLfloat kept = (keep < rule->density) ? rule->minScale + scale * (rule->maxScale - rule->minScale) : 0;
+            job->cells[cz * job->cellsX + cx] = (ScatterCell){x, z, kept};
+        }
+    }
+}
+
+// Samples one layer's background grid in four passes, then gathers the points kept
+static void scatterLayer(ScatterLayer* layer, Terrain* terrain, uint32_t seed) {
+    ScatterJob job = {&layer->rule, terrain};
+    job.cellSize = layer->rule.spacing / (GLfloat) M_SQRT2;
+    job.cellsX = (int) ceilf((terrain->xSize - 1) / job.cellSize);
+    job.cellsZ = (int) ceilf((terrain->zSize - 1) / job.cellSize);
+    job.tilesX = (job.cellsX + TILE_CELLS - 1) / TILE_CELLS;
+    job.tilesZ = (job.cellsZ + TILE_CELLS - 1) / TILE_CELLS;
+    job.seed = seed;
+    int numCells = job.cellsX * job.cellsZ;
+    job.cells = malloc(sizeof(ScatterCell) * numCells);
+    assert(job.cells != NULL);
+    for (int i = 0; i < numCells; i++) {
+        job.cells[i] = (ScatterCell){-1.0f, -1.0f, 0.0f};
+    }
+
+    for (job.phaseZ = 0; job.phaseZ < 2; job.phaseZ++) {
+        for (job.phaseX = 0; job.phaseX < 2; job.phaseX++) {
+            int count = ((job.tilesX - job.phaseX + 1) / 2) * ((job.tilesZ - job.phaseZ + 1) / 2);
+            if (count > 0) parallel_for(count, sampleTiles, &job);
+        }
+    }
+
+    layer->count = 0;
+    for (int i = 0; i < numCells; i++) {
+        if (job.cells[i].scale > 0) layer->count++;
+    }
+    free(layer->instances);
+    layer->instances = malloc(sizeof(ScatterInstance) * layer->count);
+    assert(layer->count == 0 || layer->instances != NULL);
+    int next = 0;
+    for (int i = 0; i < numCells; i++) {
+        const ScatterCell* cell = &job.cells[i];
+        if (cell->scale <= 0) continue;
+        GLfloat y = terrainHeightAt(terrain, cell->x, cell->z);
+        layer->instances[next++] = (ScatterInstance){cell->x, y, cell->z, cell->scale};
+    }
+    free(job.cells);
+}
+
+void scatterTerrain(Scatter* scatter, Terrain* terrain) {
+    for (int l = 0; l < scatter->numLayers; l++) {
+        uint32_t seed = hash_seed(scatter->seed, l);
+        scatterLayer(&scatter->layers[l], terrain, seed);
+        buildScatterBatch(&scatter->layers[l], seed);
+    }
+}
+
+// Writes the shape at a scale of 1 around its base, and the number of vertices and indices
+static void shapeTemplate(ScatterShape shape, Vector3* positions, Vector3* normals, GLuint* indices,
+                          int* numVertices, int* numIndices) {
+    if (shape == SCATTER_TREE) {
+        // A ring on the ground, then the tip
+        *numVertices = TREE_SIDES + 1;
+        *numIndices = 3 * TREE_SIDES;
+        GLfloat slope = sqrtf(TREE_HEIGHT * TREE_HEIGHT + TREE_RADIUS * TREE_RADIUS);
+        for (int i = 0; i < TREE_SIDES; i++) {
+            GLfloat angle = 2.0f * (GLfloat) M_PI * i / TREE_SIDES;
+            positions[i] = (Vector3){TREE_RADIUS * cosf(angle), 0.0f, TREE_RADIUS * sinf(angle)};
+            normals[i] = (Vector3){TREE_HEIGHT * cosf(angle) / slope, TREE_RADIUS / slope,
+                                   TREE_HEIGHT * sinf(angle) / slope};
+            indices[3 * i] = i;
+            indices[3 * i + 1] = TREE_SIDES;
+            indices[3 * i + 2] = (i + 1) % TREE_SIDES;
+        }
+        positions[TREE_SIDES] = (Vector3){0.0f, TREE_HEIGHT, 0.0f};
+        normals[TREE_SIDES] = (Vector3){0.0f, 1.0f, 0.0f};
+    } else {
+        // Four points around the middle, then the top and bottom
+        *numVertices = 6;
+        *numIndices = 3 * 8;
+        for (int i = 0; i < 4; i++) {
+            GLfloat angle = (GLfloat) M_PI_2 * i;
+            positions[i] = (Vector3){ROCK_RADIUS * cosf(angle), ROCK_MIDDLE, ROCK_RADIUS * sinf(angle)};
+            normals[i] = (Vector3){cosf(angle), 0.0f, sinf(angle)};
+            GLuint upper[3] = {i, 4, (i + 1) % 4}, lower[3] = {i, (i + 1) % 4, 5};
+            memcpy(&indices[3 * i], upper, sizeof(upper));
+            memcpy(&indices[12 + 3 * i], lower, sizeof(lower));
+        }
+        positions[4] = (Vector3){0.0f, ROCK_TOP, 0.0f};
+        positions[5] = (Vector3){0.0f, 2 * ROCK_MIDDLE - ROCK_TOP, 0.0f};
+        normals[4] = (Vector3){0.0f, 1.0f, 0.0f};
+        normals[5] = (Vector3){0.0f, -1.0f, 0.0f};
+    }
+}
+
+// OpenGL 1 has no instancing, so every instance's shape is written out into one mesh
+void buildScatterBatch(ScatterLayer* layer, uint32_t seed) {
+    int shapeVertices, shapeIndices;
+    Vector3 positions[SHAPE_VERTICES], normals[SHAPE_VERTICES];
+    GLuint indices[SHAPE_INDICES];
+    shapeTemplate(layer->rule.shape, positions, normals, indices, &shapeVertices, &shapeIndices);
+
+    if (layer->batch != NULL) freeTerrainMesh(layer->batch);
+    TerrainMesh* batch = malloc(sizeof(TerrainMesh));
+    assert(batch != NULL);
+    batch->xSize = 0;
+    batch->zSize = 0;
+    batch->numVertices = layer->count * shapeVertices;
+    batch->numIndices = layer->count * shapeIndices;
+    batch->vertexBuffer = 0;
+    batch->indexBuffer = 0;
+    batch->vertices = malloc(sizeof(TerrainVertex) * batch->numVertices);
+    batch->indices = malloc(sizeof(GLuint) * batch->numIndices);
+    assert(layer->count == 0 || (batch->vertices != NULL && batch->indices != NULL));
+
+    Vector3 colour = layer->rule.colour;
+    for (int i = 0; i < layer->count; i++) {
+        const ScatterInstance* instance = &layer->instances[i];
+        uint32_t state = hash_seed(seed, i);
+        GLfloat angle = 2.0f * (GLfloat) M_PI * random_float(&state);
+        GLfloat c = cosf(angle), s = sinf(angle);
+        GLfloat shade = 1.0f + COLOUR_VARIATION * (2.0f * random_float(&state) - 1.0f);
+        Vector3 tint = {colour.x * shade, colour.y * shade, colour.z * shade};
+        TerrainVertex* vertices = &batch->vertices[i * shapeVertices];
+        for (int v = 0; v < shapeVertices; v++) {
+            Vector3 p = positions[v], n = normals[v];
+            vertices[v].position = (Vector3){instance->x + instance->scale * (c * p.x - s * p.z),
+                                             instance->y + instance->scale * p.y,
+                                             instance->z + instance->scale * (s * p.x + c * p.z)};
+            vertices[v].normal = (Vector3){c * n.x - s * n.z, n.y, s * n.x + c * n.z};
+            vertices[v].colour = tint;
+        }
+        for (int j = 0; j < shapeIndices; j++) {
+            batch->indices[i * shapeIndices + j] = i * shapeVertices + indices[j];
+        }
+    }
+    layer->batch = batch;
+}
+
+void drawScatter(Scatter* scatter) {
+    for (int l = 0; l < scatter->numLayers; l++) {
+        TerrainMesh* batch = scatter->layers[l].batch;
+        if (batch != NULL && batch->numIndices > 0) drawTerrainMesh(batch);
+    }
+}
+
+void freeScatter(Scatter* scatter) {
+    for (int l = 0; l < scatter->numLayers; l++) {
+        free(scatter->layers[l].instances);
+        if (scatter->layers[l].batch != NULL) freeTerrainMesh(scatter->layers[l].batch);
+    }
+    free(scatter->layers);
+    free(scatter);
+}
@@ -0,0 +1,75 @@
+#ifndef SCATTER_H
+#define SCATTER_H
+
+#include <stdint.h>
+#include "structures.h"
+#include "terrain.h"
+#include "mesh.h"
+
+// Rules that hold anywhere with regard to the biome mask
+#define SCATTER_ANY_BIOME -1
+
+// The shapes objects are drawn as
+typedef enum {
+    SCATTER_TREE, // A cone on the ground, 2.5 tall and 1.2 across at a scale of 1
+    SCATTER_ROCK, // A squashed octahedron, 1 across and 0.6 tall at a scale of 1
+    NUM_SCATTER_SHAPES
+} ScatterShape;
+
+// Where one kind of object is placed, and how closely
+typedef struct {
+    ScatterShape shape;
+    GLfloat spacing;              // Least distance between two of the objects, in grid points
+    GLfloat minHeight, maxHeight; // Of the ground, as fractions of the terrain's height
+    GLfloat minUp, maxUp;         // Of the y of the ground's normal, 1 on flat ground
+    int biome;                    // 1 only inside the biome mask, 0 only outside it, or SCATTER_ANY_BIOME
+    GLfloat density;              // Share of the evenly spaced points kept, 0 to 1
+    GLfloat minScale, maxScale;
+    Vector3 colour;
+} ScatterRule;
+
+// One object, 16 bytes
+typedef struct {
+    GLfloat x, y, z; // Its base on the ground
+    GLfloat scale;
+} ScatterInstance;
+
+// The objects of one rule
+typedef struct {
+    ScatterRule rule;
+    int count;
+    ScatterInstance* instances;
+    TerrainMesh* batch; // Every instance's shape in one mesh, drawn with one call
+} ScatterLayer;
+
+typedef struct {
+    uint32_t seed;
+    int numLayers;
+    ScatterLayer* layers;
+} Scatter;
+
+// Creates a scatter with a layer per rule, all empty until the terrain is scattered
+extern Scatter* createScatter(const ScatterRule* rules, int numRules, uint32_t seed);
+
+// Creates a scatter of trees on gentle slopes below the snow outside any biomes, rocks
+// on steep ground, and dark boulders inside the biomes
+extern Scatter* createDefaultScatter(uint32_t seed);
+
+// Places every layer's objects as blue noise: points no closer than the spacing, where
+// the ground meets the rule, thinned to the density. The terrain is split into tiles
+// sampled on all threads, in four passes so that tiles sampled at once are never next to
+// each other. Each tile has its own random sequence, so the objects only depend on the
+// seed and the terrain, not the thread count. Terrains without a biome mask count as
+// outside the biomes. The batches are built again from the new instances.
+extern void scatterTerrain(Scatter*, Terrain*);
+
+// Builds the layer's batch from its instances, turning each shape by a random angle
+extern void buildScatterBatch(ScatterLayer*, uint32_t seed);
+
+// Draws each layer's batch with one call, creating its buffers the first time
+extern void drawScatter(Scatter*);
+
+// Frees the scatter, its layers and their batches
+extern void freeScatter(Scatter*);
+
+#endif
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "scatter.h"
+#include "terrain.h"
+#include "parallel.h"
+#include "structures.h"
+#include "testing.h"
+
+// Large enough for several tiles of cells each way, and not a whole number of them
+#define X_SIZE 230
+#define Z_SIZE 170
+#define HEIGHT 20
+#define SPACING 2.0f
+// Blue noise thrown until nearly full covers at least this share of the most points
+// a square grid of the spacing could hold
+#define FILLED 0.55f
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+// Whether no two instances are closer than the spacing
+static bool spaced(const ScatterLayer* layer) {
+    GLfloat spacing2 = layer->rule.spacing * layer->rule.spacing;
+    for (int i = 0; i < layer->count; i++) {
+        for (int j = i + 1; j < layer->count; j++) {
+            GLfloat dx = layer->instances[i].x - layer->instances[j].x;
+            GLfloat dz = layer->instances[i].z - layer->instances[j].z;
+            if (dx * dx + dz * dz < spacing2) return false;
+        }
+    }
+    return true;
+}
+
+// Whether every instance stands on ground the rule allows, at a scale in its range
+static bool follows_rule(const ScatterLayer* layer, const Terrain* terrain) {
+    const ScatterRule* rule = &layer->rule;
+    for (int i = 0; i < layer->count; i++) {
+        const ScatterInstance* instance = &layer->instances[i];
+        int x = (int) (instance->x + 0.5f), z = (int) (instance->z + 0.5f);
+        if (x < 0 || x >= terrain->xSize || z < 0 || z >= terrain->zSize) return false;
+        GLfloat height = terrain->heights[x][z] / terrain->height;
+        GLfloat up = terrain->normals[x][z].y;
+        bool inside = terrain->biomes != NULL && terrain->biomes[x][z] > 0;
+        if (height < rule->minHeight || height > rule->maxHeight || up < rule->minUp || up > rule->maxUp
+            || (rule->biome != SCATTER_ANY_BIOME && inside != (rule->biome == 1))
+            || instance->scale < rule->minScale || instance->scale > rule->maxScale) return false;
+    }
+    return true;
+}
+
+int main(void) {
+    printf("Testing Scatter: \n");
+    assert_test(sizeof(ScatterInstance) == 16, "Instances are 16 bytes.", TEST_OK_OUT, TEST_FAIL_OUT);
+    Terrain* terrain = createTerrain(X_SIZE, Z_SIZE, HEIGHT);
+    populateTerrain(terrain, test_hills, NULL);
+    calculateNormals(terrain);
+    addTerrainBiomes(terrain);
+    for (int x = X_SIZE / 2; x < X_SIZE; x++) {
+        for (int z = 0; z < Z_SIZE; z++) {
+            terrain->biomes[x][z] = 1.0f;
+        }
+    }
+
+    const ScatterRule rules[] = {
+        {SCATTER_TREE, SPACING, -10.0f, 10.0f, 0.0f, 1.0f, SCATTER_ANY_BIOME, 1.0f, 1.0f, 1.0f, {0, 1, 0}},
+        {SCATTER_TREE, 3.0f, 0.0f, 0.5f, 0.9f, 1.0f, 0, 0.5f, 0.5f, 1.5f, {0, 1, 0}},
+        {SCATTER_ROCK, 4.0f, -10.0f, 10.0f, 0.0f, 1.0f, 1, 1.0f, 1.0f, 2.0f, {1, 1, 1}}
+    };
+    int numRules = sizeof(rules) / sizeof(rules[0]);
+    Scatter* scatter = createScatter(rules, numRules, 7);
+    scatterTerrain(scatter, terrain);
+
+    const ScatterLayer* everywhere = &scatter->layers[0];
+    GLfloat most = (X_SIZE - 1) * (Z_SIZE - 1) / (SPACING * SPACING);
+    assert_test(everywhere->count >= FILLED * most, "Fills the terrain.", TEST_OK_OUT, TEST_FAIL_OUT);
+    bool allSpaced = true, allFollow = true;
+    for (int l = 0; l < numRules; l++) {
+        allSpaced = allSpaced && spaced(&scatter->layers[l]);
+        allFollow = allFollow && follows_rule(&scatter->layers[l], terrain);
+    }
+    assert_test(allSpaced, "No two objects closer than the spacing.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(allFollow, "Objects only where their rule holds.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(scatter->layers[1].count > 0 && scatter->layers[2].count > 0, "Every layer has objects.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // With half kept, the rest are still spaced as blue noise but there are fewer of them
+    Scatter* thinned = createScatter(rules, 1, 7);
+    thinned->layers[0].rule.density = 0.5f;
+    scatterTerrain(thinned, terrain);
+    GLfloat share = (GLfloat) thinned->layers[0].count / everywhere->count;
+    assert_test(share > 0.4f && share < 0.6f, "Density thins the objects.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    bool grounded = true;
+    for (int i = 0; i < everywhere->count; i++) {
+        const ScatterInstance* instance = &everywhere->instances[i];
+        int x = (int) instance->x, z = (int) instance->z;
+        GLfloat low = fminf(fminf(terrain->heights[x][z], terrain->heights[x + 1][z]),
+                            fminf(terrain->heights[x][z + 1], terrain->heights[x + 1][z + 1]));
+        GLfloat high = fmaxf(fmaxf(terrain->heights[x][z], terrain->heights[x + 1][z]),
+                             fmaxf(terrain->heights[x][z + 1], terrain->heights[x + 1][z + 1]));
+        grounded = grounded && instance->y >= low - 1e-4f && instance->y <= high + 1e-4f;
+    }
+    assert_test(grounded, "Objects stand on the ground.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    bool batched = true;
+    for (int l = 0; l < numRules; l++) {
+        const ScatterLayer* layer = &scatter->layers[l];
+        int shapeVertices = (layer->rule.shape == SCATTER_TREE) ? 7 : 6;
+        batched = batched && layer->batch->numVertices == layer->count * shapeVertices;
+        for (int i = 0; i < layer->batch->numIndices; i++) {
+            batched = batched && layer->batch->indices[i] < (GLuint) layer->batch->numVertices;
+        }
+    }
+    assert_test(batched, "One batch of every shape per layer.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // The tiles each have their own random sequence, so threads change nothing
+    parallel_set_threads(1);
+    Scatter* single = createScatter(rules, numRules, 7);
+    scatterTerrain(single, terrain);
+    parallel_set_threads(4);
+    Scatter* several = createScatter(rules, numRules, 7);
+    scatterTerrain(several, terrain);
+    parallel_set_threads(0);
+    bool same = true;
+    for (int l = 0; l < numRules; l++) {
+        same = same && single->layers[l].count == several->layers[l].count
+               && single->layers[l].count == scatter->layers[l].count
+               && memcmp(single->layers[l].instances, several->layers[l].instances,
+                         sizeof(ScatterInstance) * single->layers[l].count) == 0;
+    }
+    assert_test(same, "Same objects on any number of threads.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    Scatter* reseeded = createScatter(rules, 1, 8);
+    scatterTerrain(reseeded, terrain);
+    assert_test(reseeded->layers[0].count != everywhere->count
+                || memcmp(reseeded->layers[0].instances, everywhere->instances,
+                          sizeof(ScatterInstance) * everywhere->count) != 0,
+                "Seed changes the objects.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    freeScatter(reseeded);
+    freeScatter(several);
+    freeScatter(single);
+    freeScatter(thinned);
+    freeScatter(scatter);
+    freeTerrain(terrain);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,622 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "softrender.h"
+#include "parallel.h"
+
+// Window positions are snapped to 1/16 of a pixel so edge tests are exact in doubles
+#define SUBPIXEL 16.0f
+// Triangles are clipped to this many times the view's width so window positions stay small
+#define GUARD_BAND 8.0f
+// Triangles are split into this many ranges for setup, each with its own output list
+#define SETUP_BLOCKS 64
+// Most corners a triangle can have after clipping against every plane
+#define MAX_CLIPPED 8
+
+static const Vector3 waterColour = {0.0f, 0.0f, 1.0f};
+static const GLfloat waterAlpha = 0.25f;
+static const GLfloat ambient = 0.2f;
+
+// A vertex after lighting and projection
+typedef struct {
+    GLfloat clip[4];
+    GLfloat colour[4];
+    GLfloat texture[2];       // Grid position looked up in the normal map, if there is one
+} SoftVertex;
+
+// A triangle ready to rasterise, wound so its area is positive
+typedef struct {
+    GLfloat x[3], y[3];       // Window position, y down
+    GLfloat z[3];             // Depth from 0 to 1
+    GLfloat invW[3];
+    GLfloat colour[3][4];     // Divided by w, for perspective correct interpolation
+    GLfloat texture[3][2];    // Also divided by w
+    bool mapped;              // Lit per pixel from the normal map
+    int minX, minY, maxX, maxY; // Pixels whose centres may be covered, inclusive
+} ScreenTriangle;
+
+typedef struct {
+    ScreenTriangle* triangles;
+    int count, capacity;
+} TriangleList;
+
+typedef struct {
+    SoftImage* image;
+    const SoftScene* scene;
+    const TerrainVertex* input;
+    SoftVertex* output;
+    Vector3 light;
+} VertexStage;
+
+typedef struct {
+    SoftImage* image;
+    const SoftVertex* vertices;
+    const GLuint* indices;
+    int meshTriangles;
+    bool mapped;                // Whether the mesh's triangles are lit from the normal map
+    const GLuint* extraIndices; // Triangles drawn after the mesh
+    int numTriangles;
+    TriangleList lists[SETUP_BLOCKS];
+} SetupStage;
+
+typedef struct {
+    SoftImage* image;
+    const SoftScene* scene;
+    const ScreenTriangle** bins;
+    const int* binStart;
+    int tilesX;
+    const CoarseMesh* coarse;   // Whose normal map lights mapped triangles
+    Vector3 terrainLight;       // The light in the space of the normal map
+} RasterStage;
+
+SoftImage* createSoftImage(int width, int height) {
+    SoftImage* image = malloc(sizeof(SoftImage));
+    if (image == NULL) {
+        fprintf(stderr, "Allocation of software image failed.\n");
+        return NULL;
+    }
+    image->width = width;
+    image->height = height;
+    image->pixels = malloc((size_t) width * height * 3);
+    image->depth = malloc(sizeof(GLfloat) * width * height);
+    if (image->pixels == NULL || image->depth == NULL) {
+        fprintf(stderr, "Allocation of software image pixels failed.\n");
+        free(image->pixels);
+        free(image->depth);
+        free(image);
+        return NULL;
+    }
+    return image;
+}
+
+void freeSoftImage(SoftImage* image) {
+    if (image == NULL) return;
+    free(image->pixels);
+    free(image->depth);
+    free(image);
+}
+
+// Returns the matrix applied to the point (x, y, z, w)
+static void transform(const Matrix4* matrix, const GLfloat in[4], GLfloat out[4]) {
+    for (int row = 0; row < 4; row++) {
+        out[row] = matrix->m[row] * in[0] + matrix->m[4 + row] * in[1]
+                 + matrix->m[8 + row] * in[2] + matrix->m[12 + row] * in[3];
+    }
+}
+
+// Lights and projects one vertex, the colour is used for both ambient and diffuse
+// like GL_COLOR_MATERIAL
+static SoftVertex shadeVertex(const SoftScene* scene, Vector3 light,
+                              Vector3 position, Vector3 normal, Vector3 colour, GLfloat alpha) {
+    const Matrix4* mv = &scene->modelview;
+    Vector3 eyeNormal = normalise_3((Vector3){
+        mv->m[0] * normal.x + mv->m[4] * normal.y + mv->m[8] * normal.z,
+        mv->m[1] * normal.x + mv->m[5] * normal.y + mv->m[9] * normal.z,
+        mv->m[2] * normal.x + mv->m[6] * normal.y + mv->m[10] * normal.z
+    });
+    GLfloat lighting = ambient + fmaxf(0.0f, dot_product_3(eyeNormal, light));
+
+    SoftVertex out;
+    out.colour[0] = fminf(1.0f, colour.x * lighting);
+    out.colour[1] = fminf(1.0f, colour.y * lighting);
+    out.colour[2] = fminf(1.0f, colour.z * lighting);
+    out.colour[3] = alpha;
+    out.texture[0] = position.x;
+    out.texture[1] = position.z;
+
+    GLfloat world[4] = {position.x, position.y, position.z, 1.0f};
+    GLfloat eye[4];
+    transform(mv, world, eye);
+    transform(&scene->projection, eye, out.clip);
+    return out;
+}
+
+static void shadeVertices(void* context, int begin, int end) {
+    VertexStage* stage = context;
+    for (int i = begin; i < end; i++) {
+        const TerrainVertex* v = &stage->input[i];
+        stage->output[i] = shadeVertex(stage->scene, stage->light, v->position, v->normal, v->colour, 1.0f);
+    }
+}
+
+// Distance inside a clipping plane, the inside is where it is not negative.
+// The planes are the near plane then the four sides of the guard band.
+static GLfloat planeDistance(int plane, const GLfloat clip[4]) {
+    switch (plane) {
+        case 0: return clip[2] + clip[3];
+        case 1: return GUARD_BAND * clip[3] - clip[0];
+        case 2: return GUARD_BAND * clip[3] + clip[0];
+        case 3: return GUARD_BAND * clip[3] - clip[1];
+        default: return GUARD_BAND * clip[3] + clip[1];
+    }
+}
+
+// Clips the polygon against one plane, returning the new number of corners
+static int clipPolygon(int plane, SoftVertex* in, int count, SoftVertex* out) {
+    int outCount = 0;
+    for (int i = 0; i < count; i++) {
+        SoftVertex* a = &in[i];
+        SoftVertex* b = &in[(i + 1) % count];
+        GLfloat da = planeDistance(plane, a->clip);
+        GLfloat db = planeDistance(plane, b->clip);
+        if (da >= 0) out[outCount++] = *a;
+        if ((da >= 0) != (db >= 0)) {
+            GLfloat t = da / (da - db);
+            SoftVertex* v = &out[outCount++];
+            for (int k = 0; k < 4; k++) {
+                v->clip[k] = a->clip[k] + (b->clip[k] - a->clip[k]) * t;
+                v->colour[k] = a->colour[k] + (b->colour[k] - a->colour[k]) * t;
+            }
+            for (int k = 0; k < 2; k++) {
+                v->texture[k] = a->texture[k] + (b->texture[k] - a->texture[k]) * t;
+            }
+        }
+    }
+    return outCount;
+}
+
+// Twice the signed area of the triangle (a, b, p), positive when p is on the inside of ab
+static double edgeFunction(double ax, double ay, double bx, double by, double px, double py) {
+    return (px - ax) * (by - ay) - (py - ay) * (bx - ax);
+}
+
+static void appendTriangle(TriangleList* list, const ScreenTriangle* triangle) {
+    if (list->count == list->capacity) {
+        int capacity = (list->capacity == 0) ? 256 : list->capacity * 2;
+        ScreenTriangle* grown = realloc(list->triangles, sizeof(ScreenTriangle) * capacity);
+        if (grown == NULL) return;
+        list->triangles = grown;
+        list->capacity = capacity;
+    }
+    list->triangles[list->count++] = *triangle;
+}
+
+// Projects the corners to the window and adds the triangle if it covers any pixel
+static void emitTriangle(TriangleList* list, const SoftImage* image, const SoftVertex* corners[3], bool mapped) {
+    ScreenTriangle t;
+    t.mapped = mapped;
+    for (int i = 0; i < 3; i++) {
+        GLfloat invW = 1.0f / corners[i]->clip[3];
+        GLfloat x = (corners[i]->clip[0] * invW + 1.0f) * 0.5f * image->width;
+        GLfloat y = (1.0f - corners[i]->clip[1] * invW) * 0.5f * image->height;
+        t.x[i] = roundf(x * SUBPIXEL) / SUBPIXEL;
+        t.y[i] = roundf(y * SUBPIXEL) / SUBPIXEL;
+        t.z[i] = (corners[i]->clip[2] * invW + 1.0f) * 0.5f;
+        t.invW[i] = invW;
+        for (int k = 0; k < 4; k++) {
+            t.colour[i][k] = corners[i]->colour[k] * invW;
+        }
+        for (int k = 0; k < 2; k++) {
+            t.texture[i][k] = corners[i]->texture[k] * invW;
+        }
+    }
+
+    double area = edgeFunction(t.x[0], t.y[0], t.x[1], t.y[1], t.x[2], t.y[2]);
+    if (area == 0) return;
+    if (area < 0) {
+        // Swap two corners so every triangle is wound the same way, nothing is culled
+        ScreenTriangle swapped = t;
+        swapped.x[1] = t.x[2]; swapped.x[2] = t.x[1];
+        swapped.y[1] = t.y[2]; swapped.y[2] = t.y[1];
+        swapped.z[1] = t.z[2]; swapped.z[2] = t.z[1];
+        swapped.invW[1] = t.invW[2]; swapped.invW[2] = t.invW[1];
+        memcpy(swapped.colour[1], t.colour[2], sizeof(t.colour[1]));
+        memcpy(swapped.colour[2], t.colour[1], sizeof(t.colour[2]));
+        memcpy(swapped.texture[1], t.texture[2], sizeof(t.texture[1]));
+        memcpy(swapped.texture[2], t.texture[1], sizeof(t.texture[2]));
+        t = swapped;
+    }
+
+    GLfloat minX = fminf(t.x[0], fminf(t.x[1], t.x[2]));
+    GLfloat maxX = fmaxf(t.x[0], fmaxf(t.x[1], t.x[2]));
+    GLfloat minY = fminf(t.y[0], fminf(t.y[1], t.y[2]));
+    GLfloat maxY = fmaxf(t.y[0], fmaxf(t.y[1], t.y[2]));
+    t.minX = (int) fmaxf(0.0f, ceilf(minX - 0.5f));
+    t.maxX = (int) fminf(image->width - 1, floorf(maxX - 0.5f));
+    t.minY = (int) fmaxf(0.0f, ceilf(minY - 0.5f));
+    t.maxY = (int) fminf(image->height - 1, floorf(maxY - 0.5f));
+    if (t.minX > t.maxX || t.minY > t.maxY) return;
+    appendTriangle(list, &t);
+}
+
+// Clips each triangle of the block and adds what is left to the block's list
+static void setupTriangles(void* context, int begin, int end) {
+    SetupStage* stage = context;
+    for (int block = begin; block < end; block++) {
+        TriangleList* list = &stage->lists[block];
+        int first = (int) ((long long) stage->numTriangles * block / SETUP_BLOCKS);
+        int last = (int) ((long long) stage->numTriangles * (block + 1) / SETUP_BLOCKS);
+        for (int t = first; t < last; t++) {
+            const GLuint* indices = (t < stage->meshTriangles) ? &stage->indices[t * 3]
+                                  : &stage->extraIndices[(t - stage->meshTriangles) * 3];
+            const SoftVertex* corners[3] = {
+                &stage->vertices[indices[0]], &stage->vertices[indices[1]], &stage->vertices[indices[2]]
+            };
+            bool mapped = stage->mapped && t < stage->meshTriangles;
+
+            // Most triangles are inside every plane and skip clipping
+            bool inside = true;
+            bool outside = false;
+            for (int plane = 0; plane < 5; plane++) {
+                int out = 0;
+                for (int i = 0; i < 3; i++) {
+                    if (planeDistance(plane, corners[i]->clip) < 0) out++;
+                }
+                inside = inside && out == 0;
+                outside = outside || out == 3;
+            }
+            if (outside) continue;
+            if (inside) {
+                emitTriangle(list, stage->image, corners, mapped);
+                continue;
+            }
+
+            SoftVertex polygon[2][MAX_CLIPPED + 2];
+            int count = 3;
+            for (int i = 0; i < 3; i++) polygon[0][i] = *corners[i];
+            int current = 0;
+            for (int plane = 0; plane < 5 && count >= 3; plane++) {
+                count = clipPolygon(plane, polygon[current], count, polygon[1 - current]);
+                current = 1 - current;
+            }
+            for (int i = 1; i + 1 < count; i++) {
+                const SoftVertex* fan[3] = {&polygon[current][0], &polygon[current][i], &polygon[current][i + 1]};
+                emitTriangle(list, stage->image, fan, mapped);
+            }
+        }
+    }
+}
+
+// Pixels exactly on an edge belong to only one of the two triangles sharing it
+static bool ownsEdge(GLfloat ax, GLfloat ay, GLfloat bx, GLfloat by) {
+    return (by - ay < 0) || (by == ay && bx - ax > 0);
+}
+
+static GLubyte toByte(GLfloat value) {
+    return (GLubyte) (fmaxf(0.0f, fminf(1.0f, value)) * 255.0f + 0.5f);
+}
+
+// Returns the light at a grid position from the bilinearly filtered normal map, as the
+// DOT3 texture stage works it out: clamped to 0, plus the ambient light, clamped to 1
+static GLfloat mappedLighting(const RasterStage* stage, GLfloat u, GLfloat v) {
+    const CoarseMesh* coarse = stage->coarse;
+    u = fmaxf(0.0f, fminf(coarse->xSize - 1, u));
+    v = fmaxf(0.0f, fminf(coarse->zSize - 1, v));
+    int x0 = (int) u, z0 = (int) v;
+    int x1 = (x0 + 1 < coarse->xSize) ? x0 + 1 : x0;
+    int z1 = (z0 + 1 < coarse->zSize) ? z0 + 1 : z0;
+    GLfloat fu = u - x0, fv = v - z0;
+    Vector3 n00 = coarseMapNormal(coarse, x0, z0), n10 = coarseMapNormal(coarse, x1, z0);
+    Vector3 n01 = coarseMapNormal(coarse, x0, z1), n11 = coarseMapNormal(coarse, x1, z1);
+    Vector3 normal = {
+        (n00.x * (1 - fu) + n10.x * fu) * (1 - fv) + (n01.x * (1 - fu) + n11.x * fu) * fv,
+        (n00.y * (1 - fu) + n10.y * fu) * (1 - fv) + (n01.y * (1 - fu) + n11.y * fu) * fv,
+        (n00.z * (1 - fu) + n10.z * fu) * (1 - fv) + (n01.z * (1 - fu) + n11.z * fu) * fv
+    };
+    GLfloat diffuse = fmaxf(0.0f, fminf(1.0f, dot_product_3(normal, stage->terrainLight)));
+    return fminf(1.0f, ambient + diffuse);
+}
+
+static void rasteriseTriangle(const RasterStage* stage, const ScreenTriangle* t, int x0, int y0, int x1, int y1) {
+    SoftImage* image = stage->image;
+    int minX = (t->minX > x0) ? t->minX : x0;
+    int maxX = (t->maxX < x1) ? t->maxX : x1;
+    int minY = (t->minY > y0) ? t->minY : y0;
+    int maxY = (t->maxY < y1) ? t->maxY : y1;
+    double area = edgeFunction(t->x[0], t->y[0], t->x[1], t->y[1], t->x[2], t->y[2]);
+    bool owns[3] = {
+        ownsEdge(t->x[1], t->y[1], t->x[2], t->y[2]),
+        ownsEdge(t->x[2], t->y[2], t->x[0], t->y[0]),
+        ownsEdge(t->x[0], t->y[0], t->x[1], t->y[1])
+    };
+
+    for (int py = minY; py <= maxY; py++) {
+        double y = py + 0.5;
+        for (int px = minX; px <= maxX; px++) {
+            double x = px + 0.5;
+            double w[3] = {
+                edgeFunction(t->x[1], t->y[1], t->x[2], t->y[2], x, y),
+                edgeFunction(t->x[2], t->y[2], t->x[0], t->y[0], x, y),
+                edgeFunction(t->x[0], t->y[0], t->x[1], t->y[1], x, y)
+            };
+            if (w[0] < 0 || w[1] < 0 || w[2] < 0) continue;
+            if ((w[0] == 0 && !owns[0]) || (w[1] == 0 && !owns[1]) || (w[2] == 0 && !owns[2])) continue;
+
+            GLfloat l[3] = {(GLfloat) (w[0] / area), (GLfloat) (w[1] / area), (GLfloat) (w[2] / area)};
+            GLfloat z = l[0] * t->z[0] + l[1] * t->z[1] + l[2] * t->z[2];
+            int index = py * image->width + px;
+            if (!(z < image->depth[index])) continue;
+            image->depth[index] = z;
+
+            GLfloat q = 1.0f / (l[0] * t->invW[0] + l[1] * t->invW[1] + l[2] * t->invW[2]);
+            GLfloat c[4];
+            for (int k = 0; k < 4; k++) {
+                c[k] = (l[0] * t->colour[0][k] + l[1] * t->colour[1][k] + l[2] * t->colour[2][k]) * q;
+            }
+            if (t->mapped) {
+                GLfloat u = (l[0] * t->texture[0][0] + l[1] * t->texture[1][0] + l[2] * t->texture[2][0]) * q;
+                GLfloat v = (l[0] * t->texture[0][1] + l[1] * t->texture[1][1] + l[2] * t->texture[2][1]) * q;
+                GLfloat lighting = mappedLighting(stage, u, v);
+                for (int k = 0; k < 3; k++) {
+                    c[k] *= lighting;
+                }
+            }
+            GLubyte* pixel = &image->pixels[index * 3];
+            for (int k = 0; k < 3; k++) {
+                GLfloat value = (c[3] >= 1.0f) ? c[k] : c[k] * c[3] + pixel[k] / 255.0f * (1.0f - c[3]);
+                pixel[k] = toByte(value);
+            }
+        }
+    }
+}
+
+// Clears each tile then draws its triangles in the order they were submitted
+static void rasteriseTiles(void* context, int begin, int end) {
+    RasterStage* stage = context;
+    SoftImage* image = stage->image;
+    GLubyte clear[3] = {
+        toByte(stage->scene->clearColour.x), toByte(stage->scene->clearColour.y), toByte(stage->scene->clearColour.z)
+    };
+    for (int tile = begin; tile < end; tile++) {
+        int x0 = (tile % stage->tilesX) * SOFT_TILE_SIZE;
+        int y0 = (tile / stage->tilesX) * SOFT_TILE_SIZE;
+        int x1 = (x0 + SOFT_TILE_SIZE < image->width) ? x0 + SOFT_TILE_SIZE - 1 : image->width - 1;
+        int y1 = (y0 + SOFT_TILE_SIZE < image->height) ? y0 + SOFT_TILE_SIZE - 1 : image->height - 1;
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                int index = y * image->width + x;
+                memcpy(&image->pixels[index * 3], clear, 3);
+                image->depth[index] = 1.0f;
+            }
+        }
+        for (int i = stage->binStart[tile]; i < stage->binStart[tile + 1]; i++) {
+            rasteriseTriangle(stage, stage->bins[i], x0, y0, x1, y1);
+        }
+    }
+}
+
+// Runs every stage over the shaded vertices: clipping and setup, binning into tiles
+// then rasterising the tiles. The mesh's triangles are lit from the coarse mesh's normal
+// map if it is given.
+static void renderVertices(SoftImage* image, const SoftScene* scene, const SoftVertex* vertices,
+                           const GLuint* indices, int numIndices, const GLuint* extraIndices, int numExtra,
+                           const CoarseMesh* coarse) {
+    SetupStage* setup = calloc(1, sizeof(SetupStage));
+    if (setup == NULL) {
+        fprintf(stderr, "Allocation of software renderer setup failed.\n");
+        return;
+    }
+    setup->image = image;
+    setup->vertices = vertices;
+    setup->indices = indices;
+    setup->meshTriangles = numIndices / 3;
+    setup->mapped = coarse != NULL;
+    setup->extraIndices = extraIndices;
+    setup->numTriangles = (numIndices + numExtra) / 3;
+    parallel_for(SETUP_BLOCKS, setupTriangles, setup);
+
+    // Count the triangles in each tile, then fill the bins in submission order
+    int tilesX = (image->width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    int tilesY = (image->height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+    int* binStart = calloc(tilesX * tilesY + 1, sizeof(int));
+    for (int block = 0; block < SETUP_BLOCKS; block++) {
+        for (int i = 0; i < setup->lists[block].count; i++) {
+            const ScreenTriangle* t = &setup->lists[block].triangles[i];
+            for (int ty = t->minY / SOFT_TILE_SIZE; ty <= t->maxY / SOFT_TILE_SIZE; ty++) {
+                for (int tx = t->minX / SOFT_TILE_SIZE; tx <= t->maxX / SOFT_TILE_SIZE; tx++) {
+                    binStart[ty * tilesX + tx + 1]++;
+                }
+            }
+        }
+    }
+    for (int tile = 0; tile < tilesX * tilesY; tile++) {
+        binStart[tile + 1] += binStart[tile];
+    }
+    const ScreenTriangle** bins = malloc(sizeof(ScreenTriangle*) * (binStart[tilesX * tilesY] + 1));
+    int* fill = malloc(sizeof(int) * tilesX * tilesY);
+    memcpy(fill, binStart, sizeof(int) * tilesX * tilesY);
+    for (int block = 0; block < SETUP_BLOCKS; block++) {
+        for (int i = 0; i < setup->lists[block].count; i++) {
+            const ScreenTriangle* t = &setup->lists[block].triangles[i];
+            for (int ty = t->minY / SOFT_TILE_SIZE; ty <= t->maxY / SOFT_TILE_SIZE; ty++) {
+                for (int tx = t->minX / SOFT_TILE_SIZE; tx <= t->maxX / SOFT_TILE_SIZE; tx++) {
+                    bins[fill[ty * tilesX + tx]++] = t;
+                }
+            }
+        }
+    }
+
+    // The normals are in terrain space, so the light is turned back from eye space by the
+    // transpose of the view's rotation
+    const Matrix4* mv = &scene->modelview;
+    Vector3 light = normalise_3(scene->lightDirection);
+    RasterStage raster = {image, scene, bins, binStart, tilesX, coarse, normalise_3((Vector3){
+        mv->m[0] * light.x + mv->m[1] * light.y + mv->m[2] * light.z,
+        mv->m[4] * light.x + mv->m[5] * light.y + mv->m[6] * light.z,
+        mv->m[8] * light.x + mv->m[9] * light.y + mv->m[10] * light.z
+    })};
+    parallel_for(tilesX * tilesY, rasteriseTiles, &raster);
+
+    free(fill);
+    free(bins);
+    free(binStart);
+    for (int block = 0; block < SETUP_BLOCKS; block++) {
+        free(setup->lists[block].triangles);
+    }
+    free(setup);
+}
+
+// Shades the water's corners after the numVertices already in vertices and draws
+// everything, the water last
+static void renderWithWater(SoftImage* image, const SoftScene* scene, SoftVertex* vertices, int numVertices,
+                            const GLuint* indices, int numIndices, const CoarseMesh* coarse) {
+    Vector3 light = normalise_3(scene->lightDirection);
+    // The same quad drawTerrain draws, including its raised last corner
+    Vector3 corners[4] = {
+        {0.0f, 0.0f, 0.0f},
+        {scene->xSize, 0.0f, 0.0f},
+        {scene->xSize, 0.0f, scene->zSize},
+        {0.0f, 0.5f, scene->zSize}
+    };
+    for (int i = 0; i < 4; i++) {
+        vertices[numVertices + i] = shadeVertex(scene, light, corners[i],
+                                                (Vector3){0.0f, 1.0f, 0.0f}, waterColour, waterAlpha);
+    }
+    GLuint water[6] = {
+        numVertices, numVertices + 1, numVertices + 2,
+        numVertices, numVertices + 2, numVertices + 3
+    };
+    renderVertices(image, scene, vertices, indices, numIndices, water, scene->water ? 6 : 0, coarse);
+}
+
+// Shades the vertices then draws them with the water
+static void renderScene(SoftImage* image, const SoftScene* scene, const TerrainVertex* input,
+                        int numVertices, const GLuint* indices, int numIndices) {
+    SoftVertex* vertices = malloc(sizeof(SoftVertex) * (numVertices + 4));
+    if (vertices == NULL) {
+        fprintf(stderr, "Allocation of software renderer vertices failed.\n");
+        return;
+    }
+    VertexStage stage = {image, scene, input, vertices, normalise_3(scene->lightDirection)};
+    parallel_for(numVertices, shadeVertices, &stage);
+    renderWithWater(image, scene, vertices, numVertices, indices, numIndices, NULL);
+    free(vertices);
+}
+
+void renderTerrainMesh(SoftImage* image, const SoftScene* scene, const TerrainMesh* mesh) {
+    renderScene(image, scene, mesh->vertices, mesh->numVertices, mesh->indices, mesh->numIndices);
+}
+
+// Colours come from the lookup table at each vertex, OpenGL filters them per pixel
+void renderCompactMesh(SoftImage* image, const SoftScene* scene, const CompactMesh* mesh) {
+    TerrainVertex* vertices = malloc(sizeof(TerrainVertex) * mesh->numVertices);
+    GLuint* indices = malloc(sizeof(GLuint) * mesh->numIndices);
+    if (vertices == NULL || indices == NULL) {
+        fprintf(stderr, "Allocation of decoded compact mesh failed.\n");
+        free(vertices);
+        free(indices);
+        return;
+    }
+    for (int p = 0; p < mesh->patchesX * mesh->patchesZ; p++) {
+        const CompactPatch* patch = &mesh->patches[p];
+        for (int i = 0; i < patch->xCount * patch->zCount; i++) {
+            vertices[patch->firstVertex + i] = decodeCompactVertex(mesh, patch, i);
+        }
+        for (int i = 0; i < patch->numIndices; i++) {
+            indices[patch->firstIndex + i] = patch->firstVertex + mesh->indices[patch->firstIndex + i];
+        }
+    }
+    renderScene(image, scene, vertices, mesh->numVertices, indices, mesh->numIndices);
+    free(vertices);
+    free(indices);
+}
+
+typedef struct {
+    const SoftScene* scene;
+    const CoarseMesh* mesh;
+    SoftVertex* output;
+} CoarseStage;
+
+// Only projects the vertices, the lighting is done per pixel
+static void projectCoarseVertices(void* context, int begin, int end) {
+    CoarseStage* stage = context;
+    for (int i = begin; i < end; i++) {
+        const CoarseVertex* v = &stage->mesh->vertices[i];
+        SoftVertex* out = &stage->output[i];
+        GLfloat world[4] = {v->position.x, v->position.y, v->position.z, 1.0f};
+        GLfloat eye[4];
+        transform(&stage->scene->modelview, world, eye);
+        transform(&stage->scene->projection, eye, out->clip);
+        out->colour[0] = v->colour.x;
+        out->colour[1] = v->colour.y;
+        out->colour[2] = v->colour.z;
+        out->colour[3] = 1.0f;
+        out->texture[0] = v->position.x;
+        out->texture[1] = v->position.z;
+    }
+}
+
+void renderCoarseMesh(SoftImage* image, const SoftScene* scene, const CoarseMesh* mesh) {
+    SoftVertex* vertices = malloc(sizeof(SoftVertex) * (mesh->numVertices + 4));
+    if (vertices == NULL) {
+        fprintf(stderr, "Allocation of software renderer vertices failed.\n");
+        return;
+    }
+    CoarseStage stage = {scene, mesh, vertices};
+    parallel_for(mesh->numVertices, projectCoarseVertices, &stage);
+    renderWithWater(image, scene, vertices, mesh->numVertices, mesh->indices, mesh->numIndices, mesh);
+    free(vertices);
+}
+
+bool writeSoftImage(const SoftImage* image, const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not open '%s' for writing.\n", path);
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", image->width, image->height);
+    size_t size = (size_t) image->width * image->height * 3;
+    bool written = fwrite(image->pixels, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+SoftImage* readSoftImage(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return NULL;
+    int width, height, maxValue;
+    if (fscanf(file, "P6 %d %d %d", &width, &height, &maxValue) != 3 || maxValue != 255
+        || width <= 0 || height <= 0 || fgetc(file) == EOF) {
+        fclose(file);
+        return NULL;
+    }
+    SoftImage* image = createSoftImage(width, height);
+    size_t size = (size_t) width * height * 3;
+    if (image != NULL && fread(image->pixels, 1, size, file) != size) {
+        freeSoftImage(image);
+        image = NULL;
+    }
+    fclose(file);
+    return image;
+}
+
+double compareSoftImages(const SoftImage* a, const SoftImage* b, int threshold, double* outliers) {
+    if (a->width != b->width || a->height != b->height) {
+        if (outliers != NULL) *outliers = 1.0;
+        return 255.0;
+    }
+    long long total = 0;
+    int different = 0;
+    int numPixels = a->width * a->height;
+    for (int i = 0; i < numPixels; i++) {
+        bool outlier = false;
+        for (int k = 0; k < 3; k++) {
+            int difference = abs(a->pixels[i * 3 + k] - b->pixels[i * 3 + k]);
+            total += difference;
+            outlier = outlier || difference > threshold;
+        }
+        if (outlier) different++;
+    }
+    if (outliers != NULL) *outliers = (double) different / numPixels;
+    return (double) total / (numPixels * 3.0);
+}
@@ -0,0 +1,56 @@
+#ifndef SOFTRENDER_H
+#define SOFTRENDER_H
+
+#include <stdbool.h>
+#include "structures.h"
+#include "mesh.h"
+
+// Side length in pixels of the tiles the image is split into, one tile is drawn per task
+#define SOFT_TILE_SIZE 32
+
+// An image with a depth buffer, drawn into by the software renderer
+typedef struct {
+    int width, height;
+    GLubyte* pixels; // RGB, 3 bytes per pixel with the top row first
+    GLfloat* depth;
+} SoftImage;
+
+// Everything display() sets up around the terrain, in the same form OpenGL takes it
+typedef struct {
+    Matrix4 projection, modelview;
+    Vector3 clearColour;
+    Vector3 lightDirection; // In eye space, like the position of a directional GL_LIGHT0
+    bool water;             // Draws the transparent water quad over the terrain
+    int xSize, zSize;       // Size of the water quad
+} SoftScene;
+
+// Creates an image of the given size, or returns NULL if it could not be allocated
+extern SoftImage* createSoftImage(int width, int height);
+
+// Draws the mesh as the fixed-function pipeline would with the OpenGL state setupOpenGL
+// leaves: per vertex lighting with 0.2 ambient, depth testing and the blended water.
+// Tiles are drawn on all threads and the image does not depend on the thread count.
+extern void renderTerrainMesh(SoftImage*, const SoftScene*, const TerrainMesh*);
+
+// Draws the compact mesh the same way, from its decoded vertices
+extern void renderCompactMesh(SoftImage*, const SoftScene*, const CompactMesh*);
+
+// Draws the coarse mesh as drawCoarseMesh does, lighting every pixel from the filtered
+// normal map with the same ambient and clamping as its texture stages
+extern void renderCoarseMesh(SoftImage*, const SoftScene*, const CoarseMesh*);
+
+// Writes the image as a binary PPM, returns whether it succeeded
+extern bool writeSoftImage(const SoftImage*, const char* path);
+
+// Reads a binary PPM written by writeSoftImage, or returns NULL
+extern SoftImage* readSoftImage(const char* path);
+
+// Returns the mean absolute difference per colour channel of two images of the same size,
+// from 0 to 255. outliers is set to the fraction of pixels where a channel differs by more
+// than threshold.
+extern double compareSoftImages(const SoftImage*, const SoftImage*, int threshold, double* outliers);
+
+// Frees the image and its buffers
+extern void freeSoftImage(SoftImage*);
+
+#endif
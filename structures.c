@@ -23,18 +23,13 @@ Vector3 cross_product_3(Vector3 v1, Vector3 v2) {
 	    .y = (v2.x * v1.z) - (v2.z * v1.x),
 	    .z = (v1.x * v2.y) - (v1.y * v2.x)
     };
-    GLfloat magnitude = sqrtf(
-            (out.x * out.x)
-	        + (out.y * out.y)
-	        + (out.z * out.z)
-        );
-    assert(magnitude != 0);
-    GLfloat dot = dot_product_3(out, upwards);
-    if (dot >= 0) return out;
-    // Vector is pointing in the wrong direction
-    out.x /= -1;
-    out.y /= -1;
-    out.z /= -1;
+    // The magnitude is only zero if its square is, so no square root is needed
+    assert(dot_product_3(out, out) != 0);
+    // Flip the vector if it is pointing in the wrong direction
+    GLfloat sign = (dot_product_3(out, upwards) >= 0) ? 1.0f : -1.0f;
+    out.x *= sign;
+    out.y *= sign;
+    out.z *= sign;
     return out;
 }
 
@@ -52,6 +47,161 @@ Vector3 normalise_3(Vector3 v) {
     return v;
 }
 
+Vector3Arrays vector3_arrays_at(Vector3Arrays arrays, int index) {
+    return (Vector3Arrays){arrays.x + index, arrays.y + index, arrays.z + index};
+}
+
+// The loops below have no branches or calls other than sqrtf, so they vectorise
+
+void normalise_3_n(Vector3* vectors, int count) {
+    for (int i = 0; i < count; i++) {
+        Vector3 v = vectors[i];
+        GLfloat inverse = 1.0f / sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+        vectors[i] = (Vector3){v.x * inverse, v.y * inverse, v.z * inverse};
+    }
+}
+
+void normalise_3_soa_n(Vector3Arrays v, int count) {
+    GLfloat* restrict x = v.x;
+    GLfloat* restrict y = v.y;
+    GLfloat* restrict z = v.z;
+    for (int i = 0; i < count; i++) {
+        GLfloat inverse = 1.0f / sqrtf(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+        x[i] *= inverse;
+        y[i] *= inverse;
+        z[i] *= inverse;
+    }
+}
+
+// Same as cross_product_3, flipping by the sign of y as that is the dot product with up
+void cross_up_3_n(Vector3Arrays a, Vector3Arrays b, Vector3Arrays out, int count) {
+    const GLfloat* restrict ax = a.x;
+    const GLfloat* restrict ay = a.y;
+    const GLfloat* restrict az = a.z;
+    const GLfloat* restrict bx = b.x;
+    const GLfloat* restrict by = b.y;
+    const GLfloat* restrict bz = b.z;
+    GLfloat* restrict x = out.x;
+    GLfloat* restrict y = out.y;
+    GLfloat* restrict z = out.z;
+    for (int i = 0; i < count; i++) {
+        GLfloat cx = ay[i] * bz[i] - az[i] * by[i];
+        GLfloat cy = bx[i] * az[i] - bz[i] * ax[i];
+        GLfloat cz = ax[i] * by[i] - ay[i] * bx[i];
+        GLfloat sign = (cy >= 0) ? 1.0f : -1.0f;
+        x[i] = cx * sign;
+        y[i] = cy * sign;
+        z[i] = cz * sign;
+    }
+}
+
+Matrix4 matrix_identity(void) {
+    Matrix4 out = {{0}};
+    out.m[0] = out.m[5] = out.m[10] = out.m[15] = 1.0f;
+    return out;
+}
+
+Matrix4 matrix_multiply(Matrix4 a, Matrix4 b) {
+    Matrix4 out;
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            GLfloat sum = 0;
+            for (int k = 0; k < 4; k++) {
+                sum += a.m[k * 4 + row] * b.m[column * 4 + k];
+            }
+            out.m[column * 4 + row] = sum;
+        }
+    }
+    return out;
+}
+
+Matrix4 matrix_translate(Matrix4 matrix, GLfloat x, GLfloat y, GLfloat z) {
+    Matrix4 translation = matrix_identity();
+    translation.m[12] = x;
+    translation.m[13] = y;
+    translation.m[14] = z;
+    return matrix_multiply(matrix, translation);
+}
+
+// Uses the same formula as the glRotatef documentation
+Matrix4 matrix_rotate(Matrix4 matrix, GLfloat degrees, GLfloat x, GLfloat y, GLfloat z) {
+    Vector3 axis = normalise_3((Vector3){x, y, z});
+    GLfloat radians = degrees * (GLfloat) M_PI / 180.0f;
+    GLfloat c = cosf(radians);
+    GLfloat s = sinf(radians);
+    GLfloat t = 1 - c;
+    Matrix4 rotation = matrix_identity();
+    rotation.m[0] = axis.x * axis.x * t + c;
+    rotation.m[1] = axis.y * axis.x * t + axis.z * s;
+    rotation.m[2] = axis.x * axis.z * t - axis.y * s;
+    rotation.m[4] = axis.x * axis.y * t - axis.z * s;
+    rotation.m[5] = axis.y * axis.y * t + c;
+    rotation.m[6] = axis.y * axis.z * t + axis.x * s;
+    rotation.m[8] = axis.x * axis.z * t + axis.y * s;
+    rotation.m[9] = axis.y * axis.z * t - axis.x * s;
+    rotation.m[10] = axis.z * axis.z * t + c;
+    return matrix_multiply(matrix, rotation);
+}
+
+// Builds the camera's basis as rows, then moves the eye to the origin
+Matrix4 matrix_look_at(Vector3 eye, Vector3 centre, Vector3 up) {
+    Vector3 forward = normalise_3((Vector3){centre.x - eye.x, centre.y - eye.y, centre.z - eye.z});
+    Vector3 side = {
+        forward.y * up.z - forward.z * up.y,
+        forward.z * up.x - forward.x * up.z,
+        forward.x * up.y - forward.y * up.x
+    };
+    side = normalise_3(side);
+    Vector3 trueUp = {
+        side.y * forward.z - side.z * forward.y,
+        side.z * forward.x - side.x * forward.z,
+        side.x * forward.y - side.y * forward.x
+    };
+    Matrix4 out = matrix_identity();
+    out.m[0] = side.x;
+    out.m[4] = side.y;
+    out.m[8] = side.z;
+    out.m[1] = trueUp.x;
+    out.m[5] = trueUp.y;
+    out.m[9] = trueUp.z;
+    out.m[2] = -forward.x;
+    out.m[6] = -forward.y;
+    out.m[10] = -forward.z;
+    return matrix_translate(out, -eye.x, -eye.y, -eye.z);
+}
+
+Matrix4 matrix_perspective(GLfloat fovy, GLfloat aspect, GLfloat near, GLfloat far) {
+    GLfloat f = 1.0f / tanf(fovy * (GLfloat) M_PI / 360.0f);
+    Matrix4 out = {{0}};
+    out.m[0] = f / aspect;
+    out.m[5] = f;
+    out.m[10] = (far + near) / (near - far);
+    out.m[11] = -1.0f;
+    out.m[14] = 2 * far * near / (near - far);
+    return out;
+}
+
+// Splitmix-style generator: the state is a counter and the output is a hash of it,
+// so any starting state (including 0) is valid
+uint32_t random_next(uint32_t* state) {
+    *state += 0x9E3779B9u;
+    uint32_t z = *state;
+    z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+    z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+    return z ^ (z >> 16);
+}
+
+// Uses the top 24 bits so that every value is exactly representable as a float
+GLfloat random_float(uint32_t* state) {
+    return (GLfloat) (random_next(state) >> 8) * (1.0f / 16777216.0f);
+}
+
+// Returns a seed for a sequence which is independent of the sequence of 'seed'
+uint32_t hash_seed(uint32_t seed, uint32_t value) {
+    uint32_t state = seed ^ (value * 0x27D4EB2Du);
+    return random_next(&state);
+}
+
 // Allocates a 2D array of pointers, initialised to NULL
 // A pointer to the array is passed into the function, as well as its dimensions
 int allocate2D(void**** at, int xSize, int zSize) {
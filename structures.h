@@ -1,26 +1,38 @@
 #ifndef STRUCTURES_H
 #define STRUCTURES_H
 
+#include <stdint.h>
 #include <GL/gl.h>
 #include <GL/glu.h>
 #include <GLFW/glfw3.h>
 
-// A heightFunction takes an x and z, and returns the height.
-typedef GLfloat (*heightFunction) (GLfloat, GLfloat);
+// A heightFunction takes the context it was given, an x and z, and returns the height.
+typedef GLfloat (*heightFunction) (void* context, GLfloat, GLfloat);
 
 // Holds information about a 3D point.
 typedef struct {
     GLfloat x, y, z;
 } Vector3;
 
-// A colour takes an x and y and z, and returns the colour.
-typedef Vector3 (*colourFunction) (GLfloat, GLfloat, GLfloat);
+// The parts of a terrain a colour function depends on.
+typedef struct {
+    GLfloat height;     // Maximum height of the terrain
+    GLfloat** biomeMap; // Points above 0 are inside a biome, NULL if there are none.
+                        // Usually a terrain's biomes, which its generator keeps up to date.
+} ColourParams;
+
+// A colour takes the terrain's parameters, an x and y and z, and returns the colour.
+typedef Vector3 (*colourFunction) (const ColourParams*, GLfloat, GLfloat, GLfloat);
 
 // Holds information about a 2D point.
 typedef struct {
     GLfloat x, y;
 } Vector2;
 
+// A heightGradientFunction returns the height like a heightFunction, and also writes
+// the height's derivatives along x and z to the gradient.
+typedef GLfloat (*heightGradientFunction) (void* context, GLfloat, GLfloat, Vector2* gradient);
+
 // Returns the dot product of 2 2D vectors.
 extern GLfloat dot_product_2(Vector2, Vector2);
 // Returns the dot product of 2 3D vectors.
@@ -34,6 +46,54 @@ extern Vector3 cross_product_3(Vector3, Vector3);
 // normalises the vector 3
 extern Vector3 normalise_3(Vector3);
 
+// Separate arrays of the x, y and z of many vectors, so the batch functions below can
+// work on several at once with vector instructions.
+typedef struct {
+    GLfloat* x;
+    GLfloat* y;
+    GLfloat* z;
+} Vector3Arrays;
+
+// Returns the arrays starting from the vector at index.
+extern Vector3Arrays vector3_arrays_at(Vector3Arrays, int index);
+
+// Normalises count vectors in place, with one square root each.
+// PRE: No vector is zero.
+extern void normalise_3_n(Vector3*, int count);
+extern void normalise_3_soa_n(Vector3Arrays, int count);
+
+// Writes the cross products of count pairs of vectors to out, each pointing upwards like
+// cross_product_3 (NOT NORMALISED). Out must not overlap a or b.
+extern void cross_up_3_n(Vector3Arrays a, Vector3Arrays b, Vector3Arrays out, int count);
+
+// A 4x4 matrix in column-major order, the layout glLoadMatrixf takes.
+typedef struct {
+    GLfloat m[16];
+} Matrix4;
+
+// Returns the identity matrix.
+extern Matrix4 matrix_identity(void);
+// Returns a * b, which applies b first then a.
+extern Matrix4 matrix_multiply(Matrix4 a, Matrix4 b);
+// Returns the matrix followed by a translation, like glTranslatef.
+extern Matrix4 matrix_translate(Matrix4, GLfloat x, GLfloat y, GLfloat z);
+// Returns the matrix followed by a rotation of degrees about (x, y, z), like glRotatef.
+extern Matrix4 matrix_rotate(Matrix4, GLfloat degrees, GLfloat x, GLfloat y, GLfloat z);
+// Returns the viewing matrix gluLookAt would multiply by.
+extern Matrix4 matrix_look_at(Vector3 eye, Vector3 centre, Vector3 up);
+// Returns the projection matrix gluPerspective would multiply by.
+extern Matrix4 matrix_perspective(GLfloat fovy, GLfloat aspect, GLfloat near, GLfloat far);
+
+// Advances the random state and returns the next pseudo-random number.
+// A given starting state produces the same sequence on every platform.
+extern uint32_t random_next(uint32_t* state);
+
+// Returns a pseudo-random value between 0 (inclusive) and 1 (exclusive).
+extern GLfloat random_float(uint32_t* state);
+
+// Mixes a value into a seed, giving a new seed for an independent sequence.
+extern uint32_t hash_seed(uint32_t seed, uint32_t value);
+
 // Allocates a 2D array of pointers initialised to NULL. Takes a pointer to the array.
 extern int allocate2D(void****, int, int);
 
@@ -64,6 +64,71 @@ int main(void) {
     assert_test(eps_equals(normArb1.x, 1/sqrtf(2)) && eps_equals(normArb1.y, 1/sqrtf(2)) && normArb1.z == 0, "Normalisation test 2.", TEST_OK_OUT, TEST_FAIL_OUT);
     assert_test(eps_equals(normArb2.x, 1/sqrtf(6)) && eps_equals(normArb2.y, 2/sqrtf(6)) && eps_equals(normArb2.z, 1/sqrtf(6)), "Normalisation test 3.", TEST_OK_OUT, TEST_FAIL_OUT);
 
+    // Testing the batch versions against the single ones, with more vectors than fit in
+    // a vector register and pairs whose cross products need flipping
+    Vector3 batch[] = {v3UnitX, v3UnitY, v3UnitZ, v3Arb1, v3Arb2, {-3, 1, 2}, {0.5f, -4, 1}, {2, 2, -7}, {-1, -1, -1}};
+    Vector3 pairs[] = {v3UnitY, v3UnitZ, v3UnitX, v3Arb2, v3Arb1, {1, 5, -2}, {2, 1, 3}, {-1, 0, 1}, {3, -2, 1}};
+    int count = sizeof(batch) / sizeof(batch[0]);
+    GLfloat ax[9], ay[9], az[9], bx[9], by[9], bz[9], cx[9], cy[9], cz[9];
+    Vector3Arrays a = {ax, ay, az}, b = {bx, by, bz}, crosses = {cx, cy, cz};
+    for (int i = 0; i < count; i++) {
+        ax[i] = batch[i].x; ay[i] = batch[i].y; az[i] = batch[i].z;
+        bx[i] = pairs[i].x; by[i] = pairs[i].y; bz[i] = pairs[i].z;
+    }
+    cross_up_3_n(a, b, crosses, count);
+    bool crossed = true;
+    for (int i = 0; i < count; i++) {
+        Vector3 single = cross_product_3(batch[i], pairs[i]);
+        crossed = crossed && single.x == cx[i] && single.y == cy[i] && single.z == cz[i];
+    }
+    assert_test(crossed, "Batch cross products match.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    normalise_3_soa_n(vector3_arrays_at(a, 1), count - 1);
+    normalise_3_n(batch, count);
+    bool normalised = ax[0] == 1 && ay[0] == 0 && az[0] == 0;
+    for (int i = 0; i < count; i++) {
+        Vector3 single = normalise_3(pairs[i]);
+        normalise_3_n(&pairs[i], 1);
+        normalised = normalised && eps_equals(single.x, pairs[i].x) && eps_equals(single.y, pairs[i].y)
+                     && eps_equals(single.z, pairs[i].z)
+                     && eps_equals(1, sqrtf(dot_product_3(batch[i], batch[i])))
+                     && batch[i].x == ax[i] && batch[i].y == ay[i] && batch[i].z == az[i];
+    }
+    assert_test(normalised, "Batch normalisation matches.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Testing matrices
+    printf("\nTesting Matrix4: \n");
+    Matrix4 identity = matrix_identity();
+    Matrix4 moved = matrix_translate(identity, 1, 2, 3);
+    Matrix4 both = matrix_multiply(moved, matrix_translate(identity, -1, -2, -3));
+    bool isIdentity = true;
+    for (int i = 0; i < 16; i++) {
+        isIdentity = isIdentity && eps_equals(identity.m[i], both.m[i]);
+    }
+    assert_test(isIdentity, "Translation undone by its inverse.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(moved.m[12] == 1 && moved.m[13] == 2 && moved.m[14] == 3, "Translation in last column.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Rotating x by 90 degrees about y gives -z
+    Matrix4 turned = matrix_rotate(identity, 90, 0, 1, 0);
+    assert_test(eps_equals(turned.m[0], 0) && eps_equals(turned.m[2], -1), "Rotation about y.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // A camera looking down -z from the origin is the identity
+    Matrix4 look = matrix_look_at((Vector3){0, 0, 0}, (Vector3){0, 0, -1}, (Vector3){0, 1, 0});
+    bool lookIdentity = true;
+    for (int i = 0; i < 16; i++) {
+        lookIdentity = lookIdentity && eps_equals(identity.m[i], look.m[i]);
+    }
+    assert_test(lookIdentity, "Look at down -z is identity.", TEST_OK_OUT, TEST_FAIL_OUT);
+    look = matrix_look_at((Vector3){5, 0, 0}, (Vector3){5, 0, -1}, (Vector3){0, 1, 0});
+    assert_test(eps_equals(look.m[12], -5), "Look at moves the eye to the origin.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Points on the near and far planes map to -1 and 1
+    Matrix4 projection = matrix_perspective(90, 1, 1, 100);
+    GLfloat nearZ = (projection.m[10] * -1 + projection.m[14]) / 1;
+    GLfloat farZ = (projection.m[10] * -100 + projection.m[14]) / 100;
+    assert_test(eps_equals(nearZ, -1) && eps_equals(farZ, 1), "Perspective depth range.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(eps_equals(projection.m[5], 1), "Perspective field of view.", TEST_OK_OUT, TEST_FAIL_OUT);
+
     // Testing createCamera
     printf("\nTesting Create Camera: \n");
     Camera* cam = createCamera(1, 2, 3, 4, 5, 6);
@@ -1,14 +1,10 @@
 #include "terrain.h"
 #include "structures.h"
-#include "perlin.h"
+#include "parallel.h"
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
-
-typedef struct {
-    Vector3 n1;
-    Vector3 n2;
-} vertexNormals;
+#include <string.h>
 
 // Creates a terrain with empty heights and normals
 Terrain* createTerrain(int xSize, int zSize, int height) {
@@ -18,6 +14,11 @@ Terrain* createTerrain(int xSize, int zSize, int height) {
     terrain->xSize = xSize;
     terrain->zSize = zSize;
     terrain->height = height;
+    terrain->dirty = (TerrainRect){0, 0, 0, 0};
+    terrain->version = 0;
+    terrain->heightsVersion = 0;
+    terrain->shading = NULL;
+    terrain->biomes = NULL;
 
     terrain->spinning = false;
     terrain->morphing = false;
@@ -38,84 +39,336 @@ Terrain* createTerrain(int xSize, int zSize, int height) {
         assert(terrain->heights[x] != NULL);
     }
 
+    // Allocates the pyramid, halving the cells (rounding up) until one is left
+    HeightPyramid* pyramid = &terrain->pyramid;
+    int xCells = (xSize > 1) ? xSize - 1 : 1;
+    int zCells = (zSize > 1) ? zSize - 1 : 1;
+    pyramid->levels = 0;
+    while (true) {
+        int level = pyramid->levels++;
+        pyramid->xCells[level] = xCells;
+        pyramid->zCells[level] = zCells;
+        pyramid->min[level] = calloc((size_t) xCells * zCells, sizeof(GLfloat));
+        pyramid->max[level] = calloc((size_t) xCells * zCells, sizeof(GLfloat));
+        assert(pyramid->min[level] != NULL && pyramid->max[level] != NULL);
+        if (xCells == 1 && zCells == 1) break;
+        xCells = (xCells + 1) / 2;
+        zCells = (zCells + 1) / 2;
+    }
+
     return terrain;
 }
 
-static Vector3 *getFaceNormalInBounds(Terrain* terrain, vertexNormals*** faceNormals, int x, int z, int firstOrSecond) {
-    if (x >= 0 && z >= 0 && x < terrain->xSize - 1 && z < terrain->zSize - 1) {
-        return (firstOrSecond == 0) ? (&(faceNormals[x][z]->n1)) : (&(faceNormals[x][z]->n2));
+// The entries of one pyramid level inside a rectangle of entries
+typedef struct {
+    Terrain* terrain;
+    int level;
+    TerrainRect rect;
+} PyramidJob;
+
+static void updatePyramidRows(void* context, int begin, int end) {
+    PyramidJob* job = context;
+    Terrain* terrain = job->terrain;
+    HeightPyramid* pyramid = &terrain->pyramid;
+    int level = job->level;
+    int zCells = pyramid->zCells[level];
+    for (int x = job->rect.x0 + begin; x < job->rect.x0 + end; x++) {
+        for (int z = job->rect.z0; z < job->rect.z1; z++) {
+            GLfloat low = INFINITY, high = -INFINITY;
+            if (level == 0) {
+                // The cell's corners, on the last point for a terrain a single point wide
+                for (int dx = 0; dx <= 1; dx++) {
+                    for (int dz = 0; dz <= 1; dz++) {
+                        int px = (x + dx < terrain->xSize) ? x + dx : x;
+                        int pz = (z + dz < terrain->zSize) ? z + dz : z;
+                        GLfloat h = terrain->heights[px][pz];
+                        if (h < low) low = h;
+                        if (h > high) high = h;
+                    }
+                }
+            } else {
+                int childXCells = pyramid->xCells[level - 1];
+                int childZCells = pyramid->zCells[level - 1];
+                for (int cx = 2 * x; cx < 2 * x + 2 && cx < childXCells; cx++) {
+                    for (int cz = 2 * z; cz < 2 * z + 2 && cz < childZCells; cz++) {
+                        GLfloat childLow = pyramid->min[level - 1][cx * childZCells + cz];
+                        GLfloat childHigh = pyramid->max[level - 1][cx * childZCells + cz];
+                        if (childLow < low) low = childLow;
+                        if (childHigh > high) high = childHigh;
+                    }
+                }
+            }
+            pyramid->min[level][x * zCells + z] = low;
+            pyramid->max[level][x * zCells + z] = high;
+        }
+    }
+}
+
+// A point is a corner of the cells to its lower side as well as its own, so the cells
+// from one before the rectangle are updated, then their parents level by level
+static void updatePyramid(Terrain* terrain, TerrainRect rect) {
+    HeightPyramid* pyramid = &terrain->pyramid;
+    TerrainRect cells = {
+        .x0 = (rect.x0 - 1 < 0) ? 0 : rect.x0 - 1,
+        .z0 = (rect.z0 - 1 < 0) ? 0 : rect.z0 - 1,
+        .x1 = (rect.x1 > pyramid->xCells[0]) ? pyramid->xCells[0] : rect.x1,
+        .z1 = (rect.z1 > pyramid->zCells[0]) ? pyramid->zCells[0] : rect.z1
+    };
+    for (int level = 0; level < pyramid->levels; level++) {
+        if (level > 0) {
+            cells.x0 /= 2;
+            cells.z0 /= 2;
+            cells.x1 = (cells.x1 + 1) / 2;
+            cells.z1 = (cells.z1 + 1) / 2;
+        }
+        PyramidJob job = {terrain, level, cells};
+        // Only the larger levels are worth splitting across threads
+        if ((long) (cells.x1 - cells.x0) * (cells.z1 - cells.z0) > 4096) {
+            parallel_for(cells.x1 - cells.x0, updatePyramidRows, &job);
+        } else {
+            updatePyramidRows(&job, 0, cells.x1 - cells.x0);
+        }
     }
-    return NULL;
 }
 
-// Calculates the heights and normals
-void populateTerrain(Terrain* terrain, heightFunction hf) {
-    for (int x = 0; x < terrain->xSize; x++) {
+typedef struct {
+    Terrain* terrain;
+    heightFunction function;
+    void* context;
+} HeightJob;
+
+static void populateHeightRows(void* context, int begin, int end) {
+    HeightJob* job = context;
+    Terrain* terrain = job->terrain;
+    for (int x = begin; x < end; x++) {
         for (int z = 0; z < terrain->zSize; z++) {
-            terrain->heights[x][z] = hf(x, z) * terrain->height;
+            terrain->heights[x][z] = job->function(job->context, x, z) * terrain->height;
         }
     }
+}
+
+// Calculates the heights and normals
+void populateTerrain(Terrain* terrain, heightFunction hf, void* context) {
+    HeightJob job = {terrain, hf, context};
+    parallel_for(terrain->xSize, populateHeightRows, &job);
+    calculateNormals(terrain);
+}
 
-    vertexNormals ***faceNormals;
-    allocate2D((void****)&faceNormals, terrain->xSize-1, terrain->zSize-1);
-    // generate face normals
-    for (int z = 0; z < terrain->zSize - 1; z++) {
-        for (int x = 0; x < terrain->zSize - 1; x++) {
-            // Get the four vertices of the quad
-            Vector3 v0 = {x, terrain->heights[x][z], z};
-            Vector3 v1 = {x + 1, terrain->heights[x + 1][z], z};
-            Vector3 v2 = {x, terrain->heights[x][z + 1], z + 1};
-            Vector3 v3 = {x + 1, terrain->heights[x + 1][z + 1], z + 1};
-
-            // Calculate the normal for the first triangle (v0, v1, v2)
-            Vector3 edge1 = {v1.x - v0.x, v1.y - v0.y, v1.z - v0.z};
-            Vector3 edge2 = {v2.x - v0.x, v2.y - v0.y, v2.z - v0.z};
-            Vector3 normal1 = cross_product_3(edge1, edge2);
-            normal1 = normalise_3(normal1);
-
-            vertexNormals *vn = malloc(sizeof(vertexNormals));
-            // Store the normal
-            vn->n1 = normal1;
-
-            // Calculate the normal for the second triangle (v1, v3, v2)
-            edge1 = (Vector3){v3.x - v1.x, v3.y - v1.y, v3.z - v1.z};
-            edge2 = (Vector3){v2.x - v1.x, v2.y - v1.y, v2.z - v1.z};
-            Vector3 normal2 = cross_product_3(edge1, edge2);
-            normal2 = normalise_3(normal2);
-
-            // Store the normal
-            vn->n2 = normal2;
-
-            faceNormals[x][z] = vn;
+typedef struct {
+    Terrain* terrain;
+    heightGradientFunction function;
+    void* context;
+} GradientJob;
+
+// The surface is y = height * f(x, z), so its normal is (-height * df/dx, 1, -height * df/dz)
+static void populateGradientRows(void* context, int begin, int end) {
+    GradientJob* job = context;
+    Terrain* terrain = job->terrain;
+    for (int x = begin; x < end; x++) {
+        for (int z = 0; z < terrain->zSize; z++) {
+            Vector2 gradient;
+            terrain->heights[x][z] = job->function(job->context, x, z, &gradient) * terrain->height;
+            terrain->normals[x][z] = (Vector3){-gradient.x * terrain->height, 1.0f, -gradient.y * terrain->height};
         }
+        normalise_3_n(terrain->normals[x], terrain->zSize);
     }
-    // now average out nearby face normals for each vertex
-    for (int z = 0; z < terrain->xSize; z++) {
-        for (int x = 0; x < terrain->xSize; x++) {
-            Vector3* normals[6];
-
-            // up to 6 associated triangles per vertex
-            normals[0] = getFaceNormalInBounds(terrain, faceNormals, x-1, z-1, 1); // top left adjacent
-            normals[1] = getFaceNormalInBounds(terrain, faceNormals, x, z-1, 0); // top right adj 1
-            normals[2] = getFaceNormalInBounds(terrain, faceNormals, x, z-1, 1); // top right adj 2
-            normals[3] = getFaceNormalInBounds(terrain, faceNormals, x-1, z, 0); // bottom left adj 1
-            normals[4] = getFaceNormalInBounds(terrain, faceNormals, x-1, z, 1); // bottom left adj 2
-            normals[5] = getFaceNormalInBounds(terrain, faceNormals, x, z, 0); // bottom right adj
-
-            Vector3 normal = {0.0f, 0.0f, 0.0f};
-            int faces = 0; // how many successful faces around
-            for (int i = 0; i < 6; i++) {
-                if (normals[i] != NULL) {
-                    normal.x += normals[i]->x;
-                    normal.y += normals[i]->y;
-                    normal.z += normals[i]->z;
-                    faces++;
-                }
+}
+
+void populateTerrainWithGradients(Terrain* terrain, heightGradientFunction function, void* context) {
+    GradientJob job = {terrain, function, context};
+    parallel_for(terrain->xSize, populateGradientRows, &job);
+    markTerrainDirty(terrain, (TerrainRect){0, 0, terrain->xSize, terrain->zSize});
+}
+
+// The normals of the two triangles of every quad along the strip between two rows of
+// the terrain, in separate arrays of x, y and z so they are worked out many at a time.
+// The first triangle of the quad with corner (x, z) is between (x, z), (x + 1, z) and
+// (x, z + 1), the second between (x + 1, z), (x + 1, z + 1) and (x, z + 1).
+typedef struct {
+    Vector3Arrays triangles[2];
+} FaceStrip;
+
+// Works out the normals of the strip between rows x and x + 1 for the quads z0 - 1 to
+// z0 + count - 2, at indices 0 to count - 1. Quads outside the terrain are left as zero
+// vectors, which add nothing to the normals of the vertices around them.
+static void faceStrip(Terrain* terrain, int x, int z0, int count, FaceStrip* strip, Vector3Arrays edges[2]) {
+    for (int t = 0; t < 2; t++) {
+        memset(strip->triangles[t].x, 0, sizeof(GLfloat) * count);
+        memset(strip->triangles[t].y, 0, sizeof(GLfloat) * count);
+        memset(strip->triangles[t].z, 0, sizeof(GLfloat) * count);
+    }
+    if (x < 0 || x >= terrain->xSize - 1) return;
+    int begin = (z0 == 0) ? 1 : 0;
+    int end = (terrain->zSize - z0 < count) ? terrain->zSize - z0 : count;
+    if (begin >= end) return;
+
+    const GLfloat* row0 = terrain->heights[x];
+    const GLfloat* row1 = terrain->heights[x + 1];
+    for (int t = 0; t < 2; t++) {
+        for (int i = begin; i < end; i++) {
+            int z = z0 - 1 + i;
+            if (t == 0) {
+                edges[0].x[i] = 1.0f;
+                edges[0].y[i] = row1[z] - row0[z];
+                edges[0].z[i] = 0.0f;
+                edges[1].x[i] = 0.0f;
+                edges[1].y[i] = row0[z + 1] - row0[z];
+                edges[1].z[i] = 1.0f;
+            } else {
+                edges[0].x[i] = 0.0f;
+                edges[0].y[i] = row1[z + 1] - row1[z];
+                edges[0].z[i] = 1.0f;
+                edges[1].x[i] = -1.0f;
+                edges[1].y[i] = row0[z + 1] - row1[z];
+                edges[1].z[i] = 1.0f;
             }
-            terrain->normals[x][z] = normalise_3(normal);
         }
+        Vector3Arrays faces = vector3_arrays_at(strip->triangles[t], begin);
+        cross_up_3_n(vector3_arrays_at(edges[0], begin), vector3_arrays_at(edges[1], begin), faces, end - begin);
+        normalise_3_soa_n(faces, end - begin);
+    }
+}
+
+// Points the arrays at the next count floats of the block, returning the end of them
+static GLfloat* takeArrays(GLfloat* block, int count, Vector3Arrays* arrays) {
+    *arrays = (Vector3Arrays){block, block + count, block + 2 * count};
+    return block + 3 * count;
+}
+
+// The rows of a rectangle whose normals are being recalculated
+typedef struct {
+    Terrain* terrain;
+    TerrainRect rect;
+} NormalsJob;
+
+// The normal of every vertex is the average of the normals of the up to 6 triangles
+// around it, 3 in the strip before its row and 3 in the strip after. Each strip is
+// worked out once and used for the rows on both sides of it.
+static void calculateNormalRows(void* context, int begin, int end) {
+    NormalsJob* job = context;
+    Terrain* terrain = job->terrain;
+    int z0 = job->rect.z0, width = job->rect.z1 - job->rect.z0, count = width + 1;
+    GLfloat* block = malloc(sizeof(GLfloat) * 18 * count);
+    assert(block != NULL);
+    FaceStrip strips[2];
+    Vector3Arrays edges[2];
+    GLfloat* next = block;
+    for (int i = 0; i < 2; i++) {
+        next = takeArrays(next, count, &strips[i].triangles[0]);
+        next = takeArrays(next, count, &strips[i].triangles[1]);
+        next = takeArrays(next, count, &edges[i]);
+    }
+
+    FaceStrip* before = &strips[0];
+    FaceStrip* after = &strips[1];
+    faceStrip(terrain, job->rect.x0 + begin - 1, z0, count, before, edges);
+    for (int x = job->rect.x0 + begin; x < job->rect.x0 + end; x++) {
+        faceStrip(terrain, x, z0, count, after, edges);
+        const Vector3Arrays* b = before->triangles;
+        const Vector3Arrays* a = after->triangles;
+        Vector3* normals = &terrain->normals[x][z0];
+        for (int i = 0; i < width; i++) {
+            normals[i] = (Vector3){
+                b[1].x[i] + a[0].x[i] + a[1].x[i] + b[0].x[i + 1] + b[1].x[i + 1] + a[0].x[i + 1],
+                b[1].y[i] + a[0].y[i] + a[1].y[i] + b[0].y[i + 1] + b[1].y[i + 1] + a[0].y[i + 1],
+                b[1].z[i] + a[0].z[i] + a[1].z[i] + b[0].z[i + 1] + b[1].z[i + 1] + a[0].z[i + 1]
+            };
+        }
+        normalise_3_n(normals, width);
+        FaceStrip* swap = before;
+        before = after;
+        after = swap;
+    }
+    free(block);
+}
+
+// Recalculates the normals inside rect (which must be within the terrain) and marks it dirty
+static void calculateNormalsIn(Terrain* terrain, TerrainRect rect) {
+    if (rect.x0 >= rect.x1 || rect.z0 >= rect.z1) return;
+    NormalsJob job = {.terrain = terrain, .rect = rect};
+    parallel_for(rect.x1 - rect.x0, calculateNormalRows, &job);
+    markTerrainDirty(terrain, rect);
+}
+
+// Calculates the normal of every vertex
+void calculateNormals(Terrain* terrain) {
+    calculateNormalsIn(terrain, (TerrainRect){0, 0, terrain->xSize, terrain->zSize});
+}
+
+// A changed height affects the faces around it, which in turn affect the normals of
+// every vertex of those faces, so the normals one point beyond the rectangle change too
+void updateTerrainRegion(Terrain* terrain, TerrainRect rect) {
+    TerrainRect grown = {
+        .x0 = (rect.x0 - 1 < 0) ? 0 : rect.x0 - 1,
+        .z0 = (rect.z0 - 1 < 0) ? 0 : rect.z0 - 1,
+        .x1 = (rect.x1 + 1 > terrain->xSize) ? terrain->xSize : rect.x1 + 1,
+        .z1 = (rect.z1 + 1 > terrain->zSize) ? terrain->zSize : rect.z1 + 1
+    };
+    calculateNormalsIn(terrain, grown);
+}
+
+// Uses a smoothstep falloff so the edge of the stamp blends into the terrain
+void stampTerrain(Terrain* terrain, GLfloat x, GLfloat z, GLfloat radius, GLfloat amount) {
+    if (radius <= 0) return;
+    TerrainRect rect = {
+        .x0 = (int) ceilf(x - radius),
+        .z0 = (int) ceilf(z - radius),
+        .x1 = (int) floorf(x + radius) + 1,
+        .z1 = (int) floorf(z + radius) + 1
+    };
+    if (rect.x0 < 0) rect.x0 = 0;
+    if (rect.z0 < 0) rect.z0 = 0;
+    if (rect.x1 > terrain->xSize) rect.x1 = terrain->xSize;
+    if (rect.z1 > terrain->zSize) rect.z1 = terrain->zSize;
+    if (rect.x0 >= rect.x1 || rect.z0 >= rect.z1) return;
+
+    for (int px = rect.x0; px < rect.x1; px++) {
+        for (int pz = rect.z0; pz < rect.z1; pz++) {
+            GLfloat distance = sqrtf((px - x) * (px - x) + (pz - z) * (pz - z)) / radius;
+            if (distance >= 1) continue;
+            GLfloat weight = 1 - (3 - 2 * distance) * distance * distance;
+            terrain->heights[px][pz] += amount * weight;
+        }
+    }
+    updateTerrainRegion(terrain, rect);
+}
+
+// The dirty rectangle only grows until the renderer takes it
+void markTerrainShaded(Terrain* terrain, TerrainRect rect) {
+    if (rect.x0 >= rect.x1 || rect.z0 >= rect.z1) return;
+    terrain->version++;
+    TerrainRect* dirty = &terrain->dirty;
+    if (dirty->x0 >= dirty->x1 || dirty->z0 >= dirty->z1) {
+        *dirty = rect;
+        return;
+    }
+    if (rect.x0 < dirty->x0) dirty->x0 = rect.x0;
+    if (rect.z0 < dirty->z0) dirty->z0 = rect.z0;
+    if (rect.x1 > dirty->x1) dirty->x1 = rect.x1;
+    if (rect.z1 > dirty->z1) dirty->z1 = rect.z1;
+}
+
+void markTerrainDirty(Terrain* terrain, TerrainRect rect) {
+    if (rect.x0 >= rect.x1 || rect.z0 >= rect.z1) return;
+    updatePyramid(terrain, rect);
+    terrain->heightsVersion++;
+    markTerrainShaded(terrain, rect);
+}
+
+TerrainRect takeTerrainDirty(Terrain* terrain) {
+    TerrainRect dirty = terrain->dirty;
+    terrain->dirty = (TerrainRect){0, 0, 0, 0};
+    return dirty;
+}
+
+void addTerrainBiomes(Terrain* terrain) {
+    if (terrain->biomes != NULL) return;
+    terrain->biomes = malloc(sizeof(GLfloat*) * terrain->xSize);
+    GLfloat* block = calloc((size_t) terrain->xSize * terrain->zSize, sizeof(GLfloat));
+    assert(terrain->biomes != NULL && block != NULL);
+    for (int x = 0; x < terrain->xSize; x++) {
+        terrain->biomes[x] = block + (size_t) x * terrain->zSize;
     }
-    free2D((void****)&faceNormals, terrain->xSize - 1, terrain->zSize - 1);
 }
 
 // Frees the heights, then the normals, and finally the terrain itself
@@ -130,6 +383,14 @@ void freeTerrain(Terrain* terrain) {
     }
     free(terrain->normals);
 
+    for (int level = 0; level < terrain->pyramid.levels; level++) {
+        free(terrain->pyramid.min[level]);
+        free(terrain->pyramid.max[level]);
+    }
+    free(terrain->shading);
+    if (terrain->biomes != NULL) {
+        free(terrain->biomes[0]);
+        free(terrain->biomes);
+    }
     free(terrain);
 }
-
@@ -5,6 +5,25 @@
 #include <stdbool.h>
 #include "structures.h"
 
+// A rectangle of grid points, from (x0, z0) inclusive to (x1, z1) exclusive.
+// The rectangle is empty if x0 >= x1 or z0 >= z1.
+typedef struct {
+    int x0, z0, x1, z1;
+} TerrainRect;
+
+// Enough levels for a pyramid over any terrain whose size fits in an int
+#define PYRAMID_MAX_LEVELS 32
+
+// The lowest and highest heights over squares of cells, where a cell is the quad between
+// 4 neighbouring points. Level 0 has an entry per cell and every level above covers 2 by 2
+// entries of the one below, up to a single entry over the whole terrain.
+typedef struct {
+    int levels;
+    int xCells[PYRAMID_MAX_LEVELS], zCells[PYRAMID_MAX_LEVELS];
+    GLfloat* min[PYRAMID_MAX_LEVELS]; // Entries of each level by x then z
+    GLfloat* max[PYRAMID_MAX_LEVELS];
+} HeightPyramid;
+
 // A terrain stores the heights of all the points in the grid, along with their normal
 // vectors to indicate which direction every face faces (for lighting)
 typedef struct {
@@ -12,6 +31,24 @@ typedef struct {
     GLfloat** heights; // 2D Array of GLfloat
     Vector3** normals; // 2D Array of Vector3
 
+    // Points whose height or normal changed since the renderer last took the rectangle
+    TerrainRect dirty;
+
+    // Kept up to date with the heights whenever part of the terrain is marked dirty
+    HeightPyramid pyramid;
+    // Counts the rectangles marked dirty, so a copy of the terrain can tell it is stale
+    unsigned long version;
+    // Counts only the changes to the heights, not to the shading
+    unsigned long heightsVersion;
+
+    // Baked light reaching each point by x then z, from 0 for none to 255 for all of it,
+    // which the meshes multiply into the colours. NULL until a bake is applied.
+    GLubyte* shading;
+
+    // Biome mask, points above 0 are inside a biome. The rows are one block, and the
+    // generator fills it along with the heights. NULL until added with addTerrainBiomes.
+    GLfloat** biomes;
+
     bool spinning;
     bool morphing;
 } Terrain;
@@ -22,10 +59,42 @@ typedef struct {
 
 // Creates a terrain with empty heights and normals
 extern Terrain* createTerrain(int xSize, int zSize, int height);
-// Calculates the heights and normals
-extern void populateTerrain(Terrain*, heightFunction);
+// Calculates the heights and normals, passing context to every call of the height function.
+// Rows are filled on all threads, so the function must be safe to call concurrently.
+extern void populateTerrain(Terrain*, heightFunction, void* context);
+
+// Calculates the heights and their exact normals in one pass, from a height function
+// which also gives its gradient. Rows are filled on all threads, so the function must
+// be safe to call concurrently.
+extern void populateTerrainWithGradients(Terrain*, heightGradientFunction, void* context);
+
+// Recalculates every normal from the current heights
+extern void calculateNormals(Terrain*);
+
+// Call after changing the heights inside the rectangle. Recalculates the normals of
+// the rectangle and the one point border around it, and marks them as dirty.
+extern void updateTerrainRegion(Terrain*, TerrainRect);
+
+// Raises the terrain by up to amount (lowers if negative) within radius of (x, z),
+// falling off smoothly towards the edge, then updates the normals around it.
+extern void stampTerrain(Terrain*, GLfloat x, GLfloat z, GLfloat radius, GLfloat amount);
+
+// Grows the dirty rectangle so it also covers the given rectangle, updates the height
+// pyramid over it and increments the version. Call after changing any heights.
+extern void markTerrainDirty(Terrain*, TerrainRect);
+
+// Grows the dirty rectangle and increments the version like markTerrainDirty, for
+// changes to the shading alone, leaving the pyramid and heights version as they are.
+extern void markTerrainShaded(Terrain*, TerrainRect);
+
+// Returns the dirty rectangle and resets it to empty
+extern TerrainRect takeTerrainDirty(Terrain*);
+
+// Gives the terrain a biome mask with no biomes, if it has none yet
+extern void addTerrainBiomes(Terrain*);
 
-// Frees the memory associated with the terrain, its heights and normals
+// Frees the memory associated with the terrain, its heights, normals, pyramid, shading
+// and biomes
 extern void freeTerrain(Terrain*);
 
 #endif
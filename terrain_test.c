@@ -0,0 +1,175 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "terrain.h"
+#include "erosion.h"
+#include "parallel.h"
+#include "structures.h"
+#include "testing.h"
+
+#define SIZE 150
+#define HEIGHT 30
+#define EPSILON 0.01
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+static bool eps_equals(GLfloat expected, GLfloat actual) {
+    return expected <= actual + EPSILON && expected >= actual - EPSILON;
+}
+
+// Creates and populates a terrain with the shared test hills, which have a few sharp
+// ridges so both kinds of erosion have work to do
+static Terrain* create_hills(void) {
+    Terrain* terrain = createTerrain(SIZE, SIZE, HEIGHT);
+    populateTerrain(terrain, test_hills, NULL);
+    return terrain;
+}
+
+// Returns whether every height of the two terrains is identical
+static bool same_heights(Terrain* t1, Terrain* t2) {
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) {
+            if (t1->heights[x][z] != t2->heights[x][z]) return false;
+        }
+    }
+    return true;
+}
+
+// Returns the sum of every height in the terrain
+static double total_height(Terrain* terrain) {
+    double total = 0;
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) {
+            total += terrain->heights[x][z];
+        }
+    }
+    return total;
+}
+
+// Returns the largest height difference between neighbouring cells
+static GLfloat steepest_step(Terrain* terrain) {
+    GLfloat steepest = 0;
+    for (int x = 0; x < SIZE - 1; x++) {
+        for (int z = 0; z < SIZE - 1; z++) {
+            steepest = fmaxf(steepest, fabsf(terrain->heights[x][z] - terrain->heights[x + 1][z]));
+            steepest = fmaxf(steepest, fabsf(terrain->heights[x][z] - terrain->heights[x][z + 1]));
+        }
+    }
+    return steepest;
+}
+
+int main(void) {
+    // Testing normals
+    printf("Testing Normals: \n");
+    Terrain* terrain = create_hills();
+    bool unit = true;
+    bool upwards = true;
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) {
+            Vector3 n = terrain->normals[x][z];
+            GLfloat mag = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+            unit = unit && mag >= 1 - EPSILON && mag <= 1 + EPSILON;
+            upwards = upwards && n.y > 0;
+        }
+    }
+    assert_test(unit, "Normals have magnitude 1.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(upwards, "Normals point upwards.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Testing incremental normals
+    Terrain* edited = create_hills();
+    takeTerrainDirty(edited);
+    TerrainRect rect = {40, 50, 60, 75};
+    for (int x = rect.x0; x < rect.x1; x++) {
+        for (int z = rect.z0; z < rect.z1; z++) {
+            edited->heights[x][z] += 5.0f * sinf(x * 0.5f) * cosf(z * 0.4f);
+        }
+    }
+    updateTerrainRegion(edited, rect);
+    TerrainRect dirty = takeTerrainDirty(edited);
+    assert_test(dirty.x0 == rect.x0 - 1 && dirty.z0 == rect.z0 - 1 && dirty.x1 == rect.x1 + 1
+            && dirty.z1 == rect.z1 + 1, "Edited region plus border marked dirty.", TEST_OK_OUT, TEST_FAIL_OUT);
+    dirty = takeTerrainDirty(edited);
+    assert_test(dirty.x0 >= dirty.x1, "Dirty region cleared once taken.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    Terrain* recalculated = create_hills();
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) {
+            recalculated->heights[x][z] = edited->heights[x][z];
+        }
+    }
+    calculateNormals(recalculated);
+    bool matching = true;
+    for (int x = 0; x < SIZE; x++) {
+        for (int z = 0; z < SIZE; z++) {
+            Vector3 n1 = edited->normals[x][z];
+            Vector3 n2 = recalculated->normals[x][z];
+            matching = matching && n1.x == n2.x && n1.y == n2.y && n1.z == n2.z;
+        }
+    }
+    assert_test(matching, "Region normals match full recalculation.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    stampTerrain(edited, 0.0f, 0.0f, 8.0f, 3.0f);
+    dirty = takeTerrainDirty(edited);
+    assert_test(dirty.x0 == 0 && dirty.z0 == 0 && dirty.x1 == 10 && dirty.z1 == 10,
+                "Stamp at the corner clipped to terrain.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(eps_equals(edited->heights[0][0], recalculated->heights[0][0] + 3.0f),
+                "Stamp raises its centre fully.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Shading changes are drawn again, but are not changes to the heights
+    unsigned long version = edited->version, heightsVersion = edited->heightsVersion;
+    markTerrainShaded(edited, (TerrainRect){5, 6, 7, 8});
+    dirty = takeTerrainDirty(edited);
+    assert_test(edited->version == version + 1 && edited->heightsVersion == heightsVersion
+                && dirty.x0 == 5 && dirty.z1 == 8, "Shading marked dirty apart from the heights.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+    stampTerrain(edited, 20.0f, 20.0f, 4.0f, 1.0f);
+    assert_test(edited->heightsVersion == heightsVersion + 1, "Height changes counted.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Testing hydraulic erosion
+    printf("\nTesting Erosion: \n");
+    ErosionSettings settings = defaultErosionSettings(42);
+    settings.droplets = 20000;
+
+    parallel_set_threads(1);
+    Terrain* serial = create_hills();
+    hydraulicErosion(serial, &settings);
+    assert_test(!same_heights(serial, terrain), "Hydraulic erosion changes heights.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    parallel_set_threads(4);
+    Terrain* threaded = create_hills();
+    hydraulicErosion(threaded, &settings);
+    assert_test(same_heights(serial, threaded), "Hydraulic erosion independent of threads.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    settings.seed = 43;
+    Terrain* reseeded = create_hills();
+    hydraulicErosion(reseeded, &settings);
+    assert_test(!same_heights(serial, reseeded), "Hydraulic erosion depends on seed.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Testing thermal erosion
+    settings.droplets = 0;
+    settings.thermalIterations = 50;
+    Terrain* thermal = create_hills();
+    thermalErosion(thermal, &settings);
+    double before = total_height(terrain);
+    double after = total_height(thermal);
+    assert_test(fabs(before - after) < EPSILON * SIZE * SIZE, "Thermal erosion conserves material.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(steepest_step(thermal) < steepest_step(terrain), "Thermal erosion reduces slopes.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    parallel_set_threads(1);
+    Terrain* thermalSerial = create_hills();
+    thermalErosion(thermalSerial, &settings);
+    assert_test(same_heights(thermal, thermalSerial), "Thermal erosion independent of threads.", TEST_OK_OUT, TEST_FAIL_OUT);
+    parallel_set_threads(0);
+
+    freeTerrain(terrain);
+    freeTerrain(edited);
+    freeTerrain(recalculated);
+    freeTerrain(serial);
+    freeTerrain(threaded);
+    freeTerrain(reseeded);
+    freeTerrain(thermal);
+    freeTerrain(thermalSerial);
+    return EXIT_SUCCESS;
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdbool.h>
+#include <math.h>
 #include "testing.h"
 
 // Checks the test condition and outputs an appropriate message to the appropriate
@@ -16,3 +17,7 @@ void assert_test(bool test, char* testName, FILE* outOK, FILE* outFAIL) {
     }
 }
 
+
+GLfloat test_hills(void* context, GLfloat x, GLfloat z) {
+    return sinf(x * 0.07f) * cosf(z * 0.05f) + 0.3f * sinf(x * 0.31f + z * 0.23f);
+}
@@ -3,9 +3,14 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <GL/gl.h>
 
 // Takes in a boolean expression, a test name (should be less than 50 characters) and
 // output streams to write the test results to.
 extern void assert_test(bool, char*, FILE*, FILE*);
 
+// Smooth rolling hills between about -1.3 and 1.3, shared by the tests which need an
+// uneven terrain. Takes a context so it can be passed to populateTerrain.
+extern GLfloat test_hills(void* context, GLfloat x, GLfloat z);
+
 #endif
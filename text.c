@@ -0,0 +1,134 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "text.h"
+#include "stb_easy_font.h"
+
+// Size in bytes of one vertex written by stb_easy_font (x, y, z floats + RGBA)
+#define TEXT_VERTEX_SIZE 16
+// stb_easy_font uses around 270 bytes per character, this leaves plenty of headroom
+#define TEXT_BYTES_PER_CHAR 512
+
+// Creates a text layer with all its labels hidden
+TextLayer* createTextLayer(int numLabels) {
+    TextLayer* layer = malloc(sizeof(TextLayer));
+    if (layer == NULL) {
+        fprintf(stderr, "Allocation of text layer failed.\n");
+        return NULL;
+    }
+    layer->labels = calloc(numLabels, sizeof(TextLabel));
+    if (layer->labels == NULL) {
+        fprintf(stderr, "Allocation of text labels failed.\n");
+        free(layer);
+        return NULL;
+    }
+    layer->numLabels = numLabels;
+    layer->dirty = false;
+    layer->batchQuads = 0;
+    layer->batchCapacity = 0;
+    layer->batch = NULL;
+    return layer;
+}
+
+// Converts a colour with components between 0 and 1 into the RGBA bytes stb_easy_font uses
+static void colour_to_bytes(Vector3 colour, unsigned char out[4]) {
+    out[0] = (unsigned char) (colour.x * 255.0f + 0.5f);
+    out[1] = (unsigned char) (colour.y * 255.0f + 0.5f);
+    out[2] = (unsigned char) (colour.z * 255.0f + 0.5f);
+    out[3] = 255;
+}
+
+// Only rebuilds the quads of the label if its contents actually differ
+void setTextLabel(TextLayer* layer, int id, float x, float y, const char* text, Vector3 colour) {
+    if (id < 0 || id >= layer->numLabels) return;
+    TextLabel* label = &layer->labels[id];
+
+    unsigned char bytes[4];
+    colour_to_bytes(colour, bytes);
+    if (label->used && label->x == x && label->y == y
+            && memcmp(label->colour, bytes, sizeof(bytes)) == 0
+            && strncmp(label->text, text, TEXT_LABEL_LENGTH) == 0) {
+        return;
+    }
+
+    label->used = true;
+    label->x = x;
+    label->y = y;
+    memcpy(label->colour, bytes, sizeof(bytes));
+    strncpy(label->text, text, TEXT_LABEL_LENGTH - 1);
+    label->text[TEXT_LABEL_LENGTH - 1] = '\0';
+
+    // Generate the quads into a buffer sized for the text, then keep only what was used
+    int size = (strlen(label->text) + 1) * TEXT_BYTES_PER_CHAR;
+    char* vertices = realloc(label->vertices, size);
+    if (vertices == NULL) {
+        fprintf(stderr, "Allocation of text geometry failed.\n");
+        label->used = false;
+        return;
+    }
+    label->vertices = vertices;
+    label->numQuads = stb_easy_font_print(x, y, label->text, label->colour, label->vertices, size);
+    layer->dirty = true;
+}
+
+// Hides a label without freeing its buffer, so it can be reused cheaply
+void clearTextLabel(TextLayer* layer, int id) {
+    if (id < 0 || id >= layer->numLabels || !layer->labels[id].used) return;
+    layer->labels[id].used = false;
+    layer->dirty = true;
+}
+
+// Concatenates the quads of every visible label into the batch buffer
+static void rebuild_batch(TextLayer* layer) {
+    int totalQuads = 0;
+    for (int i = 0; i < layer->numLabels; i++) {
+        if (layer->labels[i].used) totalQuads += layer->labels[i].numQuads;
+    }
+
+    if (totalQuads > layer->batchCapacity) {
+        char* batch = realloc(layer->batch, totalQuads * 4 * TEXT_VERTEX_SIZE);
+        if (batch == NULL) {
+            fprintf(stderr, "Allocation of text batch failed.\n");
+            return;
+        }
+        layer->batch = batch;
+        layer->batchCapacity = totalQuads;
+    }
+
+    int offset = 0;
+    for (int i = 0; i < layer->numLabels; i++) {
+        TextLabel* label = &layer->labels[i];
+        if (!label->used) continue;
+        int bytes = label->numQuads * 4 * TEXT_VERTEX_SIZE;
+        memcpy(layer->batch + offset, label->vertices, bytes);
+        offset += bytes;
+    }
+    layer->batchQuads = totalQuads;
+    layer->dirty = false;
+}
+
+// Draws all the labels at once, using the colour stored in each vertex
+void drawTextLayer(TextLayer* layer) {
+    if (layer->dirty) {
+        rebuild_batch(layer);
+    }
+    if (layer->batchQuads == 0) return;
+
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_COLOR_ARRAY);
+    glVertexPointer(2, GL_FLOAT, TEXT_VERTEX_SIZE, layer->batch);
+    glColorPointer(4, GL_UNSIGNED_BYTE, TEXT_VERTEX_SIZE, layer->batch + 12);
+    glDrawArrays(GL_QUADS, 0, layer->batchQuads * 4);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+// Frees the geometry of every label, then the batch and the layer itself
+void freeTextLayer(TextLayer* layer) {
+    for (int i = 0; i < layer->numLabels; i++) {
+        free(layer->labels[i].vertices);
+    }
+    free(layer->labels);
+    free(layer->batch);
+    free(layer);
+}
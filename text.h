@@ -0,0 +1,49 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <stdbool.h>
+#include "structures.h"
+
+// Longest string (including the terminator) a single label can hold.
+#define TEXT_LABEL_LENGTH 128
+
+// A single line of on-screen text, with its stb_easy_font quads cached so they
+// only need to be rebuilt when the text, position or colour changes.
+typedef struct {
+    float x, y;
+    char text[TEXT_LABEL_LENGTH];
+    unsigned char colour[4];
+    bool used;
+
+    int numQuads;
+    char* vertices; // stb_easy_font vertex data, 4 vertices per quad
+} TextLabel;
+
+// A fixed number of labels which are all drawn with a single batched call.
+typedef struct {
+    int numLabels;
+    TextLabel* labels;
+
+    bool dirty; // Set when any label has changed since the batch was built
+    int batchQuads, batchCapacity;
+    char* batch;
+} TextLayer;
+
+// Creates a text layer with room for numLabels labels, all initially hidden.
+extern TextLayer* createTextLayer(int numLabels);
+
+// Sets the label at index id. Geometry is only regenerated if anything differs
+// from what the label already holds.
+extern void setTextLabel(TextLayer*, int id, float x, float y, const char* text, Vector3 colour);
+
+// Hides the label at index id.
+extern void clearTextLabel(TextLayer*, int id);
+
+// Draws every visible label in one glDrawArrays call.
+// Expects an orthographic projection with y increasing downwards.
+extern void drawTextLayer(TextLayer*);
+
+// Frees the layer, its labels and their cached geometry.
+extern void freeTextLayer(TextLayer*);
+
+#endif
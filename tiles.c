@@ -0,0 +1,397 @@
+// For readahead, and the page faults of a single thread
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "tiles.h"
+#include "parallel.h"
+
+#define TILE_MAGIC "TWLD"
+#define TILE_VERSION 1
+// The header is padded to a page so the first tile starts on one
+#define HEADER_BYTES 4096
+// Tiles ahead of the camera, in its direction of travel, that are read before it gets there
+#define LOOKAHEAD_TILES 3
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    int32_t tileSize, tilesX, tilesZ, height;
+} TileHeader;
+
+typedef struct {
+    void* mapping;           // NULL while the tile is not mapped
+    size_t mappedBytes;      // From the page the tile starts in
+    const GLfloat* heights;  // Inside the mapping, by x then z
+    int pins;                // Readers that need it to stay mapped
+} Tile;
+
+struct TileStore {
+    int fd;
+    int tileSize, tilesX, tilesZ, height;
+    size_t tileBytes;
+    long pageSize;
+    int budget;              // Most tiles mapped at once
+    Tile* tiles;             // By z then x
+    TileStats stats;
+
+    // Guards everything above that changes, and the focus
+    pthread_mutex_t lock;
+    pthread_cond_t wake, idle;
+    pthread_t thread;
+    bool threaded, stopping;
+
+    bool focused;
+    GLfloat focusX, focusZ, radius;
+    GLfloat directionX, directionZ; // Unit vector, zero until the camera moves
+    unsigned long focusVersion, prefetchedVersion;
+};
+
+typedef struct {
+    heightFunction function;
+    void* context;
+    int x0, z0, tileSize, height;
+    GLfloat* heights;
+} TileJob;
+
+static void fillTileRows(void* context, int begin, int end) {
+    TileJob* job = context;
+    for (int x = begin; x < end; x++) {
+        GLfloat* row = job->heights + (long) x * job->tileSize;
+        for (int z = 0; z < job->tileSize; z++) {
+            row[z] = job->function(job->context, job->x0 + x, job->z0 + z) * job->height;
+        }
+    }
+}
+
+bool writeTileWorld(const char* path, int tilesX, int tilesZ, int tileSize, int height,
+                    heightFunction function, void* context) {
+    assert(tilesX > 0 && tilesZ > 0 && tileSize > 0);
+    FILE* file = fopen(path, "wb");
+    if (file == NULL) return false;
+
+    unsigned char page[HEADER_BYTES] = {0};
+    TileHeader header = {.version = TILE_VERSION, .tileSize = tileSize, .tilesX = tilesX,
+                         .tilesZ = tilesZ, .height = height};
+    memcpy(header.magic, TILE_MAGIC, sizeof(header.magic));
+    memcpy(page, &header, sizeof(header));
+    bool written = fwrite(page, sizeof(page), 1, file) == 1;
+
+    size_t count = (size_t) tileSize * tileSize;
+    GLfloat* heights = malloc(sizeof(GLfloat) * count);
+    assert(heights != NULL);
+    for (int tz = 0; tz < tilesZ && written; tz++) {
+        for (int tx = 0; tx < tilesX && written; tx++) {
+            TileJob job = {function, context, tx * tileSize, tz * tileSize, tileSize, height, heights};
+            parallel_for(tileSize, fillTileRows, &job);
+            written = fwrite(heights, sizeof(GLfloat), count, file) == count;
+        }
+    }
+    free(heights);
+    return fclose(file) == 0 && written;
+}
+
+static off_t tileOffset(const TileStore* store, int index) {
+    return HEADER_BYTES + (off_t) index * store->tileBytes;
+}
+
+// Distance from the middle of the tile to the middle of the area the camera reads and
+// reads ahead, so the tiles furthest behind it are the furthest of all
+static GLfloat tileDistance(const TileStore* store, int index) {
+    GLfloat ahead = LOOKAHEAD_TILES * store->tileSize / 2.0f;
+    GLfloat x = (index % store->tilesX + 0.5f) * store->tileSize;
+    GLfloat z = (index / store->tilesX + 0.5f) * store->tileSize;
+    GLfloat dx = x - (store->focusX + store->directionX * ahead);
+    GLfloat dz = z - (store->focusZ + store->directionZ * ahead);
+    return sqrtf(dx * dx + dz * dz);
+}
+
+// Maps the tile, with the lock held. Returns false if it could not be mapped.
+static bool mapTile(TileStore* store, int index) {
+    Tile* tile = &store->tiles[index];
+    off_t offset = tileOffset(store, index);
+    off_t aligned = offset - offset % store->pageSize;
+    size_t bytes = store->tileBytes + (size_t) (offset - aligned);
+    void* mapping = mmap(NULL, bytes, PROT_READ, MAP_SHARED, store->fd, aligned);
+    if (mapping == MAP_FAILED) return false;
+    tile->mapping = mapping;
+    tile->mappedBytes = bytes;
+    tile->heights = (const GLfloat*) ((const char*) mapping + (offset - aligned));
+    store->stats.resident++;
+    return true;
+}
+
+static void unmapTile(TileStore* store, int index) {
+    Tile* tile = &store->tiles[index];
+    munmap(tile->mapping, tile->mappedBytes);
+    tile->mapping = NULL;
+    tile->heights = NULL;
+    store->stats.resident--;
+}
+
+// Unmaps the furthest tiles no one is reading until there is room for another within
+// the budget, with the lock held. Tiles no further than limit are kept, returns whether
+// there is room.
+static bool makeRoom(TileStore* store, GLfloat limit) {
+    while (store->stats.resident >= store->budget) {
+        int furthest = -1;
+        GLfloat distance = limit;
+        for (int i = 0; i < store->tilesX * store->tilesZ; i++) {
+            if (store->tiles[i].mapping == NULL || store->tiles[i].pins > 0) continue;
+            GLfloat d = tileDistance(store, i);
+            if (d > distance) {
+                distance = d;
+                furthest = i;
+            }
+        }
+        if (furthest < 0) return false;
+        unmapTile(store, furthest);
+        store->stats.evicted++;
+    }
+    return true;
+}
+
+// Maps and reads ahead every tile within the radius of the camera, then of each point
+// up to LOOKAHEAD_TILES ahead of it, nearest first. Called with the lock held, which is
+// let go while reading. Returns early once there is a newer focus.
+static void prefetchFocus(TileStore* store, unsigned long version) {
+    int size = store->tileSize;
+    bool moving = store->directionX != 0 || store->directionZ != 0;
+    for (int step = 0; step <= (moving ? LOOKAHEAD_TILES : 0); step++) {
+        GLfloat x = store->focusX + store->directionX * step * size;
+        GLfloat z = store->focusZ + store->directionZ * step * size;
+        int tx0 = (int) fmaxf(floorf((x - store->radius) / size), 0);
+        int tz0 = (int) fmaxf(floorf((z - store->radius) / size), 0);
+        int tx1 = (int) fminf(floorf((x + store->radius) / size), store->tilesX - 1);
+        int tz1 = (int) fminf(floorf((z + store->radius) / size), store->tilesZ - 1);
+        for (int tx = tx0; tx <= tx1; tx++) {
+            for (int tz = tz0; tz <= tz1; tz++) {
+                if (store->stopping || store->focusVersion != version) return;
+                int index = tz * store->tilesX + tx;
+                Tile* tile = &store->tiles[index];
+                if (tile->mapping != NULL) continue;
+                if (!makeRoom(store, tileDistance(store, index)) || !mapTile(store, index)) continue;
+                tile->pins++;
+                store->stats.prefetched++;
+                pthread_mutex_unlock(&store->lock);
+                readahead(store->fd, tileOffset(store, index), store->tileBytes);
+                madvise(tile->mapping, tile->mappedBytes, MADV_WILLNEED);
+                pthread_mutex_lock(&store->lock);
+                tile->pins--;
+            }
+        }
+    }
+}
+
+static void* runPrefetch(void* context) {
+    TileStore* store = context;
+    pthread_mutex_lock(&store->lock);
+    while (!store->stopping) {
+        if (store->prefetchedVersion == store->focusVersion) {
+            pthread_cond_wait(&store->wake, &store->lock);
+            continue;
+        }
+        unsigned long version = store->focusVersion;
+        prefetchFocus(store, version);
+        store->prefetchedVersion = version;
+        pthread_cond_broadcast(&store->idle);
+    }
+    pthread_mutex_unlock(&store->lock);
+    return NULL;
+}
+
+TileStore* openTileStore(const char* path, size_t budget) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open world '%s'.\n", path);
+        return NULL;
+    }
+    TileHeader header;
+    struct stat status;
+    bool valid = pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                 memcmp(header.magic, TILE_MAGIC, sizeof(header.magic)) == 0 &&
+                 header.version == TILE_VERSION &&
+                 header.tileSize > 0 && header.tilesX > 0 && header.tilesZ > 0 &&
+                 fstat(fd, &status) == 0;
+    size_t tileBytes = valid ? sizeof(GLfloat) * header.tileSize * header.tileSize : 0;
+    if (!valid || status.st_size < HEADER_BYTES + (off_t) tileBytes * header.tilesX * header.tilesZ) {
+        fprintf(stderr, "World '%s' is not a tiled world.\n", path);
+        close(fd);
+        return NULL;
+    }
+
+    TileStore* store = calloc(1, sizeof(TileStore));
+    assert(store != NULL);
+    store->fd = fd;
+    store->tileSize = header.tileSize;
+    store->tilesX = header.tilesX;
+    store->tilesZ = header.tilesZ;
+    store->height = header.height;
+    store->tileBytes = tileBytes;
+    store->pageSize = sysconf(_SC_PAGESIZE);
+    store->budget = (budget / tileBytes > 1) ? (int) (budget / tileBytes) : 1;
+    store->tiles = calloc((size_t) header.tilesX * header.tilesZ, sizeof(Tile));
+    assert(store->tiles != NULL);
+    pthread_mutex_init(&store->lock, NULL);
+    pthread_cond_init(&store->wake, NULL);
+    pthread_cond_init(&store->idle, NULL);
+    // Without a thread the tiles are read ahead whenever the focus moves instead
+    store->threaded = pthread_create(&store->thread, NULL, runPrefetch, store) == 0;
+    return store;
+}
+
+void tileWorldSize(const TileStore* store, int* xSize, int* zSize, int* height) {
+    *xSize = store->tilesX * store->tileSize;
+    *zSize = store->tilesZ * store->tileSize;
+    *height = store->height;
+}
+
+void focusTileStore(TileStore* store, GLfloat x, GLfloat z, GLfloat radius) {
+    pthread_mutex_lock(&store->lock);
+    GLfloat dx = x - store->focusX, dz = z - store->focusZ;
+    GLfloat travelled = sqrtf(dx * dx + dz * dz);
+    if (store->focused && travelled > 0) {
+        store->directionX = dx / travelled;
+        store->directionZ = dz / travelled;
+    }
+    store->focused = true;
+    store->focusX = x;
+    store->focusZ = z;
+    store->radius = radius;
+    store->focusVersion++;
+    if (store->threaded) {
+        pthread_cond_signal(&store->wake);
+    } else {
+        prefetchFocus(store, store->focusVersion);
+        store->prefetchedVersion = store->focusVersion;
+    }
+    pthread_mutex_unlock(&store->lock);
+}
+
+void waitTilePrefetch(TileStore* store) {
+    pthread_mutex_lock(&store->lock);
+    while (store->prefetchedVersion != store->focusVersion) {
+        pthread_cond_wait(&store->idle, &store->lock);
+    }
+    pthread_mutex_unlock(&store->lock);
+}
+
+// Returns whether every page of the tile is in memory, so reading it will not wait on
+// the disk
+static bool tileResident(const TileStore* store, const Tile* tile) {
+    size_t pages = (tile->mappedBytes + store->pageSize - 1) / store->pageSize;
+    unsigned char* vector = malloc(pages);
+    assert(vector != NULL);
+    bool resident = mincore(tile->mapping, tile->mappedBytes, vector) == 0;
+    for (size_t i = 0; i < pages && resident; i++) {
+        resident = vector[i] & 1;
+    }
+    free(vector);
+    return resident;
+}
+
+static double secondsBetween(struct timespec start, struct timespec end) {
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+// Copies the part of one tile inside the terrain, counting the faults and time it takes.
+// If the tile can not be mapped its part is left flat at 0 and false is returned.
+static bool readTile(TileStore* store, Terrain* terrain, int originX, int originZ, int tx, int tz) {
+    int size = store->tileSize;
+    int index = tz * store->tilesX + tx;
+    Tile* tile = &store->tiles[index];
+    int x0 = fmax(originX, tx * size), x1 = fmin(originX + terrain->xSize, (tx + 1) * size);
+    int z0 = fmax(originZ, tz * size), z1 = fmin(originZ + terrain->zSize, (tz + 1) * size);
+    pthread_mutex_lock(&store->lock);
+    if (tile->mapping == NULL) {
+        store->stats.misses++;
+        // Past the budget if every mapped tile is being read
+        makeRoom(store, -1.0f);
+        if (!mapTile(store, index)) {
+            pthread_mutex_unlock(&store->lock);
+            fprintf(stderr, "Could not map tile (%d, %d) of the world, leaving it flat.\n", tx, tz);
+            for (int x = x0; x < x1; x++) {
+                memset(terrain->heights[x - originX] + (z0 - originZ), 0, sizeof(GLfloat) * (z1 - z0));
+            }
+            return false;
+        }
+    }
+    tile->pins++;
+    pthread_mutex_unlock(&store->lock);
+
+    bool resident = tileResident(store, tile);
+    struct rusage before, after;
+    struct timespec start, end;
+    getrusage(RUSAGE_THREAD, &before);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int x = x0; x < x1; x++) {
+        memcpy(terrain->heights[x - originX] + (z0 - originZ),
+               tile->heights + (long) (x - tx * size) * size + (z0 - tz * size),
+               sizeof(GLfloat) * (z1 - z0));
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_THREAD, &after);
+
+    pthread_mutex_lock(&store->lock);
+    tile->pins--;
+    double seconds = secondsBetween(start, end);
+    store->stats.readSeconds += seconds;
+    store->stats.minorFaults += after.ru_minflt - before.ru_minflt;
+    store->stats.majorFaults += after.ru_majflt - before.ru_majflt;
+    if (!resident) {
+        store->stats.stalls++;
+        store->stats.stallSeconds += seconds;
+    }
+    pthread_mutex_unlock(&store->lock);
+    return true;
+}
+
+bool readTileRegion(TileStore* store, Terrain* terrain, int originX, int originZ) {
+    int size = store->tileSize;
+    assert(originX >= 0 && originZ >= 0);
+    assert(originX + terrain->xSize <= store->tilesX * size && originZ + terrain->zSize <= store->tilesZ * size);
+    bool read = true;
+    for (int tx = originX / size; tx <= (originX + terrain->xSize - 1) / size; tx++) {
+        for (int tz = originZ / size; tz <= (originZ + terrain->zSize - 1) / size; tz++) {
+            read = readTile(store, terrain, originX, originZ, tx, tz) && read;
+        }
+    }
+    calculateNormals(terrain);
+    return read;
+}
+
+TileStats tileStoreStats(TileStore* store) {
+    pthread_mutex_lock(&store->lock);
+    TileStats stats = store->stats;
+    pthread_mutex_unlock(&store->lock);
+    return stats;
+}
+
+void closeTileStore(TileStore* store) {
+    pthread_mutex_lock(&store->lock);
+    store->stopping = true;
+    pthread_cond_signal(&store->wake);
+    pthread_mutex_unlock(&store->lock);
+    if (store->threaded) {
+        pthread_join(store->thread, NULL);
+    }
+    for (int i = 0; i < store->tilesX * store->tilesZ; i++) {
+        if (store->tiles[i].mapping != NULL) unmapTile(store, i);
+    }
+    close(store->fd);
+    pthread_mutex_destroy(&store->lock);
+    pthread_cond_destroy(&store->wake);
+    pthread_cond_destroy(&store->idle);
+    free(store->tiles);
+    free(store);
+}
@@ -0,0 +1,61 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "structures.h"
+#include "terrain.h"
+
+// A world of heights too large to keep in memory, stored on disk in square tiles which
+// are mapped in only around the camera. A thread reads ahead the tiles the camera is
+// heading towards, and the tiles furthest behind are unmapped to stay within a budget.
+typedef struct TileStore TileStore;
+
+// How well the prefetching keeps up with the viewer
+typedef struct {
+    int resident;          // Tiles mapped now
+    long prefetched;       // Tiles the prefetch thread has mapped and read ahead
+    long evicted;          // Tiles unmapped to stay within the budget
+    long misses;           // Tiles the viewer needed before the prefetch thread mapped them
+    long stalls;           // Tiles the viewer read while some of their pages were on disk
+    long minorFaults;      // Page faults taken by the viewer's thread while reading tiles,
+    long majorFaults;      // the major ones each waited for the disk
+    double readSeconds;    // Spent by the viewer reading tiles into the terrain
+    double stallSeconds;   // Of which reading the tiles that stalled
+} TileStats;
+
+// Writes a world of tilesX by tilesZ tiles, each tileSize points along a side, from the
+// height function scaled by height. One tile is held in memory at a time and its rows are
+// filled on all threads, so the function must be safe to call concurrently. Returns
+// whether the file was written.
+extern bool writeTileWorld(const char* path, int tilesX, int tilesZ, int tileSize, int height,
+                           heightFunction, void* context);
+
+// Opens a world written by writeTileWorld, keeping at most budget bytes of tiles mapped,
+// and starts its prefetch thread. Returns NULL if the file can not be read.
+extern TileStore* openTileStore(const char* path, size_t budget);
+
+// Sets the size of the world in points and the height it was scaled by
+extern void tileWorldSize(const TileStore*, int* xSize, int* zSize, int* height);
+
+// Tells the prefetch thread the camera is at (x, z) in the world and reads within radius
+// of it. The direction of travel is taken from the last position, and the tiles up to a
+// few ahead in that direction are read before they are needed.
+extern void focusTileStore(TileStore*, GLfloat x, GLfloat z, GLfloat radius);
+
+// Waits until the prefetch thread has read ahead for the latest focus
+extern void waitTilePrefetch(TileStore*);
+
+// Fills the terrain's heights from the world points starting at (originX, originZ), which
+// must fit inside the world, then recalculates the normals and marks it all dirty. Tiles
+// not mapped yet are mapped on this thread and counted as misses. Returns false if any
+// tile could not be mapped, leaving its part of the terrain flat.
+extern bool readTileRegion(TileStore*, Terrain*, int originX, int originZ);
+
+// Returns the statistics so far
+extern TileStats tileStoreStats(TileStore*);
+
+// Stops the prefetch thread, then unmaps every tile and closes the file
+extern void closeTileStore(TileStore*);
+
+#endif
@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <GL/gl.h>
+#include "tiles.h"
+#include "terrain.h"
+#include "testing.h"
+
+#define WORLD_PATH "tiles_test.world"
+#define TILE_SIZE 32
+#define TILES_X 8
+#define TILES_Z 4
+#define HEIGHT 30
+#define TILE_BYTES (sizeof(GLfloat) * TILE_SIZE * TILE_SIZE)
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+static GLfloat slope(void* context, GLfloat x, GLfloat z) {
+    return x * 0.004f - z * 0.003f;
+}
+
+// Whether the terrain holds the world's heights from the origin
+static bool matches_world(Terrain* terrain, int originX, int originZ) {
+    for (int x = 0; x < terrain->xSize; x++) {
+        for (int z = 0; z < terrain->zSize; z++) {
+            if (terrain->heights[x][z] != slope(NULL, originX + x, originZ + z) * HEIGHT) return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    printf("Testing Tiles: \n");
+    bool written = writeTileWorld(WORLD_PATH, TILES_X, TILES_Z, TILE_SIZE, HEIGHT, slope, NULL);
+    assert_test(written, "World written.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Room for the tiles of a terrain two tiles across, and what is read ahead of it
+    TileStore* store = openTileStore(WORLD_PATH, 16 * TILE_BYTES);
+    assert_test(store != NULL, "World opened.", TEST_OK_OUT, TEST_FAIL_OUT);
+    int xSize, zSize, height;
+    tileWorldSize(store, &xSize, &zSize, &height);
+    assert_test(xSize == TILES_X * TILE_SIZE && zSize == TILES_Z * TILE_SIZE && height == HEIGHT,
+                "World size read.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Reading across tile edges without any prefetching maps the tiles on demand
+    Terrain* terrain = createTerrain(2 * TILE_SIZE, 2 * TILE_SIZE, HEIGHT);
+    bool read = readTileRegion(store, terrain, 10, 20);
+    TileStats stats = tileStoreStats(store);
+    assert_test(read && matches_world(terrain, 10, 20), "Heights read across tiles.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(stats.misses == 9 && stats.resident == 9, "Unfocused tiles mapped on demand.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(terrain->normals[20][20].y > 0.98f, "Normals calculated.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Flying along x, the tiles ahead are read before the terrain moves onto them
+    focusTileStore(store, 40, 64, TILE_SIZE);
+    focusTileStore(store, 60, 64, TILE_SIZE);
+    waitTilePrefetch(store);
+    stats = tileStoreStats(store);
+    readTileRegion(store, terrain, 120, 32);
+    TileStats after = tileStoreStats(store);
+    assert_test(stats.prefetched > 0 && after.misses == stats.misses,
+                "Tiles ahead prefetched.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(matches_world(terrain, 120, 32), "Heights read from prefetched tiles.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Moving on to the far end keeps within the budget by unmapping the tiles behind
+    for (int x = 80; x <= xSize - TILE_SIZE; x += 8) {
+        focusTileStore(store, x, 64, TILE_SIZE);
+        waitTilePrefetch(store);
+    }
+    readTileRegion(store, terrain, xSize - 2 * TILE_SIZE, 32);
+    stats = tileStoreStats(store);
+    assert_test(stats.evicted > 0 && stats.resident <= 16, "Tiles behind evicted.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(matches_world(terrain, xSize - 2 * TILE_SIZE, 32), "Heights read at the far end.",
+                TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(stats.misses == 9 && stats.stalls == 0, "No stalls once prefetching.", TEST_OK_OUT, TEST_FAIL_OUT);
+    closeTileStore(store);
+    freeTerrain(terrain);
+
+    // Anything but a tiled world is refused
+    FILE* file = fopen(WORLD_PATH, "wb");
+    fputs("not a world", file);
+    fclose(file);
+    assert_test(openTileStore(WORLD_PATH, TILE_BYTES) == NULL, "Invalid world refused.", TEST_OK_OUT, TEST_FAIL_OUT);
+    assert_test(openTileStore("tiles_test.missing", TILE_BYTES) == NULL, "Missing world refused.", TEST_OK_OUT, TEST_FAIL_OUT);
+    remove(WORLD_PATH);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <math.h>
+#include "viewshed.h"
+#include "parallel.h"
+
+// The 8 octants around an observer. A point of an octant is a steps along its major
+// axis and b along its minor axis, with 0 <= b <= a.
+typedef struct {
+    int sx, sz;
+    bool xMajor;
+} Octant;
+
+static const Octant octants[8] = {
+    {1, 1, true}, {1, 1, false}, {-1, 1, true}, {-1, 1, false},
+    {1, -1, true}, {1, -1, false}, {-1, -1, true}, {-1, -1, false}
+};
+
+// Neighbouring octants share the points on the axes and diagonals, which are swept by
+// both but only written by one, so every point belongs to a single octant
+static bool ownsPoint(const Octant* octant, int a, int b) {
+    if (b > 0 && b < a) return true;
+    if (b == a) return octant->xMajor;
+    return octant->xMajor ? octant->sz > 0 : octant->sx > 0;
+}
+
+TerrainRect observerArea(Terrain* terrain, Observer observer) {
+    TerrainRect area = {0, 0, terrain->xSize, terrain->zSize};
+    if (observer.radius > 0) {
+        int reach = (int) ceilf(observer.radius);
+        if (observer.x - reach > area.x0) area.x0 = observer.x - reach;
+        if (observer.z - reach > area.z0) area.z0 = observer.z - reach;
+        if (observer.x + reach + 1 < area.x1) area.x1 = observer.x + reach + 1;
+        if (observer.z + reach + 1 < area.z1) area.z1 = observer.z + reach + 1;
+    }
+    return area;
+}
+
+Viewshed* createViewshed(TerrainRect area) {
+    Viewshed* viewshed = malloc(sizeof(Viewshed));
+    assert(viewshed != NULL);
+    viewshed->area = area;
+    viewshed->stride = (area.z1 - area.z0 + 63) / 64;
+    viewshed->bits = calloc((size_t) (area.x1 - area.x0) * viewshed->stride, sizeof(uint64_t));
+    assert(viewshed->bits != NULL);
+    return viewshed;
+}
+
+bool viewshedVisible(const Viewshed* viewshed, int x, int z) {
+    int row = x - viewshed->area.x0;
+    int column = z - viewshed->area.z0;
+    return (viewshed->bits[row * viewshed->stride + column / 64] >> (column % 64)) & 1;
+}
+
+long viewshedCount(const Viewshed* viewshed) {
+    long count = 0;
+    long words = (long) (viewshed->area.x1 - viewshed->area.x0) * viewshed->stride;
+    for (long i = 0; i < words; i++) {
+        uint64_t word = viewshed->bits[i];
+        while (word) {
+            word &= word - 1;
+            count++;
+        }
+    }
+    return count;
+}
+
+// Where an octant sweep writes the points it sees. Sweeps of one observer running at
+// once write a byte per point, as neighbouring octants share words of the bits.
+typedef struct {
+    Viewshed* viewshed;
+    unsigned char* bytes; // One per point of the area by x then z, or NULL to write the bits
+} ViewshedOutput;
+
+static void markVisible(const ViewshedOutput* output, int x, int z) {
+    TerrainRect area = output->viewshed->area;
+    int row = x - area.x0;
+    int column = z - area.z0;
+    if (output->bytes) {
+        output->bytes[(long) row * (area.z1 - area.z0) + column] = 1;
+    } else {
+        output->viewshed->bits[row * output->viewshed->stride + column / 64] |= (uint64_t) 1 << (column % 64);
+    }
+}
+
+// Sweeps one octant outwards from the observer. Previous and current hold the
+// steepest slopes of the last ring and the one being swept, and need space for a
+// point per step across the area.
+static void sweepOctant(Terrain* terrain, Observer observer, const Octant* octant,
+                        const ViewshedOutput* output, GLfloat* previous, GLfloat* current) {
+    TerrainRect area = output->viewshed->area;
+    int xSteps = (octant->sx > 0) ? area.x1 - 1 - observer.x : observer.x - area.x0;
+    int zSteps = (octant->sz > 0) ? area.z1 - 1 - observer.z : observer.z - area.z0;
+    int majorSteps = octant->xMajor ? xSteps : zSteps;
+    int minorSteps = octant->xMajor ? zSteps : xSteps;
+    if (observer.radius > 0 && majorSteps > (int) observer.radius) majorSteps = (int) observer.radius;
+
+    GLfloat eye = terrain->heights[observer.x][observer.z] + observer.eyeHeight;
+    GLfloat furthest = observer.radius * observer.radius;
+    for (int a = 1; a <= majorSteps; a++) {
+        int bEnd = (a < minorSteps) ? a : minorSteps;
+        for (int b = 0; b <= bEnd; b++) {
+            int x = observer.x + octant->sx * (octant->xMajor ? a : b);
+            int z = observer.z + octant->sz * (octant->xMajor ? b : a);
+            GLfloat squared = (GLfloat) (a * a + b * b);
+            GLfloat inverse = 1.0f / sqrtf(squared);
+
+            // The line of sight crosses the previous ring at b * (a - 1) / a
+            GLfloat horizon = -INFINITY;
+            if (a > 1) {
+                GLfloat crossing = (GLfloat) (b * (a - 1)) / a;
+                int b0 = (int) crossing;
+                GLfloat fraction = crossing - b0;
+                horizon = previous[b0];
+                if (fraction > 0) horizon += fraction * (previous[b0 + 1] - previous[b0]);
+            }
+
+            GLfloat ground = terrain->heights[x][z];
+            GLfloat slope = (ground - eye) * inverse;
+            current[b] = (slope > horizon) ? slope : horizon;
+            bool visible = (ground + observer.targetHeight - eye) * inverse >= horizon;
+            if (visible && (observer.radius <= 0 || squared <= furthest) && ownsPoint(octant, a, b)) {
+                markVisible(output, x, z);
+            }
+        }
+        GLfloat* swap = previous;
+        previous = current;
+        current = swap;
+    }
+}
+
+// Sweeps every octant in the range one after the other
+static void sweepOctants(Terrain* terrain, Observer observer, const ViewshedOutput* output, int begin, int end) {
+    TerrainRect area = output->viewshed->area;
+    int steps = (area.x1 - area.x0 > area.z1 - area.z0) ? area.x1 - area.x0 : area.z1 - area.z0;
+    GLfloat* rings = malloc(sizeof(GLfloat) * 2 * (steps + 1));
+    assert(rings != NULL);
+    for (int i = begin; i < end; i++) {
+        sweepOctant(terrain, observer, &octants[i], output, rings, rings + steps + 1);
+    }
+    free(rings);
+}
+
+typedef struct {
+    Terrain* terrain;
+    Observer observer;
+    ViewshedOutput output;
+} OctantJob;
+
+static void sweepOctantRange(void* context, int begin, int end) {
+    OctantJob* job = context;
+    sweepOctants(job->terrain, job->observer, &job->output, begin, end);
+}
+
+// Packs rows of bytes into the bits, each row's words only written by its own thread
+static void packRows(void* context, int begin, int end) {
+    OctantJob* job = context;
+    Viewshed* viewshed = job->output.viewshed;
+    int width = viewshed->area.z1 - viewshed->area.z0;
+    for (int row = begin; row < end; row++) {
+        const unsigned char* bytes = job->output.bytes + (long) row * width;
+        uint64_t* words = viewshed->bits + row * viewshed->stride;
+        for (int column = 0; column < width; column++) {
+            words[column / 64] |= (uint64_t) bytes[column] << (column % 64);
+        }
+    }
+}
+
+void computeViewshed(Terrain* terrain, Observer observer, Viewshed* viewshed) {
+    TerrainRect area = viewshed->area;
+    long points = (long) (area.x1 - area.x0) * (area.z1 - area.z0);
+    memset(viewshed->bits, 0, sizeof(uint64_t) * (area.x1 - area.x0) * viewshed->stride);
+
+    OctantJob job = {terrain, observer, {viewshed, calloc(points, 1)}};
+    assert(job.output.bytes != NULL);
+    markVisible(&job.output, observer.x, observer.z);
+    parallel_for(8, sweepOctantRange, &job);
+    parallel_for(area.x1 - area.x0, packRows, &job);
+    free(job.output.bytes);
+}
+
+typedef struct {
+    Terrain* terrain;
+    const Observer* observers;
+    Viewshed** viewsheds;
+} ObserverJob;
+
+// Each observer is swept by one thread, so it can write its bits directly
+static void computeObserverRange(void* context, int begin, int end) {
+    ObserverJob* job = context;
+    for (int i = begin; i < end; i++) {
+        Viewshed* viewshed = job->viewsheds[i];
+        TerrainRect area = viewshed->area;
+        memset(viewshed->bits, 0, sizeof(uint64_t) * (area.x1 - area.x0) * viewshed->stride);
+        ViewshedOutput output = {viewshed, NULL};
+        markVisible(&output, job->observers[i].x, job->observers[i].z);
+        sweepOctants(job->terrain, job->observers[i], &output, 0, 8);
+    }
+}
+
+void computeViewsheds(Terrain* terrain, const Observer* observers, int count, Viewshed** viewsheds) {
+    ObserverJob job = {terrain, observers, viewsheds};
+    parallel_for(count, computeObserverRange, &job);
+}
+
+void freeViewshed(Viewshed* viewshed) {
+    free(viewshed->bits);
+    free(viewshed);
+}
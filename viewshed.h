@@ -0,0 +1,52 @@
+#ifndef VIEWSHED_H
+#define VIEWSHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "structures.h"
+#include "terrain.h"
+
+// A point the terrain is looked at from
+typedef struct {
+    int x, z;             // Grid point the observer stands on
+    GLfloat eyeHeight;    // Height of the eye above the ground
+    GLfloat targetHeight; // Height above the ground a point is looked at, 0 for the ground itself
+    GLfloat radius;       // Furthest distance seen, 0 for no limit
+} Observer;
+
+// Which points of a rectangle of the terrain an observer can see, one bit per point
+typedef struct {
+    TerrainRect area;
+    int stride;     // Words per row of the area, a row being one x
+    uint64_t* bits; // Bit (z - z0) % 64 of word (x - x0) * stride + (z - z0) / 64
+} Viewshed;
+
+// Returns the part of the terrain within the observer's radius
+extern TerrainRect observerArea(Terrain*, Observer);
+
+// Allocates a viewshed over the rectangle with nothing visible
+extern Viewshed* createViewshed(TerrainRect area);
+
+// Returns whether the point, which must be inside the viewshed's area, is visible
+extern bool viewshedVisible(const Viewshed*, int x, int z);
+
+// Returns the number of visible points
+extern long viewshedCount(const Viewshed*);
+
+// Works out which points of the viewshed's area the observer can see, using the XDraw
+// approximation: the area is swept outwards from the observer in 8 octants, a ring of
+// points at a time. Each point keeps the steepest slope from the eye to anything up
+// to and including it, found by interpolating between the 2 points of the previous
+// ring its line of sight passes between, so every point is visited once.
+// The octants are swept on all threads.
+// PRE: The area is inside the terrain and contains the observer.
+extern void computeViewshed(Terrain*, Observer, Viewshed*);
+
+// Computes the viewshed of every observer, the observers split across all threads.
+// Gives the same results as computeViewshed for each.
+extern void computeViewsheds(Terrain*, const Observer*, int count, Viewshed** viewsheds);
+
+// Frees the viewshed and its bits
+extern void freeViewshed(Viewshed*);
+
+#endif
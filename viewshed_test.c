@@ -0,0 +1,150 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <GL/gl.h>
+#include "viewshed.h"
+#include "terrain.h"
+#include "parallel.h"
+#include "testing.h"
+
+#define SIZE 201
+#define HEIGHT 30
+#define OBSERVERS 12
+
+#define TEST_OK_OUT NULL
+#define TEST_FAIL_OUT stdout
+
+static GLfloat flat(void* context, GLfloat x, GLfloat z) {
+    return 0;
+}
+
+// A wall 20 high along x = 120, apart from a gap at the middle
+static GLfloat wall(void* context, GLfloat x, GLfloat z) {
+    return (x == 120 && (z < 95 || z > 105)) ? 20.0f / HEIGHT : 0;
+}
+
+// Walks the straight line from the eye to the point, checking the bilinear heights
+// between every point of the grid it crosses
+static bool line_of_sight(Terrain* terrain, Observer observer, int x, int z) {
+    GLfloat eye = terrain->heights[observer.x][observer.z] + observer.eyeHeight;
+    GLfloat target = terrain->heights[x][z] + observer.targetHeight;
+    int steps = 4 * (abs(x - observer.x) + abs(z - observer.z));
+    for (int i = 1; i < steps; i++) {
+        GLfloat t = (GLfloat) i / steps;
+        GLfloat px = observer.x + t * (x - observer.x);
+        GLfloat pz = observer.z + t * (z - observer.z);
+        int x0 = (int) px, z0 = (int) pz;
+        int x1 = (x0 + 1 < terrain->xSize) ? x0 + 1 : x0;
+        int z1 = (z0 + 1 < terrain->zSize) ? z0 + 1 : z0;
+        GLfloat u = px - x0, v = pz - z0;
+        GLfloat ground = (1 - u) * (1 - v) * terrain->heights[x0][z0] + u * (1 - v) * terrain->heights[x1][z0]
+                       + (1 - u) * v * terrain->heights[x0][z1] + u * v * terrain->heights[x1][z1];
+        if (ground > eye + t * (target - eye)) return false;
+    }
+    return true;
+}
+
+// Returns whether the two viewsheds have the same area and bits
+static bool same_viewshed(const Viewshed* v1, const Viewshed* v2) {
+    TerrainRect a = v1->area, b = v2->area;
+    if (a.x0 != b.x0 || a.z0 != b.z0 || a.x1 != b.x1 || a.z1 != b.z1) return false;
+    for (int x = a.x0; x < a.x1; x++) {
+        for (int z = a.z0; z < a.z1; z++) {
+            if (viewshedVisible(v1, x, z) != viewshedVisible(v2, x, z)) return false;
+        }
+    }
+    return true;
+}
+
+int main(void) {
+    printf("Testing Viewsheds: \n");
+    Terrain* terrain = createTerrain(SIZE, SIZE, HEIGHT);
+
+    // On flat ground everything within the radius is visible
+    populateTerrain(terrain, flat, NULL);
+    Observer observer = {60, 150, 2, 0, 40};
+    TerrainRect area = observerArea(terrain, observer);
+    assert_test(area.x0 == 20 && area.x1 == 101 && area.z0 == 110 && area.z1 == 191,
+                "Area covers the radius inside the terrain.", TEST_OK_OUT, TEST_FAIL_OUT);
+    Viewshed* viewshed = createViewshed(area);
+    computeViewshed(terrain, observer, viewshed);
+    long inside = 0;
+    bool matching = true;
+    for (int x = area.x0; x < area.x1; x++) {
+        for (int z = area.z0; z < area.z1; z++) {
+            bool within = (x - 60) * (x - 60) + (z - 150) * (z - 150) <= 40 * 40;
+            inside += within;
+            matching = matching && viewshedVisible(viewshed, x, z) == within;
+        }
+    }
+    assert_test(matching && viewshedCount(viewshed) == inside, "Flat ground visible within radius.", TEST_OK_OUT, TEST_FAIL_OUT);
+    freeViewshed(viewshed);
+
+    // A wall hides the ground behind it, apart from through the gap
+    populateTerrain(terrain, wall, NULL);
+    observer = (Observer){100, 100, 2, 0, 0};
+    viewshed = createViewshed(observerArea(terrain, observer));
+    computeViewshed(terrain, observer, viewshed);
+    bool wallVisible = viewshedVisible(viewshed, 120, 50) && viewshedVisible(viewshed, 120, 150);
+    bool hidden = !viewshedVisible(viewshed, 150, 50) && !viewshedVisible(viewshed, 190, 160);
+    bool gap = viewshedVisible(viewshed, 150, 100) && viewshedVisible(viewshed, 190, 100);
+    bool front = viewshedVisible(viewshed, 110, 20) && viewshedVisible(viewshed, 0, 0);
+    assert_test(wallVisible && hidden && gap && front, "Wall hides the ground behind it.", TEST_OK_OUT, TEST_FAIL_OUT);
+    freeViewshed(viewshed);
+
+    // Nearly every point agrees with walking the line of sight, the rest being where
+    // the interpolation approximates
+    populateTerrain(terrain, test_hills, NULL);
+    Observer observers[OBSERVERS];
+    Viewshed* batch[OBSERVERS];
+    uint32_t state = 3;
+    for (int i = 0; i < OBSERVERS; i++) {
+        observers[i] = (Observer){
+            random_next(&state) % SIZE, random_next(&state) % SIZE,
+            1 + random_float(&state) * 5, random_float(&state), (i % 2) ? 0 : 30 + random_float(&state) * 60
+        };
+        batch[i] = createViewshed(observerArea(terrain, observers[i]));
+    }
+    long agree = 0, total = 0;
+    for (int i = 0; i < OBSERVERS; i += 3) {
+        viewshed = createViewshed(observerArea(terrain, observers[i]));
+        computeViewshed(terrain, observers[i], viewshed);
+        area = viewshed->area;
+        for (int x = area.x0; x < area.x1; x++) {
+            for (int z = area.z0; z < area.z1; z++) {
+                GLfloat dx = x - observers[i].x, dz = z - observers[i].z;
+                if (observers[i].radius > 0 && dx * dx + dz * dz > observers[i].radius * observers[i].radius) continue;
+                agree += viewshedVisible(viewshed, x, z) == line_of_sight(terrain, observers[i], x, z);
+                total++;
+            }
+        }
+        freeViewshed(viewshed);
+    }
+    assert_test(agree > total * 0.97, "Viewsheds match lines of sight.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    // Sweeping the octants or the observers in parallel gives the same bits
+    computeViewsheds(terrain, observers, OBSERVERS, batch);
+    parallel_set_threads(1);
+    matching = true;
+    for (int i = 0; i < OBSERVERS; i++) {
+        viewshed = createViewshed(observerArea(terrain, observers[i]));
+        computeViewshed(terrain, observers[i], viewshed);
+        matching = matching && same_viewshed(viewshed, batch[i]);
+        freeViewshed(viewshed);
+    }
+    parallel_set_threads(4);
+    for (int i = 0; i < OBSERVERS; i++) {
+        viewshed = createViewshed(observerArea(terrain, observers[i]));
+        computeViewshed(terrain, observers[i], viewshed);
+        matching = matching && same_viewshed(viewshed, batch[i]);
+        freeViewshed(viewshed);
+    }
+    parallel_set_threads(0);
+    assert_test(matching, "Viewsheds independent of threads.", TEST_OK_OUT, TEST_FAIL_OUT);
+
+    for (int i = 0; i < OBSERVERS; i++) {
+        freeViewshed(batch[i]);
+    }
+    freeTerrain(terrain);
+    return EXIT_SUCCESS;
+}